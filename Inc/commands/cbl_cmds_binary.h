@@ -0,0 +1,44 @@
+/** @file cbl_cmds_binary.h
+ *
+ * @brief Binary framed protocol, alternative to the text shell for
+ *        programming jigs. Entered from the shell with TXT_CMD_BINARY
+ *
+ * @note  Request:  SOF_REQ(1) | code(1) | len(2) | payload(len) | pad | CRC32
+ *        Response: SOF_RESP(1) | code(1) | len(2) | status(4) | data | pad |
+ *                  CRC32
+ *        All fields are little endian, code is cmd_t enumerator. pad are 0 to
+ *        3 zero bytes which bring payload to a multiple of 4, len doesn't
+ *        count them. CRC32 covers everything before it and is sent MSB first,
+ *        same as checksum of flash-write
+ *
+ *        Requests run the shell command with the same code, data of the
+ *        response is what the command sends in the shell
+ */
+#ifndef CBL_CMDS_BINARY_H
+#define CBL_CMDS_BINARY_H
+#include "etc/cbl_common.h"
+#include "commands/cbl_cmds_memory.h"
+
+#define TXT_CMD_BINARY "\x1b" "binary" /*!< ESC in front, so it can't be typed
+                                            by mistake */
+#define TXT_CMD_BINARY_HELP "<ESC>binary" /*!< Used in help function */
+
+#define TXT_RESP_BINARY "\r\nbinary\r\n"
+
+#define BIN_SOF_REQ 0xA5u /*!< Start of request frame */
+#define BIN_SOF_RESP 0x5Au /*!< Start of response frame */
+#define BIN_CODE_LEAVE 0xFFu /*!< Code to get back to the text shell */
+#define BIN_CODE_DATA 0xFEu /*!< Response asks for more data of the running
+                                 command, request carries it */
+#define BIN_CODE_MORE 0xFDu /*!< Response carries part of the data of the
+                                 running command, final response follows */
+
+#define BIN_HDR_SZ 4u /*!< Start of frame, code and length */
+#define BIN_CRC_SZ 4u
+#define BIN_MAX_DATA FLASH_WRITE_SZ /*!< Max data in flash write and mem read */
+#define BIN_MAX_PAYLOAD (BIN_MAX_DATA + 4u) /*!< Max data and an address */
+
+cbl_err_code_t cmd_binary (parser_t * phPrsr);
+
+#endif /* CBL_CMDS_BINARY_H */
+/*** end of file ***/
@@ -2,16 +2,46 @@
  *
  * @brief Commands that don't fall in no other category, but don't deserve their
  *        own file
+ *
+ * @note  set-baud needs from the HAL layer:
+ *          - hal_uart_baud_set(baud) - switches UART to the baud rate, after
+ *            the last byte was sent
+ * @note  set-baud is refused on links without baud rate, e.g. USB
  */
 #ifndef CBL_CMDS_ETC_H
 #define CBL_CMDS_ETC_H
 #include "etc/cbl_common.h"
+#include "etc/cbl_checksum.h"
 
 #define TXT_CMD_CID "cid"
 #define TXT_CMD_EXIT "exit"
+#define TXT_CMD_FAST_BOOT "fast-boot"
+#define TXT_PAR_FAST_BOOT_EN "enable"
+#define TXT_CMD_CKSUM_BENCH "cksum-bench"
+#define TXT_PAR_CKSUM_BENCH_COUNT "count"
+#define TXT_CMD_PERF "perf"
+#define TXT_PAR_PERF_RESET "reset"
+#define TXT_CMD_SET_BAUD "set-baud"
+#define TXT_PAR_SET_BAUD_RATE "rate"
+#define TXT_SET_BAUD_PROBE "baud?\r\n" /*!< Host sends it at the new rate */
+#define TXT_SET_BAUD_CONFIRM "baud ok\r\n" /*!< Answer to the probe */
+#define TXT_CMD_MEM_STATS "mem-stats"
+
+#define CKSUM_BENCH_DEF_COUNT 65536u /*!< Bytes hashed when count isn't given */
+#define SET_BAUD_DEFAULT 115200u /*!< Rate hal_periph_init sets */
+#define SET_BAUD_MIN 9600u
+#define SET_BAUD_MAX 5250000u /*!< USART1 at 84 MHz, oversampling by 16 */
+#define SET_BAUD_TIMEOUT_MS 1000u /*!< Time host has to send the probe */
 
 cbl_err_code_t cmd_cid (parser_t * phPrsr);
 cbl_err_code_t cmd_exit (parser_t * phPrsr);
+cbl_err_code_t cmd_fast_boot (parser_t * phPrsr);
+cbl_err_code_t cmd_cksum_bench (parser_t * phPrsr);
+#if 1 == USE_PERF
+cbl_err_code_t cmd_perf (parser_t * phPrsr);
+#endif /* USE_PERF */
+cbl_err_code_t cmd_set_baud (parser_t * phPrsr);
+cbl_err_code_t cmd_mem_stats (parser_t * phPrsr);
 
 #endif /* CBL_CMDS_ETC_H */
 /*** end of file ***/
@@ -6,21 +6,47 @@
 #define CBL_CMDS_MEMORY_H
 #include "etc/cbl_common.h"
 #include "etc/cbl_checksum.h"
+#include "etc/cbl_records.h"
+#include "etc/cbl_lz4.h"
+#include "etc/cbl_mem.h"
+#include "etc/cbl_boot_record.h"
 
 #define TXT_FLASH_WRITE_SZ "5120" /*!< Size of a buffer used to write to flash
                                   as char array */
 #define FLASH_WRITE_SZ 5120 /*!< Size of a buffer used to write to flash */
-/* NOTE: Flash write size shall be divisible by 4 if CRC32 checksum is used*/
+/* NOTE: Flash write size shall be divisible by 4, chunks are fed to CRC32 in
+ * whole words */
+#define FLASH_WRITE_N_BUFS 2 /*!< Number of chunk buffers, maximum window */
+#define TXT_FLASH_WRITE_N_BUFS "2" /*!< FLASH_WRITE_N_BUFS as char array */
+#define FLASH_WRITE_FRAME_OVERHEAD 8 /*!< Sequence number and CRC32 of a frame */
+#define FLASH_WRITE_BUF_SZ (FLASH_WRITE_SZ + FLASH_WRITE_FRAME_OVERHEAD)
+#define FLASH_WRITE_MAX_CHUNKS 256 /*!< Maximum number of chunks in a write */
+#define FLASH_WRITE_MAX_NAKS 64 /*!< Rejected frames before write is aborted */
+/** Taken from the arena by flash_write: chunk buffers and hash context */
+#define FLASH_WRITE_ARENA_SZ (FLASH_WRITE_N_BUFS * FLASH_WRITE_BUF_SZ \
+        + sizeof(sha256_ctx_t) + 2 * MEM_ALIGN)
+
+/** Bootloader and boot record are below, with USE_SECURE_BOOT host can't
+ *  write or erase them */
+#define FLASH_PROT_END BOOT_ACT_APP_START
+#define FLASH_PROT_END_SECTOR BOOT_ACT_APP_START_SECTOR
 
 #define TXT_CMD_JUMP_TO "jump-to"
 #define TXT_CMD_FLASH_ERASE "flash-erase"
 #define TXT_CMD_FLASH_WRITE "flash-write"
 #define TXT_CMD_MEM_READ "mem-read"
+#define TXT_CMD_MEM_HASH "mem-hash"
+
+#define MEM_READ_CHUNK_SZ 4096u /*!< Bytes sent to host at once in mem-read */
 
 #define TXT_PAR_JUMP_TO_ADDR "addr"
 
 #define TXT_PAR_FLASH_WRITE_START "start"
 #define TXT_PAR_FLASH_WRITE_COUNT "count"
+#define TXT_PAR_FLASH_WRITE_WINDOW "window"
+#define TXT_PAR_FLASH_WRITE_FRAME "frame"
+
+#define TXT_RESP_FLASH_WRITE_CHUNK_NOK "\r\nchunk NOK\r\n"
 
 
 #define TXT_PAR_FLASH_ERASE_TYPE "type"
@@ -29,10 +55,35 @@
 #define TXT_PAR_FLASH_ERASE_TYPE_MASS "mass"
 #define TXT_PAR_FLASH_ERASE_TYPE_SECT "sector"
 
+typedef struct
+{
+    cksum_t cksum; /*!< Checksum of the whole transfer */
+    uint32_t window; /*!< Number of chunks host may have in flight */
+    bool is_framed; /*!< Chunks carry sequence number and CRC32 */
+    h_records_t * ph_records; /*!< If not NULL, chunks are text of hex or
+     srec file and are decoded instead of written to start */
+    h_lz4_t * ph_lz4; /*!< If not NULL, chunks are LZ4 frame and are
+     decompressed instead of written to start */
+    cbl_err_code_t (*write) (uint32_t address, uint8_t * p_data,
+            uint32_t len); /*!< If not NULL, plain chunks are written with
+     it instead of flash_program */
+    uint32_t resumed_len; /*!< Bytes right before start, written by an
+     interrupted transfer. Checksum covers them too */
+} flash_write_opt_t;
+
 cbl_err_code_t cmd_jump_to (parser_t * phPrsr);
 cbl_err_code_t cmd_flash_erase (parser_t * phPrsr);
 cbl_err_code_t cmd_flash_write (parser_t * phPrsr);
 cbl_err_code_t cmd_mem_read (parser_t * phPrsr);
-cbl_err_code_t flash_write (uint32_t start, uint32_t len, cksum_t cksum);
+cbl_err_code_t cmd_mem_hash (parser_t * phPrsr);
+cbl_err_code_t mem_hash (uint32_t start, uint32_t len, cksum_t cksum,
+        uint8_t * p_digest);
+cbl_err_code_t flash_write (uint32_t start, uint32_t len,
+        const flash_write_opt_t * p_opt);
+cbl_err_code_t flash_write_get_opts (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt);
+cbl_err_code_t flash_verify_range (uint32_t start, uint32_t len);
+cbl_err_code_t flash_verify_sectors (uint32_t first_sect, uint32_t count);
+cbl_err_code_t jump_verify_address (uint32_t addr);
 #endif /* CBL_CMDS_MEMORY_H */
 /*** end of file ***/
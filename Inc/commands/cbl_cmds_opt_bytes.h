@@ -1,6 +1,12 @@
 /** @file cbl_cmds_opt_bytes.h
  *
  * @brief Function handles for handling option bytes
+ *
+ * @note  opt-bytes-set needs from the HAL layer:
+ *          - hal_opt_bytes_get(p_opt) - reads RDP, WRP and BOR from the
+ *            option bytes
+ *          - hal_opt_bytes_program(p_opt) - programs all of them with one
+ *            unlock, program and launch of the option bytes
  */
 #ifndef CBL_CMDS_OPT_BYTES_H
 #define CBL_CMDS_OPT_BYTES_H
@@ -11,11 +17,30 @@
 #define TXT_CMD_DIS_WRITE_PROT "dis-write-prot"
 #define TXT_CMD_READ_SECT_PROT_STAT "get-write-prot"
 
+#define TXT_CMD_OPT_BYTES_SET "opt-bytes-set"
+
 #define TXT_PAR_EN_WRITE_PROT_MASK "mask"
+#define TXT_PAR_OPT_BYTES_RDP "rdp"
+#define TXT_PAR_OPT_BYTES_WRP "wrp"
+#define TXT_PAR_OPT_BYTES_BOR "bor"
+
+#define OPT_BYTES_WRP_ALL 0xFFFu /*!< Bits of all 12 sectors */
+#define OPT_BYTES_RDP_MAX 1u /*!< Level 2 can never be undone, refused */
+#define OPT_BYTES_BOR_MAX 3u /*!< BOR level 3, 0 is BOR off */
+
+typedef struct
+{
+    uint8_t rdp_lvl; /*!< Read protection level, 0 to 2 */
+    uint8_t bor_lvl; /*!< Brown-out reset level 1 to 3, 0 is off */
+    uint32_t wrp_mask; /*!< Write protected sectors, LSB is sector 0 */
+} opt_bytes_t;
 
 cbl_err_code_t cmd_get_rdp_lvl (parser_t * phPrsr);
 cbl_err_code_t cmd_change_write_prot (parser_t * phPrsr, bool EnDis);
+cbl_err_code_t cmd_en_write_prot (parser_t * phPrsr);
+cbl_err_code_t cmd_dis_write_prot (parser_t * phPrsr);
 cbl_err_code_t cmd_get_write_prot (parser_t * phPrsr);
+cbl_err_code_t cmd_opt_bytes_set (parser_t * phPrsr);
 
 #endif /* CBL_CMDS_OPT_BYTES_H */
 /*** end of file ***/
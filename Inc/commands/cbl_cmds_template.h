@@ -11,16 +11,15 @@
 
 /* To add a new command:
  *  1. Create a command handler, from this template's .c file
- *  2. Add an enumerator in cmd_t (custom_bootloader.c)
+ *  2. Append an enumerator in cmd_t (custom_bootloader.h), it is also the
+ *     code of the command in the binary protocol
  *  3. Add defines in header file for command name and parameters
  *     (as demonstrated below)
- *  4. Add, in enum_cmd (custom_bootloader.c), new 'if' to check if input
- *   command matches
- *  5. Add, in handle_cmd, new case with a call for command handler
- *  6. Add an enumerator in cbl_err_code_t (custom_bootloader.h) for errors
+ *  4. Add, in cmd_table (custom_bootloader.c), an entry with name, code,
+ *     handler, required parameters and description for help
+ *  5. Add an enumerator in cbl_err_code_t (custom_bootloader.h) for errors
  *     from the function
- *  7. In sys_state_error (custom_bootloader.c) add handlers for new errors
- *  8. In cmd_help (custom_bootloader.c) add description of newly added command
+ *  6. In sys_state_error (custom_bootloader.c) add handlers for new errors
  *
  *  All steps have been done for function below, just include this header in
  *  custom_bootloader.c for demonstration of cmd_template
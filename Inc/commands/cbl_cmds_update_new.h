@@ -7,11 +7,16 @@
 #define CBL_CMDS_UPDATE_NEW_H
 #include "etc/cbl_common.h"
 #include "etc/cbl_boot_record.h"
+#include "commands/cbl_cmds_memory.h"
 
 #define TXT_CMD_UPDATE_NEW "update-new"
 #define TXT_PAR_UP_NEW_COUNT "count"
+#define TXT_PAR_UP_NEW_DECODE "decode"
+#define TXT_PAR_UP_NEW_ID "id"
+#define TXT_PAR_UP_NEW_RESUME "resume"
 /* Also takes checksum parameter from cbl_checksum.h */
 /* Also takes application type parameter from cbl_boot_record.h */
+/* Also takes window parameter from cbl_cmds_memory.h */
 
 cbl_err_code_t cmd_update_new (parser_t * phPrsr);
 
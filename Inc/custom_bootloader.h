@@ -11,6 +11,7 @@
 #define __CBL_H
 
 #include <stdlib.h>
+#include <stdbool.h>
 
 #define CBL_VERSION "v1.1"
 
@@ -59,13 +60,63 @@ typedef enum
     CBL_ERR_INV_HEX, /*!< Invalid hex value character given to the function */
     CBL_ERR_SEGMEN, /*!< Tried accessing forbidden address */
     CBL_ERR_IHEX_FCN, /*!< Invalid intel hex function requested */
-    CBL_ERR_INV_IHEX /*!< Invalid intel hex function */
+    CBL_ERR_INV_IHEX, /*!< Invalid intel hex function */
+    CBL_ERR_INV_WINDOW, /*!< Invalid number of chunks in flight requested */
+    CBL_ERR_PAR_BOOL, /*!< Boolean parameter is neither true nor false */
+    CBL_ERR_FRAME_NAKS, /*!< Too many chunks rejected in framed transfer */
+    CBL_ERR_APP_LEN_UNKNOWN, /*!< Boot record has no active application length */
+    CBL_ERR_FAST_BOOT, /*!< Active application vector table is not valid */
+    CBL_ERR_CRC_DMA, /*!< HAL failed to start DMA to CRC unit */
+    CBL_ERR_INV_LZ4, /*!< Invalid or truncated LZ4 frame */
+    CBL_ERR_NO_RESUME, /*!< No interrupted transfer matches the resumed one */
+    CBL_ERR_RX_TIMEOUT, /*!< Host didn't send the bytes in time */
+    CBL_ERR_BAUD, /*!< Host didn't confirm new baud rate, previous is kept */
+    CBL_ERR_NO_MEM, /*!< Memory arena is full */
+    CBL_ERR_VERIFY, /*!< Flash doesn't hold the bytes just written */
+    CBL_ERR_BATCH, /*!< Batch script is empty, too long or nested */
+    CBL_ERR_SIG, /*!< Signature of active application is invalid */
+    CBL_ERR_OPT_BYTES, /*!< Option bytes value refused or out of range */
+    CBL_ERR_REC_CKSUM, /*!< Checksum of a hex or srec record is wrong */
+    CBL_ERR_BAUD_RANGE /*!< Requested baud rate is not supported */
 } cbl_err_code_t;
 
+/* WARNING: Values are command codes of the binary protocol, only append */
+typedef enum
+{
+    CMD_UNDEF = 0,
+    CMD_VERSION,
+    CMD_HELP,
+    CMD_CID,
+    CMD_GET_RDP_LVL,
+    CMD_JUMP_TO,
+    CMD_FLASH_ERASE,
+    CMD_EN_WRITE_PROT,
+    CMD_DIS_WRITE_PROT,
+    CMD_READ_SECT_PROT_STAT,
+    CMD_MEM_READ,
+    CMD_FLASH_WRITE,
+    CMD_EXIT,
+    CMD_TEMPLATE,
+    CMD_RESET,
+    CMD_UPDATE_NEW,
+    CMD_UPDATE_ACT,
+    CMD_BINARY,
+    CMD_FAST_BOOT,
+    CMD_CKSUM_BENCH,
+    CMD_MEM_HASH,
+    CMD_PERF,
+    CMD_SET_BAUD,
+    CMD_MEM_STATS,
+    CMD_BATCH,
+    CMD_OPT_BYTES_SET
+} cmd_t;
+
 void CBL_hal_init(void);
 void CBL_periph_init(void);
 void CBL_run_system (void);
 cbl_err_code_t CBL_process_cmd (char * cmd, size_t len);
+cbl_err_code_t CBL_run_cmd (char * cmd, size_t len);
+const char * CBL_cmd_name (cmd_t code);
 
 #endif /* __CBL_H */
 /****END OF FILE****/
@@ -0,0 +1,37 @@
+/** @file cbl_ab_slots.h
+ *
+ * @brief A/B application slots. With USE_AB_SLOTS set to 1 in cbl_config.h,
+ *        new application is written to the slot which doesn't run and update
+ *        only switches the active slot in boot record, nothing is copied.
+ *        Switched application is on trial, if it doesn't confirm itself in
+ *        AB_MAX_TRIAL_BOOTS boots previous slot is made active again
+ *
+ * @note  Application has to be linked for the slot it is written to
+ * @note  Needs from the HAL layer:
+ *          - hal_app_confirm_get() - true if application confirmed it started
+ *            well, e.g. it wrote a magic value to a RTC backup register
+ *          - hal_app_confirm_clear() - clears the confirmation
+ * @note  Without USE_AB_SLOTS functions describe the fixed layout, active
+ *        application and new application staging area
+ */
+#ifndef CBL_AB_SLOTS_H
+#define CBL_AB_SLOTS_H
+#include "cbl_common.h"
+#include "cbl_boot_record.h"
+
+#define AB_SLOT_A 0u /*!< Slot at BOOT_ACT_APP_START */
+#define AB_SLOT_B 1u /*!< Slot at BOOT_NEW_APP_START */
+
+#define AB_SLOT_MAX_LEN BOOT_ACT_APP_MAX_LEN /*!< Image has to fit both slots */
+#define AB_MAX_TRIAL_BOOTS 3u /*!< Boots application has to confirm in */
+
+uint32_t ab_act_start (void);
+uint32_t ab_new_start (void);
+uint32_t ab_new_max_len (void);
+#if 1 == USE_AB_SLOTS
+void ab_boot_check (void);
+cbl_err_code_t ab_switch (void);
+#endif /* USE_AB_SLOTS */
+
+#endif /* CBL_AB_SLOTS_H */
+/*** end of file ***/
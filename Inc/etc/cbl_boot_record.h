@@ -2,6 +2,18 @@
  *
  * @brief Boot record hold useful data about current version of user application
  *        and of a new one, if it is available
+ *
+ * @note  Boot record sector is a log of slots, every change is appended to the
+ *        first erased slot with a higher sequence number and CRC32. Newest
+ *        valid slot is the boot record. Sector is erased only when all slots
+ *        are used
+ * @note  Layout of the sector, version 2: BOOT_RECORD_N_SLOTS slots of
+ *        BOOT_RECORD_SLOT_SZ bytes, each is sequence number (4 bytes), CRC32
+ *        of the record (4 bytes) and boot_record_t of BOOT_RECORD_REC_SZ
+ *        bytes. Version 1 had one boot_record_t at BOOT_RECORD_START, it is
+ *        still read and is moved to the log by the next boot_record_set.
+ *        Applications which read version 1 directly don't see changes of
+ *        version 2 and shall be built with cbl_boot_record.c again
  */
 #ifndef CBL_BOOT_RECORD_H
 #define CBL_BOOT_RECORD_H
@@ -13,11 +25,18 @@
 #define BOOT_RECORD_START 0x800C000UL
 #define BOOT_RECORD_SECTOR 3
 #define BOOT_RECORD_MAX_SECTORS 1
+#define BOOT_RECORD_SZ (16 * 1024) /*!< Size of boot record sector */
+#define BOOT_RECORD_SLOT_SZ 512 /*!< One version of boot record in the log */
+#define BOOT_RECORD_N_SLOTS (BOOT_RECORD_SZ / BOOT_RECORD_SLOT_SZ)
+#define BOOT_RECORD_REC_SZ 288 /*!< Size of boot_record_t, same in every
+                                    version of the layout */
 
 #define BOOT_ACT_APP_START 0x08010000UL
 #define BOOT_ACT_APP_MAX_LEN (448 * 1024)
 #define BOOT_ACT_APP_START_SECTOR 4
 #define BOOT_ACT_APP_MAX_SECTORS 4
+#define BOOT_ACT_APP_SECTOR_SIZES { 64 * 1024, 128 * 1024, 128 * 1024, \
+        128 * 1024 } /*!< Sizes of active application sectors, in order */
 
 #define IS_ACT_APP_ADDRESS(ADDR) (((ADDR) >= (BOOT_ACT_APP_START)) && \
         ((ADDR) <= ((BOOT_ACT_APP_START) + (BOOT_ACT_APP_MAX_LEN) - 1)))
@@ -26,6 +45,8 @@
 #define BOOT_NEW_APP_MAX_LEN (512 * 1024)
 #define BOOT_NEW_APP_START_SECTOR 8
 #define BOOT_NEW_APP_MAX_SECTORS 4
+#define BOOT_NEW_APP_SECTOR_SIZES { 128 * 1024, 128 * 1024, 128 * 1024, \
+        128 * 1024 } /*!< Sizes of new application sectors, in order */
 
 #define IS_NEW_APP_ADDRESS(ADDR) (((ADDR) >= (BOOT_NEW_APP_START)) && \
         ((ADDR) <= ((BOOT_NEW_APP_START) + (BOOT_NEW_APP_MAX_LEN) - 1)))
@@ -34,13 +55,15 @@
 #define TXT_PAR_APP_TYPE_BIN "bin"
 #define TXT_PAR_APP_TYPE_HEX "hex"
 #define TXT_PAR_APP_TYPE_SREC "srec"
+#define TXT_PAR_APP_TYPE_BIN_LZ4 "bin-lz4"
 
 typedef enum
 {
     TYPE_UNDEF = 0,
     TYPE_BIN,
     TYPE_HEX,
-    TYPE_SREC
+    TYPE_SREC,
+    TYPE_BIN_LZ4 /*!< LZ4 frame of binary, only while received */
 } app_type_t;
 
 typedef struct
@@ -52,6 +75,14 @@ typedef struct
     uint32_t len;
 } app_meta_t;
 
+typedef struct
+{
+    uint32_t id; /*!< Image ID given by the host, 0 if none was given */
+    app_meta_t app; /*!< Checksum, type and length of the transfer */
+    uint32_t done; /*!< Bytes from start of new application written, on a
+     sector boundary. 0 if there is nothing to resume */
+} xfer_ckpt_t;
+
 typedef struct
 {
     bool is_new_app_ready; /* WARNING: Size of 1 byte assumed */
@@ -59,13 +90,30 @@ typedef struct
     app_meta_t new_app; /*!< New application meta data */
     uint32_t key; /*!< Used to check if boot_record was initialized.
      Boot record user shall ignore */
-    uint8_t reserved[255];
+    uint32_t act_app_crc; /*!< CRC32 of active application, see fast boot */
+    bool is_fast_boot; /*!< Jump to active application without the shell */
+    uint8_t act_slot; /*!< Slot active application runs from, see A/B slots */
+    bool is_trial; /*!< Active slot wasn't confirmed by application yet */
+    uint8_t boot_attempts; /*!< Boots of application on trial */
+    app_meta_t prev_app; /*!< Application in the other slot, len is 0 if it
+     can't be rolled back to */
+    uint32_t prev_app_crc; /*!< CRC32 of application in the other slot */
+    xfer_ckpt_t xfer; /*!< Progress of update-new, to resume after link drop */
+    uint8_t sig_digest[SHA256_DIGEST_SZ]; /*!< SHA-256 of active application
+     whose signature was verified, see secure boot */
+    bool is_sig_ok; /*!< Signature of active application was verified */
+    uint32_t fast_boot_cycles; /*!< Cycles from reset to the jump of the
+     first fast boot of active application, 0 until measured */
+    uint8_t reserved[172]; /*!< Shrinks with new fields, size of the record
+     is checked against BOOT_RECORD_REC_SZ */
 } boot_record_t;
 
 boot_record_t * boot_record_get (void);
 cbl_err_code_t boot_record_set (boot_record_t * p_new_boot_record);
 cbl_err_code_t enum_app_type (char *char_app_type, uint32_t len,
         app_type_t * p_app_type);
+cbl_err_code_t parser_get_app_type (parser_t * ph_prsr,
+        app_type_t * p_app_type);
 
 #endif /* CBL_CMDS_TEMPLATE_H */
 /*** end of file ***/
@@ -1,11 +1,17 @@
 /** @file cbl_checksum.h
  *
  * @brief All checksum implementations available
+ *
+ * @note  With USE_CRC_DMA set to 1 in cbl_config.h, DMA can feed the CRC unit
+ *        from memory. It needs from the HAL layer:
+ *          - hal_crc_dma_start(p_words, n_words) - start memory to CRC data
+ *            register DMA of n_words (at most CRC_DMA_MAX_WORDS) words
+ *          - hal_crc_dma_is_done() - true when DMA isn't running
  */
 #ifndef CBL_CHECKSUM_H
 #define CBL_CHECKSUM_H
 #include "cbl_common.h"
-#include "sha256.h"
+#include "cbl_sha256.h"
 
 typedef enum
 {
@@ -20,19 +26,30 @@ typedef enum
 #define TXT_CKSUM_CRC "crc32"
 #define TXT_CKSUM_NO "no"
 
+#define CRC_DMA_MAX_WORDS 0xFFFFu /*!< Max DMA transfer, 16 bit counter */
+
 cbl_err_code_t enum_checksum (char * checksum, uint32_t len, cksum_t * p_cksum);
-void init_checksum (cksum_t cksum, SHA256_CTX * ph_sha256);
+cbl_err_code_t parser_get_cksum (parser_t * ph_prsr, cksum_t * p_cksum);
+void init_checksum (cksum_t cksum, sha256_ctx_t * ph_sha256);
 cbl_err_code_t accumulate_checksum (uint8_t * buf, uint32_t len, cksum_t cksum,
-        SHA256_CTX * ph_sha256);
+        sha256_ctx_t * ph_sha256);
 cbl_err_code_t accumulate_crc32 (uint8_t * buf, uint32_t len);
 cbl_err_code_t accumulate_sha256 (uint8_t * buf, uint32_t len,
-        SHA256_CTX * ph_sha256);
+        sha256_ctx_t * ph_sha256);
 cbl_err_code_t verify_checksum (uint8_t * buf, uint32_t len, cksum_t cksum,
-        SHA256_CTX * ph_sha256);
+        sha256_ctx_t * ph_sha256);
 cbl_err_code_t verify_crc32 (uint8_t * p_recv_cksum, uint32_t cksum_len);
+uint32_t crc32_get (void);
+uint32_t crc32_calc (const uint8_t * p_start, uint32_t len);
+#if 1 == USE_CRC_DMA
+cbl_err_code_t crc32_native_start (const uint32_t * p_words, uint32_t n_words);
+uint32_t crc32_native_wait (void);
+#endif /* USE_CRC_DMA */
 cbl_err_code_t verify_sha256 (uint8_t * p_recv_cksum, uint32_t cksum_len,
-        SHA256_CTX * ph_sha256);
+        sha256_ctx_t * ph_sha256);
 uint32_t checksum_get_length(cksum_t cksum);
+cbl_err_code_t checksum_get (cksum_t cksum, sha256_ctx_t * ph_sha256,
+        uint8_t * p_digest);
 #if 0
 cbl_err_code_t verify_checksum_old (uint8_t * buf, uint32_t len, cksum_t cksum);
 cbl_err_code_t verify_crc_old (uint8_t * write_buf, uint32_t len);
@@ -50,7 +50,13 @@
 
 #endif /* #ifndef NDEBUG */
 
-#define MAX_ARGS 8 /*!< Maximum number of arguments in an input cmd */
+#define MAX_ARGS 16 /*!< Maximum number of arguments in an input cmd */
+#define PARSER_IDX_SZ 32u /*!< Slots of the argument hash index, power of 2
+                               and at least twice MAX_ARGS */
+#define PARSER_IDX_EMPTY UINT8_MAX /*!< Hash index slot without an argument */
+
+#define STR_HASH_FNV_BASIS 2166136261u
+#define STR_HASH_FNV_PRIME 16777619u
 
 #define TXT_SUCCESS      "\r\nOK\r\n"
 #define TXT_SUCCESS_HELP "\\r\\nOK\\r\\n" /*!< Used in help function */
@@ -58,6 +64,9 @@
 #define TXT_RESP_FLASH_WRITE_READY      "\r\nready\r\n"
 #define TXT_RESP_FLASH_WRITE_READY_HELP "\\r\\nready\\r\\n" /*!< Used in help
                                                                     function */
+#define TXT_PAR_TRUE "true" /*!< Value of boolean parameters */
+#define TXT_PAR_FALSE "false" /*!< Value of boolean parameters */
+
 #define UNUSED(X) (void)X      /* To avoid gcc/g++ warnings */
 
 #define CRLF "\r\n"
@@ -77,22 +86,42 @@ extern bool gIsExitReq;
 
 typedef enum
 {
-    ARG_NAME = 0, //!< ARG_NAME
-    ARG_VAL = 1, //!< ARG_VAL
-    ARG_MAX = 2  //!< ARG_MAX
-} cmd_arg_t;
+    CONV_NONE = 0, /*!< Value wasn't converted yet */
+    CONV_DEC, /*!< Decimal number */
+    CONV_HEX, /*!< Hex number */
+    CONV_BOOL, /*!< Boolean */
+    CONV_CKSUM, /*!< cksum_t */
+    CONV_APP_TYPE /*!< app_type_t */
+} parser_conv_t;
+
+typedef struct
+{
+    char *name; /*!< Name of the argument, ends with '\0' */
+    char *val; /*!< Value of the argument, ends with '\0' */
+    uint16_t nameLen;
+    uint16_t valLen;
+    parser_conv_t conv; /*!< What num holds, typed getters fill it once */
+    uint32_t num; /*!< Value converted by a typed getter */
+} parser_arg_t;
 
 typedef struct
 {
     char *cmd; /*!< Command buffer */
     size_t len; /*!< length of the whole cmd string */
-    char *args[MAX_ARGS][ARG_MAX]; /*!< Pointers to buffers holding name and
-     value of an argument */
+    parser_arg_t args[MAX_ARGS];
+    uint8_t idx[PARSER_IDX_SZ]; /*!< Indexes of args by hash of the name */
     uint8_t numOfArgs;
 } parser_t;
 
 cbl_err_code_t parser_run (char * cmd, size_t len, parser_t * phPrsr);
+parser_arg_t *parser_get_arg (parser_t * phPrsr, const char * name,
+        size_t lenName);
 char *parser_get_val (parser_t * phPrsr, char * name, size_t lenName);
+cbl_err_code_t parser_get_u32 (parser_t * phPrsr, const char * name,
+        uint8_t base, uint32_t * p_num);
+cbl_err_code_t parser_get_bool (parser_t * phPrsr, const char * name,
+        bool * p_bool);
+uint32_t str_hash (const char * buf, size_t len);
 
 cbl_err_code_t str2ui32 (const char * str, size_t len, uint32_t * num,
         uint8_t base);
@@ -105,6 +134,9 @@ cbl_err_code_t four_hex_chars2ui16 (uint8_t * array, uint32_t len,
         uint16_t * p_result);
 cbl_err_code_t eight_hex_chars2ui32 (uint8_t * array, uint32_t len,
         uint32_t * p_result);
+cbl_err_code_t hex_decode (const uint8_t * p_hex, uint32_t n_bytes,
+        uint8_t * p_out, uint32_t * p_sum);
+cbl_err_code_t enum_bool (char * char_bool, uint32_t len, bool * p_bool);
 
 #endif /* CBL_CMDS_COMMON_H */
 /*** end of file ***/
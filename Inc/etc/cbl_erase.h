@@ -0,0 +1,50 @@
+/** @file cbl_erase.h
+ *
+ * @brief Lazy erase of the area an application is written to. Sectors are
+ *        erased just before the first write reaches them, so only sectors the
+ *        transfer covers are erased. Sectors which are already blank are
+ *        never erased, also when erased by number
+ *
+ * @note  Flash has one bank, erasing stalls the processor but not DMA. Chunk
+ *        host sends meanwhile is received and waits, see cbl_rx.h
+ * @note  Every write of applications goes through flash_program, boot
+ *        record compares its slot the same way, see cbl_boot_record.c. With USE_WRITE_VERIFY set to 1 in cbl_config.h it
+ *        compares flash with the source right after programming, no second
+ *        pass over the image is needed. HAL layer shall leave no stale lines
+ *        of the flash data cache after programming
+ */
+#ifndef CBL_ERASE_H
+#define CBL_ERASE_H
+#include <stdbool.h>
+#include "cbl_common.h"
+
+#define ERASE_FLASH_START 0x08000000UL /*!< Address of sector 0 */
+#define ERASE_N_SECTORS 12u /*!< Sectors of STM32F407 1 MB flash */
+#define ERASE_SECTOR_SIZES { 16 * 1024, 16 * 1024, 16 * 1024, 16 * 1024, \
+        64 * 1024, 128 * 1024, 128 * 1024, 128 * 1024, 128 * 1024, \
+        128 * 1024, 128 * 1024, 128 * 1024 } /*!< Sizes of all sectors */
+
+typedef struct
+{
+    uint32_t area_start; /*!< Address of the first sector of the area */
+    const uint32_t * p_sect_sz; /*!< Sizes of sectors of the area, in order */
+    uint8_t first_sect; /*!< Number of the first sector of the area */
+    uint8_t n_sect; /*!< Number of sectors in the area */
+    uint8_t n_done; /*!< Sectors from the start already erased or blank */
+    uint32_t done_end; /*!< Address after the last sector done */
+    uint32_t n_erased; /*!< Sectors which had to be erased */
+} h_erase_t;
+
+cbl_err_code_t erase_init (h_erase_t * ph_erase, uint32_t area_start);
+cbl_err_code_t erase_prepare (h_erase_t * ph_erase, uint32_t address,
+        uint32_t len);
+void erase_skip (h_erase_t * ph_erase, uint32_t address);
+uint32_t erase_sect_floor (const h_erase_t * ph_erase, uint32_t address);
+cbl_err_code_t erase_sectors (uint32_t first_sect, uint32_t count,
+        uint32_t * p_n_erased);
+bool flash_is_blank (uint32_t address, uint32_t len);
+cbl_err_code_t flash_program (uint32_t address, const uint8_t * p_data,
+        uint32_t len);
+
+#endif /* CBL_ERASE_H */
+/*** end of file ***/
@@ -0,0 +1,22 @@
+/** @file cbl_fast_boot.h
+ *
+ * @brief Fast boot jumps to the active application without the shell, when
+ *        boot record enables it, no update is pending and the application
+ *        passes the check of its length, vector table and CRC32
+ */
+#ifndef CBL_FAST_BOOT_H
+#define CBL_FAST_BOOT_H
+#include "cbl_common.h"
+
+#define FAST_BOOT_SRAM_START 0x20000000UL /*!< SRAM1 and SRAM2, 128 KB */
+#define FAST_BOOT_SRAM_END 0x20020000UL
+#define FAST_BOOT_CCM_START 0x10000000UL /*!< CCM data RAM, 64 KB */
+#define FAST_BOOT_CCM_END 0x10010000UL
+
+bool fast_boot_is_on (void);
+cbl_err_code_t fast_boot_verify (void);
+uint32_t fast_boot_digest (uint32_t start, uint32_t len);
+void fast_boot_cycles_store (void);
+
+#endif /* CBL_FAST_BOOT_H */
+/*** end of file ***/
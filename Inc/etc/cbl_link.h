@@ -0,0 +1,75 @@
+/** @file cbl_link.h
+ *
+ * @brief Link to the host. Bootloader core sends and receives only through
+ *        the link chosen when the shell starts, UART or USB CDC (USE_LINK_USB
+ *        set to 1 in cbl_config.h). New links, e.g. CAN, add their link_t
+ *
+ * @note  USB needs from the HAL layer:
+ *          - hal_usb_is_configured() - true if host enumerated the device on
+ *            the OTG port
+ *          - hal_usb_send(buf, len) - sends to CDC IN endpoint, blocks until
+ *            sent
+ *          - hal_usb_recv_circ_start(buf, len) - CDC OUT packets are copied
+ *            into buf in circles, never stopping
+ *          - hal_usb_recv_circ_pos() - index in buf the next byte goes to
+ *          - hal_usb_recv_stop() - stops receiving
+ * @note  USB link works only with receive ring, USE_RX_RING set to 1
+ * @note  With USE_TX_QUEUE set to 1 in cbl_config.h link_send copies bytes
+ *        to a queue drained by TX DMA and returns at once. Queue is drained
+ *        while bootloader waits for bytes or sends more. link_flush waits
+ *        until everything is sent, needed before jump, reset or changing the
+ *        link. Needs from the HAL layer:
+ *          - hal_send_to_host_start(buf, len) - starts TX DMA, doesn't block
+ *          - hal_send_to_host_is_done() - true when TX DMA isn't running
+ * @note  With a sink set, what commands send goes to the sink instead of the
+ *        link, e.g. binary protocol wraps it in response frames. link_flush
+ *        flushes the sink first
+ */
+#ifndef CBL_LINK_H
+#define CBL_LINK_H
+#include <stdbool.h>
+#include "cbl_common.h"
+
+#define LINK_TX_QUEUE_SZ 1024u /*!< Bytes of TX queue, power of 2. Sends
+                                    longer than half of it aren't queued */
+
+#if 1 == USE_LINK_USB && 1 != USE_RX_RING
+#error "USB link needs receive ring, set USE_RX_RING to 1"
+#endif /* USE_LINK_USB */
+
+typedef struct
+{
+    const char * name; /*!< Shown in the welcome message */
+    cbl_err_code_t (*send) (const char * buf, size_t len); /*!< Blocks until
+     buf can be reused */
+    cbl_err_code_t (*recv_start) (uint8_t * buf, uint32_t len); /*!< Receive
+     of one request, NULL if link only has a ring */
+    bool (*recv_is_done) (void); /*!< True when request was received */
+    cbl_err_code_t (*recv_circ_start) (uint8_t * buf, uint32_t len); /*!<
+     Starts endless receive into the ring */
+    uint32_t (*recv_circ_pos) (void); /*!< Index in ring written next */
+    void (*recv_stop) (void); /*!< Stops any receive */
+    cbl_err_code_t (*baud_set) (uint32_t baud); /*!< Switches baud rate,
+     NULL if link has none */
+    cbl_err_code_t (*send_start) (const char * buf, size_t len); /*!< Starts
+     send without blocking, NULL if link can't queue */
+    bool (*send_is_done) (void); /*!< True when started send finished */
+} link_t;
+
+typedef struct
+{
+    cbl_err_code_t (*send) (const char * buf, size_t len); /*!< Takes bytes
+     of link_send */
+    cbl_err_code_t (*flush) (void); /*!< Passes on what is held, called by
+     link_flush */
+} link_sink_t;
+
+void link_init (void);
+const link_t * link_get (void);
+cbl_err_code_t link_send (const char * buf, size_t len);
+cbl_err_code_t link_flush (void);
+cbl_err_code_t link_tx_poll (void);
+const link_sink_t * link_sink_set (const link_sink_t * p_new_sink);
+
+#endif /* CBL_LINK_H */
+/*** end of file ***/
@@ -0,0 +1,48 @@
+/** @file cbl_lz4.h
+ *
+ * @brief Streaming decompression of LZ4 frames straight to flash. Output is
+ *        written in order, so matches are copied from the flash already
+ *        written and only a small write buffer is kept in RAM
+ *
+ * @note  Frame header and content checksums are skipped, not checked. Whole
+ *        decompressed image is covered by the checksum of the transfer
+ */
+#ifndef CBL_LZ4_H
+#define CBL_LZ4_H
+#include "cbl_common.h"
+
+#define LZ4_WBUF_SZ 256 /*!< Output is written in blocks of this size, shall
+                             be multiple of 4 */
+#define LZ4_MAGIC 0x184D2204UL /*!< Start of LZ4 frame */
+
+/** Called with pieces of output in order, address goes up without gaps */
+typedef cbl_err_code_t (*lz4_write_t) (uint32_t address, uint8_t * p_data,
+        uint32_t len);
+
+typedef struct
+{
+    lz4_write_t write; /*!< Sink of output */
+    uint32_t out_start; /*!< Address of the first output byte */
+    uint32_t out_max; /*!< Maximum length of output */
+    uint32_t out_len; /*!< Output produced so far, written or in wbuf */
+    uint32_t state; /*!< Part of the frame expected next */
+    uint32_t next_state; /*!< State after bytes are skipped */
+    uint32_t field; /*!< Little endian field being collected */
+    uint32_t field_len; /*!< Bytes of field collected */
+    uint32_t skip; /*!< Bytes left to skip */
+    uint8_t flg; /*!< Frame descriptor flags */
+    uint32_t block_left; /*!< Bytes of current block not yet consumed */
+    uint32_t lit_len; /*!< Literals left in current sequence */
+    uint32_t match_len; /*!< Length of match of current sequence */
+    uint32_t wbuf_len; /*!< Bytes in wbuf */
+    uint8_t wbuf[LZ4_WBUF_SZ] __attribute__((aligned(4))); /*!< Output not
+     written yet */
+} h_lz4_t;
+
+cbl_err_code_t lz4_init (h_lz4_t * ph_lz4, uint32_t out_start,
+        uint32_t out_max, lz4_write_t write);
+cbl_err_code_t lz4_feed (h_lz4_t * ph_lz4, const uint8_t * buf, uint32_t len);
+cbl_err_code_t lz4_finish (h_lz4_t * ph_lz4);
+
+#endif /* CBL_LZ4_H */
+/*** end of file ***/
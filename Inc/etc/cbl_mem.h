@@ -0,0 +1,41 @@
+/** @file cbl_mem.h
+ *
+ * @brief Static memory arena for the big buffers of the commands: command
+ *        line, chunk buffers, hash context and decoder handles. Arena is
+ *        used as a stack, a command takes what it needs and it is given
+ *        back when the command ends. Peak use of the arena and of the stack
+ *        is returned with mem-stats
+ *
+ * @note  Arena is in SRAM1 as chunks are received by DMA, which can't reach
+ *        CCM RAM. Message schedule of sha256 is in CCM RAM, see cbl_sha256.h
+ * @note  Users check at compile time that their biggest need fits, e.g.
+ *        FLASH_WRITE_ARENA_SZ in cbl_cmds_memory.c. Batch runs commands
+ *        inside a command, its check is in custom_bootloader.c
+ * @note  Stack peak needs symbols from the linker script: _estack, top of
+ *        the stack, and _Min_Stack_Size
+ */
+#ifndef CBL_MEM_H
+#define CBL_MEM_H
+#include "cbl_common.h"
+
+#define MEM_ARENA_SZ (16 * 1024) /*!< Bytes of the arena */
+#define MEM_ALIGN 8u /*!< Alignment of every allocation */
+#define MEM_STACK_PAINT 0xA5A5A5A5UL /*!< Fill of unused stack */
+
+typedef struct
+{
+    uint32_t arena_sz; /*!< Size of the arena */
+    uint32_t arena_used; /*!< Bytes taken now */
+    uint32_t arena_peak; /*!< Most bytes taken since reset */
+    uint32_t stack_sz; /*!< Size of the stack */
+    uint32_t stack_peak; /*!< Most bytes of stack used since reset */
+} mem_stats_t;
+
+void * mem_alloc (uint32_t size);
+uint32_t mem_mark (void);
+void mem_release (uint32_t mark);
+void mem_stack_paint (void);
+void mem_stats_get (mem_stats_t * p_stats);
+
+#endif /* CBL_MEM_H */
+/*** end of file ***/
@@ -0,0 +1,63 @@
+/** @file cbl_perf.h
+ *
+ * @brief Cycle counter probes around the hot paths of an update. With
+ *        USE_PERF set to 1 in cbl_config.h every probe adds count, total, min
+ *        and max of the cycles it took to a static table, which is shown with
+ *        the perf command. Without it probes compile to nothing
+ *
+ * @note  Cycle counter (DWT CYCCNT) is started when bootloader starts and is
+ *        left running, so user application can read the time bootloader took.
+ *        First fast boot of an application stores it in the boot record, perf
+ *        command shows it
+ * @note  Probes may be nested, time of the outer one includes the inner one,
+ *        e.g. decoding of records includes writing of decoded data
+ */
+#ifndef CBL_PERF_H
+#define CBL_PERF_H
+#include "cbl_common.h"
+
+typedef enum
+{
+    PERF_RX_WAIT = 0, /*!< Waiting for chunk bytes from the host */
+    PERF_ERASE, /*!< Erasing flash sectors */
+    PERF_WRITE, /*!< Programming flash */
+    PERF_CKSUM, /*!< Accumulating CRC32 or sha256 */
+    PERF_RECORDS, /*!< Decoding hex or srec */
+    PERF_LZ4, /*!< Decompressing LZ4 */
+    PERF_N_PROBES
+} perf_probe_t;
+
+typedef struct
+{
+    uint32_t count; /*!< Times the probe was hit */
+    uint64_t total; /*!< Sum of cycles */
+    uint32_t min; /*!< Fewest cycles of a hit, UINT32_MAX if not hit */
+    uint32_t max; /*!< Most cycles of a hit */
+} perf_stat_t;
+
+#if 1 == USE_PERF
+/** Starts the probe, at most one start of a probe in a scope */
+#define PERF_START(PROBE) uint32_t perf_start_##PROBE = perf_cycles()
+/** Adds cycles since PERF_START of the same probe to the table */
+#define PERF_STOP(PROBE) perf_add((PROBE), perf_cycles() - perf_start_##PROBE)
+#else
+#define PERF_START(PROBE)
+#define PERF_STOP(PROBE)
+#endif /* USE_PERF */
+
+#ifndef PERF_CLK_HZ
+#define PERF_CLK_HZ 168000000UL /*!< Core clock set by HAL layer, cycles per
+                                     second of the counter */
+#endif /* PERF_CLK_HZ */
+
+void perf_timer_start (void);
+uint32_t perf_cycles (void);
+#if 1 == USE_PERF
+void perf_add (perf_probe_t probe, uint32_t cycles);
+void perf_reset (void);
+const perf_stat_t * perf_get (perf_probe_t probe);
+const char * perf_name (perf_probe_t probe);
+#endif /* USE_PERF */
+
+#endif /* CBL_PERF_H */
+/*** end of file ***/
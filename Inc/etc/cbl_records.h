@@ -0,0 +1,54 @@
+/** @file cbl_records.h
+ *
+ * @brief Decoding of Intel hex and Motorola S-record files. Text is fed in
+ *        pieces of any length, records split between pieces are put together
+ *        before they are decoded
+ */
+#ifndef CBL_RECORDS_H
+#define CBL_RECORDS_H
+#include "cbl_common.h"
+#include "cbl_boot_record.h"
+
+#define IHEX_MAX_LEN (1 + 2 + 4 + 2 + 2 * 255 + 2) /*!< ':', byte count,
+                                     address, type, 255 data bytes, checksum */
+#define SREC_MAX_LEN (1 + 1 + 2 * 256) /*!< 'S', type and 255 byte pairs
+                                            with count */
+#define RECORD_MAX_LEN IHEX_MAX_LEN /*!< Longest record of both formats */
+#define RECORDS_WBUF_SZ 256 /*!< Contiguous data is collected and written in
+                                 blocks aligned to this, shall be power of 2 */
+
+/** Called with decoded data of every data record, address is checked to be
+ *  inside of the area (active application by default) before */
+typedef cbl_err_code_t (*record_write_t) (uint32_t address, uint8_t * p_data,
+        uint32_t len);
+
+typedef struct
+{
+    app_type_t app_type; /*!< TYPE_HEX or TYPE_SREC */
+    record_write_t write; /*!< Sink of decoded data */
+    bool is_EOF; /*!< Signal of end of file, set by ihex function 01 */
+    uint16_t upper_address; /*!< Set by ihex function 04 */
+    uint32_t * p_main; /*!< Set by ihex function 05, BIG ENDIAN */
+    uint32_t area_start; /*!< Data records shall be inside of area, active
+     application by default */
+    uint32_t area_len; /*!< Length of the area */
+    uint32_t addr_end; /*!< Address after the highest written byte, 0 if
+     nothing was written */
+    uint32_t line_len; /*!< Characters of current record collected so far */
+    uint32_t rec_len; /*!< Length of current record, 0 while unknown */
+    uint32_t wbuf_addr; /*!< Address of the first byte in wbuf */
+    uint32_t wbuf_len; /*!< Bytes collected in wbuf */
+    uint8_t wbuf[RECORDS_WBUF_SZ] __attribute__((aligned(4))); /*!< Data of
+     consecutive records waiting to be written */
+    uint8_t line[RECORD_MAX_LEN]; /*!< Current record */
+} h_records_t;
+
+cbl_err_code_t records_init (h_records_t * ph_rec, app_type_t app_type,
+        record_write_t write);
+void records_set_area (h_records_t * ph_rec, uint32_t start, uint32_t len);
+cbl_err_code_t records_feed (h_records_t * ph_rec, const uint8_t * buf,
+        uint32_t len);
+cbl_err_code_t records_finish (h_records_t * ph_rec);
+
+#endif /* CBL_RECORDS_H */
+/*** end of file ***/
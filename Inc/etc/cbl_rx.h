@@ -0,0 +1,38 @@
+/** @file cbl_rx.h
+ *
+ * @brief Receiving bytes from the host. Bytes are either received by arming
+ *        DMA for every request, or are taken from a circular DMA ring that
+ *        runs for the whole shell session (USE_RX_RING set to 1 in
+ *        cbl_config.h)
+ *
+ * @note  Ring over UART needs from the HAL layer:
+ *          - hal_recv_from_host_circ_start(buf, len) - start circular DMA
+ *            receive into buf, never stopping
+ *          - hal_recv_from_host_circ_pos() - index in buf DMA writes next
+ * @note  Receive goes through the link, see cbl_link.h
+ * @note  With a source set, requests are filled by the source before
+ *        rx_start returns instead of by the link, e.g. binary protocol takes
+ *        the bytes from request frames
+ */
+#ifndef CBL_RX_H
+#define CBL_RX_H
+#include "cbl_common.h"
+
+#define RX_RING_SZ 16384 /*!< Size of receive ring, shall be a power of 2 and
+                              hold at least two frames of flash write */
+#define RX_ABORT_TIMEOUT_MS 10000u /*!< Time for the rest of an aborted
+                                        request, a frame at 9600 baud */
+
+/** Fills the whole request, returns when bytes are in buf */
+typedef cbl_err_code_t (*rx_src_t) (uint8_t * buf, uint32_t len);
+
+cbl_err_code_t rx_init (void);
+void rx_deinit (void);
+cbl_err_code_t rx_start (uint8_t * buf, uint32_t len);
+void rx_wait (void);
+cbl_err_code_t rx_wait_timeout (uint32_t timeout_ms);
+void rx_abort (void);
+rx_src_t rx_src_set (rx_src_t new_src);
+
+#endif /* CBL_RX_H */
+/*** end of file ***/
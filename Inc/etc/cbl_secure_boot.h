@@ -0,0 +1,29 @@
+/** @file cbl_secure_boot.h
+ *
+ * @brief Secure boot checks signature of the active application before it is
+ *        started (USE_SECURE_BOOT set to 1 in cbl_config.h). Signature is the
+ *        last SECURE_BOOT_SIG_SZ bytes of the image, over SHA-256 of the bytes
+ *        before it. Verified digest is cached in the boot record, later boots
+ *        hash the image and compare the digest, signature isn't verified again
+ *
+ * @note  Signature is checked by the HAL layer, which holds the public key:
+ *          - hal_sig_verify(p_digest, p_sig) - CBL_ERR_OK if p_sig is a valid
+ *            signature of the SHA-256 p_digest, e.g. Ed25519 or ECDSA P-256
+ * @note  Signature is verified again after update-act, A/B switch or roll
+ *        back, and when digest of the image doesn't match the cached one
+ * @note  Host can't write or erase the bootloader and the boot record, also
+ *        not with mass erase, so the cache can't be forged, see
+ *        flash_verify_range. jump-to only jumps into the verified active
+ *        application
+ * @note  STM32F407 has no HASH unit, every boot hashes in software
+ */
+#ifndef CBL_SECURE_BOOT_H
+#define CBL_SECURE_BOOT_H
+#include "cbl_common.h"
+
+#define SECURE_BOOT_SIG_SZ 64u /*!< Ed25519 or raw r|s of ECDSA P-256 */
+
+cbl_err_code_t secure_boot_check (void);
+
+#endif /* CBL_SECURE_BOOT_H */
+/*** end of file ***/
@@ -0,0 +1,31 @@
+/** @file cbl_sha256.h
+ *
+ * @brief SHA-256 tuned for Cortex-M4. Rounds are unrolled so the working
+ *        variables stay in registers, rotations are folded into EOR by the
+ *        barrel shifter
+ *
+ * @note  With USE_SHA256_CCM set to 1 in cbl_config.h message schedule is
+ *        kept in CCM RAM (".ccmram" section of the linker script), which DMA
+ *        can't reach so hashing doesn't wait for UART DMA on the bus matrix
+ */
+#ifndef CBL_SHA256_H
+#define CBL_SHA256_H
+#include "cbl_common.h"
+
+#define SHA256_DIGEST_SZ 32u /*!< Length of SHA-256 digest */
+#define SHA256_BLOCK_SZ 64u /*!< Bytes compressed at once */
+
+typedef struct
+{
+    uint32_t state[8]; /*!< Hash of the blocks compressed so far */
+    uint64_t len; /*!< Number of bytes added */
+    uint32_t block_len; /*!< Bytes waiting in block */
+    uint8_t block[SHA256_BLOCK_SZ]; /*!< Bytes that don't fill a block yet */
+} sha256_ctx_t;
+
+void sha256_start (sha256_ctx_t * p_ctx);
+void sha256_add (sha256_ctx_t * p_ctx, const uint8_t * buf, uint32_t len);
+void sha256_finish (sha256_ctx_t * p_ctx, uint8_t * p_digest);
+
+#endif /* CBL_SHA256_H */
+/*** end of file ***/
@@ -0,0 +1,705 @@
+/** @file cbl_cmds_binary.c
+ *
+ * @brief Binary framed protocol. Every request is answered with exactly one
+ *        response frame carrying cbl_err_code_t as status, errors don't leave
+ *        binary mode
+ */
+#include "commands/cbl_cmds_binary.h"
+#include "etc/cbl_checksum.h"
+#include "etc/cbl_boot_record.h"
+#include "etc/cbl_rx.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_mem.h"
+#include <stdio.h>
+#include "string.h"
+#if 1 == USE_CMDS_OPT_BYTES
+#include "commands/cbl_cmds_opt_bytes.h"
+#endif
+#if 1 == USE_CMDS_UPDATE_NEW
+#include "commands/cbl_cmds_update_new.h"
+#endif
+
+#define BIN_PAD(LEN) (((LEN) + 3u) & ~3u) /*!< Length with padding */
+#define BIN_BUF_SZ (BIN_HDR_SZ + BIN_PAD(BIN_MAX_PAYLOAD) + BIN_CRC_SZ)
+#define BIN_MAX_FIELDS 3u /*!< Fields of a request before its data */
+#define BIN_LINE_SZ 128u /*!< Command line the fields are converted to */
+
+#define BIN_ERASE_SECT 0u /*!< Erase type in flash erase request */
+#define BIN_ERASE_MASS 1u /*!< Erase type in flash erase request */
+
+typedef enum
+{
+    BIN_FIELD_HEX = 0, /*!< Number, given to the command in hex */
+    BIN_FIELD_DEC, /*!< Number, given to the command in decimal */
+    BIN_FIELD_ERASE, /*!< BIN_ERASE_SECT or BIN_ERASE_MASS */
+    BIN_FIELD_CKSUM, /*!< cksum_t */
+    BIN_FIELD_CKSUM_STREAM, /*!< cksum_t of data sent in data frames, CRC32
+     unit checks the frames meanwhile so crc32 can't be used */
+    BIN_FIELD_APP_TYPE, /*!< app_type_t */
+    BIN_FIELD_DATA_LEN /*!< Not in the payload, bytes after the fields */
+} bin_field_t;
+
+typedef struct
+{
+    cmd_t code;
+    const char * names[BIN_MAX_FIELDS]; /*!< Parameters, NULL ends them */
+    bin_field_t types[BIN_MAX_FIELDS];
+} bin_cmd_t;
+
+/* Fields of requests, in order. Commands not here have none, their whole
+ * payload is data */
+static const bin_cmd_t bin_cmds[] =
+{
+#ifdef CBL_CMDS_OPT_BYTES_H
+    {
+        CMD_EN_WRITE_PROT, { TXT_PAR_EN_WRITE_PROT_MASK }, { BIN_FIELD_HEX }
+    },
+    {
+        CMD_DIS_WRITE_PROT, { TXT_PAR_EN_WRITE_PROT_MASK }, { BIN_FIELD_HEX }
+    },
+#endif /* CBL_CMDS_OPT_BYTES_H */
+    {
+        CMD_JUMP_TO, { TXT_PAR_JUMP_TO_ADDR }, { BIN_FIELD_HEX }
+    },
+    {
+        CMD_FLASH_ERASE,
+        { TXT_PAR_FLASH_ERASE_TYPE, TXT_PAR_FLASH_ERASE_SECT,
+                TXT_PAR_FLASH_ERASE_COUNT },
+        { BIN_FIELD_ERASE, BIN_FIELD_DEC, BIN_FIELD_DEC }
+    },
+    {
+        CMD_FLASH_WRITE,
+        { TXT_PAR_FLASH_WRITE_START, TXT_PAR_FLASH_WRITE_COUNT },
+        { BIN_FIELD_HEX, BIN_FIELD_DATA_LEN }
+    },
+    {
+        CMD_MEM_READ,
+        { TXT_PAR_FLASH_WRITE_START, TXT_PAR_FLASH_WRITE_COUNT },
+        { BIN_FIELD_HEX, BIN_FIELD_DEC }
+    },
+    {
+        CMD_MEM_HASH,
+        { TXT_PAR_FLASH_WRITE_START, TXT_PAR_FLASH_WRITE_COUNT,
+                TXT_PAR_CKSUM },
+        { BIN_FIELD_HEX, BIN_FIELD_DEC, BIN_FIELD_CKSUM }
+    },
+#ifdef CBL_CMDS_UPDATE_NEW_H
+    {
+        CMD_UPDATE_NEW,
+        { TXT_PAR_UP_NEW_COUNT, TXT_PAR_APP_TYPE, TXT_PAR_CKSUM },
+        { BIN_FIELD_DEC, BIN_FIELD_APP_TYPE, BIN_FIELD_CKSUM_STREAM }
+    },
+#endif /* CBL_CMDS_UPDATE_NEW_H */
+};
+#define BIN_CMDS_LEN (sizeof(bin_cmds) / sizeof(bin_cmds[0]))
+
+static cbl_err_code_t bin_recv_frame (uint8_t * p_code, uint32_t * p_len,
+        cbl_err_code_t * p_status);
+static cbl_err_code_t bin_handle_frame (uint8_t code, uint8_t * p_payload,
+        uint32_t len, bool * p_is_leave);
+static cbl_err_code_t bin_make_line (uint8_t code, const uint8_t * p_payload,
+        uint32_t len, char * line, uint32_t * p_fields_len);
+static cbl_err_code_t bin_put_field (char * line, uint32_t * p_pos,
+        const char * name, bin_field_t type, uint32_t val);
+static cbl_err_code_t bin_sink_send (const char * buf, size_t len);
+static cbl_err_code_t bin_sink_flush (void);
+static cbl_err_code_t bin_src_recv (uint8_t * buf, uint32_t len);
+static cbl_err_code_t bin_send_direct (uint8_t code, cbl_err_code_t status,
+        const uint8_t * p_data, uint32_t len);
+static cbl_err_code_t bin_send_resp (uint8_t code, cbl_err_code_t status,
+        const uint8_t * p_data, uint32_t len);
+static uint32_t bin_get_u32 (const uint8_t * p);
+static void bin_put_u32 (uint8_t * p, uint32_t val);
+
+/** Holds one request frame, payload is at offset BIN_HDR_SZ */
+static uint8_t bin_buf[BIN_BUF_SZ] __attribute__((aligned(4)));
+/** What the running command sent, goes out as data of its response */
+static uint8_t bin_resp[BIN_MAX_DATA] __attribute__((aligned(4)));
+static uint32_t bin_resp_len = 0;
+/** Code of the running command */
+static uint8_t bin_code = CMD_UNDEF;
+/** Response of the running command was sent, e.g. before a jump */
+static bool is_bin_resp_sent = false;
+/** Data of requests not yet taken by the running command */
+static const uint8_t * p_bin_data = NULL;
+static uint32_t bin_data_len = 0;
+
+static const link_sink_t bin_sink =
+{
+    .send = bin_sink_send,
+    .flush = bin_sink_flush,
+};
+
+/**
+ * @brief   Runs binary protocol until BIN_CODE_LEAVE is received. Frames are
+ *          described in cbl_cmds_binary.h
+ *
+ *          Every command of the shell runs through its own handler. Fields of
+ *          the request (u32) are given to it as parameters, bytes after them
+ *          are what the command receives. Fields of the commands:
+ *              - CMD_EN_WRITE_PROT, CMD_DIS_WRITE_PROT - mask
+ *              - CMD_JUMP_TO - address
+ *              - CMD_FLASH_ERASE - type (0 sector, 1 mass), sector, count
+ *              - CMD_FLASH_WRITE - address, data (up to BIN_MAX_DATA)
+ *              - CMD_MEM_READ - address, count
+ *              - CMD_MEM_HASH - address, count, cksum (cksum_t)
+ *              - CMD_UPDATE_NEW - length, type (app_type_t), cksum (cksum_t,
+ *                not crc32). Image and checksum follow in BIN_CODE_DATA frames
+ *          Commands not listed have no fields
+ *
+ * @note    Command has no parameters
+ */
+cbl_err_code_t cmd_binary (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    cbl_err_code_t status;
+    uint8_t code;
+    uint32_t len;
+    bool is_leave = false;
+
+    UNUSED(phPrsr);
+    DEBUG("Started\r\n");
+
+    eCode = link_send(TXT_RESP_BINARY, strlen(TXT_RESP_BINARY));
+    ERR_CHECK(eCode);
+
+    while (false == is_leave)
+    {
+        eCode = bin_recv_frame(&code, &len, &status);
+        ERR_CHECK(eCode);
+
+        if (CBL_ERR_OK != status)
+        {
+            /* Frame is discarded, host repeats it */
+            eCode = bin_send_resp(code, status, NULL, 0);
+        }
+        else
+        {
+            eCode = bin_handle_frame(code, &bin_buf[BIN_HDR_SZ], len,
+                    &is_leave);
+        }
+        ERR_CHECK(eCode);
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Receives a request frame into bin_buf. Bytes before start of frame
+ *        are dropped
+ *
+ * @param p_code[out]   Code of the request
+ * @param p_len[out]    Length of the payload, without padding
+ * @param p_status[out] CBL_ERR_OK if the frame is valid
+ *
+ * @return Error only if receiving failed
+ */
+static cbl_err_code_t bin_recv_frame (uint8_t * p_code, uint32_t * p_len,
+        cbl_err_code_t * p_status)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t padded;
+
+    /* Synchronize on start of frame */
+    do
+    {
+        eCode = rx_start(bin_buf, 1);
+        ERR_CHECK(eCode);
+        rx_wait();
+    }
+    while (BIN_SOF_REQ != bin_buf[0]);
+
+    eCode = rx_start(&bin_buf[1], BIN_HDR_SZ - 1);
+    ERR_CHECK(eCode);
+    rx_wait();
+
+    *p_code = bin_buf[1];
+    *p_len = (uint32_t)bin_buf[2] | ((uint32_t)bin_buf[3] << 8);
+
+    if (*p_len > BIN_MAX_PAYLOAD)
+    {
+        /* Rest of the frame is dropped while synchronizing on the next one */
+        *p_status = CBL_ERR_INV_SZ;
+        return eCode;
+    }
+
+    padded = BIN_PAD(*p_len);
+    eCode = rx_start(&bin_buf[BIN_HDR_SZ], padded + BIN_CRC_SZ);
+    ERR_CHECK(eCode);
+    rx_wait();
+
+    init_checksum(CKSUM_CRC32, NULL);
+    accumulate_crc32(bin_buf, BIN_HDR_SZ + padded);
+    *p_status = verify_crc32(&bin_buf[BIN_HDR_SZ + padded], BIN_CRC_SZ);
+
+    return eCode;
+}
+
+/**
+ * @brief Runs the command of a request through the command table and sends
+ *        the response. What the command sends is the data of the response,
+ *        what it receives is taken from the request and the data frames
+ *        after it
+ *
+ * @param code            Code of the request
+ * @param p_payload       Payload of the request
+ * @param len             Length of the payload
+ * @param p_is_leave[out] Set when binary mode shall be left
+ *
+ * @return Error only if sending failed
+ */
+static cbl_err_code_t bin_handle_frame (uint8_t code, uint8_t * p_payload,
+        uint32_t len, bool * p_is_leave)
+{
+    cbl_err_code_t status = CBL_ERR_OK;
+    char line[BIN_LINE_SZ] = { 0 };
+    uint32_t fields_len = 0;
+    const link_sink_t * p_prev_sink;
+    rx_src_t prev_src;
+    uint32_t mark;
+
+    if (BIN_CODE_LEAVE == code)
+    {
+        *p_is_leave = true;
+        return bin_send_resp(code, status, NULL, 0);
+    }
+
+    /* Link would be switched under the frames, and binary is running */
+    if (CMD_SET_BAUD == code || CMD_BINARY == code)
+    {
+        return bin_send_resp(code, CBL_ERR_CMD_UNDEF, NULL, 0);
+    }
+
+    status = bin_make_line(code, p_payload, len, line, &fields_len);
+    if (CBL_ERR_OK != status)
+    {
+        return bin_send_resp(code, status, NULL, 0);
+    }
+
+    bin_code = code;
+    bin_resp_len = 0;
+    is_bin_resp_sent = false;
+    p_bin_data = &p_payload[fields_len];
+    bin_data_len = len - fields_len;
+
+    /* Everything the command takes from the arena is given back with it */
+    mark = mem_mark();
+    p_prev_sink = link_sink_set( &bin_sink);
+    prev_src = rx_src_set(bin_src_recv);
+
+    status = CBL_run_cmd(line, strlen(line));
+
+    link_sink_set(p_prev_sink);
+    rx_src_set(prev_src);
+    mem_release(mark);
+
+    if (CMD_EXIT == code && CBL_ERR_OK == status)
+    {
+        *p_is_leave = true;
+    }
+
+    if (true == is_bin_resp_sent)
+    {
+        return CBL_ERR_OK;
+    }
+
+    return bin_send_resp(code, status, bin_resp, bin_resp_len);
+}
+
+/**
+ * @brief Converts fields of the request to the command line of the shell,
+ *        e.g. "flash-write start=0x08080000 count=5120"
+ *
+ * @param code              Code of the request
+ * @param p_payload         Payload of the request
+ * @param len               Length of the payload
+ * @param line[out]         BIN_LINE_SZ bytes for the command line
+ * @param p_fields_len[out] Bytes of the fields, data starts after them
+ *
+ * @return CBL_ERR_CMD_UNDEF if command isn't compiled in, CBL_ERR_NEED_PARAM
+ *         if payload is too short for the fields
+ */
+static cbl_err_code_t bin_make_line (uint8_t code, const uint8_t * p_payload,
+        uint32_t len, char * line, uint32_t * p_fields_len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    const char * name = CBL_cmd_name((cmd_t)code);
+    const bin_cmd_t * p_bin_cmd = NULL;
+    uint32_t fields_len = 0;
+    uint32_t pos;
+
+    if (NULL == name)
+    {
+        return CBL_ERR_CMD_UNDEF;
+    }
+
+    pos = snprintf(line, BIN_LINE_SZ, "%s", name);
+
+    for (uint32_t iii = 0; iii < BIN_CMDS_LEN; iii++)
+    {
+        if (code == bin_cmds[iii].code)
+        {
+            p_bin_cmd = &bin_cmds[iii];
+        }
+    }
+
+    if (NULL != p_bin_cmd)
+    {
+        for (uint32_t iii = 0;
+                iii < BIN_MAX_FIELDS && NULL != p_bin_cmd->names[iii]; iii++)
+        {
+            if (BIN_FIELD_DATA_LEN != p_bin_cmd->types[iii])
+            {
+                fields_len += 4;
+            }
+        }
+
+        if (len < fields_len)
+        {
+            return CBL_ERR_NEED_PARAM;
+        }
+
+        for (uint32_t iii = 0, offset = 0;
+                iii < BIN_MAX_FIELDS && NULL != p_bin_cmd->names[iii]; iii++)
+        {
+            uint32_t val = len - fields_len;
+
+            if (BIN_FIELD_DATA_LEN != p_bin_cmd->types[iii])
+            {
+                val = bin_get_u32( &p_payload[offset]);
+                offset += 4;
+            }
+
+            eCode = bin_put_field(line, &pos, p_bin_cmd->names[iii],
+                    p_bin_cmd->types[iii], val);
+            ERR_CHECK(eCode);
+        }
+    }
+
+    *p_fields_len = fields_len;
+
+    return eCode;
+}
+
+/**
+ * @brief Appends one field to the command line as "name=value"
+ *
+ * @param line[in,out]  Command line of BIN_LINE_SZ bytes
+ * @param p_pos[in,out] Length of the line
+ * @param name          Name of the parameter
+ * @param type          How the value is written
+ * @param val           Value of the field
+ */
+static cbl_err_code_t bin_put_field (char * line, uint32_t * p_pos,
+        const char * name, bin_field_t type, uint32_t val)
+{
+    const char * txt_val = NULL;
+
+    switch (type)
+    {
+        case BIN_FIELD_HEX:
+        {
+            *p_pos += snprintf( &line[ *p_pos], BIN_LINE_SZ - *p_pos,
+                    " %s=0x%08lx", name, val);
+        }
+        break;
+
+        case BIN_FIELD_DEC:
+        case BIN_FIELD_DATA_LEN:
+        {
+            *p_pos += snprintf( &line[ *p_pos], BIN_LINE_SZ - *p_pos,
+                    " %s=%lu", name, val);
+        }
+        break;
+
+        case BIN_FIELD_ERASE:
+        {
+            if (BIN_ERASE_SECT == val)
+            {
+                txt_val = TXT_PAR_FLASH_ERASE_TYPE_SECT;
+            }
+            else if (BIN_ERASE_MASS == val)
+            {
+                txt_val = TXT_PAR_FLASH_ERASE_TYPE_MASS;
+            }
+            else
+            {
+                return CBL_ERR_ERASE_INV_TYPE;
+            }
+        }
+        break;
+
+        case BIN_FIELD_CKSUM:
+        case BIN_FIELD_CKSUM_STREAM:
+        {
+            if (CKSUM_SHA256 == val)
+            {
+                txt_val = TXT_CKSUM_SHA256;
+            }
+            else if (CKSUM_CRC32 == val && BIN_FIELD_CKSUM == type)
+            {
+                txt_val = TXT_CKSUM_CRC;
+            }
+            else if (CKSUM_NO == val)
+            {
+                txt_val = TXT_CKSUM_NO;
+            }
+            else
+            {
+                return CBL_ERR_UNSUP_CKSUM;
+            }
+        }
+        break;
+
+        case BIN_FIELD_APP_TYPE:
+        {
+            if (TYPE_BIN == val)
+            {
+                txt_val = TXT_PAR_APP_TYPE_BIN;
+            }
+            else if (TYPE_HEX == val)
+            {
+                txt_val = TXT_PAR_APP_TYPE_HEX;
+            }
+            else if (TYPE_SREC == val)
+            {
+                txt_val = TXT_PAR_APP_TYPE_SREC;
+            }
+            else if (TYPE_BIN_LZ4 == val)
+            {
+                txt_val = TXT_PAR_APP_TYPE_BIN_LZ4;
+            }
+            else
+            {
+                return CBL_ERR_APP_TYPE;
+            }
+        }
+        break;
+
+        default:
+        {
+            return CBL_ERR_INV_PARAM;
+        }
+        break;
+    }
+
+    if (NULL != txt_val)
+    {
+        *p_pos += snprintf( &line[ *p_pos], BIN_LINE_SZ - *p_pos, " %s=%s",
+                name, txt_val);
+    }
+
+    /* Line is cut, fields don't fit */
+    if ( *p_pos >= BIN_LINE_SZ)
+    {
+        return CBL_ERR_READ_OF;
+    }
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Takes what the running command sends. Full buffer goes out in a
+ *        BIN_CODE_MORE response and the command continues
+ */
+static cbl_err_code_t bin_sink_send (const char * buf, size_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    while (len > 0)
+    {
+        uint32_t part = ui32_min(len, sizeof(bin_resp) - bin_resp_len);
+
+        memcpy( &bin_resp[bin_resp_len], buf, part);
+        bin_resp_len += part;
+        buf += part;
+        len -= part;
+
+        if (sizeof(bin_resp) == bin_resp_len)
+        {
+            eCode = bin_send_direct(BIN_CODE_MORE, CBL_ERR_OK, bin_resp,
+                    bin_resp_len);
+            ERR_CHECK(eCode);
+            bin_resp_len = 0;
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Sends the response of the running command before link_flush, which
+ *        comes before jumps and resets. Command doesn't return after it
+ */
+static cbl_err_code_t bin_sink_flush (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (false == is_bin_resp_sent)
+    {
+        eCode = bin_send_direct(bin_code, CBL_ERR_OK, bin_resp, bin_resp_len);
+        is_bin_resp_sent = true;
+        bin_resp_len = 0;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Fills a request of the running command. Data of the request comes
+ *        first, then every BIN_CODE_DATA frame host sends. Each is asked for
+ *        with a BIN_CODE_DATA response carrying what the command sent so far
+ *
+ * @return CBL_ERR_STATE if host sent another request instead of data, the
+ *         request is dropped and the command fails
+ */
+static cbl_err_code_t bin_src_recv (uint8_t * buf, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    cbl_err_code_t status = CBL_ERR_OK;
+    rx_src_t prev_src;
+    uint8_t code;
+    uint32_t frame_len;
+
+    while (len > 0)
+    {
+        uint32_t part;
+
+        while (0 == bin_data_len)
+        {
+            eCode = bin_send_direct(BIN_CODE_DATA, status, bin_resp,
+                    bin_resp_len);
+            ERR_CHECK(eCode);
+            bin_resp_len = 0;
+
+            prev_src = rx_src_set(NULL);
+            eCode = bin_recv_frame( &code, &frame_len, &status);
+            rx_src_set(prev_src);
+            ERR_CHECK(eCode);
+
+            if (CBL_ERR_OK != status)
+            {
+                /* Asked for again with the error */
+                continue;
+            }
+            if (BIN_CODE_DATA != code)
+            {
+                return CBL_ERR_STATE;
+            }
+
+            p_bin_data = &bin_buf[BIN_HDR_SZ];
+            bin_data_len = frame_len;
+        }
+
+        part = ui32_min(len, bin_data_len);
+        memcpy(buf, p_bin_data, part);
+        p_bin_data += part;
+        bin_data_len -= part;
+        buf += part;
+        len -= part;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Sends a response frame to the link also while a command runs and
+ *        its sends go to the sink
+ */
+static cbl_err_code_t bin_send_direct (uint8_t code, cbl_err_code_t status,
+        const uint8_t * p_data, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    const link_sink_t * p_prev_sink = link_sink_set(NULL);
+
+    eCode = bin_send_resp(code, status, p_data, len);
+    link_sink_set(p_prev_sink);
+
+    return eCode;
+}
+
+/**
+ * @brief Sends a response frame, data is taken from where it is
+ *
+ * @param code   Code of the request being answered
+ * @param status Result of the request
+ * @param p_data Data of the response, can be NULL if len is 0
+ * @param len    Length of data
+ */
+static cbl_err_code_t bin_send_resp (uint8_t code, cbl_err_code_t status,
+        const uint8_t * p_data, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint8_t hdr[BIN_HDR_SZ + 4] __attribute__((aligned(4)));
+    uint8_t tail[4] __attribute__((aligned(4))) = { 0 };
+    uint8_t crc[BIN_CRC_SZ];
+    uint32_t aligned_len = len & ~3u;
+    uint32_t crc32;
+
+    hdr[0] = BIN_SOF_RESP;
+    hdr[1] = code;
+    hdr[2] = (uint8_t)((len + 4) & 0xFF);
+    hdr[3] = (uint8_t)((len + 4) >> 8);
+    bin_put_u32(&hdr[BIN_HDR_SZ], (uint32_t)status);
+
+    if (len != aligned_len)
+    {
+        memcpy(tail, &p_data[aligned_len], len - aligned_len);
+    }
+
+    init_checksum(CKSUM_CRC32, NULL);
+    accumulate_crc32(hdr, sizeof(hdr));
+    if (0 != aligned_len)
+    {
+        accumulate_crc32((uint8_t *)p_data, aligned_len);
+    }
+    if (len != aligned_len)
+    {
+        accumulate_crc32(tail, sizeof(tail));
+    }
+    crc32 = crc32_get();
+
+    /* MSB first, same as the host sends it */
+    crc[0] = (uint8_t)(crc32 >> 24);
+    crc[1] = (uint8_t)(crc32 >> 16);
+    crc[2] = (uint8_t)(crc32 >> 8);
+    crc[3] = (uint8_t)crc32;
+
+    eCode = link_send((char *)hdr, sizeof(hdr));
+    ERR_CHECK(eCode);
+    if (0 != aligned_len)
+    {
+        eCode = link_send((char *)p_data, aligned_len);
+        ERR_CHECK(eCode);
+    }
+    if (len != aligned_len)
+    {
+        eCode = link_send((char *)tail, sizeof(tail));
+        ERR_CHECK(eCode);
+    }
+    eCode = link_send((char *)crc, sizeof(crc));
+
+    return eCode;
+}
+
+/**
+ * @brief Reads little endian uint32_t from unaligned buffer
+ */
+static uint32_t bin_get_u32 (const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+            | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Writes uint32_t to unaligned buffer as little endian
+ */
+static void bin_put_u32 (uint8_t * p, uint32_t val)
+{
+    p[0] = (uint8_t)val;
+    p[1] = (uint8_t)(val >> 8);
+    p[2] = (uint8_t)(val >> 16);
+    p[3] = (uint8_t)(val >> 24);
+}
+
+/*** end of file ***/
@@ -4,11 +4,21 @@
  *        own file
  */
 #include "commands/cbl_cmds_etc.h"
+#include "etc/cbl_boot_record.h"
+#include "etc/cbl_fast_boot.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_perf.h"
+#include "etc/cbl_rx.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_mem.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/** Baud rate UART runs at, switched with set-baud */
+static uint32_t baud_rate = SET_BAUD_DEFAULT;
+
 /**
  * @brief Returns chip ID to the host
  */
@@ -31,7 +41,7 @@ cbl_err_code_t cmd_cid (parser_t * phPrsr)
     strlcat(cid, CRLF, 12);
 
     /* Send response */
-    eCode = hal_send_to_host(cid, strlen(cid));
+    eCode = link_send(cid, strlen(cid));
 
     return eCode;
 }
@@ -50,4 +60,298 @@ cbl_err_code_t cmd_exit (parser_t * phPrsr)
     return eCode;
 }
 
+/**
+ * @brief   Turns fast boot on or off and returns its state. Turning it on
+ *          stores CRC32 of the active application, which is checked on every
+ *          fast boot.
+ *          Parameters from phPrsr:
+ *              - enable - "true" or "false", optional. Without it only state
+ *                is returned
+ */
+cbl_err_code_t cmd_fast_boot (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    bool is_enable;
+    boot_record_t * p_boot_record;
+    uint32_t act_start;
+    char msg[64] = { 0 };
+
+    DEBUG("Started\r\n");
+
+    /* Before the record is edited, getting start reads the record again */
+    act_start = ab_act_start();
+    p_boot_record = boot_record_get();
+
+    eCode = parser_get_bool(phPrsr, TXT_PAR_FAST_BOOT_EN, &is_enable);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
+        ERR_CHECK(eCode);
+
+        if (true == is_enable)
+        {
+            if (0 == p_boot_record->act_app.len
+                    || p_boot_record->act_app.len > BOOT_ACT_APP_MAX_LEN)
+            {
+                return CBL_ERR_APP_LEN_UNKNOWN;
+            }
+            p_boot_record->act_app_crc = fast_boot_digest(act_start,
+                    p_boot_record->act_app.len);
+            /* Next fast boot is measured again */
+            p_boot_record->fast_boot_cycles = 0;
+        }
+
+        p_boot_record->is_fast_boot = is_enable;
+
+        eCode = boot_record_set(p_boot_record);
+        ERR_CHECK(eCode);
+    }
+
+    snprintf(msg, sizeof(msg), "fast boot:%s|crc32:0x%08lx\r\n",
+            true == p_boot_record->is_fast_boot ? "on" : "off",
+            p_boot_record->act_app_crc);
+    eCode = link_send(msg, strlen(msg));
+
+    return eCode;
+}
+
+/**
+ * @brief   Measures speed of a checksum over the active application in flash
+ *          and returns cycles it took.
+ *          Parameters from phPrsr:
+ *              - cksum - "crc32" or "sha256"
+ *              - count - Optional, number of bytes in decimal. Default is
+ *                CKSUM_BENCH_DEF_COUNT
+ */
+cbl_err_code_t cmd_cksum_bench (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    cksum_t cksum = CKSUM_UNDEF;
+    uint32_t count = CKSUM_BENCH_DEF_COUNT;
+    sha256_ctx_t h_sha256;
+    uint8_t digest[SHA256_DIGEST_SZ];
+    uint32_t cycles;
+    uint32_t centi_per_byte;
+    char msg[80] = { 0 };
+
+    DEBUG("Started\r\n");
+
+    eCode = parser_get_cksum(phPrsr, &cksum);
+    ERR_CHECK(eCode);
+    if (CKSUM_CRC32 != cksum && CKSUM_SHA256 != cksum)
+    {
+        return CBL_ERR_UNSUP_CKSUM;
+    }
+
+    eCode = parser_get_u32(phPrsr, TXT_PAR_CKSUM_BENCH_COUNT, 10, &count);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
+        ERR_CHECK(eCode);
+    }
+    if (0 == count || count > BOOT_ACT_APP_MAX_LEN)
+    {
+        return CBL_ERR_INV_SZ;
+    }
+
+    cycles = perf_cycles();
+    if (CKSUM_CRC32 == cksum)
+    {
+        crc32_calc((const uint8_t *)BOOT_ACT_APP_START, count);
+    }
+    else
+    {
+        sha256_start( &h_sha256);
+        sha256_add( &h_sha256, (const uint8_t *)BOOT_ACT_APP_START, count);
+        sha256_finish( &h_sha256, digest);
+    }
+    cycles = perf_cycles() - cycles;
+
+    centi_per_byte = (uint32_t)((uint64_t)cycles * 100u / count);
+    snprintf(msg, sizeof(msg), "cycles:%lu|bytes:%lu|cycles/byte:%lu.%02lu"
+    "\r\n", cycles, count, centi_per_byte / 100u, centi_per_byte % 100u);
+    eCode = link_send(msg, strlen(msg));
+
+    return eCode;
+}
+
+#if 1 == USE_PERF
+/**
+ * @brief   Returns count, total, min and max cycles of every probe around the
+ *          hot paths, see cbl_perf.h, and cycles from reset to the jump of
+ *          the first fast boot of active application, 0 until measured.
+ *          Word after the command:
+ *              - reset - Optional, clears all probes instead
+ */
+cbl_err_code_t cmd_perf (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    size_t cmd_len = strlen(phPrsr->cmd);
+    char msg[96] = { 0 };
+    uint32_t fast_boot_cycles;
+
+    DEBUG("Started\r\n");
+
+    /* Parser ends command name with '\0', "reset" has no value so it is right
+     * after it */
+    if (phPrsr->len > cmd_len)
+    {
+        char *p_word = &phPrsr->cmd[cmd_len + 1];
+
+        if (strlen(p_word) != strlen(TXT_PAR_PERF_RESET)
+                || strncmp(p_word, TXT_PAR_PERF_RESET,
+                        strlen(TXT_PAR_PERF_RESET)) != 0)
+        {
+            return CBL_ERR_CMD_UNDEF;
+        }
+
+        perf_reset();
+        return eCode;
+    }
+
+    for (uint32_t iii = 0; iii < PERF_N_PROBES; iii++)
+    {
+        const perf_stat_t * p_stat = perf_get((perf_probe_t)iii);
+        /* printf of newlib nano has no 64 bit integers, split in decimal */
+        uint32_t total_hi = (uint32_t)(p_stat->total / 1000000000u);
+        uint32_t total_lo = (uint32_t)(p_stat->total % 1000000000u);
+
+        if (0 == total_hi)
+        {
+            snprintf(msg, sizeof(msg), "%s|count:%lu|total:%lu", perf_name(
+                    (perf_probe_t)iii), p_stat->count, total_lo);
+        }
+        else
+        {
+            snprintf(msg, sizeof(msg), "%s|count:%lu|total:%lu%09lu",
+                    perf_name((perf_probe_t)iii), p_stat->count, total_hi,
+                    total_lo);
+        }
+        eCode = link_send(msg, strlen(msg));
+        ERR_CHECK(eCode);
+
+        snprintf(msg, sizeof(msg), "|min:%lu|max:%lu\r\n",
+                0 == p_stat->count ? 0 : p_stat->min, p_stat->max);
+        eCode = link_send(msg, strlen(msg));
+        ERR_CHECK(eCode);
+    }
+
+    /* Reset to jump of the first fast boot, kept in the boot record */
+    fast_boot_cycles = boot_record_get()->fast_boot_cycles;
+    snprintf(msg, sizeof(msg), "fast-boot|cycles:%lu|us:%lu\r\n",
+            fast_boot_cycles, fast_boot_cycles / (PERF_CLK_HZ / 1000000u));
+    eCode = link_send(msg, strlen(msg));
+
+    return eCode;
+}
+#endif /* USE_PERF */
+
+/**
+ * @brief   Switches UART to another baud rate. Response is sent at the old
+ *          rate, then both sides switch and host sends TXT_SET_BAUD_PROBE.
+ *          Bootloader answers TXT_SET_BAUD_CONFIRM at the new rate. If probe
+ *          doesn't come in SET_BAUD_TIMEOUT_MS, or is wrong, previous rate is
+ *          used again.
+ *          Parameters from phPrsr:
+ *              - rate - New baud rate in decimal
+ *
+ * @note    If the confirmation is lost host may send the probe again, shell
+ *          already runs at the new rate and answers with an error
+ */
+cbl_err_code_t cmd_set_baud (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t new_rate;
+    uint32_t old_rate = baud_rate;
+    char probe[sizeof(TXT_SET_BAUD_PROBE)] = { 0 };
+    char msg[32] = { 0 };
+
+    DEBUG("Started\r\n");
+
+    eCode = parser_get_u32(phPrsr, TXT_PAR_SET_BAUD_RATE, 10, &new_rate);
+    ERR_CHECK(eCode);
+    if (new_rate < SET_BAUD_MIN || new_rate > SET_BAUD_MAX)
+    {
+        return CBL_ERR_BAUD_RANGE;
+    }
+
+    if (NULL == link_get()->baud_set)
+    {
+        /* E.g. USB runs at its own speed */
+        return CBL_ERR_NOT_IMPL;
+    }
+
+    snprintf(msg, sizeof(msg), "baud:%lu\r\n", new_rate);
+    eCode = link_send(msg, strlen(msg));
+    ERR_CHECK(eCode);
+
+    /* Response has to go out at the old rate. Bytes received while
+     * switching are garbage, ring starts again */
+    eCode = link_flush();
+    ERR_CHECK(eCode);
+    rx_deinit();
+    eCode = link_get()->baud_set(new_rate);
+    if (CBL_ERR_OK == eCode)
+    {
+        eCode = rx_init();
+    }
+
+    if (CBL_ERR_OK == eCode)
+    {
+        eCode = rx_start((uint8_t *)probe, strlen(TXT_SET_BAUD_PROBE));
+    }
+
+    if (CBL_ERR_OK == eCode)
+    {
+        eCode = rx_wait_timeout(SET_BAUD_TIMEOUT_MS);
+    }
+
+    if (CBL_ERR_OK == eCode
+            && strncmp(probe, TXT_SET_BAUD_PROBE, strlen(TXT_SET_BAUD_PROBE))
+                    != 0)
+    {
+        eCode = CBL_ERR_BAUD;
+    }
+
+    if (CBL_ERR_OK != eCode)
+    {
+        /* Host is expected to switch back after its own timeout */
+        link_flush();
+        rx_deinit();
+        link_get()->baud_set(old_rate);
+        rx_init();
+
+        return CBL_ERR_BAUD;
+    }
+
+    baud_rate = new_rate;
+    INFO("Baud rate %lu\r\n", baud_rate);
+
+    eCode = link_send(TXT_SET_BAUD_CONFIRM,
+            strlen(TXT_SET_BAUD_CONFIRM));
+
+    return eCode;
+}
+
+/**
+ * @brief   Returns size, current and peak use of the static memory arena and
+ *          size and peak use of the stack, see cbl_mem.h
+ */
+cbl_err_code_t cmd_mem_stats (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    mem_stats_t stats;
+    char msg[96] = { 0 };
+
+    DEBUG("Started\r\n");
+
+    mem_stats_get( &stats);
+
+    snprintf(msg, sizeof(msg), "arena:%lu|used:%lu|peak:%lu\r\n"
+            "stack:%lu|peak:%lu\r\n", stats.arena_sz, stats.arena_used,
+            stats.arena_peak, stats.stack_sz, stats.stack_peak);
+
+    eCode = link_send(msg, strlen(msg));
+
+    return eCode;
+}
+
 /*** end of file ***/
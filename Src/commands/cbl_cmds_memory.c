@@ -3,10 +3,46 @@
  * @brief Contains functions for memory access from the bootloader
  */
 #include "commands/cbl_cmds_memory.h"
+#include "etc/cbl_rx.h"
+#include "etc/cbl_erase.h"
+#include "etc/cbl_perf.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_mem.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_secure_boot.h"
 #include "string.h"
 
+#define CHUNK_NONE UINT32_MAX /*!< Returned when there is no chunk to request */
+
+typedef struct
+{
+    uint32_t to_req[(FLASH_WRITE_MAX_CHUNKS + 31) / 32]; /*!< Bit per chunk,
+     set when the chunk has to be requested */
+    uint32_t n_chunks; /*!< Number of chunks in transfer */
+    uint32_t cursor; /*!< Chunk after the last requested one */
+} h_chunk_map_t;
+
+/* Biggest transfer has to fit the arena, commands take little else */
+typedef char flash_write_arena_check[
+        (FLASH_WRITE_ARENA_SZ + 1024 <= MEM_ARENA_SZ) ? 1 : -1];
+
 static cbl_err_code_t write_get_params (parser_t * ph_prsr, uint32_t * p_start,
         uint32_t * p_len, cksum_t * cksum);
+static cbl_err_code_t read_get_params (parser_t * ph_prsr, uint32_t * p_start,
+        uint32_t * p_len, cksum_t * p_cksum);
+static cbl_err_code_t flash_write_req_chunk (uint32_t chunk, uint32_t start,
+        uint32_t len, const flash_write_opt_t * p_opt, uint8_t * buf);
+static cbl_err_code_t flash_write_handle_chunk (uint32_t chunk, uint8_t * buf,
+        uint32_t start, uint32_t len, const flash_write_opt_t * p_opt,
+        sha256_ctx_t * ph_sha256, uint32_t * p_n_hashed);
+static bool flash_write_is_stream (const flash_write_opt_t * p_opt);
+static cbl_err_code_t flash_write_run (uint32_t start, uint32_t len,
+        const flash_write_opt_t * p_opt,
+        uint8_t (*write_buf)[FLASH_WRITE_BUF_SZ], sha256_ctx_t * ph_sha256);
+static void chunk_map_init (h_chunk_map_t * ph_map, uint32_t n_chunks);
+static void chunk_map_reset (h_chunk_map_t * ph_map, uint32_t chunk);
+static uint32_t chunk_map_next (h_chunk_map_t * ph_map);
+static void chunk_map_rewind (h_chunk_map_t * ph_map, uint32_t chunk);
 
 /**
  * @brief   Jumps to a requested address.
@@ -16,25 +52,17 @@ static cbl_err_code_t write_get_params (parser_t * ph_prsr, uint32_t * p_start,
 cbl_err_code_t cmd_jump_to (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char *charAddr;
     uint32_t addr = 0u;
     void (*jump) (void);
 
     DEBUG("Started\r\n");
 
-    /* Get the address in hex form */
-    charAddr = parser_get_val(phPrsr, TXT_PAR_JUMP_TO_ADDR,
-            strlen(TXT_PAR_JUMP_TO_ADDR));
-    if (NULL == charAddr)
-    {
-        return CBL_ERR_NEED_PARAM;
-    }
-    /* Fill addr, skips 0x if present */
-    eCode = str2ui32(charAddr, strlen(charAddr), &addr, 16u);
+    /* Get the address in hex form, skips 0x if present */
+    eCode = parser_get_u32(phPrsr, TXT_PAR_JUMP_TO_ADDR, 16u, &addr);
     ERR_CHECK(eCode);
 
     /* Make sure we can jump to the wanted location */
-    eCode = hal_verify_jump_address(addr);
+    eCode = jump_verify_address(addr);
     ERR_CHECK(eCode);
 
     /* Add 1 to the address to set the T bit */
@@ -47,8 +75,9 @@ cbl_err_code_t cmd_jump_to (parser_t * phPrsr)
     jump = (void *)addr;
 
     /* Send response */
-    eCode = hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    eCode = link_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
     ERR_CHECK(eCode);
+    link_flush();
 
     /* Jump to requested address, user ensures requested address is valid */
     jump();
@@ -60,19 +89,23 @@ cbl_err_code_t cmd_jump_to (parser_t * phPrsr)
  * @brief   Erases flash memory according to parameters.
  *          Parameters needed from phPrsr:
  *              - type - Defines type of flash erase. "mass" erases all sectors,
- *               "sector" erases only selected sectors
- *              - sector - First sector to erase. Bootloader is on sectors 0, 1
- *               and 2. Not needed with mass erase
+ *               "sector" erases only selected sectors. With USE_SECURE_BOOT
+ *               mass erase erases sectors from FLASH_PROT_END_SECTOR on
+ *              - sector - First sector to erase. With USE_SECURE_BOOT
+ *               bootloader (sectors 0, 1 and 2) and boot record (3) are
+ *               refused. Not needed with mass erase
  *              - count - Number of sectors to erase. Not needed with mass erase
+ *          Blank sectors are not erased, numbers of erased and skipped sectors
+ *          are returned
  */
 cbl_err_code_t cmd_flash_erase (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char *charSect = NULL;
-    char *charCount = NULL;
     char *type = NULL;
     uint32_t sect;
     uint32_t count;
+    uint32_t n_erased;
+    char msg[32] = { 0 };
 
     DEBUG("Started\r\n");
 
@@ -88,39 +121,42 @@ cbl_err_code_t cmd_flash_erase (parser_t * phPrsr)
             strlen(TXT_PAR_FLASH_ERASE_TYPE_SECT)) == 0)
     {
         /* Get first sector to write to */
-        charSect = parser_get_val(phPrsr, TXT_PAR_FLASH_ERASE_SECT,
-                strlen(TXT_PAR_FLASH_ERASE_SECT));
-        if (NULL == charSect)
-        {
-            /* No sector present throw error */
-            return CBL_ERR_NEED_PARAM;
-        }
-
-        /* Fill sect */
-        eCode = str2ui32(charSect, strlen(charSect), &sect, 10);
+        eCode = parser_get_u32(phPrsr, TXT_PAR_FLASH_ERASE_SECT, 10, &sect);
         ERR_CHECK(eCode);
 
         /* Get how many sectors to erase */
-        charCount = parser_get_val(phPrsr, TXT_PAR_FLASH_ERASE_COUNT,
-                strlen(TXT_PAR_FLASH_ERASE_COUNT));
-        if (NULL == charCount)
-        {
-            /* No sector count present throw error */
-            return CBL_ERR_NEED_PARAM;
-        }
+        eCode = parser_get_u32(phPrsr, TXT_PAR_FLASH_ERASE_COUNT, 10, &count);
+        ERR_CHECK(eCode);
+
+        eCode = flash_verify_sectors(sect, count);
+        ERR_CHECK(eCode);
 
-        /* Fill count */
-        eCode = str2ui32(charCount, strlen(charCount), &count, 10);
+        /* Sectors already blank, e.g. after mass erase, are skipped */
+        eCode = erase_sectors(sect, count, &n_erased);
         ERR_CHECK(eCode);
 
-        eCode = hal_flash_erase_sector(sect, count);
+        snprintf(msg, sizeof(msg), "erased:%lu|skipped:%lu\r\n", n_erased,
+                count - n_erased);
+        eCode = link_send(msg, strlen(msg));
         ERR_CHECK(eCode);
     }
     else if (strncmp(type, TXT_PAR_FLASH_ERASE_TYPE_MASS,
             strlen(TXT_PAR_FLASH_ERASE_TYPE_MASS)) == 0)
     {
+#if 1 == USE_SECURE_BOOT
+        /* Bootloader and boot record stay, rest is erased as sectors */
+        count = ERASE_N_SECTORS - FLASH_PROT_END_SECTOR;
+        eCode = erase_sectors(FLASH_PROT_END_SECTOR, count, &n_erased);
+        ERR_CHECK(eCode);
+
+        snprintf(msg, sizeof(msg), "erased:%lu|skipped:%lu\r\n", n_erased,
+                count - n_erased);
+        eCode = link_send(msg, strlen(msg));
+        ERR_CHECK(eCode);
+#else
         eCode = hal_flash_erase_mass();
         ERR_CHECK(eCode);
+#endif /* USE_SECURE_BOOT */
     }
     else
     {
@@ -139,6 +175,8 @@ cbl_err_code_t cmd_flash_erase (parser_t * phPrsr)
  *             - count - Number of bytes to write without checksum.
  *                       Maximum bytes: FLASH_WRITE_SZ
  *             - cksum - Checksum to use
+ *             - window - Chunks in flight, 1 (default) or FLASH_WRITE_N_BUFS
+ *             - frame - Chunks carry sequence number and CRC32
  *
  * @note    If using checksum, data will be written to memory before checking
  *          for checksum!
@@ -148,60 +186,183 @@ cbl_err_code_t cmd_flash_write (parser_t * phPrsr)
     cbl_err_code_t eCode = CBL_ERR_OK;
     uint32_t start;
     uint32_t len;
-    cksum_t cksum = CKSUM_UNDEF;
+    flash_write_opt_t opt = { 0 };
 
     DEBUG("Started\r\n");
 
-    eCode = write_get_params(phPrsr, &start, &len, &cksum);
+    eCode = write_get_params(phPrsr, &start, &len, &opt.cksum);
+    ERR_CHECK(eCode);
+
+    eCode = flash_write_get_opts(phPrsr, &opt);
     ERR_CHECK(eCode);
 
-    eCode = flash_write(start, len, cksum);
+    eCode = flash_write(start, len, &opt);
 
     return eCode;
 }
 
 // \f - new page
 /**
- * @brief   Read bytes from memory
+ * @brief   Read bytes from memory. Bytes are sent in chunks of
+ *          MEM_READ_CHUNK_SZ, checksum of them is accumulated while sending
+ *          and sent after the last one.
  *          Parameters needed from phPrsr:
  *             - start - Starting address in hex format (e.g. 0x12345678),
  *              0x can be omitted
  *             - count - Number of bytes to read
+ *             - cksum - Optional, checksum sent after the bytes, CRC32 MSB
+ *              first. Default "no"
  */
 cbl_err_code_t cmd_mem_read (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char *charStart = NULL;
-    char *charLen = NULL;
     uint32_t start;
     uint32_t len;
+    uint32_t chunk_len;
+    cksum_t cksum;
+    sha256_ctx_t h_sha256;
+    uint8_t digest[SHA256_DIGEST_SZ];
 
     DEBUG("Started\r\n");
 
-    /* Get starting address */
-    charStart = parser_get_val(phPrsr, TXT_PAR_FLASH_WRITE_START,
-            strlen(TXT_PAR_FLASH_WRITE_START));
-    if (NULL == charStart)
+    eCode = read_get_params(phPrsr, &start, &len, &cksum);
+    ERR_CHECK(eCode);
+
+    init_checksum(cksum, &h_sha256);
+
+    /* Send requested bytes, HAL sends at most 64 KB at once */
+    for (uint32_t offset = 0; offset < len; offset += chunk_len)
     {
-        return CBL_ERR_NEED_PARAM;
+        chunk_len = ui32_min(len - offset, MEM_READ_CHUNK_SZ);
+
+        eCode = link_send((char *)(start + offset), chunk_len);
+        ERR_CHECK(eCode);
+
+        accumulate_checksum((uint8_t *)(start + offset), chunk_len, cksum,
+                &h_sha256);
     }
-    /* Get length in bytes */
-    charLen = parser_get_val(phPrsr, TXT_PAR_FLASH_WRITE_COUNT,
-            strlen(TXT_PAR_FLASH_WRITE_COUNT));
-    if (NULL == charLen)
+
+    if (CKSUM_NO != cksum)
+    {
+        eCode = checksum_get(cksum, &h_sha256, digest);
+        ERR_CHECK(eCode);
+
+        eCode = link_send((char *)digest, checksum_get_length(cksum));
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief   Calculates checksum of memory and returns only the checksum, used
+ *          to verify an image without reading it back.
+ *          Parameters needed from phPrsr:
+ *             - start - Starting address in hex format (e.g. 0x12345678),
+ *              0x can be omitted
+ *             - count - Number of bytes
+ *             - cksum - "crc32" or "sha256"
+ */
+cbl_err_code_t cmd_mem_hash (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t start;
+    uint32_t len;
+    cksum_t cksum;
+    uint8_t digest[SHA256_DIGEST_SZ];
+    char resp[sizeof(TXT_CKSUM_SHA256) + 2 * SHA256_DIGEST_SZ + 4] = { 0 };
+    uint32_t digest_len;
+    uint32_t pos;
+
+    DEBUG("Started\r\n");
+
+    eCode = read_get_params(phPrsr, &start, &len, &cksum);
+    ERR_CHECK(eCode);
+
+    if (CKSUM_NO == cksum)
     {
         return CBL_ERR_NEED_PARAM;
     }
-    /* Fill start */
-    eCode = str2ui32(charStart, strlen(charStart), &start, 16);
+
+    eCode = mem_hash(start, len, cksum, digest);
+    ERR_CHECK(eCode);
+
+    /* Response is name of the checksum and its bytes in hex */
+    digest_len = checksum_get_length(cksum);
+    pos = snprintf(resp, sizeof(resp), "%s:",
+            CKSUM_CRC32 == cksum ? TXT_CKSUM_CRC : TXT_CKSUM_SHA256);
+    for (uint32_t iii = 0; iii < digest_len; iii++)
+    {
+        pos += snprintf( &resp[pos], sizeof(resp) - pos, "%02x", digest[iii]);
+    }
+    strlcat(resp, CRLF, sizeof(resp));
+
+    eCode = link_send(resp, strlen(resp));
+
+    return eCode;
+}
+
+/**
+ * @brief Calculates checksum of memory in place
+ *
+ * @param start[in]     Starting address
+ * @param len[in]       Number of bytes
+ * @param cksum[in]     CKSUM_CRC32 or CKSUM_SHA256
+ * @param p_digest[out] checksum_get_length bytes of checksum, CRC32 MSB first
+ */
+cbl_err_code_t mem_hash (uint32_t start, uint32_t len, cksum_t cksum,
+        uint8_t * p_digest)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    sha256_ctx_t h_sha256;
+
+    if (CKSUM_CRC32 != cksum && CKSUM_SHA256 != cksum)
+    {
+        return CBL_ERR_UNSUP_CKSUM;
+    }
+
+    init_checksum(cksum, &h_sha256);
+    eCode = accumulate_checksum((uint8_t *)start, len, cksum, &h_sha256);
+    ERR_CHECK(eCode);
+
+    eCode = checksum_get(cksum, &h_sha256, p_digest);
+
+    return eCode;
+}
+
+/**
+ * @brief Gets the parameters of reading memory
+ *
+ * @param ph_prsr[in]  Pointer to parser with parameters
+ * @param p_start[out] Starting address
+ * @param p_len[out]   Number of bytes, region doesn't go over end of memory
+ * @param p_cksum[out] Checksum, CKSUM_NO if not given
+ */
+static cbl_err_code_t read_get_params (parser_t * ph_prsr, uint32_t * p_start,
+        uint32_t * p_len, cksum_t * p_cksum)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    /* Get starting address */
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_FLASH_WRITE_START, 16, p_start);
     ERR_CHECK(eCode);
 
-    /* Fill len */
-    eCode = str2ui32(charLen, strlen(charLen), &len, 10);
+    /* Get length in bytes */
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_FLASH_WRITE_COUNT, 10, p_len);
     ERR_CHECK(eCode);
 
-    /* Send requested bytes */
-    eCode = hal_send_to_host((char *)start, len);
+    if (0 == *p_len || *p_len - 1 > UINT32_MAX - *p_start)
+    {
+        return CBL_ERR_INV_SZ;
+    }
+
+    /* Optional, not given is CKSUM_NO */
+    *p_cksum = CKSUM_NO;
+    eCode = parser_get_cksum(ph_prsr, p_cksum);
+    if (CBL_ERR_NEED_PARAM == eCode)
+    {
+        eCode = CBL_ERR_OK;
+    }
+
     return eCode;
 }
 
@@ -210,119 +371,655 @@ cbl_err_code_t cmd_mem_read (parser_t * phPrsr)
  *
  * @param start Starting address
  * @param len   Number of bytes to write without checksum.
- * @param cksum Checksum to use
+ * @param p_opt Options of the transfer: checksum, window and framing
  *
  * @note    If using checksum, data will be written to memory before checking
  *          for checksum!
+ * @note    With framed transfer every chunk is sent as: sequence number
+ *          (4 bytes, little endian), data, CRC32 of sequence number and data
+ *          (4 bytes, same as checksum). Rejected chunks are requested again
+ *          after the other ones, checksum of the whole transfer is calculated
+ *          from flash when all chunks are written.
+ * @note    With records decoder set, chunks are decoded instead of written
+ *          and are handled strictly in order. Rejected framed chunk is
+ *          requested again before any following chunk.
+ * @note    With LZ4 decompressor set, chunks are handled in order the same
+ *          way. Frame is finished here and checksum is calculated from the
+ *          flash over the decompressed output, not over the received bytes
  */
-cbl_err_code_t flash_write (uint32_t start, uint32_t len, cksum_t cksum)
+cbl_err_code_t flash_write (uint32_t start, uint32_t len,
+        const flash_write_opt_t * p_opt)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t mark = mem_mark();
+    /* Chunk buffers, one is received into while the other is programmed.
+     * Each can hold a whole frame when framed transfer is used */
+    uint8_t (*write_buf)[FLASH_WRITE_BUF_SZ] = mem_alloc(
+            FLASH_WRITE_N_BUFS * FLASH_WRITE_BUF_SZ);
+    sha256_ctx_t * ph_sha256 = mem_alloc(sizeof( *ph_sha256));
+
+    if (NULL == write_buf || NULL == ph_sha256)
+    {
+        mem_release(mark);
+        return CBL_ERR_NO_MEM;
+    }
+    memset(ph_sha256, 0, sizeof( *ph_sha256));
+
+    eCode = flash_write_run(start, len, p_opt, write_buf, ph_sha256);
+    if (CBL_ERR_OK != eCode)
+    {
+        /* Windowed transfer may fail with the next chunk in flight, its
+         * bytes shall not land in the buffers given back below */
+        rx_abort();
+    }
+
+    /* Binary mode writes many times in one command */
+    mem_release(mark);
+
+    return eCode;
+}
+
+/**
+ * @brief Runs the transfer of flash_write with buffers taken from the arena
+ *
+ * @param start      Starting address
+ * @param len        Number of bytes to write without checksum
+ * @param p_opt      Options of the transfer
+ * @param write_buf  FLASH_WRITE_N_BUFS chunk buffers
+ * @param ph_sha256  Hash context, used only when sha256 is used
+ */
+static cbl_err_code_t flash_write_run (uint32_t start, uint32_t len,
+        const flash_write_opt_t * p_opt,
+        uint8_t (*write_buf)[FLASH_WRITE_BUF_SZ], sha256_ctx_t * ph_sha256)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    uint8_t write_buf[FLASH_WRITE_SZ] = { 0 };
     uint32_t n_chunks;
-    uint32_t iii = 0;
-    uint32_t left_to_write;
-    uint32_t chunk_addr;
-    char chunk_succ[] = "\r\nchunk OK\r\n";
-    SHA256_CTX h_cksum_sha256 = { 0 };
+    uint32_t chunk;
+    uint32_t buf_idx = 0;
+    uint32_t n_naks = 0;
+    uint32_t n_hashed = 0;
+    h_chunk_map_t h_map;
+    bool is_pending;
     char chunk_info[64] = { 0 };
     uint32_t cksum_len = 0;
 
+    if (p_opt->window == 0 || p_opt->window > FLASH_WRITE_N_BUFS)
+    {
+        return CBL_ERR_INV_WINDOW;
+    }
+
     /* Get number of chunks */
     n_chunks = len / FLASH_WRITE_SZ;
     n_chunks = len % FLASH_WRITE_SZ ? n_chunks + 1 : n_chunks;
 
-    /* Notify host how many chunks are expected */
-    snprintf(chunk_info, sizeof(chunk_info), "\r\nchunks:%lu\r\n", n_chunks);
-    eCode = hal_send_to_host(chunk_info, strlen(chunk_info));
-    ERR_CHECK(eCode);
+    if (n_chunks > FLASH_WRITE_MAX_CHUNKS)
+    {
+        return CBL_ERR_INV_SZ;
+    }
+
+    /* CRC32 of a frame is calculated over whole words */
+    if (true == p_opt->is_framed && (len % 4) != 0)
+    {
+        return CBL_ERR_CRC_LEN;
+    }
+
+    /* Decoded data can't be read back to calculate checksum of the transfer,
+     * and CRC32 hardware is taken by the frames */
+    if (true == p_opt->is_framed && NULL != p_opt->ph_records
+            && CKSUM_CRC32 == p_opt->cksum)
+    {
+        return CBL_ERR_UNSUP_CKSUM;
+    }
 
-    left_to_write = len;
-    chunk_addr = start;
+    /* Notify host how many chunks are expected, window is sent only when
+     * pipelining is requested so lock-step hosts see the same response */
+    if (p_opt->window > 1)
+    {
+        snprintf(chunk_info, sizeof(chunk_info),
+                "\r\nchunks:%lu|window:%lu\r\n", n_chunks, p_opt->window);
+    }
+    else
+    {
+        snprintf(chunk_info, sizeof(chunk_info), "\r\nchunks:%lu\r\n",
+                n_chunks);
+    }
+    eCode = link_send(chunk_info, strlen(chunk_info));
+    ERR_CHECK(eCode);
 
     /* Second parameter is used only when sha256 is used */
-    init_checksum(cksum, &h_cksum_sha256);
+    init_checksum(p_opt->cksum, ph_sha256);
+
+    if (0 != p_opt->resumed_len)
+    {
+        /* Bytes of interrupted transfer are only in flash */
+        accumulate_checksum((uint8_t *)(start - p_opt->resumed_len),
+                p_opt->resumed_len, p_opt->cksum, ph_sha256);
+    }
+
+    chunk_map_init( &h_map, n_chunks);
+
+    /* Request the first chunk */
+    chunk = chunk_map_next( &h_map);
+    eCode = flash_write_req_chunk(chunk, start, len, p_opt,
+            write_buf[buf_idx]);
+    ERR_CHECK(eCode);
+    is_pending = true;
 
     /* Get chunks one by one from host, and write them to memory, accumulating
      * checksum */
-    while (iii < n_chunks)
+    while (true == is_pending)
     {
-        uint32_t chunk_len = ui32_min(left_to_write, (uint32_t)FLASH_WRITE_SZ);
+        uint32_t cur_chunk = chunk;
+        uint8_t *p_cur_buf = write_buf[buf_idx];
 
-        /* Notify host about current chunk number and length */
-        snprintf(chunk_info, sizeof(chunk_info),
-                "\r\nchunk:%lu|length:%lu|address:0x%08lx\r\n", iii, chunk_len,
-                chunk_addr);
-        eCode = hal_send_to_host(chunk_info, strlen(chunk_info));
-        ERR_CHECK(eCode);
+        PERF_START(PERF_RX_WAIT);
+        rx_wait();
+        PERF_STOP(PERF_RX_WAIT);
+        is_pending = false;
 
-        /* Reset UART byte counter */
-        gRxCmdCntr = 0;
+        /* In pipelined mode request the next chunk into the free buffer
+         * before programming, so UART receive overlaps flash programming */
+        if (p_opt->window > 1)
+        {
+            chunk = chunk_map_next( &h_map);
+            if (chunk != CHUNK_NONE)
+            {
+                buf_idx = (buf_idx + 1) % FLASH_WRITE_N_BUFS;
+                eCode = flash_write_req_chunk(chunk, start, len, p_opt,
+                        write_buf[buf_idx]);
+                ERR_CHECK(eCode);
+                is_pending = true;
+            }
+        }
 
-        /* Notify host to send the bytes */
-        eCode = hal_send_to_host(TXT_RESP_FLASH_WRITE_READY,
-                strlen(TXT_RESP_FLASH_WRITE_READY));
-        ERR_CHECK(eCode);
+        eCode = flash_write_handle_chunk(cur_chunk, p_cur_buf, start, len,
+                p_opt, ph_sha256, &n_hashed);
+        if (CBL_ERR_CKSUM_WRONG == eCode && true == p_opt->is_framed)
+        {
+            /* Reject only this chunk, it will be requested again */
+            n_naks++;
+            if (n_naks > FLASH_WRITE_MAX_NAKS)
+            {
+                return CBL_ERR_FRAME_NAKS;
+            }
 
-        /* Request 'chunk_len' bytes */
-        eCode = hal_recv_from_host_start(write_buf, chunk_len);
-        ERR_CHECK(eCode);
+            chunk_map_reset( &h_map, cur_chunk);
 
+            eCode = link_send(TXT_RESP_FLASH_WRITE_CHUNK_NOK,
+                    strlen(TXT_RESP_FLASH_WRITE_CHUNK_NOK));
+            ERR_CHECK(eCode);
 
-        while (gRxCmdCntr != 1)
-        {
-            /* Wait for 'len' bytes */
-        }
+            if (true == flash_write_is_stream(p_opt))
+            {
+                /* Streams are decoded in order, reject the chunk in flight
+                 * too and continue from the rejected one */
+                if (true == is_pending)
+                {
+                    PERF_START(PERF_RX_WAIT);
+                    rx_wait();
+                    PERF_STOP(PERF_RX_WAIT);
+                    chunk_map_reset( &h_map, chunk);
+                    is_pending = false;
 
-        hal_led_on(LED_MEMORY);
-        eCode = hal_write_program_bytes(chunk_addr, write_buf, chunk_len);
-        hal_led_off(LED_MEMORY);
+                    eCode = link_send(TXT_RESP_FLASH_WRITE_CHUNK_NOK,
+                            strlen(TXT_RESP_FLASH_WRITE_CHUNK_NOK));
+                    ERR_CHECK(eCode);
+                }
+                chunk_map_rewind( &h_map, cur_chunk);
+            }
+        }
         ERR_CHECK(eCode);
 
-        /* NOTE: Last parameter is used only when sha256 is used */
-        accumulate_checksum(write_buf, chunk_len, cksum, &h_cksum_sha256);
+        /* In lock-step mode next chunk is requested after acknowledge */
+        if (false == is_pending)
+        {
+            chunk = chunk_map_next( &h_map);
+            if (chunk != CHUNK_NONE)
+            {
+                eCode = flash_write_req_chunk(chunk, start, len, p_opt,
+                        write_buf[buf_idx]);
+                ERR_CHECK(eCode);
+                is_pending = true;
+            }
+        }
+    }
 
-        eCode = hal_send_to_host(chunk_succ, strlen(chunk_succ));
+    if (NULL != p_opt->ph_lz4)
+    {
+        eCode = lz4_finish(p_opt->ph_lz4);
         ERR_CHECK(eCode);
-
-        chunk_addr += chunk_len;
-        left_to_write -= chunk_len;
-        iii++;
     }
 
-    if (cksum != CKSUM_NO)
+    if (p_opt->cksum != CKSUM_NO)
     {
-        cksum_len = checksum_get_length(cksum);
+        if (NULL != p_opt->ph_lz4)
+        {
+            /* Output is complete only now, it shall match the image */
+            init_checksum(p_opt->cksum, ph_sha256);
+            accumulate_checksum((uint8_t *)p_opt->ph_lz4->out_start,
+                    p_opt->ph_lz4->out_len, p_opt->cksum, ph_sha256);
+        }
+        else if (true == p_opt->is_framed && NULL == p_opt->ph_records)
+        {
+            /* Chunks could come out of order and CRC32 hardware was used for
+             * frames, calculate the checksum from the flash. Chunks hashed
+             * in order while receiving are skipped */
+            uint32_t hashed_len = ui32_min(n_hashed * FLASH_WRITE_SZ, len);
+
+            if (CKSUM_SHA256 != p_opt->cksum)
+            {
+                init_checksum(p_opt->cksum, ph_sha256);
+                hashed_len = 0;
+
+                if (0 != p_opt->resumed_len)
+                {
+                    accumulate_checksum(
+                            (uint8_t *)(start - p_opt->resumed_len),
+                            p_opt->resumed_len, p_opt->cksum,
+                            ph_sha256);
+                }
+            }
+            accumulate_checksum((uint8_t *)(start + hashed_len),
+                    len - hashed_len, p_opt->cksum, ph_sha256);
+        }
+
+        cksum_len = checksum_get_length(p_opt->cksum);
 
         /* Notify host cksum is expected */
         snprintf(chunk_info, sizeof(chunk_info), "\r\nchecksum|length:%lu\r\n",
                 cksum_len);
-        eCode = hal_send_to_host(chunk_info, strlen(chunk_info));
+        eCode = link_send(chunk_info, strlen(chunk_info));
         ERR_CHECK(eCode);
 
-        /* Reset UART byte counter */
-        gRxCmdCntr = 0;
+        /* Request 'cksum_len' bytes */
+        eCode = rx_start(write_buf[0], cksum_len);
+        ERR_CHECK(eCode);
 
         /* Notify host to send the bytes */
-        eCode = hal_send_to_host(TXT_RESP_FLASH_WRITE_READY,
+        eCode = link_send(TXT_RESP_FLASH_WRITE_READY,
                 strlen(TXT_RESP_FLASH_WRITE_READY));
         ERR_CHECK(eCode);
 
-        /* Request 'chunk_len' bytes */
-        eCode = hal_recv_from_host_start(write_buf, cksum_len);
+        /* Wait for 'cksum_len' bytes */
+        PERF_START(PERF_RX_WAIT);
+        rx_wait();
+        PERF_STOP(PERF_RX_WAIT);
+
+        eCode = verify_checksum(write_buf[0], cksum_len, p_opt->cksum,
+                ph_sha256);
+        ERR_CHECK(eCode);
+    }
+    return eCode;
+}
+
+/**
+ * @brief Checks the host may write the bytes. With USE_SECURE_BOOT
+ *        bootloader and boot record below FLASH_PROT_END are refused, written
+ *        boot record could mark an unsigned application as verified
+ *
+ * @param start[in] Starting address
+ * @param len[in]   Number of bytes
+ *
+ * @return CBL_ERR_WRITE_INV_ADDR if any of the bytes can't be written
+ */
+cbl_err_code_t flash_verify_range (uint32_t start, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (0 == len || len - 1 > UINT32_MAX - start)
+    {
+        return CBL_ERR_INV_SZ;
+    }
+
+#if 1 == USE_SECURE_BOOT
+    if (start < FLASH_PROT_END)
+    {
+        return CBL_ERR_WRITE_INV_ADDR;
+    }
+#endif /* USE_SECURE_BOOT */
+
+    eCode = hal_verify_flash_address(start);
+    ERR_CHECK(eCode);
+
+    eCode = hal_verify_flash_address(start + len - 1);
+
+    return eCode;
+}
+
+/**
+ * @brief Checks the host may erase the sectors. Sectors have to be in the
+ *        flash, with USE_SECURE_BOOT sectors of bootloader and boot record
+ *        below FLASH_PROT_END_SECTOR are refused
+ *
+ * @param first_sect[in] First sector to erase
+ * @param count[in]      Number of sectors
+ */
+cbl_err_code_t flash_verify_sectors (uint32_t first_sect, uint32_t count)
+{
+    if (first_sect >= ERASE_N_SECTORS)
+    {
+        return CBL_ERR_INV_SECT;
+    }
+
+    if (0 == count || count > ERASE_N_SECTORS - first_sect)
+    {
+        return CBL_ERR_INV_SECT_COUNT;
+    }
+
+#if 1 == USE_SECURE_BOOT
+    if (first_sect < FLASH_PROT_END_SECTOR)
+    {
+        return CBL_ERR_INV_SECT;
+    }
+#endif /* USE_SECURE_BOOT */
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Checks the host may jump to the address. With USE_SECURE_BOOT only
+ *        addresses in the active application are allowed, and only if its
+ *        signature is valid
+ *
+ * @param addr[in] Address to jump to
+ *
+ * @return CBL_ERR_JUMP_INV_ADDR if address is refused, CBL_ERR_SIG if
+ *         signature of the active application is invalid
+ */
+cbl_err_code_t jump_verify_address (uint32_t addr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = hal_verify_jump_address(addr);
+    ERR_CHECK(eCode);
+
+#if 1 == USE_SECURE_BOOT
+    /* Checks length of the application too */
+    eCode = secure_boot_check();
+    ERR_CHECK(eCode);
+
+    if (addr < ab_act_start() || addr - ab_act_start()
+            >= boot_record_get()->act_app.len - SECURE_BOOT_SIG_SZ)
+    {
+        return CBL_ERR_JUMP_INV_ADDR;
+    }
+#endif /* USE_SECURE_BOOT */
+
+    return eCode;
+}
+
+/**
+ * @brief Gets the optional transfer parameters for flash write. Checksum is
+ *        not filled, caller gets it with its own parameters
+ *
+ * @note If window is not present lock-step transfer (1) is assumed, if frame
+ *       is not present raw chunks are assumed
+ *
+ * @param ph_prsr[in] Parser containing parameters
+ * @param p_opt[out]  Options to fill
+ */
+cbl_err_code_t flash_write_get_opts (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    p_opt->window = 1;
+    p_opt->is_framed = false;
+
+    /* These are optional parameters, if not present, don't throw error */
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_FLASH_WRITE_WINDOW, 10,
+            &p_opt->window);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
         ERR_CHECK(eCode);
 
-        while (gRxCmdCntr != 1)
+        if (p_opt->window == 0 || p_opt->window > FLASH_WRITE_N_BUFS)
         {
-            /* Wait for 'cksum_len' bytes */
+            return CBL_ERR_INV_WINDOW;
         }
+    }
+
+    eCode = parser_get_bool(ph_prsr, TXT_PAR_FLASH_WRITE_FRAME,
+            &p_opt->is_framed);
+    if (CBL_ERR_NEED_PARAM == eCode)
+    {
+        eCode = CBL_ERR_OK;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Notifies the host about the chunk and starts receiving it
+ *
+ * @note  Receive is started before "ready" is sent, so no byte can arrive
+ *        before the DMA is armed. With receive ring host is told "ready" only
+ *        after previous chunk was taken out, so the ring never overflows
+ *
+ * @param chunk[in] Index of a chunk to request
+ * @param start[in] Starting address of the whole write
+ * @param len[in]   Length of the whole write
+ * @param p_opt[in] Options of the transfer
+ * @param buf[out]  Buffer of at least FLASH_WRITE_BUF_SZ bytes to receive into
+ */
+static cbl_err_code_t flash_write_req_chunk (uint32_t chunk, uint32_t start,
+        uint32_t len, const flash_write_opt_t * p_opt, uint8_t * buf)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char chunk_info[64] = { 0 };
+    uint32_t chunk_addr = start + chunk * FLASH_WRITE_SZ;
+    uint32_t chunk_len = ui32_min(len - chunk * FLASH_WRITE_SZ,
+            (uint32_t)FLASH_WRITE_SZ);
+    uint32_t recv_len = chunk_len;
+
+    if (true == p_opt->is_framed)
+    {
+        recv_len += FLASH_WRITE_FRAME_OVERHEAD;
+    }
+
+    /* Notify host about current chunk number and length */
+    snprintf(chunk_info, sizeof(chunk_info),
+            "\r\nchunk:%lu|length:%lu|address:0x%08lx\r\n", chunk, chunk_len,
+            chunk_addr);
+    eCode = link_send(chunk_info, strlen(chunk_info));
+    ERR_CHECK(eCode);
+
+    /* Request 'recv_len' bytes */
+    eCode = rx_start(buf, recv_len);
+    ERR_CHECK(eCode);
+
+    /* Notify host to send the bytes */
+    eCode = link_send(TXT_RESP_FLASH_WRITE_READY,
+            strlen(TXT_RESP_FLASH_WRITE_READY));
+
+    return eCode;
+}
+
+/**
+ * @brief Checks the received chunk, writes it to flash and acknowledges it
+ *
+ * @param chunk[in]     Index of the received chunk
+ * @param buf[in]       Buffer chunk was received into
+ * @param start[in]     Starting address of the whole write
+ * @param len[in]       Length of the whole write
+ * @param p_opt[in]     Options of the transfer
+ * @param ph_sha256[in] Handle of sha256, used only when sha256 is used
+ * @param p_n_hashed[in,out] Framed chunks hashed in order so far
+ *
+ * @return CBL_ERR_CKSUM_WRONG if frame is corrupted, nothing is written then
+ */
+static cbl_err_code_t flash_write_handle_chunk (uint32_t chunk, uint8_t * buf,
+        uint32_t start, uint32_t len, const flash_write_opt_t * p_opt,
+        sha256_ctx_t * ph_sha256, uint32_t * p_n_hashed)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t chunk_addr = start + chunk * FLASH_WRITE_SZ;
+    uint32_t chunk_len = ui32_min(len - chunk * FLASH_WRITE_SZ,
+            (uint32_t)FLASH_WRITE_SZ);
+    uint8_t *p_data = buf;
+    char chunk_succ[] = "\r\nchunk OK\r\n";
+
+    if (true == p_opt->is_framed)
+    {
+        uint32_t seq;
+
+        memcpy( &seq, buf, sizeof(seq));
 
-        eCode = verify_checksum(write_buf, cksum_len, cksum, &h_cksum_sha256);
+        /* Sequence number and data are protected by CRC32 */
+        init_checksum(CKSUM_CRC32, NULL);
+        eCode = accumulate_crc32(buf, sizeof(seq) + chunk_len);
         ERR_CHECK(eCode);
+
+        eCode = verify_crc32( &buf[sizeof(seq) + chunk_len], 4);
+        ERR_CHECK(eCode);
+
+        if (seq != chunk)
+        {
+            /* Host sent a different chunk than requested */
+            return CBL_ERR_CKSUM_WRONG;
+        }
+
+        p_data += sizeof(seq);
     }
+
+    hal_led_on(LED_MEMORY);
+    if (NULL != p_opt->ph_records)
+    {
+        PERF_START(PERF_RECORDS);
+        eCode = records_feed(p_opt->ph_records, p_data, chunk_len);
+        PERF_STOP(PERF_RECORDS);
+    }
+    else if (NULL != p_opt->ph_lz4)
+    {
+        PERF_START(PERF_LZ4);
+        eCode = lz4_feed(p_opt->ph_lz4, p_data, chunk_len);
+        PERF_STOP(PERF_LZ4);
+    }
+    else
+    {
+        PERF_START(PERF_WRITE);
+        if (NULL != p_opt->write)
+        {
+            eCode = p_opt->write(chunk_addr, p_data, chunk_len);
+        }
+        else
+        {
+            eCode = flash_program(chunk_addr, p_data, chunk_len);
+        }
+        PERF_STOP(PERF_WRITE);
+    }
+    hal_led_off(LED_MEMORY);
+    if (CBL_ERR_VERIFY == eCode)
+    {
+        char msg[40];
+
+        /* Writes of decoders are verified too, chunk tells which input */
+        snprintf(msg, sizeof(msg), "\r\nverify NOK|chunk:%lu\r\n", chunk);
+        link_send(msg, strlen(msg));
+    }
+    ERR_CHECK(eCode);
+
+    /* Decoded chunks always come in order, framed ones are checked from the
+     * flash at the end. Compressed chunks are not, output is checked */
+    if (NULL != p_opt->ph_lz4)
+    {
+        /* Checksum of decompressed output is calculated at the end */
+    }
+    else if (false == p_opt->is_framed || NULL != p_opt->ph_records)
+    {
+        /* NOTE: Last parameter is used only when sha256 is used */
+        accumulate_checksum(p_data, chunk_len, p_opt->cksum, ph_sha256);
+    }
+    else if (CKSUM_SHA256 == p_opt->cksum && chunk == *p_n_hashed)
+    {
+        /* Software hash doesn't need CRC32 hardware, hash framed chunks
+         * which come in order while the next one is received */
+        accumulate_sha256(p_data, chunk_len, ph_sha256);
+        ( *p_n_hashed)++;
+    }
+
+    eCode = link_send(chunk_succ, strlen(chunk_succ));
+
     return eCode;
 }
 
+/**
+ * @brief Chunks of a stream are decoded instead of written, and have to be
+ *        handled in order
+ */
+static bool flash_write_is_stream (const flash_write_opt_t * p_opt)
+{
+    return (NULL != p_opt->ph_records || NULL != p_opt->ph_lz4);
+}
+
+/**
+ * @brief Marks all chunks as not yet requested
+ *
+ * @param ph_map[out]  Handle of chunk map
+ * @param n_chunks[in] Number of chunks, at most FLASH_WRITE_MAX_CHUNKS
+ */
+static void chunk_map_init (h_chunk_map_t * ph_map, uint32_t n_chunks)
+{
+    memset(ph_map->to_req, 0, sizeof(ph_map->to_req));
+
+    for (uint32_t iii = 0; iii < n_chunks; iii++)
+    {
+        chunk_map_reset(ph_map, iii);
+    }
+
+    ph_map->n_chunks = n_chunks;
+    ph_map->cursor = 0;
+}
+
+/**
+ * @brief Marks the chunk to be requested again
+ *
+ * @param ph_map[in] Handle of chunk map
+ * @param chunk[in]  Index of the chunk
+ */
+static void chunk_map_reset (h_chunk_map_t * ph_map, uint32_t chunk)
+{
+    ph_map->to_req[chunk / 32] |= 1UL << (chunk % 32);
+}
+
+/**
+ * @brief Gets the next chunk that has to be requested and marks it requested.
+ *        Search continues after the last returned chunk and wraps around, so
+ *        rejected chunks are requested after the ones not requested yet
+ *
+ * @param ph_map[in] Handle of chunk map
+ *
+ * @return Index of the chunk, CHUNK_NONE if every chunk was requested
+ */
+static uint32_t chunk_map_next (h_chunk_map_t * ph_map)
+{
+    for (uint32_t iii = 0; iii < ph_map->n_chunks; iii++)
+    {
+        uint32_t chunk = (ph_map->cursor + iii) % ph_map->n_chunks;
+        uint32_t mask = 1UL << (chunk % 32);
+
+        if ((ph_map->to_req[chunk / 32] & mask) != 0)
+        {
+            ph_map->to_req[chunk / 32] &= ~mask;
+            ph_map->cursor = chunk + 1;
+            return chunk;
+        }
+    }
+
+    return CHUNK_NONE;
+}
+
+/**
+ * @brief Continues the search for the next chunk from the given chunk
+ *
+ * @param ph_map[in] Handle of chunk map
+ * @param chunk[in]  Index of the chunk
+ */
+static void chunk_map_rewind (h_chunk_map_t * ph_map, uint32_t chunk)
+{
+    ph_map->cursor = chunk;
+}
+
 /**
  * @brief Gets parameters from parser handle
  *
@@ -335,50 +1032,31 @@ static cbl_err_code_t write_get_params (parser_t * ph_prsr, uint32_t * p_start,
         uint32_t * p_len, cksum_t * p_cksum)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char *charStart = NULL;
-    char *charLen = NULL;
-    char *charChecksum = NULL;
 
     /* Get starting address */
-    charStart = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_START,
-            strlen(TXT_PAR_FLASH_WRITE_START));
-    if (NULL == charStart)
-    {
-        return CBL_ERR_NEED_PARAM;
-    }
-    /* Get length in bytes */
-    charLen = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_COUNT,
-            strlen(TXT_PAR_FLASH_WRITE_COUNT));
-    if (NULL == charLen)
-    {
-        return CBL_ERR_NEED_PARAM;
-    }
-
-    /* Get checksum to be used */
-    charChecksum = parser_get_val(ph_prsr, TXT_PAR_CKSUM,
-            strlen(TXT_PAR_CKSUM));
-    /* This is an optional parameter, if it is not present, don't throw error */
-
-    /* Fill start */
-    eCode = str2ui32(charStart, strlen(charStart), p_start, 16);
-    ERR_CHECK(eCode);
-
-    /* Fill len */
-    eCode = str2ui32(charLen, strlen(charLen), p_len, 10);
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_FLASH_WRITE_START, 16, p_start);
     ERR_CHECK(eCode);
 
-    eCode = hal_verify_flash_address(*p_start);
+    /* Get length in bytes */
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_FLASH_WRITE_COUNT, 10, p_len);
     ERR_CHECK(eCode);
 
-    eCode = hal_verify_flash_address((*p_start) + (*p_len) - 1);
+    eCode = flash_verify_range( *p_start, *p_len);
     ERR_CHECK(eCode);
 
-    eCode = enum_checksum(charChecksum, strlen(charChecksum), p_cksum);
+    /* This is an optional parameter, if it is not present, don't throw error */
+    *p_cksum = CKSUM_NO;
+    eCode = parser_get_cksum(ph_prsr, p_cksum);
+    if (CBL_ERR_NEED_PARAM == eCode)
+    {
+        eCode = CBL_ERR_OK;
+    }
     ERR_CHECK(eCode);
 
-    if ((( *p_len) == 0) || (( *p_cksum == CKSUM_CRC32) && ( *p_len % 4 != 0)))
+    /* CRC32 takes any length, tail of a transfer is padded internally */
+    if (0 == *p_len)
     {
-        return CBL_ERR_CRC_LEN;
+        return CBL_ERR_INV_SZ;
     }
 
     return eCode;
@@ -4,11 +4,15 @@
  */
 #include "commands/cbl_cmds_opt_bytes.h"
 #include "etc/cbl_common.h"
+#include "etc/cbl_link.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+static cbl_err_code_t opt_bytes_stage (parser_t * ph_prsr,
+        const opt_bytes_t * p_cur, opt_bytes_t * p_new);
+
 /**
  * @brief   RDP - Read protection
  *              - Used to protect the software code stored in Flash memory.
@@ -24,7 +28,7 @@ cbl_err_code_t cmd_get_rdp_lvl (parser_t * phPrsr)
     hal_rdp_lvl_get(rdp_lvl, sizeof(rdp_lvl));
 
     /* Send response */
-    eCode = hal_send_to_host(rdp_lvl, strlen(rdp_lvl));
+    eCode = link_send(rdp_lvl, strlen(rdp_lvl));
 
     return eCode;
 }
@@ -41,28 +45,34 @@ cbl_err_code_t cmd_get_rdp_lvl (parser_t * phPrsr)
 cbl_err_code_t cmd_change_write_prot (parser_t * phPrsr, bool EnDis)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char *charMask = NULL;
     uint32_t mask = 0u;
 
     DEBUG("Started\r\n");
 
-    /* Mask of sectors to affect */
-    charMask = parser_get_val(phPrsr, TXT_PAR_EN_WRITE_PROT_MASK,
-            strlen(TXT_PAR_EN_WRITE_PROT_MASK));
-
-    if (NULL == charMask)
-    {
-        return CBL_ERR_NEED_PARAM;
-    }
-    /* Fill mask */
-    eCode = str2ui32(charMask, strlen(charMask), &mask, 16); /* Mask is in
-     hex */
+    /* Mask of sectors to affect, in hex */
+    eCode = parser_get_u32(phPrsr, TXT_PAR_EN_WRITE_PROT_MASK, 16, &mask);
     ERR_CHECK(eCode);
 
     eCode = hal_change_write_prot(mask, EnDis);
     return eCode;
 }
 
+/**
+ * @brief   Enables write protection, see cmd_change_write_prot
+ */
+cbl_err_code_t cmd_en_write_prot (parser_t * phPrsr)
+{
+    return cmd_change_write_prot(phPrsr, true);
+}
+
+/**
+ * @brief   Disables write protection, see cmd_change_write_prot
+ */
+cbl_err_code_t cmd_dis_write_prot (parser_t * phPrsr)
+{
+    return cmd_change_write_prot(phPrsr, false);
+}
+
 // \f - new page
 /**
  * @brief   Returns bit array of sector write protection to the user.
@@ -79,8 +89,117 @@ cbl_err_code_t cmd_get_write_prot (parser_t * phPrsr)
     ERR_CHECK(eCode);
 
     /* Send response */
-    eCode = hal_send_to_host(write_prot, strlen(write_prot));
+    eCode = link_send(write_prot, strlen(write_prot));
+
+    return eCode;
+}
+
+// \f - new page
+/**
+ * @brief   Sets read protection, write protection and brown-out reset level
+ *          together. Changes are staged on the current option bytes and
+ *          checked, then programmed with one unlock, program and launch.
+ *          Nothing is programmed if nothing changes. Resulting state is
+ *          read back and returned.
+ *          Parameters from phPrsr, all optional, not given stay as they are:
+ *              - rdp - Read protection level 0 or 1
+ *              - wrp - Mask in hex of write protected sectors, LSB is
+ *                sector 0. Sectors not in it are unprotected
+ *              - bor - Brown-out reset level 1 to 3, 0 turns it off
+ *
+ * @note    Level 2 can't be undone and level 1 to 0 mass erases flash, with
+ *          the bootloader, both are refused
+ */
+cbl_err_code_t cmd_opt_bytes_set (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    opt_bytes_t cur;
+    opt_bytes_t staged;
+    char msg[48] = { 0 };
+
+    DEBUG("Started\r\n");
+
+    eCode = hal_opt_bytes_get( &cur);
+    ERR_CHECK(eCode);
+
+    eCode = opt_bytes_stage(phPrsr, &cur, &staged);
+    ERR_CHECK(eCode);
+
+    if (memcmp( &cur, &staged, sizeof(cur)) != 0)
+    {
+        INFO("Option bytes rdp:%u|wrp:0x%03lx|bor:%u\r\n", staged.rdp_lvl,
+                staged.wrp_mask, staged.bor_lvl);
+
+        eCode = hal_opt_bytes_program( &staged);
+        ERR_CHECK(eCode);
+
+        eCode = hal_opt_bytes_get( &cur);
+        ERR_CHECK(eCode);
+    }
+
+    snprintf(msg, sizeof(msg), "rdp:%u|wrp:0x%03lx|bor:%u\r\n", cur.rdp_lvl,
+            cur.wrp_mask, cur.bor_lvl);
+    eCode = link_send(msg, strlen(msg));
 
     return eCode;
 }
+
+/**
+ * @brief Applies parameters of opt-bytes-set to the current option bytes
+ *        and checks them
+ *
+ * @param ph_prsr[in] Parser with the parameters
+ * @param p_cur[in]   Current option bytes
+ * @param p_new[out]  Option bytes to program
+ *
+ * @return CBL_ERR_OPT_BYTES if change of read protection is refused, or
+ *         write protection mask or brown-out level is out of range
+ */
+static cbl_err_code_t opt_bytes_stage (parser_t * ph_prsr,
+        const opt_bytes_t * p_cur, opt_bytes_t * p_new)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t val;
+
+    /* Struct is compared as a whole, padding has to match too */
+    memcpy(p_new, p_cur, sizeof( *p_new));
+
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_OPT_BYTES_RDP, 10, &val);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
+        ERR_CHECK(eCode);
+
+        if (val > OPT_BYTES_RDP_MAX || val < p_cur->rdp_lvl)
+        {
+            return CBL_ERR_OPT_BYTES;
+        }
+        p_new->rdp_lvl = (uint8_t)val;
+    }
+
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_OPT_BYTES_WRP, 16, &val);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
+        ERR_CHECK(eCode);
+
+        if ((val & ~OPT_BYTES_WRP_ALL) != 0)
+        {
+            return CBL_ERR_OPT_BYTES;
+        }
+        p_new->wrp_mask = val;
+    }
+
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_OPT_BYTES_BOR, 10, &val);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
+        ERR_CHECK(eCode);
+
+        if (val > OPT_BYTES_BOR_MAX)
+        {
+            return CBL_ERR_OPT_BYTES;
+        }
+        p_new->bor_lvl = (uint8_t)val;
+    }
+
+    return CBL_ERR_OK;
+}
 /*** end of file ***/
@@ -4,6 +4,13 @@
  *        record
  */
 #include "etc/cbl_boot_record.h"
+#include "etc/cbl_records.h"
+#include "etc/cbl_fast_boot.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_erase.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_mem.h"
+#include "etc/cbl_perf.h"
 #include "commands/cbl_cmds_memory.h"
 #include "commands/cbl_cmds_update_act.h"
 #include <stdbool.h>
@@ -11,40 +18,24 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct
-{
-    bool is_EOF; /*!< Signal of end of file, set by function 01 */
-    uint16_t upper_address; /*!< Set by function 04 */
-    uint32_t * p_main; /*!< Set by function 05, BIG ENDIAN */
-} h_ihex_t;
-
-static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len);
+#if 1 != USE_AB_SLOTS
+static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len,
+        uint32_t * p_act_len);
 static cbl_err_code_t update_act_bin (uint32_t new_len);
-static cbl_err_code_t update_act_hex (uint32_t new_len);
-static cbl_err_code_t update_act_srec (uint32_t new_len);
+static bool update_act_is_sect_same (uint32_t offset, uint32_t sect_sz,
+        uint32_t new_len);
+static cbl_err_code_t update_act_records (app_type_t app_type,
+        uint32_t new_len, uint32_t * p_act_len);
+static cbl_err_code_t update_act_write (uint32_t address, uint8_t * p_data,
+        uint32_t len);
+#endif /* USE_AB_SLOTS */
 static cbl_err_code_t enum_param_force (char * char_force, uint32_t len,
 bool * p_force);
-static cbl_err_code_t hex_handle_fcn (h_ihex_t * ph_ihex, uint8_t * p_fcn_start,
-        uint32_t len, uint32_t * p_fcn_len);
-static cbl_err_code_t srec_handle_fcn (uint8_t * p_fcn_start, uint32_t len,
-        uint32_t * p_fcn_len);
-static cbl_err_code_t srec_handle_fcn_3 (uint8_t byte_count,
-        uint8_t * p_fcn_start, uint32_t offset);
-static cbl_err_code_t hex_handle_fcn_00 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum);
-static cbl_err_code_t hex_handle_fcn_01 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum);
-static cbl_err_code_t hex_handle_fcn_04 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum);
-static cbl_err_code_t hex_handle_fcn_05 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum);
+
 /**
  * @brief Checks 'boot record' if update to user application is available.
- *        If it is available updates the user application.
+ *        If it is available updates the user application. With A/B slots
+ *        active slot is switched instead of copying.
  *        Parameters from phPrsr:
  *          force - force update even if flag for update is not set
  *                  valid values TXT_PAR_UP_ACT_TRUE and TXT_PAR_UP_ACT_FALSE
@@ -55,29 +46,30 @@ cbl_err_code_t cmd_update_act (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
     boot_record_t * p_boot_record;
-    uint32_t new_len;
+#if 1 != USE_AB_SLOTS
+    uint32_t act_len;
+#endif /* USE_AB_SLOTS */
 
     p_boot_record = boot_record_get();
-    new_len = p_boot_record->new_app.len;
 
     if (p_boot_record->is_new_app_ready == false)
     {
-        char *char_force = NULL;
+        parser_arg_t * p_force = NULL;
         bool force = false;
 
         /* Notify that no update is required */
         const char *msg = "No update needed for user application\r\n";
         INFO("%s", msg);
-        eCode = hal_send_to_host(msg, strlen(msg));
+        eCode = link_send(msg, strlen(msg));
         ERR_CHECK(eCode);
 
         /* Check if force parameter is given */
-        char_force = parser_get_val(phPrsr, TXT_PAR_UP_ACT_FORCE,
+        p_force = parser_get_arg(phPrsr, TXT_PAR_UP_ACT_FORCE,
                 strlen(TXT_PAR_UP_ACT_FORCE));
-        if (char_force != NULL)
+        if (p_force != NULL)
         {
             /* Fill boolean force */
-            eCode = enum_param_force(char_force, strlen(char_force), &force);
+            eCode = enum_param_force(p_force->val, p_force->valLen, &force);
             ERR_CHECK(eCode);
         }
 
@@ -91,33 +83,46 @@ cbl_err_code_t cmd_update_act (parser_t * phPrsr)
         /* Notify that update is available */
         const char *msg = "Update for user application available\r\n";
         INFO("%s", msg);
-        eCode = hal_send_to_host(msg, strlen(msg));
+        eCode = link_send(msg, strlen(msg));
         ERR_CHECK(eCode);
     }
 
     const char *msg = "Updating user application\r\n";
     INFO("%s", msg);
-    eCode = hal_send_to_host(msg, strlen(msg));
+    eCode = link_send(msg, strlen(msg));
+    ERR_CHECK(eCode);
+
+#if 1 == USE_AB_SLOTS
+    eCode = ab_switch();
     ERR_CHECK(eCode);
 
+    msg = "Switched active slot, application is on trial\r\n";
+    INFO("%s", msg);
+    eCode = link_send(msg, strlen(msg));
+#else
     /* Remove the flag signalizing update */
     p_boot_record->is_new_app_ready = false;
 
-    /* Erase user application sectors */
-    eCode = hal_flash_erase_sector(BOOT_ACT_APP_START_SECTOR,
-    BOOT_ACT_APP_MAX_SECTORS);
-    ERR_CHECK(eCode);
-
     /* Write bytes to active application location */
-    eCode = update_act(p_boot_record->new_app.app_type, new_len);
+    eCode = update_act(p_boot_record->new_app.app_type,
+            p_boot_record->new_app.len, &act_len);
     ERR_CHECK(eCode);
 
-    /* Update active application meta data */
-    p_boot_record->act_app.app_type = p_boot_record->new_app.app_type;
+    /* Update active application meta data. Records are decoded, active
+     * application is a straight image of act_len bytes */
+    p_boot_record->act_app.app_type = TYPE_BIN;
     p_boot_record->act_app.cksum_used = p_boot_record->new_app.cksum_used;
-    p_boot_record->act_app.len = p_boot_record->new_app.len;
+    p_boot_record->act_app.len = act_len;
+
+    /* Keep fast boot check valid for the new application */
+    p_boot_record->act_app_crc = fast_boot_digest(BOOT_ACT_APP_START,
+            p_boot_record->act_app.len);
+    p_boot_record->fast_boot_cycles = 0;
+    /* Signature is verified again when it starts */
+    p_boot_record->is_sig_ok = false;
 
     eCode = boot_record_set(p_boot_record);
+#endif /* USE_AB_SLOTS */
 
     return eCode;
 }
@@ -156,35 +161,42 @@ bool * p_force)
     return eCode;
 }
 
+#if 1 != USE_AB_SLOTS
 /**
  * @brief Updates the flash bytes according to app_type
  *
- * @param app_type Application type used in new application
- * @param new_len  Length of new application
+ * @param app_type[in]   Application type used in new application
+ * @param new_len[in]    Length of new application
+ * @param p_act_len[out] Length of active application image written
  */
-static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len)
+static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len,
+        uint32_t * p_act_len)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t n_erased;
+
     switch (app_type)
     {
         case TYPE_BIN:
         {
+            *p_act_len = new_len;
             eCode = update_act_bin(new_len);
         }
         break;
 
         case TYPE_HEX:
-        {
-            eCode = update_act_hex(new_len);
-        }
-        break;
-
         case TYPE_SREC:
         {
-            eCode = update_act_srec(new_len);
+            /* Erase user application sectors, blank ones are skipped */
+            eCode = erase_sectors(BOOT_ACT_APP_START_SECTOR,
+            BOOT_ACT_APP_MAX_SECTORS, &n_erased);
+            ERR_CHECK(eCode);
+
+            eCode = update_act_records(app_type, new_len, p_act_len);
         }
         break;
 
+        case TYPE_BIN_LZ4: /* Stored decompressed, as TYPE_BIN */
         case TYPE_UNDEF:
         default:
         {
@@ -197,13 +209,21 @@ static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len)
 }
 
 /**
- * @brief Updates bytes of current application from binary new application
+ * @brief Updates bytes of current application from binary new application.
+ *        Only sectors whose content changes are erased and written
  *
  * @param new_len Length of new application
  */
 static cbl_err_code_t update_act_bin (uint32_t new_len)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
+    const uint32_t sect_sz[BOOT_ACT_APP_MAX_SECTORS] =
+    BOOT_ACT_APP_SECTOR_SIZES;
+    uint32_t offset = 0;
+    uint32_t n_written = 0;
+    uint32_t n_erased;
+    uint32_t n_erased_all = 0;
+    char msg[64] = { 0 };
 
     if (new_len > BOOT_ACT_APP_MAX_LEN)
     {
@@ -211,528 +231,146 @@ static cbl_err_code_t update_act_bin (uint32_t new_len)
         return CBL_ERR_NEW_APP_LEN;
     }
 
-    eCode = hal_write_program_bytes(BOOT_ACT_APP_START,
-            (uint8_t *)BOOT_NEW_APP_START, new_len);
-
-    return eCode;
-}
-
-/**
- * @brief Updates bytes of current application from Intel hex new application
- *
- * @param new_len Length of new application
- */
-static cbl_err_code_t update_act_hex (uint32_t new_len)
-{
-    cbl_err_code_t eCode = CBL_ERR_INV_IHEX;
-    h_ihex_t h_ihex;
-    uint8_t * p_app = (uint8_t *)BOOT_NEW_APP_START;
-    uint8_t * p_fcn_start = memchr(p_app, ':', new_len);
-
-    h_ihex.is_EOF = false;
-    h_ihex.p_main = 0; /* Unused! */
-    h_ihex.upper_address = 0;
-
-    while (p_fcn_start != NULL)
+    for (uint32_t iii = 0; iii < BOOT_ACT_APP_MAX_SECTORS; iii++)
     {
-        uint32_t fcn_len;
-        uint32_t fcn_offset;
-
-        fcn_offset = p_fcn_start - p_app;
-
-        eCode = hex_handle_fcn( &h_ihex, p_fcn_start, new_len - fcn_offset,
-                &fcn_len);
-        ERR_CHECK(eCode);
-
-        /* Check if EOF record received */
-        if (true == h_ihex.is_EOF)
+        if (false == update_act_is_sect_same(offset, sect_sz[iii], new_len))
         {
-            eCode = CBL_ERR_OK;
-            break;
+            /* Sector may be blank and need only writing */
+            eCode = erase_sectors(BOOT_ACT_APP_START_SECTOR + iii, 1,
+                    &n_erased);
+            ERR_CHECK(eCode);
+            n_erased_all += n_erased;
+
+            if (offset < new_len)
+            {
+                PERF_START(PERF_WRITE);
+                eCode = flash_program(BOOT_ACT_APP_START + offset,
+                        (const uint8_t *)BOOT_NEW_APP_START + offset,
+                        ui32_min(new_len - offset, sect_sz[iii]));
+                PERF_STOP(PERF_WRITE);
+                if (CBL_ERR_VERIFY == eCode)
+                {
+                    /* Sector is the chunk of this copy */
+                    snprintf(msg, sizeof(msg), "\r\nverify NOK|sector:%lu"
+                            "\r\n", BOOT_ACT_APP_START_SECTOR + iii);
+                    link_send(msg, strlen(msg));
+                }
+                ERR_CHECK(eCode);
+            }
+
+            n_written++;
         }
 
-        /* Get next function start */
-        p_fcn_start = memchr(p_fcn_start + fcn_len, ':', new_len);
+        offset += sect_sz[iii];
     }
+
+    snprintf(msg, sizeof(msg), "Sectors written: %lu, erased: %lu, "
+    "unchanged: %lu\r\n", n_written, n_erased_all,
+            BOOT_ACT_APP_MAX_SECTORS - n_written);
+    INFO("%s", msg);
+    eCode = link_send(msg, strlen(msg));
+
     return eCode;
 }
 
 /**
- * @brief Updates bytes of current application from Motorola S-Record S37-style
- *        new application. Writes to flash
+ * @brief Checks if active application sector already holds what new
+ *        application would write. Bytes after new application are expected
+ *        to be erased
  *
+ * @param offset  Offset of the sector from start of active application
+ * @param sect_sz Size of the sector
  * @param new_len Length of new application
+ *
+ * @return True if the sector can be skipped
  */
-static cbl_err_code_t update_act_srec (uint32_t new_len)
+static bool update_act_is_sect_same (uint32_t offset, uint32_t sect_sz,
+        uint32_t new_len)
 {
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    uint8_t * p_app = (uint8_t *)BOOT_NEW_APP_START;
-    uint8_t * p_fcn_start = memchr(p_app, 'S', new_len);
-
-    while (p_fcn_start != NULL)
-    {
-        uint32_t fcn_len;
-        uint32_t fcn_offset;
-
-        fcn_offset = p_fcn_start - p_app;
-
-        eCode = srec_handle_fcn(p_fcn_start, new_len - fcn_offset, &fcn_len);
-        ERR_CHECK(eCode);
-
-        /* Get next function start */
-        p_fcn_start = memchr(p_fcn_start + fcn_len, 'S', new_len);
-    }
-
-    return eCode;
-}
-
-static cbl_err_code_t hex_handle_fcn (h_ihex_t * ph_ihex, uint8_t * p_fcn_start,
-        uint32_t len, uint32_t * p_fcn_len)
-{
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    uint8_t fcn_code;
-    uint32_t offset = 1;
-    uint8_t byte_count; /* Number of byte PAIRS, not number of characters! */
-    uint64_t calc_checksum = 0;
-    uint8_t expected_checksum;
-    uint16_t fcn_address;
-
-    /* 11 is the minimal theoretical function length */
-    if (len < 11)
-    {
-        return CBL_ERR_INV_SREC;
-    }
-
-    /* Byte count is on index 1 and 2 */
-    eCode = two_hex_chars2ui8(p_fcn_start[offset], p_fcn_start[offset + 1],
-            &byte_count);
-    ERR_CHECK(eCode);
-
-    /* Accumulate checksum */
-    calc_checksum += byte_count;
-
-    /* 1 - ':', 2 - byte count, 4 - address, 2 - fcn code, 2*n -  data,
-     * 2 - checksum */
-    *p_fcn_len = 1 + 2 + 4 + 2 + byte_count * 2 + 2;
-
-    if ( *p_fcn_len > len)
-    {
-        return CBL_ERR_INV_IHEX;
-    }
+    const uint8_t *p_act = (const uint8_t *)BOOT_ACT_APP_START + offset;
+    const uint8_t *p_new = (const uint8_t *)BOOT_NEW_APP_START + offset;
+    uint32_t same_len = 0;
 
-    /* Set offset for address */
-    offset = 3;
-
-    eCode = four_hex_chars2ui16( &p_fcn_start[offset], 4, &fcn_address);
-    ERR_CHECK(eCode);
-
-    /* Calculate checksum for address */
-    for (uint32_t iii = 0; iii < 4; iii += 2)
-    {
-        uint8_t one_byte;
-
-        eCode = two_hex_chars2ui8(p_fcn_start[offset + iii],
-                p_fcn_start[offset + iii + 1], &one_byte);
-        ERR_CHECK(eCode);
-
-        calc_checksum += one_byte;
-    }
-
-    /* Set to checksum */
-    offset = 9 + byte_count * 2;
-
-    /* Fill expected checksum */
-    eCode = two_hex_chars2ui8(p_fcn_start[offset], p_fcn_start[offset + 1],
-            &expected_checksum);
-    ERR_CHECK(eCode);
-
-    /* Set offset for function code */
-    offset = 7;
-
-    /* Fill function code */
-    eCode = two_hex_chars2ui8(p_fcn_start[offset], p_fcn_start[offset + 1],
-            &fcn_code);
-    ERR_CHECK(eCode);
-
-    /* Accumulate checksum for function code */
-    calc_checksum += fcn_code;
-
-    switch (fcn_code)
+    if (offset < new_len)
     {
-        case 00:
-        {
-            /* Data function handler */
-            eCode = hex_handle_fcn_00(ph_ihex, p_fcn_start, fcn_address,
-                    byte_count, calc_checksum, expected_checksum);
-        }
-        break;
-
-        case 01:
-        {
-            /* EOF function handler */
-            eCode = hex_handle_fcn_01(ph_ihex, p_fcn_start, fcn_address,
-                    byte_count, calc_checksum, expected_checksum);
-        }
-        break;
+        same_len = ui32_min(new_len - offset, sect_sz);
 
-        case 04:
+        if (memcmp(p_act, p_new, same_len) != 0)
         {
-            /* Extended linear address handler */
-            eCode = hex_handle_fcn_04(ph_ihex, p_fcn_start, fcn_address,
-                    byte_count, calc_checksum, expected_checksum);
+            return false;
         }
-        break;
-
-        case 05:
-        {
-            /* Start linear address handler */
-            eCode = hex_handle_fcn_05(ph_ihex, p_fcn_start, fcn_address,
-                    byte_count, calc_checksum, expected_checksum);
-        }
-        break;
-
-        default:
-        {
-            return CBL_ERR_IHEX_FCN;
-        }
-        break;
-
     }
 
-    return eCode;
-}
-
-static cbl_err_code_t hex_handle_fcn_00 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum)
-{
-    cbl_err_code_t eCode = CBL_ERR_OK;
-
-    /* Data function handler */
-    uint16_t lower_address;
-    uint32_t address;
-    uint8_t p_data[255]; /* 255 is maximum value for a byte */
-    uint32_t offset;
-
-    lower_address = fcn_address;
-
-    address = (ph_ihex->upper_address << 16) | lower_address;
-
-    if ( IS_ACT_APP_ADDRESS(address) == false
-            || IS_ACT_APP_ADDRESS(address + byte_count - 1) == false)
+    /* Rest of the sector shall be erased */
+    for (uint32_t iii = same_len; iii < sect_sz; iii++)
     {
-        return CBL_ERR_SEGMEN;
-    }
-
-    /* Move to the data start */
-    offset = 9;
-
-    /* Fill p_data */
-    for (uint32_t iii = 0; iii < (byte_count * 2); iii += 2)
-    {
-        /* Fill p_data */
-        eCode = two_hex_chars2ui8(p_fcn_start[offset + iii],
-                p_fcn_start[offset + iii + 1], &p_data[iii / 2]);
-        ERR_CHECK(eCode);
-
-        /* Calculate checksum */
-        calc_checksum += p_data[iii / 2];
-    }
-
-    /* 2's complement */
-    calc_checksum = (((calc_checksum ^ 0xFF) & 0xFF) + 1) & 0xFF;
-
-    if (calc_checksum != expected_checksum)
-    {
-        return CBL_ERR_CKSUM_WRONG;
-    }
-
-    eCode = hal_write_program_bytes(address, p_data, byte_count);
-    ERR_CHECK(eCode);
-
-    return eCode;
-}
-
-static cbl_err_code_t hex_handle_fcn_01 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum)
-{
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    /* EOF function handler */
-
-    /* 2's complement */
-    calc_checksum = ((calc_checksum ^ 0xFF) & 0xFF) + 1;
-
-    if (expected_checksum != calc_checksum)
-    {
-        return CBL_ERR_CKSUM_WRONG;
+        if (p_act[iii] != 0xFF)
+        {
+            return false;
+        }
     }
 
-    ph_ihex->is_EOF = true;
-
-    return eCode;
+    return true;
 }
 
-static cbl_err_code_t hex_handle_fcn_04 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum)
+/**
+ * @brief Updates bytes of current application from Intel hex or Motorola
+ *        S-Record S37-style new application. Writes to flash
+ *
+ * @param app_type[in]   TYPE_HEX or TYPE_SREC
+ * @param new_len[in]    Length of new application, text of the records
+ * @param p_act_len[out] Length of decoded image, from start of active
+ *                       application to the highest written byte
+ */
+static cbl_err_code_t update_act_records (app_type_t app_type,
+        uint32_t new_len, uint32_t * p_act_len)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t offset;
-    /* Extended linear address handler */
-
-    uint16_t temp_upper_address;
+    /* Also runs at boot, outside of any command, so gives back itself */
+    uint32_t mark = mem_mark();
+    h_records_t * ph_rec = mem_alloc(sizeof(h_records_t));
 
-    if (byte_count != 2)
+    if (NULL == ph_rec)
     {
-        return CBL_ERR_INV_IHEX;
+        return CBL_ERR_NO_MEM;
     }
 
-    /* Put to data field*/
-    offset = 9;
-
-    eCode = four_hex_chars2ui16( &p_fcn_start[offset], 4, &temp_upper_address);
-    ERR_CHECK(eCode);
-
-    /* Calculate checksum for data field */
-    for (uint32_t iii = 0; iii < 4; iii += 2)
+    eCode = records_init(ph_rec, app_type, update_act_write);
+    if (CBL_ERR_OK == eCode)
     {
-        uint8_t one_byte;
-
-        eCode = two_hex_chars2ui8(p_fcn_start[offset + iii],
-                p_fcn_start[offset + iii + 1], &one_byte);
-        ERR_CHECK(eCode);
-
-        calc_checksum += one_byte;
+        PERF_START(PERF_RECORDS);
+        eCode = records_feed(ph_rec, (uint8_t *)BOOT_NEW_APP_START, new_len);
+        PERF_STOP(PERF_RECORDS);
     }
 
-    /* 2's complement */
-    calc_checksum = ((calc_checksum ^ 0xFF) & 0xFF) + 1;
-
-    if (expected_checksum != calc_checksum)
+    if (CBL_ERR_OK == eCode)
     {
-        return CBL_ERR_CKSUM_WRONG;
+        eCode = records_finish(ph_rec);
     }
 
-    ph_ihex->upper_address = temp_upper_address;
-    return eCode;
-}
-
-static cbl_err_code_t hex_handle_fcn_05 (h_ihex_t * ph_ihex,
-        uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
-        uint64_t calc_checksum, uint8_t expected_checksum)
-{
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t offset;
-    /* Start linear address handler */
-
-    uint32_t main_fcn;
-
-    if (byte_count != 4)
+    if (CBL_ERR_OK == eCode && 0 == ph_rec->addr_end)
     {
-        return CBL_ERR_INV_IHEX;
+        /* File had no data records */
+        eCode = CBL_ERR_NEW_APP_LEN;
     }
 
-    /* Put to data field */
-    offset = 9;
-
-    /* BIG ENDIAN */
-    eCode = eight_hex_chars2ui32( &p_fcn_start[offset], 8, &main_fcn);
-    ERR_CHECK(eCode);
-
-    /* Calculate checksum for data field */
-    for (uint32_t iii = 0; iii < 8; iii += 2)
-    {
-        uint8_t one_byte;
-
-        eCode = two_hex_chars2ui8(p_fcn_start[offset + iii],
-                p_fcn_start[offset + iii + 1], &one_byte);
-        ERR_CHECK(eCode);
-
-        calc_checksum += one_byte;
-    }
-
-    /* 2's complement */
-    calc_checksum = ((calc_checksum ^ 0xFF) & 0xFF) + 1;
-
-    if (expected_checksum != calc_checksum)
+    if (CBL_ERR_OK == eCode)
     {
-        return CBL_ERR_CKSUM_WRONG;
+        *p_act_len = ph_rec->addr_end - ph_rec->area_start;
     }
 
-    /* BIG ENDIAN */
-    ph_ihex->p_main = (uint32_t *)main_fcn;
+    mem_release(mark);
     return eCode;
 }
 
 /**
- * @brief Handles given S-record function and write to active application flash
- *        if needed
- *
- * @note Flash sectors containing active application shall be erased before
- *
- * @param p_fcn_start[in] Pointer to function
- * @param len[in]         Length of buffer containing function
- * @param p_fcn_len[out]  Length of the actual function
- *
- * @return Error status
+ * @brief Writes decoded record data to active application
  */
-static cbl_err_code_t srec_handle_fcn (uint8_t * p_fcn_start, uint32_t len,
-        uint32_t * p_fcn_len)
+static cbl_err_code_t update_act_write (uint32_t address, uint8_t * p_data,
+        uint32_t len)
 {
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    uint8_t fcn_num;
-    uint32_t offset = 2;
-    uint8_t byte_count; /* Number of byte PAIRS, not number of characters! */
-
-    /* 8 is the minimal theoretical function length */
-    if (len < 8)
-    {
-        return CBL_ERR_INV_SREC;
-    }
-
-    /* Byte count is on index 2 and 3, big endian format */
-    eCode = two_hex_chars2ui8(p_fcn_start[offset], p_fcn_start[offset + 1],
-            &byte_count);
-    ERR_CHECK(eCode);
-
-    *p_fcn_len = byte_count * 2 + 4; /* 4 = 'S', function type and byte count */
-
-    if (len < *p_fcn_len || byte_count < 3)
-    {
-        return CBL_ERR_INV_SREC;
-    }
-
-    fcn_num = p_fcn_start[1];
-
-    /* Move to starting index of Address */
-    offset += 2;
-
-    switch (fcn_num)
-    {
-        case '0':
-        {
-            /* Header: contains description of following bytes
-             * SW4STM32 usually writes file name */
-            /* Handle not needed */
-        }
-        break;
-
-        case '3':
-        {
-            eCode = srec_handle_fcn_3(byte_count, p_fcn_start, offset);
-            ERR_CHECK(eCode);
-        }
-        break;
-
-        case '5':
-        {
-            /* Optional */
-            /* Contains number of 'S3' functions in a file */
-            /* Handle not needed */
-        }
-        break;
-
-        case '6':
-        {
-            /* Optional */
-            /* Contains number of 'S3' functions in a file */
-            /* Handle not needed */
-        }
-        break;
-
-        case '7':
-        {
-            /* File terminator */
-            /* Contains starting execution location */
-            /* Handle not needed for memory devices */
-        }
-        break;
-
-        default:
-        {
-            return CBL_ERR_SREC_FCN;
-        }
-        break;
-
-    }
-
-    return eCode;
-}
-
-/**
- * @brief Handler for S-record function '3'
- *
- * @param byte_count[in]   Number contained in byte_count field
- * @param p_fcn_start[in]  Pointer to function start
- * @param offset[in]       Offset preset to offset of address
- */
-static cbl_err_code_t srec_handle_fcn_3 (uint8_t byte_count,
-        uint8_t * p_fcn_start, uint32_t offset)
-{
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t address;
-    uint16_t data_len = byte_count * 2 - 8 - 2; /* - 8 for address,
-     - 2 for checksum */
-    uint8_t p_data[255 - 4 - 1] = { 0 }; /* 255 is max value of
-     one byte */
-    uint8_t expected_checksum = 0;
-    uint64_t calc_checksum = 0;
-
-    eCode = eight_hex_chars2ui32( &p_fcn_start[offset], 8, &address);
-    ERR_CHECK(eCode);
-
-    /* Calculate checksum */
-    calc_checksum = byte_count;
-
-    /* Calculate checksum for address */
-    for (uint32_t iii = 0; iii < 8; iii += 2)
-    {
-        uint8_t one_byte;
-
-        eCode = two_hex_chars2ui8(p_fcn_start[offset + iii],
-                p_fcn_start[offset + iii + 1], &one_byte);
-        ERR_CHECK(eCode);
-
-        calc_checksum += one_byte;
-    }
-
-    /* Move offset to data */
-    offset += 8;
-
-    for (uint32_t iii = 0; iii < data_len; iii += 2)
-    {
-        /* Fill p_data */
-        eCode = two_hex_chars2ui8(p_fcn_start[offset + iii],
-                p_fcn_start[offset + iii + 1], &p_data[iii / 2]);
-        ERR_CHECK(eCode);
-
-        /* Calculate checksum */
-        calc_checksum += p_data[iii / 2];
-    }
-
-    /* Move offset to checksum */
-    offset += data_len;
-
-    /* Fill checksum */
-    eCode = two_hex_chars2ui8(p_fcn_start[offset], p_fcn_start[offset + 1],
-            &expected_checksum);
-    ERR_CHECK(eCode);
-
-    if (((calc_checksum ^ 0xFF) & 0xFF) != expected_checksum)
-    {
-        return CBL_ERR_CKSUM_WRONG;
-    }
-
-    if ( IS_ACT_APP_ADDRESS(address) == false
-            || IS_ACT_APP_ADDRESS(address + (data_len / 2) - 1) == false)
-    {
-        return CBL_ERR_SEGMEN;
-    }
-
-    eCode = hal_write_program_bytes(address, p_data, data_len / 2);
-
-    return eCode;
+    return flash_program(address, p_data, len);
 }
+#endif /* USE_AB_SLOTS */
 
 /*** end of file ***/
@@ -6,13 +6,32 @@
 #include "etc/cbl_checksum.h"
 #include "commands/cbl_cmds_memory.h"
 #include "commands/cbl_cmds_update_new.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_erase.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_mem.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 static cbl_err_code_t update_new_get_params (parser_t * ph_prsr,
-        uint32_t * p_len, cksum_t * p_cksum, app_type_t * p_app_type);
+        uint32_t * p_len, cksum_t * p_cksum, app_type_t * p_app_type,
+        bool * p_is_decode);
+static cbl_err_code_t update_new_write (uint32_t address, uint8_t * p_data,
+        uint32_t len);
+static cbl_err_code_t update_new_program (uint32_t address, uint8_t * p_data,
+        uint32_t len);
+static cbl_err_code_t update_new_resume (parser_t * ph_prsr,
+        const xfer_ckpt_t * p_xfer, uint32_t * p_offset);
+static cbl_err_code_t update_new_ckpt (void);
+
+/** Sectors of new application area are erased as writes reach them */
+static h_erase_t h_erase;
+/** Transfer is checkpointed in boot record, so it can be resumed */
+static bool is_ckpt = false;
+/** End of bytes written in order from start of new application */
+static uint32_t ckpt_end;
 
 /**
  * @brief Updates new application bytes and writes to boot_record. On success
@@ -21,6 +40,26 @@ static cbl_err_code_t update_new_get_params (parser_t * ph_prsr,
  *          count - number of bytes to write
  *          cksum - checksum used
  *          type - application type (bin, hex...)
+ *          window - chunks in flight, optional
+ *          frame - chunks carry sequence number and CRC32, optional
+ *          decode - hex or srec is decoded while received and stored as
+ *                   binary, at offset of its address in active application.
+ *                   Count is then length of the text, optional. With A/B
+ *                   slots hex and srec are always decoded, their addresses
+ *                   have to be in the slot new application is written to
+ *          Type bin-lz4 is LZ4 frame of binary, decompressed while received.
+ *          Count is length of the frame, checksum is over decompressed
+ *          binary
+ *          id - image ID in hex, kept with the checkpoints, optional
+ *          resume - "true" continues interrupted transfer of the same image,
+ *                   id, count, type and cksum have to be the same, optional
+ *        Sectors are erased just before the first write reaches them, only
+ *        as many as the application covers. Blank sectors are not erased
+ *        Binary and not decoded text are checkpointed in boot record every
+ *        time a sector is written full. Resumed transfer continues from the
+ *        last checkpoint, checksum is calculated over the bytes before it
+ *        from the flash. Decoded and compressed transfers keep their state
+ *        in RAM and can't be resumed
  *
  * @param phPrsr Pointer to handle of parser
  */
@@ -31,35 +70,135 @@ cbl_err_code_t cmd_update_new (parser_t * phPrsr)
     cksum_t cksum;
     app_type_t app_type;
     boot_record_t * p_boot_record;
+    flash_write_opt_t opt = { 0 };
+    bool is_decode = false;
+    h_records_t * ph_rec = NULL;
+    h_lz4_t * ph_lz4 = NULL;
+    uint32_t new_start = ab_new_start();
+    xfer_ckpt_t xfer = { 0 };
+    uint32_t offset = 0;
 
-    eCode = update_new_get_params(phPrsr, &len, &cksum, &app_type);
+    eCode = update_new_get_params(phPrsr, &len, &cksum, &app_type,
+            &is_decode);
     ERR_CHECK(eCode);
 
-    eCode = hal_flash_erase_sector(BOOT_NEW_APP_START_SECTOR,
-            BOOT_NEW_APP_MAX_SECTORS);
+#if 1 == USE_AB_SLOTS
+    /* Slot is switched to, it can't hold text */
+    is_decode = (TYPE_HEX == app_type || TYPE_SREC == app_type);
+#endif /* USE_AB_SLOTS */
+
+    /* Optional, not given is 0 */
+    eCode = parser_get_u32(phPrsr, TXT_PAR_UP_NEW_ID, 16, &xfer.id);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
+        ERR_CHECK(eCode);
+    }
+    xfer.app.cksum_used = cksum;
+    xfer.app.app_type = app_type;
+    xfer.app.len = len;
+
+    is_ckpt = (false == is_decode && TYPE_BIN_LZ4 != app_type);
+
+    eCode = flash_write_get_opts(phPrsr, &opt);
     ERR_CHECK(eCode);
+    opt.cksum = cksum;
+
+    /* Decoder handles are taken from the arena, given back when command
+     * ends */
+    if (true == is_decode)
+    {
+        ph_rec = mem_alloc(sizeof(h_records_t));
+        if (NULL == ph_rec)
+        {
+            return CBL_ERR_NO_MEM;
+        }
+
+        eCode = records_init(ph_rec, app_type, update_new_write);
+        ERR_CHECK(eCode);
+#if 1 == USE_AB_SLOTS
+        records_set_area(ph_rec, new_start, AB_SLOT_MAX_LEN);
+#endif /* USE_AB_SLOTS */
+        opt.ph_records = ph_rec;
+    }
+    else if (TYPE_BIN_LZ4 == app_type)
+    {
+        ph_lz4 = mem_alloc(sizeof(h_lz4_t));
+        if (NULL == ph_lz4)
+        {
+            return CBL_ERR_NO_MEM;
+        }
 
-    eCode = flash_write(BOOT_NEW_APP_START, len, cksum);
+        eCode = lz4_init(ph_lz4, new_start, ab_new_max_len(),
+                update_new_program);
+        ERR_CHECK(eCode);
+        opt.ph_lz4 = ph_lz4;
+    }
+
+    eCode = erase_init( &h_erase, new_start);
+    ERR_CHECK(eCode);
+    opt.write = update_new_program;
+
+    eCode = update_new_resume(phPrsr, &xfer, &offset);
+    ERR_CHECK(eCode);
+    erase_skip( &h_erase, new_start + offset);
+    ckpt_end = new_start + offset;
+    opt.resumed_len = offset;
+
+    /* Chunks are numbered from the offset, their addresses tell where */
+    eCode = flash_write(new_start + offset, len - offset, &opt);
     ERR_CHECK(eCode);
 
+    if (true == is_decode)
+    {
+        eCode = records_finish(ph_rec);
+        ERR_CHECK(eCode);
+
+        if (0 == ph_rec->addr_end)
+        {
+            /* File had no data records */
+            return CBL_ERR_NEW_APP_LEN;
+        }
+
+        /* Active application becomes a straight copy */
+        app_type = TYPE_BIN;
+        len = ph_rec->addr_end - ph_rec->area_start;
+    }
+    else if (TYPE_BIN_LZ4 == app_type)
+    {
+        if (0 == ph_lz4->out_len)
+        {
+            return CBL_ERR_NEW_APP_LEN;
+        }
+
+        app_type = TYPE_BIN;
+        len = ph_lz4->out_len;
+    }
+
     p_boot_record = boot_record_get();
 
+#if 1 == USE_AB_SLOTS
+    /* Application to roll back to was overwritten */
+    p_boot_record->prev_app.len = 0;
+#endif /* USE_AB_SLOTS */
+
     p_boot_record->new_app.app_type = app_type;
     p_boot_record->new_app.cksum_used = cksum;
     p_boot_record->new_app.len = len;
 
     p_boot_record->is_new_app_ready = true;
+    p_boot_record->xfer.done = 0;
 
     eCode = boot_record_set(p_boot_record);
     ERR_CHECK(eCode);
 
-    eCode = hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    eCode = link_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
     ERR_CHECK(eCode);
 
     char restart_msg[] = "Restarting...\r\n";
     INFO("%s", restart_msg);
-    eCode = hal_send_to_host(restart_msg, strlen(restart_msg));
+    eCode = link_send(restart_msg, strlen(restart_msg));
     ERR_CHECK(eCode);
+    link_flush();
 
     hal_system_restart();
 
@@ -74,48 +213,169 @@ cbl_err_code_t cmd_update_new (parser_t * phPrsr)
  * @param p_len[out]       Pointer to length of new application
  * @param p_cksum[out]     Pointer to checksum type
  * @param p_app_type[out]  Pointer to application type
+ * @param p_is_decode[out] Pointer to decode flag
  */
 static cbl_err_code_t update_new_get_params (parser_t * ph_prsr,
-        uint32_t * p_len, cksum_t * p_cksum, app_type_t * p_app_type)
+        uint32_t * p_len, cksum_t * p_cksum, app_type_t * p_app_type,
+        bool * p_is_decode)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char *char_len = NULL;
-    char *char_cksum = NULL;
-    char *char_app_type = NULL;
 
-    char_len = parser_get_val(ph_prsr, TXT_PAR_UP_NEW_COUNT,
-            strlen(TXT_PAR_UP_NEW_COUNT));
-
-    if (NULL == char_len)
+    /* This is an optional parameter, if not present, don't throw error */
+    eCode = parser_get_bool(ph_prsr, TXT_PAR_UP_NEW_DECODE, p_is_decode);
+    if (CBL_ERR_NEED_PARAM != eCode)
     {
-        return CBL_ERR_NEED_PARAM;
+        ERR_CHECK(eCode);
     }
 
     /* Fill len */
-    eCode = str2ui32(char_len, strlen(char_len), p_len, 10u);
+    eCode = parser_get_u32(ph_prsr, TXT_PAR_UP_NEW_COUNT, 10u, p_len);
+    ERR_CHECK(eCode);
+
+    /* Optional, not given is CKSUM_NO */
+    *p_cksum = CKSUM_NO;
+    eCode = parser_get_cksum(ph_prsr, p_cksum);
+    if (CBL_ERR_NEED_PARAM != eCode)
+    {
+        ERR_CHECK(eCode);
+    }
+
+    eCode = parser_get_app_type(ph_prsr, p_app_type);
     ERR_CHECK(eCode);
 
-    if (( *p_len) > BOOT_NEW_APP_MAX_LEN)
+    if (true == *p_is_decode
+            && (TYPE_BIN == *p_app_type || TYPE_BIN_LZ4 == *p_app_type))
+    {
+        /* Only text formats can be decoded */
+        return CBL_ERR_APP_TYPE;
+    }
+
+    /* Decoded text is limited by the addresses in it and compressed binary
+     * by its output, not by their length */
+    if (false == *p_is_decode && TYPE_BIN_LZ4 != *p_app_type
+            && ( *p_len) > ab_new_max_len())
     {
         return CBL_ERR_NEW_APP_LEN;
     }
 
-    char_cksum = parser_get_val(ph_prsr, TXT_PAR_CKSUM, strlen(TXT_PAR_CKSUM));
+    return eCode;
+}
 
-    eCode = enum_checksum(char_cksum, strlen(char_cksum), p_cksum);
+/**
+ * @brief Writes decoded record data to new application area, at the same
+ *        offset it will have in active application. With A/B slots records
+ *        are linked for the slot and are written to their address
+ */
+static cbl_err_code_t update_new_write (uint32_t address, uint8_t * p_data,
+        uint32_t len)
+{
+#if 1 == USE_AB_SLOTS
+    return update_new_program(address, p_data, len);
+#else
+    return update_new_program(
+            BOOT_NEW_APP_START + (address - BOOT_ACT_APP_START), p_data, len);
+#endif /* USE_AB_SLOTS */
+}
+
+/**
+ * @brief Writes bytes to new application area, erasing sectors up to them
+ *        first
+ */
+static cbl_err_code_t update_new_program (uint32_t address, uint8_t * p_data,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = erase_prepare( &h_erase, address, len);
+    ERR_CHECK(eCode);
+
+    eCode = flash_program(address, p_data, len);
     ERR_CHECK(eCode);
 
-    char_app_type = parser_get_val(ph_prsr, TXT_PAR_APP_TYPE,
-            strlen(TXT_PAR_APP_TYPE));
+    /* Chunk rewritten after a rejected one breaks the order, checkpoint then
+     * stays behind and resume only repeats more */
+    if (true == is_ckpt && address == ckpt_end)
+    {
+        ckpt_end += len;
+        eCode = update_new_ckpt();
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Starts the transfer anew or continues the interrupted one. New
+ *        transfer is stored in boot record before anything is written, so
+ *        the previous checkpoint and new application can't be used anymore
+ *
+ * @param ph_prsr[in]  Parser with parameters
+ * @param p_xfer[in]   Transfer requested by the host
+ * @param p_offset[out] Offset in new application transfer continues from
+ */
+static cbl_err_code_t update_new_resume (parser_t * ph_prsr,
+        const xfer_ckpt_t * p_xfer, uint32_t * p_offset)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    bool is_resume = false;
+    boot_record_t * p_boot_record = boot_record_get();
+    const xfer_ckpt_t * p_ckpt = &p_boot_record->xfer;
+    char msg[32] = { 0 };
+
+    *p_offset = 0;
 
-    if (NULL == char_app_type)
+    /* This is an optional parameter, if not present, don't throw error */
+    eCode = parser_get_bool(ph_prsr, TXT_PAR_UP_NEW_RESUME, &is_resume);
+    if (CBL_ERR_NEED_PARAM != eCode)
     {
-        return CBL_ERR_NEED_PARAM;
+        ERR_CHECK(eCode);
     }
+    eCode = CBL_ERR_OK;
 
-    eCode = enum_app_type(char_app_type, strlen(char_app_type), p_app_type);
+    if (false == is_resume)
+    {
+        p_boot_record->xfer = *p_xfer;
+        p_boot_record->xfer.done = 0;
+        p_boot_record->is_new_app_ready = false;
+
+        return boot_record_set(p_boot_record);
+    }
+
+    if (false == is_ckpt || 0 == p_ckpt->done || p_ckpt->done >= p_xfer->app.len
+            || p_ckpt->id != p_xfer->id
+            || p_ckpt->app.len != p_xfer->app.len
+            || p_ckpt->app.app_type != p_xfer->app.app_type
+            || p_ckpt->app.cksum_used != p_xfer->app.cksum_used)
+    {
+        return CBL_ERR_NO_RESUME;
+    }
+
+    *p_offset = p_ckpt->done;
+
+    snprintf(msg, sizeof(msg), "\r\nresume|offset:%lu\r\n", *p_offset);
+    eCode = link_send(msg, strlen(msg));
 
     return eCode;
 }
 
+/**
+ * @brief Stores progress in boot record when bytes written in order reach a
+ *        new sector. Sector they end in may still change, so the checkpoint is
+ *        at its start
+ */
+static cbl_err_code_t update_new_ckpt (void)
+{
+    boot_record_t * p_boot_record;
+    uint32_t done = erase_sect_floor( &h_erase, ckpt_end) - h_erase.area_start;
+
+    p_boot_record = boot_record_get();
+    if (done <= p_boot_record->xfer.done)
+    {
+        return CBL_ERR_OK;
+    }
+
+    p_boot_record->xfer.done = done;
+
+    return boot_record_set(p_boot_record);
+}
+
 /*** end of file ***/
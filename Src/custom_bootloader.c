@@ -13,6 +13,13 @@
  *              - 7.1 m     - Boolean begins with is, e.g. isExample
  */
 #include "etc/cbl_common.h"
+#include "etc/cbl_rx.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_fast_boot.h"
+#include "etc/cbl_perf.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_mem.h"
+#include "etc/cbl_secure_boot.h"
 #include "custom_bootloader.h"
 #include <stdbool.h>
 #include <stdio.h>
@@ -36,12 +43,52 @@
 #if 1 == USE_CMDS_TEMPLATE
 #include "commands/cbl_cmds_template.h"
 #endif
+#if 1 == USE_CMDS_BINARY
+#include "commands/cbl_cmds_binary.h"
+#endif
 
 #define CMD_BUF_SZ 128 /*!< Size of a new command buffer */
 
 #define TXT_CMD_VERSION "version"
 #define TXT_CMD_HELP "help"
 #define TXT_CMD_RESET "reset"
+#define TXT_CMD_BATCH "batch"
+#define TXT_PAR_BATCH_COUNT "count"
+#define TXT_PAR_BATCH_START "start"
+
+#define BATCH_MAX_LEN 1024u /*!< Bytes of a batch script */
+#define BATCH_MAX_STEPS 32u /*!< Commands in a batch script */
+#define BATCH_SEPARATORS "\r\n;" /*!< End commands in a batch script */
+
+#define CMD_HASH_SZ 64u /*!< Slots of the hash index, power of 2 and at least
+                             twice the number of commands */
+#define CMD_HASH_EMPTY UINT8_MAX /*!< Hash index slot without a command */
+#define CMD_TABLE_LEN (sizeof(cmd_table) / sizeof(cmd_table[0]))
+
+typedef cbl_err_code_t (*cmd_handler_t) (parser_t * phPrsr);
+
+typedef struct
+{
+    const char *name; /*!< Command as typed in the shell */
+    cmd_t code; /*!< Command code, also used by the binary protocol */
+    cmd_handler_t handler; /*!< Function handling the command */
+    const char * const *req_params; /*!< Required parameters or NULL */
+    const char *help; /*!< Description shown by help */
+} cmd_entry_t;
+
+typedef struct
+{
+    const char *name; /*!< Command of the step, in the script */
+    uint32_t us; /*!< Microseconds the step took */
+} batch_step_t;
+
+#ifdef CBL_CMDS_MEMORY_H
+/* Biggest nested command takes the arena after the batch */
+typedef char batch_arena_check[(CMD_BUF_SZ + BATCH_MAX_LEN
+        + BATCH_MAX_STEPS * sizeof(batch_step_t) + sizeof(parser_t)
+        + FLASH_WRITE_ARENA_SZ + sizeof(h_records_t) + 5 * MEM_ALIGN
+        <= MEM_ARENA_SZ) ? 1 : -1];
+#endif /* CBL_CMDS_MEMORY_H */
 
 typedef enum
 {
@@ -50,38 +97,383 @@ typedef enum
     STATE_EXIT /*!< Deconstructor state */
 } sys_states_t;
 
-typedef enum
-{
-    CMD_UNDEF = 0,
-    CMD_VERSION,
-    CMD_HELP,
-    CMD_CID,
-    CMD_GET_RDP_LVL,
-    CMD_JUMP_TO,
-    CMD_FLASH_ERASE,
-    CMD_EN_WRITE_PROT,
-    CMD_DIS_WRITE_PROT,
-    CMD_READ_SECT_PROT_STAT,
-    CMD_MEM_READ,
-    CMD_FLASH_WRITE,
-    CMD_EXIT,
-    CMD_TEMPLATE,
-    CMD_RESET,
-    CMD_UPDATE_NEW,
-    CMD_UPDATE_ACT
-} cmd_t;
-
 static void shell_init (void);
-static void go_to_user_app (void);
+static void go_to_user_app (bool is_silent);
 static cbl_err_code_t run_shell_system (void);
 static cbl_err_code_t sys_state_operation (void);
 static cbl_err_code_t wait_for_cmd (char * buf, size_t len);
-static cbl_err_code_t enum_cmd (char * buf, size_t len, cmd_t * pCmdCode);
-static cbl_err_code_t handle_cmd (cmd_t cmdCode, parser_t * phPrsr);
+static void cmd_hash_init (void);
+static cbl_err_code_t enum_cmd (char * buf, size_t len,
+        const cmd_entry_t ** ppCmd);
+static cbl_err_code_t handle_cmd (const cmd_entry_t * p_cmd, parser_t * phPrsr,
+        bool is_quiet);
 static cbl_err_code_t sys_state_error (cbl_err_code_t eCode);
 static cbl_err_code_t cmd_version (parser_t * phPrsr);
 static cbl_err_code_t cmd_help (parser_t * phPrsr);
 static cbl_err_code_t cmd_reset (parser_t * phPrsr);
+static cbl_err_code_t cmd_batch (parser_t * phPrsr);
+static cbl_err_code_t batch_split (char * script, uint32_t len,
+        uint32_t * p_n_steps);
+static cbl_err_code_t batch_summary (const batch_step_t * p_steps,
+        uint32_t n_steps, uint32_t n_done, cbl_err_code_t step_err);
+static cbl_err_code_t batch_sink_send (const char * buf, size_t len);
+static cbl_err_code_t batch_sink_flush (void);
+
+/* Parameters commands can't run without, NULL terminated */
+static const char * const req_batch[] = { TXT_PAR_BATCH_COUNT, NULL };
+#ifdef CBL_CMDS_OPT_BYTES_H
+static const char * const req_mask[] = { TXT_PAR_EN_WRITE_PROT_MASK, NULL };
+#endif /* CBL_CMDS_OPT_BYTES_H */
+#ifdef CBL_CMDS_MEMORY_H
+static const char * const req_jump_to[] = { TXT_PAR_JUMP_TO_ADDR, NULL };
+static const char * const req_flash_erase[] =
+{ TXT_PAR_FLASH_ERASE_TYPE, NULL };
+static const char * const req_start_count[] =
+{ TXT_PAR_FLASH_WRITE_START, TXT_PAR_FLASH_WRITE_COUNT, NULL };
+static const char * const req_mem_hash[] =
+{ TXT_PAR_FLASH_WRITE_START, TXT_PAR_FLASH_WRITE_COUNT, TXT_PAR_CKSUM, NULL };
+#endif /* CBL_CMDS_MEMORY_H */
+#ifdef CBL_CMDS_UPDATE_NEW_H
+static const char * const req_update_new[] =
+{ TXT_PAR_UP_NEW_COUNT, TXT_PAR_APP_TYPE, NULL };
+#endif /* CBL_CMDS_UPDATE_NEW_H */
+#ifdef CBL_CMDS_TEMPLATE_H
+static const char * const req_template[] = { TXT_PAR_TEMPLATE_PARAM1, NULL };
+#endif /* CBL_CMDS_TEMPLATE_H */
+#ifdef CBL_CMDS_ETC_H
+static const char * const req_cksum_bench[] = { TXT_PAR_CKSUM, NULL };
+static const char * const req_set_baud[] = { TXT_PAR_SET_BAUD_RATE, NULL };
+#endif /* CBL_CMDS_ETC_H */
+
+/* Every command of the shell. Adding a command is adding its entry here, help
+ * and binary protocol come from it too */
+static const cmd_entry_t cmd_table[] =
+{
+    {
+        TXT_CMD_VERSION, CMD_VERSION, cmd_version, NULL,
+        "- " TXT_CMD_VERSION " | Gets the current version of the running "
+        "bootloader" CRLF CRLF
+    },
+    {
+        TXT_CMD_HELP, CMD_HELP, cmd_help, NULL,
+        "- " TXT_CMD_HELP " | Makes life easier" CRLF CRLF
+    },
+    {
+        TXT_CMD_RESET, CMD_RESET, cmd_reset, NULL,
+        "- " TXT_CMD_RESET " | Resets the microcontroller" CRLF CRLF
+    },
+    {
+        TXT_CMD_BATCH, CMD_BATCH, cmd_batch, req_batch,
+        "- " TXT_CMD_BATCH " | Runs a script of commands without prompts, "
+        "stops at the first error" CRLF
+        "     " TXT_PAR_BATCH_COUNT " - Length of the script in decimal, "
+        "commands end with CR, LF or ';'" CRLF
+        "     " TXT_PAR_BATCH_START " - Optional, script is read from this "
+        "address in hex instead of sent after \"ready\"" CRLF CRLF
+    },
+#ifdef CBL_CMDS_OPT_BYTES_H
+    {
+        TXT_CMD_GET_RDP_LVL, CMD_GET_RDP_LVL, cmd_get_rdp_lvl, NULL,
+        "- "
+        TXT_CMD_GET_RDP_LVL
+        " |  Read protection. Used to protect the"
+        " software code stored in Flash memory."
+        " Ref. man. p. 93" CRLF CRLF
+    },
+    {
+        TXT_CMD_EN_WRITE_PROT, CMD_EN_WRITE_PROT, cmd_en_write_prot, req_mask,
+        "- "
+        TXT_CMD_EN_WRITE_PROT
+        " | Enables write protection per sector,"
+        " as selected with \""
+        TXT_PAR_EN_WRITE_PROT_MASK
+        "\"." CRLF
+        "     "
+        TXT_PAR_EN_WRITE_PROT_MASK
+        " - Mask in hex form for sectors"
+        " where LSB corresponds to sector 0." CRLF CRLF
+    },
+    {
+        TXT_CMD_DIS_WRITE_PROT, CMD_DIS_WRITE_PROT, cmd_dis_write_prot,
+        req_mask,
+        "- "
+        TXT_CMD_DIS_WRITE_PROT
+        " | Disables write protection per "
+        "sector, as selected with \""
+        TXT_PAR_EN_WRITE_PROT_MASK
+        "\"." CRLF
+        "     "
+        TXT_PAR_EN_WRITE_PROT_MASK
+        " - Mask in hex form for sectors"
+        " where LSB corresponds to sector 0." CRLF CRLF
+    },
+    {
+        TXT_CMD_READ_SECT_PROT_STAT, CMD_READ_SECT_PROT_STAT,
+        cmd_get_write_prot, NULL,
+        "- "
+        TXT_CMD_READ_SECT_PROT_STAT
+        " | Returns bit array of sector "
+        "write protection. LSB corresponds to sector 0. " CRLF CRLF
+    },
+    {
+        TXT_CMD_OPT_BYTES_SET, CMD_OPT_BYTES_SET, cmd_opt_bytes_set, NULL,
+        "- " TXT_CMD_OPT_BYTES_SET " | Sets read and write protection and "
+        "brown-out level in one option bytes cycle" CRLF
+        "     " TXT_PAR_OPT_BYTES_RDP " - Optional, read protection level "
+        "0 or 1" CRLF
+        "     " TXT_PAR_OPT_BYTES_WRP " - Optional, mask in hex of write "
+        "protected sectors, LSB is sector 0" CRLF
+        "     " TXT_PAR_OPT_BYTES_BOR " - Optional, brown-out reset level 1 "
+        "to 3, 0 is off" CRLF CRLF
+    },
+#endif /* CBL_CMDS_OPT_BYTES_H */
+#ifdef CBL_CMDS_MEMORY_H
+    {
+        TXT_CMD_JUMP_TO, CMD_JUMP_TO, cmd_jump_to, req_jump_to,
+        "- " TXT_CMD_JUMP_TO
+        " | Jumps to a requested address" CRLF
+        "    " TXT_PAR_JUMP_TO_ADDR " - Address to jump to in hex format "
+        "(e.g. 0x12345678), 0x can be omitted. " CRLF CRLF
+    },
+    {
+        TXT_CMD_FLASH_ERASE, CMD_FLASH_ERASE, cmd_flash_erase, req_flash_erase,
+        "- " TXT_CMD_FLASH_ERASE
+        " | Erases flash memory" CRLF "    " TXT_PAR_FLASH_ERASE_TYPE
+        " - Defines type of flash erase." CRLF
+        "          \"" TXT_PAR_FLASH_ERASE_TYPE_MASS "\" - erases all "
+        "sectors" CRLF
+        "          \"" TXT_PAR_FLASH_ERASE_TYPE_SECT "\" - erases only "
+        "selected sectors" CRLF
+        "    " TXT_PAR_FLASH_ERASE_SECT " - First sector to erase. "
+        "Bootloader is on sectors 0, 1 and 2. Not needed with mass erase."
+        CRLF "    " TXT_PAR_FLASH_ERASE_COUNT
+        " - Number of sectors to erase. Not needed with mass erase." CRLF
+        "    Blank sectors are skipped, erased and skipped are returned." CRLF
+        CRLF
+    },
+    {
+        TXT_CMD_FLASH_WRITE, CMD_FLASH_WRITE, cmd_flash_write, req_start_count,
+        "- " TXT_CMD_FLASH_WRITE " | Writes to flash byte by byte. "
+        "Splits data into chunks" CRLF
+        "     " TXT_PAR_FLASH_WRITE_START " - Starting address in hex "
+        "format (e.g. 0x12345678), 0x can be omitted."CRLF
+        "     " TXT_PAR_FLASH_WRITE_COUNT " - Number of bytes to write, "
+        "without checksum. Chunk size: " TXT_FLASH_WRITE_SZ CRLF
+        "     [" TXT_PAR_CKSUM "] - Checksum to use. If not"
+        " present, no checksum is assumed" CRLF
+        "             WARNING: Even if checksum is wrong data "
+        "will be written into flash memory!" CRLF
+        "                \"" TXT_CKSUM_SHA256 "\" - Best protection, "
+        "slowest" CRLF
+        "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
+        " uses inbuilt CRC32 hardware." CRLF
+        "                   Note: Any data length, also not divisible by 4"
+        CRLF
+        "                   Settings:" CRLF
+        "                            Polynomial: 0x4C11DB7 (Ethernet)" CRLF
+        "                            Init value: 0xFFFFFFFF" CRLF
+        "                                XORout: true" CRLF
+        "                                 RefIn: true" CRLF
+        "                                RefOut: true" CRLF
+        "                \"" TXT_CKSUM_NO "\" - No protection, fastest"
+        CRLF
+        "     [" TXT_PAR_FLASH_WRITE_WINDOW "] - Chunks host may have in "
+        "flight, 1 (default) or " TXT_FLASH_WRITE_N_BUFS ". With "
+        TXT_FLASH_WRITE_N_BUFS CRLF
+        "             next chunk is requested before the current one is "
+        "acknowledged" CRLF
+        "     [" TXT_PAR_FLASH_WRITE_FRAME "] - \"" TXT_PAR_TRUE
+        "\" sends every chunk as: sequence number (4 bytes, LE)," CRLF
+        "             data, CRC32 of sequence number and data. Corrupted "
+        "chunks get" CRLF
+        "             \"chunk NOK\" and are requested again. Data length "
+        "must be divisible by 4" CRLF CRLF
+    },
+    {
+        TXT_CMD_MEM_READ, CMD_MEM_READ, cmd_mem_read, req_start_count,
+        "- " TXT_CMD_MEM_READ
+        " | Read bytes from memory" CRLF
+        "     "
+        TXT_PAR_FLASH_WRITE_START
+        " - Starting address in hex "
+        "format (e.g. 0x12345678), 0x can be omitted."CRLF
+        "     "
+        TXT_PAR_FLASH_WRITE_COUNT
+        " - Number of bytes to read."
+        CRLF
+        "     [" TXT_PAR_CKSUM "] - Checksum sent after the bytes, \""
+        TXT_CKSUM_CRC "\" or \"" TXT_CKSUM_SHA256 "\"" CRLF CRLF
+    },
+    {
+        TXT_CMD_MEM_HASH, CMD_MEM_HASH, cmd_mem_hash, req_mem_hash,
+        "- " TXT_CMD_MEM_HASH " | Returns checksum of memory, bytes "
+        "aren't sent" CRLF
+        "     " TXT_PAR_FLASH_WRITE_START " - Starting address in hex "
+        "format" CRLF
+        "     " TXT_PAR_FLASH_WRITE_COUNT " - Number of bytes" CRLF
+        "     " TXT_PAR_CKSUM " - \"" TXT_CKSUM_CRC "\" or \""
+        TXT_CKSUM_SHA256 "\"" CRLF CRLF
+    },
+#endif /* CBL_CMDS_MEMORY_H */
+#ifdef CBL_CMDS_UPDATE_ACT_H
+    {
+        TXT_CMD_UPDATE_ACT, CMD_UPDATE_ACT, cmd_update_act, NULL,
+        "- " TXT_CMD_UPDATE_ACT " | Updates active application from new "
+        "application memory area" CRLF
+        "     [" TXT_PAR_UP_ACT_FORCE "] - Forces update even if not "
+        "needed" CRLF
+        "                \"" TXT_PAR_UP_ACT_TRUE "\" - Force the "
+        "update" CRLF
+        "                \"" TXT_PAR_UP_ACT_FALSE "\" - Don't force the "
+        "update" CRLF CRLF
+    },
+#endif /* CBL_CMDS_UPDATE_ACT_H */
+#ifdef CBL_CMDS_UPDATE_NEW_H
+    {
+        TXT_CMD_UPDATE_NEW, CMD_UPDATE_NEW, cmd_update_new, req_update_new,
+        "- " TXT_CMD_UPDATE_NEW " | Updates new application" CRLF
+        "     " TXT_PAR_UP_NEW_COUNT " - Number of bytes to write, "
+        "without checksum." CRLF
+        "     " TXT_PAR_APP_TYPE " - Type of application coding" CRLF
+        "                \"" TXT_PAR_APP_TYPE_BIN "\" - Binary format "
+        "(.bin)" CRLF
+        "                \"" TXT_PAR_APP_TYPE_HEX "\" - Intel hex "
+        "format (.hex)" CRLF
+        "                \"" TXT_PAR_APP_TYPE_SREC "\" - Motorola S-record"
+        " format (.srec)" CRLF
+        "                \"" TXT_PAR_APP_TYPE_BIN_LZ4 "\" - LZ4 frame of "
+        "binary, decompressed while" CRLF
+        "                   received. Checksum is over decompressed "
+        "binary" CRLF
+        "     [" TXT_PAR_CKSUM "] - Checksum to use. If not"
+        " present, no checksum is assumed" CRLF
+        "             WARNING: Even if checksum is wrong data "
+        "will be written into flash memory!" CRLF
+        "                \"" TXT_CKSUM_SHA256 "\" - Best protection, "
+        "slowest" CRLF
+        "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
+        " uses inbuilt CRC32 hardware." CRLF
+        "                   Note: Any data length, also not divisible by 4"
+        CRLF
+        "                   Settings:" CRLF
+        "                            Polynomial: 0x4C11DB7 (Ethernet)" CRLF
+        "                            Init value: 0xFFFFFFFF" CRLF
+        "                                XORout: true" CRLF
+        "                                 RefIn: true" CRLF
+        "                                RefOut: true" CRLF
+        "                \"" TXT_CKSUM_NO "\" - No protection, fastest"
+        CRLF
+        "     [" TXT_PAR_FLASH_WRITE_WINDOW "] - Chunks host may have in "
+        "flight, same as for " TXT_CMD_FLASH_WRITE CRLF
+        "     [" TXT_PAR_FLASH_WRITE_FRAME "] - Framed chunks, same as for "
+        TXT_CMD_FLASH_WRITE CRLF
+        "     [" TXT_PAR_UP_NEW_DECODE "] - \"" TXT_PAR_TRUE "\" decodes "
+        TXT_PAR_APP_TYPE_HEX " or " TXT_PAR_APP_TYPE_SREC " while "
+        "receiving," CRLF
+        "             new application is stored as binary. "
+        "Default \"" TXT_PAR_FALSE "\"" CRLF
+        "     [" TXT_PAR_UP_NEW_ID "] - Image ID in hex, kept with "
+        "checkpoints. Default 0" CRLF
+        "     [" TXT_PAR_UP_NEW_RESUME "] - \"" TXT_PAR_TRUE "\" continues "
+        "interrupted transfer of the same" CRLF
+        "             image from the last checkpoint. Default \""
+        TXT_PAR_FALSE "\"" CRLF
+        "     Only sectors the application reaches are erased, just before "
+        "they are" CRLF
+        "     written. Blank sectors are not erased" CRLF CRLF
+    },
+#endif /* CBL_CMDS_UPDATE_NEW_H */
+#ifdef CBL_CMDS_BINARY_H
+    {
+        TXT_CMD_BINARY, CMD_BINARY, cmd_binary, NULL,
+        "- " TXT_CMD_BINARY_HELP " | Enters binary framed mode, meant "
+        "for programming jigs. Frame layout is in README.md" CRLF CRLF
+    },
+#endif /* CBL_CMDS_BINARY_H */
+#ifdef CBL_CMDS_TEMPLATE_H
+    {
+        /* Add a description of newly added command */
+        TXT_CMD_TEMPLATE, CMD_TEMPLATE, cmd_template, req_template,
+        "- " TXT_CMD_TEMPLATE
+        " | Explanation of function" CRLF
+        "     "
+        TXT_PAR_TEMPLATE_PARAM1
+        " - Example param, valid value is: "
+        TXT_PAR_TEMPLATE_VAL1
+        CRLF CRLF
+    },
+#endif /* CBL_CMDS_TEMPLATE_H */
+#ifdef CBL_CMDS_ETC_H
+    {
+        TXT_CMD_CID, CMD_CID, cmd_cid, NULL,
+        "- " TXT_CMD_CID " | Gets chip identification number" CRLF CRLF
+    },
+    {
+        TXT_CMD_EXIT, CMD_EXIT, cmd_exit, NULL,
+        "- "TXT_CMD_EXIT " | Exits the bootloader and starts the user "
+        "application" CRLF CRLF
+    },
+    {
+        TXT_CMD_FAST_BOOT, CMD_FAST_BOOT, cmd_fast_boot, NULL,
+        "- " TXT_CMD_FAST_BOOT " | Gets fast boot state. On next resets "
+        "shell is skipped," CRLF
+        "             application is checked and started. Blue button "
+        "requests the shell" CRLF
+        "     " TXT_PAR_FAST_BOOT_EN " - \"" TXT_PAR_TRUE "\" or \""
+        TXT_PAR_FALSE "\", optional" CRLF CRLF
+    },
+    {
+        TXT_CMD_CKSUM_BENCH, CMD_CKSUM_BENCH, cmd_cksum_bench, req_cksum_bench,
+        "- " TXT_CMD_CKSUM_BENCH " | Measures cycles a checksum takes "
+        "over active application" CRLF
+        "     " TXT_PAR_CKSUM " - \"" TXT_CKSUM_CRC "\" or \""
+        TXT_CKSUM_SHA256 "\"" CRLF
+        "     " TXT_PAR_CKSUM_BENCH_COUNT " - Optional, bytes in decimal"
+        CRLF CRLF
+    },
+#if 1 == USE_PERF
+    {
+        TXT_CMD_PERF, CMD_PERF, cmd_perf, NULL,
+        "- " TXT_CMD_PERF " | Gets count, total, min and max cycles of "
+        "update phases" CRLF
+        "     " TXT_PAR_PERF_RESET " - Optional word, \""
+        TXT_CMD_PERF " " TXT_PAR_PERF_RESET "\" clears them" CRLF CRLF
+    },
+#endif /* USE_PERF */
+    {
+        TXT_CMD_SET_BAUD, CMD_SET_BAUD, cmd_set_baud, req_set_baud,
+        "- " TXT_CMD_SET_BAUD " | Switches UART to another baud rate, "
+        "host confirms it" CRLF
+        "     " TXT_PAR_SET_BAUD_RATE " - New baud rate in decimal" CRLF
+        "     After response host switches too and sends \""
+        TXT_SET_BAUD_PROBE "\" within" CRLF
+        "     SET_BAUD_TIMEOUT_MS, else previous rate is used again" CRLF
+        CRLF
+    },
+    {
+        TXT_CMD_MEM_STATS, CMD_MEM_STATS, cmd_mem_stats, NULL,
+        "- " TXT_CMD_MEM_STATS " | Gets size, use and peak use of memory "
+        "arena and of the stack" CRLF CRLF
+    },
+#endif /* CBL_CMDS_ETC_H */
+};
+
+static uint8_t cmd_hash_idx[CMD_HASH_SZ]; /*!< Indexes of cmd_table by hash */
+static bool is_cmd_hash_init = false;
+
+/** Step of the batch which doesn't return, summary is sent when it
+ * flushes the link, after its checks passed */
+static const batch_step_t * p_batch_steps = NULL;
+static uint32_t batch_n_steps = 0;
+static uint32_t batch_n_done = 0;
+/** Sink of the link when the batch started, the batch sink passes to it */
+static const link_sink_t * p_batch_prev_sink = NULL;
+
+static const link_sink_t batch_sink =
+{
+    .send = batch_sink_send,
+    .flush = batch_sink_flush,
+};
 
 // \f - new page
 
@@ -105,13 +497,56 @@ void CBL_periph_init(void)
  * @brief   Gives control to the bootloader system. Bootloader system waits for
  *          a command from the host and blocks the thread until exit is
  *          requested or unrecoverable error happens.
+ *
+ * @note    With fast boot on, shell is skipped and active application is
+ *          started right after its check. Blue button then requests the
+ *          shell, and the shell is started when the check fails.
  */
 void CBL_run_system ()
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
+    bool is_silent = false;
+
+    /* Left running, user application can read bootloader time from it */
+    perf_timer_start();
+
+    /* Stack is nearly empty, mem-stats finds its peak from the paint */
+    mem_stack_paint();
+
     INFO("Custom bootloader started\r\n");
 
-    if (hal_blue_btn_state_get() == true)
+#if 1 == USE_AB_SLOTS
+    /* Counts boots of switched application, can roll back */
+    ab_boot_check();
+#endif /* USE_AB_SLOTS */
+
+    if (true == fast_boot_is_on())
+    {
+        if (hal_blue_btn_state_get() == true)
+        {
+            INFO("Blue button pressed, shell requested...\r\n");
+            eCode = run_shell_system();
+        }
+        else
+        {
+            eCode = fast_boot_verify();
+
+            if (CBL_ERR_OK == eCode)
+            {
+                is_silent = true;
+            }
+            else
+            {
+                const char msg[] = "\r\nWARNING: Fast boot check failed, "
+                        "starting the shell\r\n";
+
+                WARNING("Fast boot check failed, ErrCode=%d\r\n", eCode);
+                link_send(msg, strlen(msg));
+                eCode = run_shell_system();
+            }
+        }
+    }
+    else if (hal_blue_btn_state_get() == true)
     {
         INFO("Blue button pressed...\r\n");
     }
@@ -123,7 +558,35 @@ void CBL_run_system ()
 
     ASSERT(CBL_ERR_OK == eCode, "ErrCode=%d:Restart the application.\r\n",
             eCode);
-    go_to_user_app();
+
+#if 1 == USE_SECURE_BOOT
+    /* Every way to the application passes here, shell runs until it is
+     * replaced with a signed one */
+    eCode = secure_boot_check();
+    while (CBL_ERR_OK != eCode)
+    {
+        const char msg[] = "\r\nWARNING: Secure boot check failed, "
+                "starting the shell\r\n";
+
+        WARNING("Secure boot check failed, ErrCode=%d\r\n", eCode);
+        link_send(msg, strlen(msg));
+        is_silent = false;
+
+        eCode = run_shell_system();
+        ASSERT(CBL_ERR_OK == eCode, "ErrCode=%d:Restart the application.\r\n",
+                eCode);
+
+        eCode = secure_boot_check();
+    }
+#endif /* USE_SECURE_BOOT */
+
+    if (true == is_silent)
+    {
+        /* Measured before the boot record is written */
+        fast_boot_cycles_store();
+    }
+
+    go_to_user_app(is_silent);
     ERROR("Switching to user application failed\r\n");
 }
 
@@ -144,16 +607,40 @@ void CBL_run_system ()
 cbl_err_code_t CBL_process_cmd (char * cmd, size_t len)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    cmd_t cmdCode = CMD_UNDEF;
+    const cmd_entry_t * p_cmd = NULL;
+    parser_t parser = { 0 };
+
+    eCode = parser_run(cmd, len, &parser);
+    ERR_CHECK(eCode);
+
+    eCode = enum_cmd(parser.cmd, strlen(parser.cmd), &p_cmd);
+    ERR_CHECK(eCode);
+
+    eCode = handle_cmd(p_cmd, &parser, false);
+    return eCode;
+}
+
+/**
+ * @brief Handles command like CBL_process_cmd, but success isn't responded
+ *        and errors are only returned. Binary protocol runs commands with it
+ *        and answers with status of its own
+ *
+ * @param cmd[in] Command to process, changed by parser
+ * @param len[in] length of cmd
+ */
+cbl_err_code_t CBL_run_cmd (char * cmd, size_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    const cmd_entry_t * p_cmd = NULL;
     parser_t parser = { 0 };
 
     eCode = parser_run(cmd, len, &parser);
     ERR_CHECK(eCode);
 
-    eCode = enum_cmd(parser.cmd, strlen(parser.cmd), &cmdCode);
+    eCode = enum_cmd(parser.cmd, strlen(parser.cmd), &p_cmd);
     ERR_CHECK(eCode);
 
-    eCode = handle_cmd(cmdCode, &parser);
+    eCode = handle_cmd(p_cmd, &parser, true);
     return eCode;
 }
 
@@ -180,9 +667,14 @@ static void shell_init (void)
     "          If confused type \"help\"          " CRLF
     "*********************************************" CRLF;
 
-    hal_send_to_host(bufWelcome, strlen(bufWelcome));
+    /* Host is on USB if it enumerated the device, else on UART */
+    link_init();
+    INFO("Link: %s\r\n", link_get()->name);
 
-    UNUSED( &hal_recv_from_host_stop);
+    link_send(bufWelcome, strlen(bufWelcome));
+
+    /* Start receiving, with receive ring bytes are kept from now on */
+    rx_init();
 
     /* Bootloader started turn on red LED */
     hal_led_on(LED_POWER_ON);
@@ -209,23 +701,34 @@ static void shell_init (void)
  *          #define VECT_TAB_OFFSET 0x8000.
  *          VECT_TAB_OFFSET is located in system_stm32f4xx.c
  *
+ * @param   is_silent Skips the hello message, used by fast boot where
+ *          nothing was received
+ *
  * @return  Procesor never returns from this application
  */
-static void go_to_user_app (void)
+static void go_to_user_app (bool is_silent)
 {
     void (*pUserAppResetHandler) (void);
     uint32_t addressRstHndl;
-    volatile uint32_t msp_value = *(volatile uint32_t *)CBL_ADDR_USERAPP;
+    uint32_t app_start = ab_act_start();
+    volatile uint32_t msp_value = *(volatile uint32_t *)app_start;
 
     char userAppHello[] = "Jumping to user application :)\r\n";
 
     /* Send hello message to user and debug output */
-    hal_send_to_host(userAppHello, strlen(userAppHello));
+    if (false == is_silent)
+    {
+        link_send(userAppHello, strlen(userAppHello));
+    }
     INFO("%s", userAppHello);
 
+    /* Queued responses are lost with the peripherals */
+    link_flush();
+    rx_deinit();
+
     hal_deinit();
 
-    addressRstHndl = *(volatile uint32_t *)(CBL_ADDR_USERAPP + 4u);
+    addressRstHndl = *(volatile uint32_t *)(app_start + 4u);
 
     pUserAppResetHandler = (void *)addressRstHndl;
 
@@ -236,7 +739,7 @@ static void go_to_user_app (void)
     DEBUG("Reset handler address: %#x\r\n", (unsigned int ) addressRstHndl);
 
     /* Reconfigure the vector table location */
-    hal_vtor_set(CBL_ADDR_USERAPP);
+    hal_vtor_set(app_start);
 
     hal_stop_systick();
 
@@ -317,7 +820,7 @@ static cbl_err_code_t run_shell_system (void)
                 char bye[] = "Exiting\r\n\r\n";
 
                 INFO(bye);
-                eCode = hal_send_to_host(bye, strlen(bye));
+                eCode = link_send(bye, strlen(bye));
                 ERR_CHECK(eCode);
 
                 isExitNeeded = true;
@@ -347,16 +850,28 @@ static cbl_err_code_t run_shell_system (void)
 static cbl_err_code_t sys_state_operation (void)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char cmd[CMD_BUF_SZ] = { 0 };
+    /* Everything the command takes from the arena is given back with it */
+    uint32_t mark = mem_mark();
+    char * cmd = mem_alloc(CMD_BUF_SZ);
+
+    if (NULL == cmd)
+    {
+        return CBL_ERR_NO_MEM;
+    }
+    memset(cmd, 0, CMD_BUF_SZ);
 
     hal_led_on(LED_READY);
     eCode = wait_for_cmd(cmd, CMD_BUF_SZ);
-    ERR_CHECK(eCode);
-    hal_led_off(LED_READY);
+    if (CBL_ERR_OK == eCode)
+    {
+        hal_led_off(LED_READY);
 
-    hal_led_on(LED_BUSY);
-    eCode = CBL_process_cmd(cmd, strlen(cmd));
-    hal_led_off(LED_BUSY);
+        hal_led_on(LED_BUSY);
+        eCode = CBL_process_cmd(cmd, strlen(cmd));
+        hal_led_off(LED_BUSY);
+    }
+
+    mem_release(mark);
     return eCode;
 }
 
@@ -366,6 +881,9 @@ static cbl_err_code_t sys_state_operation (void)
  *                  New command is considered received when CR LF is received
  *                  or buffer for command overflows
  *
+ * @note            With receive ring bytes after CR LF stay in the ring, so
+ *                  host can send commands back-to-back
+ *
  * @param buf[out]  Buffer for command
  *
  * @param len[in]   Length of buf
@@ -376,22 +894,19 @@ static cbl_err_code_t wait_for_cmd (char * buf, size_t len)
     bool isLastCharCR = false;
     bool isOverflow = true;
     uint32_t iii = 0u;
-    gRxCmdCntr = 0u;
 
-    eCode = hal_send_to_host("\r\n> ", 4);
+    eCode = link_send("\r\n> ", 4);
     ERR_CHECK(eCode);
 
-    /* Read until CRLF or until full DMA */
-    while (gRxCmdCntr < len)
+    /* Read until CRLF or until full buffer */
+    while (iii < len)
     {
-        /* Receive one char from host */
-        eCode = hal_recv_from_host_start((uint8_t *)buf + iii, 1);
+        /* Receive one char from host, with receive ring no DMA is re-armed */
+        eCode = rx_start((uint8_t *)buf + iii, 1);
         ERR_CHECK(eCode);
 
-        while (iii != (gRxCmdCntr - 1))
-        {
-            /* Wait for a new char */
-        }
+        /* Wait for a new char */
+        rx_wait();
 
         if (true == isLastCharCR)
         {
@@ -412,7 +927,7 @@ static cbl_err_code_t wait_for_cmd (char * buf, size_t len)
         /* Prepare for next char */
         iii++;
     }
-    /* If DMA fills the buffer and no CRLF is received throw an error */
+    /* If buffer fills and no CRLF is received throw an error */
     if (true == isOverflow)
     {
         eCode = CBL_ERR_READ_OF;
@@ -424,346 +939,206 @@ static cbl_err_code_t wait_for_cmd (char * buf, size_t len)
 
 // \f - new page
 /**
- * @brief               Enumerates the buf for command
+ * @brief   Fills the hash index with all commands from cmd_table, collisions
+ *          take the next free slot
+ */
+static void cmd_hash_init (void)
+{
+    memset(cmd_hash_idx, CMD_HASH_EMPTY, sizeof(cmd_hash_idx));
+
+    for (uint32_t iii = 0u; iii < CMD_TABLE_LEN; iii++)
+    {
+        uint32_t slot = str_hash(cmd_table[iii].name,
+                strlen(cmd_table[iii].name)) & (CMD_HASH_SZ - 1u);
+
+        while (CMD_HASH_EMPTY != cmd_hash_idx[slot])
+        {
+            slot = (slot + 1u) & (CMD_HASH_SZ - 1u);
+        }
+        cmd_hash_idx[slot] = (uint8_t)iii;
+    }
+
+    is_cmd_hash_init = true;
+}
+
+// \f - new page
+/**
+ * @brief               Enumerates the buf for command, finds it in cmd_table
+ *                      through the hash index
  *
  * @param buf[in]       Buffer for command
  *
  * @param len[in]       Length of buffer
  *
- * @param pCmdCode[out] Pointer to command code enum
+ * @param ppCmd[out]    Entry of the command in cmd_table
  *
  * @return              Error status
  */
-static cbl_err_code_t enum_cmd (char * buf, size_t len, cmd_t * pCmdCode)
+static cbl_err_code_t enum_cmd (char * buf, size_t len,
+        const cmd_entry_t ** ppCmd)
 {
-    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t slot;
 
     if (0u == len)
     {
-        eCode = CBL_ERR_CMD_SHORT;
-    }
-    else if (len == strlen(TXT_CMD_VERSION)
-            && strncmp(buf, TXT_CMD_VERSION, strlen(TXT_CMD_VERSION)) == 0)
-    {
-        *pCmdCode = CMD_VERSION;
-    }
-    else if (len == strlen(TXT_CMD_HELP)
-            && strncmp(buf, TXT_CMD_HELP, strlen(TXT_CMD_HELP)) == 0)
-    {
-        *pCmdCode = CMD_HELP;
-    }
-    else if (len == strlen(TXT_CMD_RESET)
-            && strncmp(buf, TXT_CMD_RESET, strlen(TXT_CMD_RESET)) == 0)
-    {
-        *pCmdCode = CMD_RESET;
-    }
-#ifdef CBL_CMDS_ETC_H
-    else if (len == strlen(TXT_CMD_CID)
-            && strncmp(buf, TXT_CMD_CID, strlen(TXT_CMD_CID)) == 0)
-    {
-        *pCmdCode = CMD_CID;
-    }
-    else if (len == strlen(TXT_CMD_EXIT)
-            && strncmp(buf, TXT_CMD_EXIT, strlen(TXT_CMD_EXIT)) == 0)
-    {
-        *pCmdCode = CMD_EXIT;
-    }
-#endif
-#ifdef CBL_CMDS_OPT_BYTES_H
-    else if (len == strlen(TXT_CMD_GET_RDP_LVL)
-            && strncmp(buf, TXT_CMD_GET_RDP_LVL, strlen(TXT_CMD_GET_RDP_LVL))
-                    == 0)
-    {
-        *pCmdCode = CMD_GET_RDP_LVL;
-    }
-    else if (len == strlen(TXT_CMD_EN_WRITE_PROT)
-            && strncmp(buf, TXT_CMD_EN_WRITE_PROT,
-                    strlen(TXT_CMD_EN_WRITE_PROT)) == 0)
-    {
-        *pCmdCode = CMD_EN_WRITE_PROT;
-    }
-    else if (len == strlen(TXT_CMD_DIS_WRITE_PROT)
-            && strncmp(buf, TXT_CMD_DIS_WRITE_PROT,
-                    strlen(TXT_CMD_DIS_WRITE_PROT)) == 0)
-    {
-        *pCmdCode = CMD_DIS_WRITE_PROT;
-    }
-    else if (len == strlen(TXT_CMD_READ_SECT_PROT_STAT)
-            && strncmp(buf, TXT_CMD_READ_SECT_PROT_STAT,
-                    strlen(TXT_CMD_READ_SECT_PROT_STAT)) == 0)
-    {
-        *pCmdCode = CMD_READ_SECT_PROT_STAT;
-    }
-#endif /* CBL_CMDS_OPT_BYTES_H */
-#ifdef CBL_CMDS_MEMORY_H
-    else if (len == strlen(TXT_CMD_JUMP_TO)
-            && strncmp(buf, TXT_CMD_JUMP_TO, strlen(TXT_CMD_JUMP_TO)) == 0)
-    {
-        *pCmdCode = CMD_JUMP_TO;
-    }
-    else if (len == strlen(TXT_CMD_FLASH_ERASE)
-            && strncmp(buf, TXT_CMD_FLASH_ERASE, strlen(TXT_CMD_FLASH_ERASE))
-                    == 0)
-    {
-        *pCmdCode = CMD_FLASH_ERASE;
+        return CBL_ERR_CMD_SHORT;
     }
 
-    else if (len == strlen(TXT_CMD_MEM_READ)
-            && strncmp(buf, TXT_CMD_MEM_READ, strlen(TXT_CMD_MEM_READ)) == 0)
+    if (false == is_cmd_hash_init)
     {
-        *pCmdCode = CMD_MEM_READ;
+        cmd_hash_init();
     }
-    else if (len == strlen(TXT_CMD_FLASH_WRITE)
-            && strncmp(buf, TXT_CMD_FLASH_WRITE, strlen(TXT_CMD_FLASH_WRITE))
-                    == 0)
-    {
-        *pCmdCode = CMD_FLASH_WRITE;
-    }
-#endif /* CBL_CMDS_MEMORY_H */
-#ifdef CBL_CMDS_UPDATE_NEW_H
-    else if (len == strlen(TXT_CMD_UPDATE_NEW)
-            && strncmp(buf, TXT_CMD_UPDATE_NEW, strlen(TXT_CMD_UPDATE_NEW))
-                    == 0)
-    {
-        *pCmdCode = CMD_UPDATE_NEW;
-    }
-#endif /* CBL_CMDS_UPDATE_NEW_H */
-#ifdef CBL_CMDS_UPDATE_ACT_H
-    else if (len == strlen(TXT_CMD_UPDATE_ACT)
-            && strncmp(buf, TXT_CMD_UPDATE_ACT, strlen(TXT_CMD_UPDATE_ACT))
-                    == 0)
+
+    slot = str_hash(buf, len) & (CMD_HASH_SZ - 1u);
+
+    /* Empty slot ends the run of colliding commands */
+    while (CMD_HASH_EMPTY != cmd_hash_idx[slot])
     {
-        *pCmdCode = CMD_UPDATE_ACT;
+        const cmd_entry_t * p_cmd = &cmd_table[cmd_hash_idx[slot]];
+
+        if (len == strlen(p_cmd->name) && strncmp(buf, p_cmd->name, len) == 0)
+        {
+            *ppCmd = p_cmd;
+            return CBL_ERR_OK;
+        }
+        slot = (slot + 1u) & (CMD_HASH_SZ - 1u);
     }
-#endif /* CBL_CMDS_UPDATE_ACT_H */
-#ifdef CBL_CMDS_TEMPLATE_H
-    /* Add a new enum value in cmd_t and check for it here */
-    else if (len == strlen(TXT_CMD_TEMPLATE)
-            && strncmp(buf, TXT_CMD_TEMPLATE, strlen(TXT_CMD_TEMPLATE)) == 0)
+
+    return CBL_ERR_CMD_UNDEF;
+}
+
+/**
+ * @brief           Gets name of the command, binary protocol uses it for its
+ *                  codes
+ *
+ * @param code[in]  Code of the command
+ *
+ * @return          Name as typed in the shell, NULL if command isn't compiled
+ *                  in
+ */
+const char * CBL_cmd_name (cmd_t code)
+{
+    for (uint32_t iii = 0u; iii < CMD_TABLE_LEN; iii++)
     {
-        *pCmdCode = CMD_TEMPLATE;
+        if (code == cmd_table[iii].code)
+        {
+            return cmd_table[iii].name;
+        }
     }
-#endif /* CBL_CMDS_TEMPLATE_H */
-    else
+
+    return NULL;
+}
+
+// \f - new page
+/**
+ * @brief               Checks required parameters and calls handler of the
+ *                      command
+ *
+ * @param p_cmd[in]     Entry of the command in cmd_table
+ *
+ * @param phPrsr[in]    Handle of the parser containing parameters
+ *
+ * @param is_quiet[in]  Success isn't responded, batch responds once for all
+ */
+static cbl_err_code_t handle_cmd (const cmd_entry_t * p_cmd, parser_t * phPrsr,
+        bool is_quiet)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (NULL != p_cmd->req_params)
     {
-        *pCmdCode = CMD_UNDEF;
+        for (const char * const * pp_par = p_cmd->req_params; NULL != *pp_par;
+                pp_par++)
+        {
+            if (NULL == parser_get_arg(phPrsr, *pp_par, strlen(*pp_par)))
+            {
+                return CBL_ERR_NEED_PARAM;
+            }
+        }
     }
 
-    if (CBL_ERR_OK == eCode && CMD_UNDEF == *pCmdCode)
+    eCode = p_cmd->handler(phPrsr);
+
+    if (eCode == CBL_ERR_OK && false == is_quiet)
     {
-        eCode = CBL_ERR_CMD_UNDEF;
+        /* Send success response */
+        eCode = link_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
     }
 
+    DEBUG("Responded\r\n");
     return eCode;
 }
 
 // \f - new page
 /**
- * @brief               Handler for all defined commands
- *
- * @param cmdCode[in]   Enumerator for the commands
+ * @brief           Handler for all errors
  *
- * @param phPrsr[in]    Handle of the parser containing parameters
+ * @param eCode[in] Error code that happened
  */
-static cbl_err_code_t handle_cmd (cmd_t cmdCode, parser_t * phPrsr)
+static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 {
-    cbl_err_code_t eCode = CBL_ERR_OK;
+    DEBUG("Started\r\n");
+
+    /* Turn off all LEDs except red */
+    hal_led_off(LED_MEMORY);
+    hal_led_off(LED_READY);
+    hal_led_off(LED_BUSY);
 
-    switch (cmdCode)
+    switch (eCode)
     {
-        case CMD_VERSION:
+        case CBL_ERR_OK:
+            /* FALSE ALARM - no error */
+        break;
+
+        case CBL_ERR_READ_OF:
         {
-            eCode = cmd_version(phPrsr);
+            const char msg[] = "\r\nERROR: Command too long\r\n";
+            WARNING("Overflow while reading happened\r\n");
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
         }
         break;
 
-        case CMD_HELP:
+        case CBL_ERR_WRITE:
         {
-            eCode = cmd_help(phPrsr);
+            WARNING("Error occurred while writing\r\n");
+            eCode = CBL_ERR_OK;
         }
         break;
 
-        case CMD_RESET:
+        case CBL_ERR_STATE:
         {
-            eCode = cmd_reset(phPrsr);
+            WARNING("System entered unknown state, "
+                    "returning to operational\r\n");
+            eCode = CBL_ERR_OK;
         }
         break;
 
-#ifdef CBL_CMDS_OPT_BYTES_H
-        case CMD_GET_RDP_LVL:
+        case CBL_ERR_HAL_TX:
         {
-            eCode = cmd_get_rdp_lvl(phPrsr);
+            WARNING("HAL transmit error happened\r\n");
+            eCode = CBL_ERR_OK;
         }
         break;
 
-        case CMD_EN_WRITE_PROT:
+        case CBL_ERR_HAL_RX:
         {
-            eCode = cmd_change_write_prot(phPrsr, true);
+            WARNING("HAL receive error happened\r\n");
+            eCode = CBL_ERR_OK;
         }
         break;
 
-        case CMD_DIS_WRITE_PROT:
+        case CBL_ERR_RX_ABORT:
         {
-            eCode = cmd_change_write_prot(phPrsr, false);
+            WARNING("Error happened while aborting receive\r\n");
+            eCode = CBL_ERR_OK;
         }
         break;
 
-        case CMD_READ_SECT_PROT_STAT:
+        case CBL_ERR_CMD_SHORT:
         {
-            eCode = cmd_get_write_prot(phPrsr);
-        }
-        break;
-#endif /* CBL_CMDS_OPT_BYTES_H */
-#ifdef CBL_CMDS_MEMORY_H
-        case CMD_JUMP_TO:
-        {
-            eCode = cmd_jump_to(phPrsr);
-        }
-        break;
-
-        case CMD_FLASH_ERASE:
-        {
-            eCode = cmd_flash_erase(phPrsr);
-        }
-        break;
-
-        case CMD_MEM_READ:
-        {
-            eCode = cmd_mem_read(phPrsr);
-        }
-        break;
-
-        case CMD_FLASH_WRITE:
-        {
-            eCode = cmd_flash_write(phPrsr);
-        }
-        break;
-#endif /* CBL_CMDS_MEMORY_H */
-#ifdef CBL_CMDS_UPDATE_NEW_H
-        case CMD_UPDATE_NEW:
-        {
-            eCode = cmd_update_new(phPrsr);
-        }
-        break;
-#endif /* CBL_CMDS_UPDATE_NEW_H */
-#ifdef CBL_CMDS_UPDATE_ACT_H
-        case CMD_UPDATE_ACT:
-        {
-            eCode = cmd_update_act(phPrsr);
-        }
-        break;
-#endif /* CBL_CMDS_UPDATE_ACT_H */
-#ifdef CBL_CMDS_ETC_H
-        case CMD_CID:
-        {
-            eCode = cmd_cid(phPrsr);
-        }
-        break;
-
-        case CMD_EXIT:
-        {
-            eCode = cmd_exit(phPrsr);
-        }
-        break;
-#endif /* CBL_CMDS_ETC_H */
-#ifdef CBL_CMDS_TEMPLATE_H
-            /* Add a new case for the enumerator and call function handler */
-            case CMD_TEMPLATE:
-            {
-                eCode = cmd_template(phPrsr);
-            }
-            break;
-#endif /* CBL_CMDS_TEMPLATE_H */
-
-        case CMD_UNDEF:
-            /* No break */
-        default:
-        {
-            eCode = CBL_ERR_CMDCD;
-        }
-        break;
-    }
-
-    if (eCode == CBL_ERR_OK)
-    {
-        /* Send success response */
-        eCode = hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
-    }
-
-    DEBUG("Responded\r\n");
-    return eCode;
-}
-
-// \f - new page
-/**
- * @brief           Handler for all errors
- *
- * @param eCode[in] Error code that happened
- */
-static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
-{
-    DEBUG("Started\r\n");
-
-    /* Turn off all LEDs except red */
-    hal_led_off(LED_MEMORY);
-    hal_led_off(LED_READY);
-    hal_led_off(LED_BUSY);
-
-    switch (eCode)
-    {
-        case CBL_ERR_OK:
-            /* FALSE ALARM - no error */
-        break;
-
-        case CBL_ERR_READ_OF:
-        {
-            const char msg[] = "\r\nERROR: Command too long\r\n";
-            WARNING("Overflow while reading happened\r\n");
-            hal_send_to_host(msg, strlen(msg));
-            eCode = CBL_ERR_OK;
-        }
-        break;
-
-        case CBL_ERR_WRITE:
-        {
-            WARNING("Error occurred while writing\r\n");
-            eCode = CBL_ERR_OK;
-        }
-        break;
-
-        case CBL_ERR_STATE:
-        {
-            WARNING("System entered unknown state, "
-                    "returning to operational\r\n");
-            eCode = CBL_ERR_OK;
-        }
-        break;
-
-        case CBL_ERR_HAL_TX:
-        {
-            WARNING("HAL transmit error happened\r\n");
-            eCode = CBL_ERR_OK;
-        }
-        break;
-
-        case CBL_ERR_HAL_RX:
-        {
-            WARNING("HAL receive error happened\r\n");
-            eCode = CBL_ERR_OK;
-        }
-        break;
-
-        case CBL_ERR_RX_ABORT:
-        {
-            WARNING("Error happened while aborting receive\r\n");
-            eCode = CBL_ERR_OK;
-        }
-        break;
-
-        case CBL_ERR_CMD_SHORT:
-        {
-            INFO("Client sent an empty command\r\n");
-            eCode = CBL_ERR_OK;
+            INFO("Client sent an empty command\r\n");
+            eCode = CBL_ERR_OK;
         }
         break;
 
@@ -771,7 +1146,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
         {
             const char msg[] = "\r\nERROR: Invalid command\r\n";
             INFO("Client sent an invalid command\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -780,7 +1155,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
         {
             const char msg[] = "\r\nERROR: Missing parameter(s)\r\n";
             INFO("Command is missing parameter(s)\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -792,7 +1167,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "BKPSRAM, SYSMEM and EXTMEM (if connected)\r\n";
 
             INFO("Invalid address inputed for jumping\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -803,7 +1178,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "\r\nERROR: Internal error while erasing sectors\r\n";
 
             WARNING("Error while erasing sectors\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -813,7 +1188,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Wrong sector given\r\n";
 
             INFO("Wrong sector given\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -823,7 +1198,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Wrong sector count given\r\n";
 
             INFO("Wrong sector count given\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -833,7 +1208,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid address range entered\r\n";
 
             INFO("Invalid address range entered for writing\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -843,7 +1218,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid length\r\n";
 
             INFO("User entered length 0 or too big\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -854,7 +1229,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     " Retry last message.\r\n";
 
             INFO("Error while writing to flash on HAL level\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -864,7 +1239,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid erase type\r\n";
 
             INFO("User entered invalid erase type\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -874,7 +1249,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: HAL error while erasing sectors \r\n";
 
             INFO("HAL error while erasing sector\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -884,7 +1259,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Unlocking flash failed\r\n";
 
             WARNING("Unlocking flash with HAL failed\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -902,7 +1277,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "\r\nERROR: Number parameter contains letters\r\n";
 
             WARNING("User entered number parameter containing letters\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -915,7 +1290,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("User entered number parameter with 'x', "
                     "but not '0' on index 0\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -926,7 +1301,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     " (Invalid checksum). Retry last message.\r\n";
 
             WARNING("Data corrupted during transport, invalid checksum\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -936,7 +1311,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Value for parameter invalid...\r\n";
 
             WARNING("User entered wrong param. value in template function\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -946,7 +1321,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Requested checksum not supported\r\n";
 
             WARNING("User requested checksum not supported\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -957,7 +1332,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "divisible by 4 \r\n";
 
             WARNING("User entered invalid length for CRC32\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -967,7 +1342,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid length for sha256\r\n";
 
             WARNING("User entered invalid length for sha256\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -978,7 +1353,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("New user application is too long"
                     "to for updating\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -989,7 +1364,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "\r\nERROR: Requested action is not implemented\r\n";
 
             WARNING("Requested action is not implemented\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -999,7 +1374,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid user application type\r\n";
 
             WARNING("Invalid user application type\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1011,7 +1386,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("NULL sent as a parameter of a function\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1022,7 +1397,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid force parameter\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1033,7 +1408,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid S-record file\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1044,7 +1419,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid S-record function\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1055,7 +1430,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid hex value character\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1066,7 +1441,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Tried accessing forbidden address\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1077,7 +1452,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Unsupported Intel hex function\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1088,7 +1463,206 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid contents of intel hex\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_INV_WINDOW:
+        {
+            const char msg[] = "\r\nERROR: Invalid window size\r\n";
+
+            WARNING("Invalid number of chunks in flight requested\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_PAR_BOOL:
+        {
+            const char msg[] = "\r\nERROR: Boolean parameter must be "
+                    "\"true\" or \"false\"\r\n";
+
+            WARNING("Invalid boolean parameter\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_FRAME_NAKS:
+        {
+            const char msg[] = "\r\nERROR: Too many corrupted chunks. "
+                    "Aborting\r\n";
+
+            WARNING("Too many chunks rejected in framed transfer\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_APP_LEN_UNKNOWN:
+        {
+            const char msg[] = "\r\nERROR: Length of active application is "
+                    "unknown. Update it first\r\n";
+
+            WARNING("Active application length unknown\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_FAST_BOOT:
+        {
+            const char msg[] = "\r\nERROR: Active application has invalid "
+                    "stack pointer or reset handler\r\n";
+
+            WARNING("Active application failed fast boot check\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_CRC_DMA:
+        {
+            const char msg[] = "\r\nERROR: DMA to CRC unit failed\r\n";
+
+            WARNING("HAL failed to start DMA to CRC unit\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_INV_LZ4:
+        {
+            const char msg[] = "\r\nERROR: Invalid LZ4 frame\r\n";
+
+            WARNING("Invalid or truncated LZ4 frame\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_NO_RESUME:
+        {
+            const char msg[] = "\r\nERROR: No interrupted transfer to "
+                    "resume\r\n";
+
+            WARNING("No interrupted transfer matches the resumed one\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_RX_TIMEOUT:
+        {
+            const char msg[] = "\r\nERROR: Timeout while receiving\r\n";
+
+            WARNING("Host didn't send the bytes in time\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_BAUD:
+        {
+            const char msg[] = "\r\nERROR: New baud rate not confirmed, "
+                    "previous is kept\r\n";
+
+            WARNING("Host didn't confirm new baud rate\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_NO_MEM:
+        {
+            const char msg[] = "\r\nERROR: Out of memory\r\n";
+
+            WARNING("Memory arena is full\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_VERIFY:
+        {
+            const char msg[] = "\r\nERROR: Flash doesn't match written "
+                    "data\r\n";
+
+            WARNING("Read back of written flash failed\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_BATCH:
+        {
+            const char msg[] = "\r\nERROR: Invalid batch script\r\n";
+
+            WARNING("Batch script is empty, too long, or has a batch\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_SIG:
+        {
+            const char msg[] = "\r\nERROR: Signature of active application "
+                    "is invalid\r\n";
+
+            WARNING("Secure boot check failed\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_OPT_BYTES:
+        {
+            const char msg[] = "\r\nERROR: Option bytes refused, read "
+                    "protection level 2 or lowering it, write protection mask "
+                    "above sector 11 or brown-out level above 3\r\n";
+
+            WARNING("Option bytes change refused\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_REC_CKSUM:
+        {
+            const char msg[] = "\r\nERROR: Checksum of hex or srec record "
+                    "is wrong\r\n";
+
+            WARNING("Checksum of a record is wrong\r\n");
+
+            link_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_BAUD_RANGE:
+        {
+            const char msg[] = "\r\nERROR: Baud rate not supported, "
+                    "allowed 9600 to 5250000\r\n";
+
+            WARNING("Host requested unsupported baud rate\r\n");
+
+            link_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1123,19 +1697,19 @@ static cbl_err_code_t cmd_version (parser_t * phPrsr)
     strlcat(verbuf, CRLF, 12);
 
     /* Send response */
-    eCode = hal_send_to_host(verbuf, strlen(verbuf));
+    eCode = link_send(verbuf, strlen(verbuf));
 
     return eCode;
 }
 
 // \f - new page
 /**
- * @brief Returns string to the host of all commands
+ * @brief Returns string to the host of all commands in cmd_table
  */
 static cbl_err_code_t cmd_help (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    const char helpPrintout[] =
+    const char helpHeader[] =
             "*************************************************************" CRLF
             "*************************************************************" CRLF
             "Custom STM32F4 bootloader shell by Dino Saric - " CBL_VERSION "***"
@@ -1146,163 +1720,314 @@ static cbl_err_code_t cmd_help (parser_t * phPrsr)
             "Commands*****************************************************" CRLF
             "*************************************************************" CRLF
             CRLF
-            "Optional parameters are surrounded with [] " CRLF CRLF
-            "- " TXT_CMD_VERSION " | Gets the current version of the running "
-            "bootloader" CRLF CRLF
-            "- " TXT_CMD_HELP " | Makes life easier" CRLF CRLF
-            "- " TXT_CMD_RESET " | Resets the microcontroller" CRLF CRLF
-#ifdef CBL_CMDS_OPT_BYTES_H
-            "- "
-            TXT_CMD_GET_RDP_LVL
-            " |  Read protection. Used to protect the"
-            " software code stored in Flash memory."
-            " Ref. man. p. 93" CRLF CRLF
-            "- "
-            TXT_CMD_EN_WRITE_PROT
-            " | Enables write protection per sector,"
-            " as selected with \""
-            TXT_PAR_EN_WRITE_PROT_MASK
-            "\"." CRLF
-            "     "
-            TXT_PAR_EN_WRITE_PROT_MASK
-            " - Mask in hex form for sectors"
-            " where LSB corresponds to sector 0." CRLF CRLF
-            "- "
-            TXT_CMD_DIS_WRITE_PROT
-            " | Disables write protection per "
-            "sector, as selected with \""
-            TXT_PAR_EN_WRITE_PROT_MASK
-            "\"." CRLF
-            "     "
-            TXT_PAR_EN_WRITE_PROT_MASK
-            " - Mask in hex form for sectors"
-            " where LSB corresponds to sector 0." CRLF CRLF
-            "- "
-            TXT_CMD_READ_SECT_PROT_STAT
-            " | Returns bit array of sector "
-            "write protection. LSB corresponds to sector 0. " CRLF CRLF
-#endif /* CBL_CMDS_OPT_BYTES_H */
-#ifdef CBL_CMDS_MEMORY_H
-            "- " TXT_CMD_JUMP_TO
-            " | Jumps to a requested address" CRLF
-            "    " TXT_PAR_JUMP_TO_ADDR " - Address to jump to in hex format "
-            "(e.g. 0x12345678), 0x can be omitted. " CRLF CRLF
-            "- " TXT_CMD_FLASH_ERASE
-            " | Erases flash memory" CRLF "    " TXT_PAR_FLASH_ERASE_TYPE
-            " - Defines type of flash erase." CRLF
-            "          \"" TXT_PAR_FLASH_ERASE_TYPE_MASS "\" - erases all "
-            "sectors" CRLF
-            "          \"" TXT_PAR_FLASH_ERASE_TYPE_SECT "\" - erases only "
-            "selected sectors" CRLF
-            "    " TXT_PAR_FLASH_ERASE_SECT " - First sector to erase. "
-            "Bootloader is on sectors 0, 1 and 2. Not needed with mass erase."
-            CRLF "    " TXT_PAR_FLASH_ERASE_COUNT
-            " - Number of sectors to erase. Not needed with mass erase." CRLF
-            CRLF "- " TXT_CMD_FLASH_WRITE " | Writes to flash byte by byte. "
-            "Splits data into chunks" CRLF
-            "     " TXT_PAR_FLASH_WRITE_START " - Starting address in hex "
-            "format (e.g. 0x12345678), 0x can be omitted."CRLF
-            "     " TXT_PAR_FLASH_WRITE_COUNT " - Number of bytes to write, "
-            "without checksum. Chunk size: " TXT_FLASH_WRITE_SZ CRLF
-            "     [" TXT_PAR_CKSUM "] - Checksum to use. If not"
-            " present, no checksum is assumed" CRLF
-            "             WARNING: Even if checksum is wrong data "
-            "will be written into flash memory!" CRLF
-            "                \"" TXT_CKSUM_SHA256 "\" - Best protection, "
-            "slowest" CRLF
-            "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
-            " uses inbuilt CRC32 hardware." CRLF
-            "                   Note: Data length must be divisible by 4! " CRLF
-            "                   Settings:" CRLF
-            "                            Polynomial: 0x4C11DB7 (Ethernet)" CRLF
-            "                            Init value: 0xFFFFFFFF" CRLF
-            "                                XORout: true" CRLF
-            "                                 RefIn: true" CRLF
-            "                                RefOut: true" CRLF
-            "                \"" TXT_CKSUM_NO "\" - No protection, fastest"
-            CRLF CRLF
-            "- " TXT_CMD_MEM_READ
-            " | Read bytes from memory" CRLF
-            "     "
-            TXT_PAR_FLASH_WRITE_START
-            " - Starting address in hex "
-            "format (e.g. 0x12345678), 0x can be omitted."CRLF
-            "     "
-            TXT_PAR_FLASH_WRITE_COUNT
-            " - Number of bytes to read."
-            CRLF CRLF
-#endif /* CBL_CMDS_MEMORY_H */
-#ifdef CBL_CMDS_UPDATE_ACT_H
-            "- " TXT_CMD_UPDATE_ACT " | Updates active application from new "
-            "application memory area" CRLF
-            "     [" TXT_PAR_UP_ACT_FORCE "] - Forces update even if not "
-            "needed" CRLF
-            "                \"" TXT_PAR_UP_ACT_TRUE "\" - Force the "
-            "update" CRLF
-            "                \"" TXT_PAR_UP_ACT_FALSE "\" - Don't force the "
-            "update" CRLF CRLF
-#endif /* CBL_CMDS_UPDATE_ACT_H */
-#ifdef CBL_CMDS_UPDATE_NEW_H
-            "- " TXT_CMD_UPDATE_NEW " | Updates new application" CRLF
-            "     " TXT_PAR_UP_NEW_COUNT " - Number of bytes to write, "
-            "without checksum." CRLF
-            "     " TXT_PAR_APP_TYPE " - Type of application coding" CRLF
-            "                \"" TXT_PAR_APP_TYPE_BIN "\" - Binary format "
-            "(.bin)" CRLF
-            "                \"" TXT_PAR_APP_TYPE_HEX "\" - Intel hex "
-            "format (.hex)" CRLF
-            "                \"" TXT_PAR_APP_TYPE_SREC "\" - Motorola S-record"
-            " format (.srec)" CRLF
-            "     [" TXT_PAR_CKSUM "] - Checksum to use. If not"
-            " present, no checksum is assumed" CRLF
-            "             WARNING: Even if checksum is wrong data "
-            "will be written into flash memory!" CRLF
-            "                \"" TXT_CKSUM_SHA256 "\" - Best protection, "
-            "slowest" CRLF
-            "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
-            " uses inbuilt CRC32 hardware." CRLF
-            "                   Note: Data length must be divisible by 4! " CRLF
-            "                   Settings:" CRLF
-            "                            Polynomial: 0x4C11DB7 (Ethernet)" CRLF
-            "                            Init value: 0xFFFFFFFF" CRLF
-            "                                XORout: true" CRLF
-            "                                 RefIn: true" CRLF
-            "                                RefOut: true" CRLF
-            "                \"" TXT_CKSUM_NO "\" - No protection, fastest"
-            CRLF CRLF
-#endif /* CBL_CMDS_UPDATE_NEW_H */
-#ifdef CBL_CMDS_TEMPLATE_H
-            /* Add a description of newly added command */
-            TXT_CMD_TEMPLATE
-            " | Explanation of function" CRLF
-            "     "
-            TXT_PAR_TEMPLATE_PARAM1
-            " - Example param, valid value is: "
-            TXT_PAR_TEMPLATE_VAL1
-            CRLF CRLF
-#endif /* CBL_CMDS_TEMPLATE_H */
-#ifdef CBL_CMDS_ETC_H
-            "- " TXT_CMD_CID " | Gets chip identification number" CRLF CRLF
-            "- "TXT_CMD_EXIT " | Exits the bootloader and starts the user "
-            "application" CRLF CRLF
-#endif /* CBL_CMDS_ETC_H */
+            "Optional parameters are surrounded with [] " CRLF CRLF;
+    const char helpFooter[] =
             "********************************************************" CRLF
             "Examples are contained in README.md" CRLF
             "********************************************************" CRLF;
     DEBUG("Started\r\n");
     /* Send response */
-    eCode = hal_send_to_host(helpPrintout, strlen(helpPrintout));
+    eCode = link_send(helpHeader, strlen(helpHeader));
+    ERR_CHECK(eCode);
+
+    for (uint32_t iii = 0u; iii < CMD_TABLE_LEN; iii++)
+    {
+        eCode = link_send(cmd_table[iii].help,
+                strlen(cmd_table[iii].help));
+        ERR_CHECK(eCode);
+    }
+
+    eCode = link_send(helpFooter, strlen(helpFooter));
 
     return eCode;
 }
 
 static cbl_err_code_t cmd_reset (parser_t * phPrsr)
 {
-    hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    link_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    link_flush();
 
     hal_system_restart();
 
     /* Never returns */
     return CBL_ERR_OK;
 }
+
+// \f - new page
+/**
+ * @brief   Runs commands of a script back-to-back, without prompts and
+ *          without their own "OK", and stops at the first error. Responses
+ *          of the commands themselves, e.g. chunk requests of flash-write,
+ *          are sent as usual. One summary with time of every step is sent
+ *          at the end.
+ *          Parameters from phPrsr:
+ *              - count - Length of the script in decimal
+ *              - start - Optional, address of the script in hex, e.g. in
+ *                a flash script area. Whole script has to pass
+ *                hal_verify_flash_address. If not given host sends the
+ *                script after "ready"
+ *
+ * @note    Batch ends after exit. reset and jump-to don't return, summary
+ *          is sent when they flush the link, after their checks passed. If
+ *          they fail the summary reports them as failed
+ */
+static cbl_err_code_t cmd_batch (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t len;
+    uint32_t start;
+    uint32_t n_steps = 0;
+    uint32_t n_done = 0;
+    char * script;
+    char * p_step;
+    batch_step_t * p_steps;
+    parser_t * ph_prsr;
+    const char ready[] = "\r\nready\r\n";
+
+    DEBUG("Started\r\n");
+
+    eCode = parser_get_u32(phPrsr, TXT_PAR_BATCH_COUNT, 10, &len);
+    ERR_CHECK(eCode);
+
+    if (0 == len || len > BATCH_MAX_LEN)
+    {
+        return CBL_ERR_INV_SZ;
+    }
+
+    /* Given back with the command line when batch ends. Parser of steps
+     * is here too, stack already holds the one of the batch */
+    script = mem_alloc(len + 1u);
+    p_steps = mem_alloc(BATCH_MAX_STEPS * sizeof(batch_step_t));
+    ph_prsr = mem_alloc(sizeof(parser_t));
+    if (NULL == script || NULL == p_steps || NULL == ph_prsr)
+    {
+        return CBL_ERR_NO_MEM;
+    }
+
+    eCode = parser_get_u32(phPrsr, TXT_PAR_BATCH_START, 16, &start);
+    if (CBL_ERR_OK == eCode)
+    {
+        if (len - 1 > UINT32_MAX - start)
+        {
+            return CBL_ERR_INV_SZ;
+        }
+
+        eCode = hal_verify_flash_address(start);
+        ERR_CHECK(eCode);
+
+        eCode = hal_verify_flash_address(start + len - 1);
+        ERR_CHECK(eCode);
+
+        /* Parser changes the script, it is copied out of flash */
+        memcpy(script, (const void *)start, len);
+    }
+    else if (CBL_ERR_NEED_PARAM == eCode)
+    {
+        eCode = rx_start((uint8_t *)script, len);
+        ERR_CHECK(eCode);
+
+        eCode = link_send(ready, strlen(ready));
+        ERR_CHECK(eCode);
+
+        rx_wait();
+        eCode = CBL_ERR_OK;
+    }
+    ERR_CHECK(eCode);
+    script[len] = '\0';
+
+    eCode = batch_split(script, len, &n_steps);
+    ERR_CHECK(eCode);
+
+    p_step = script;
+    while (n_done < n_steps)
+    {
+        const cmd_entry_t * p_cmd = NULL;
+        uint32_t step_len;
+        uint32_t started;
+        uint32_t mark;
+
+        /* Steps are separated by one or more '\0' */
+        while ('\0' == *p_step)
+        {
+            p_step++;
+        }
+        step_len = strlen(p_step);
+        p_steps[n_done].name = p_step;
+        p_steps[n_done].us = 0;
+
+        /* Every step gives back what it took, as a command of the shell */
+        mark = mem_mark();
+        started = perf_cycles();
+        memset(ph_prsr, 0, sizeof(parser_t));
+        eCode = parser_run(p_step, step_len, ph_prsr);
+        if (CBL_ERR_OK == eCode)
+        {
+            eCode = enum_cmd(ph_prsr->cmd, strlen(ph_prsr->cmd), &p_cmd);
+        }
+
+        if (CBL_ERR_OK == eCode
+                && (CMD_RESET == p_cmd->code || CMD_JUMP_TO == p_cmd->code))
+        {
+            /* Won't come back if it passes, this step is reported as
+             * started when it flushes the link */
+            p_batch_steps = p_steps;
+            batch_n_steps = n_steps;
+            batch_n_done = n_done + 1u;
+            p_batch_prev_sink = link_sink_set( &batch_sink);
+            eCode = handle_cmd(p_cmd, ph_prsr, true);
+            link_sink_set(p_batch_prev_sink);
+            p_batch_steps = NULL;
+        }
+        else if (CBL_ERR_OK == eCode)
+        {
+            eCode = handle_cmd(p_cmd, ph_prsr, true);
+        }
+        p_steps[n_done].us = (perf_cycles() - started)
+                / (PERF_CLK_HZ / 1000000u);
+        mem_release(mark);
+        n_done++;
+
+        if (CBL_ERR_OK != eCode || true == gIsExitReq)
+        {
+            /* Steps after exit don't run */
+            break;
+        }
+
+        p_step += step_len;
+    }
+
+    /* Error of the failed step follows the summary */
+    batch_summary(p_steps, n_steps, n_done, eCode);
+
+    return eCode;
+}
+
+/**
+ * @brief Ends every step of the script with '\0' and counts the steps.
+ *        Script may not have more than BATCH_MAX_STEPS steps, nor a batch
+ *
+ * @param script[in,out] Script, ends with '\0'
+ * @param len[in]        Length of the script
+ * @param p_n_steps[out] Number of steps
+ */
+static cbl_err_code_t batch_split (char * script, uint32_t len,
+        uint32_t * p_n_steps)
+{
+    uint32_t n_steps = 0;
+
+    for (uint32_t iii = 0; iii < len;)
+    {
+        uint32_t step_len = strcspn( &script[iii], BATCH_SEPARATORS);
+        uint32_t name_len = strcspn( &script[iii], " ");
+
+        if (0 != step_len)
+        {
+            if (BATCH_MAX_STEPS == n_steps)
+            {
+                return CBL_ERR_BATCH;
+            }
+
+            /* Nested batch would take the arena again */
+            if (ui32_min(step_len, name_len) == strlen(TXT_CMD_BATCH)
+                    && strncmp( &script[iii], TXT_CMD_BATCH,
+                            strlen(TXT_CMD_BATCH)) == 0)
+            {
+                return CBL_ERR_BATCH;
+            }
+            n_steps++;
+        }
+
+        iii += step_len;
+        if (iii < len)
+        {
+            script[iii] = '\0';
+            iii++;
+        }
+    }
+
+    *p_n_steps = n_steps;
+
+    return 0 == n_steps ? CBL_ERR_BATCH : CBL_ERR_OK;
+}
+
+/**
+ * @brief Sends summary of the batch, one line per step which ran
+ *
+ * @param p_steps[in]  Steps which ran
+ * @param n_steps[in]  Number of steps in the script
+ * @param n_done[in]   Number of steps which ran
+ * @param step_err[in] Error of the last step which ran
+ */
+static cbl_err_code_t batch_summary (const batch_step_t * p_steps,
+        uint32_t n_steps, uint32_t n_done, cbl_err_code_t step_err)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t total_us = 0;
+    char msg[64];
+
+    for (uint32_t iii = 0; iii < n_done; iii++)
+    {
+        total_us += p_steps[iii].us;
+    }
+
+    snprintf(msg, sizeof(msg), "\r\nbatch|steps:%lu|done:%lu|us:%lu\r\n",
+            n_steps, n_done, total_us);
+    eCode = link_send(msg, strlen(msg));
+    ERR_CHECK(eCode);
+
+    for (uint32_t iii = 0; iii < n_done; iii++)
+    {
+        bool is_failed = (iii + 1u == n_done && CBL_ERR_OK != step_err);
+
+        /* Parser ended the name of the command with '\0' */
+        snprintf(msg, sizeof(msg), "step:%lu|%.16s|%s|us:%lu\r\n", iii,
+                p_steps[iii].name, true == is_failed ? "ERROR" : "OK",
+                p_steps[iii].us);
+        eCode = link_send(msg, strlen(msg));
+        ERR_CHECK(eCode);
+    }
+
+    return eCode;
+}
+/**
+ * @brief Passes what the step of the batch sends to the sink of the link
+ *        when the batch started, or to the link if there was none
+ */
+static cbl_err_code_t batch_sink_send (const char * buf, size_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    const link_sink_t * p_own = link_sink_set(p_batch_prev_sink);
+
+    eCode = link_send(buf, len);
+    link_sink_set(p_own);
+
+    return eCode;
+}
+
+/**
+ * @brief Step flushes the link just before it leaves, e.g. reset or jump,
+ *        sends the summary of the batch first. Sent once, later flushes only
+ *        pass on
+ */
+static cbl_err_code_t batch_sink_flush (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    const link_sink_t * p_own;
+
+    if (NULL != p_batch_steps)
+    {
+        const batch_step_t * p_steps = p_batch_steps;
+
+        p_batch_steps = NULL;
+        eCode = batch_summary(p_steps, batch_n_steps, batch_n_done,
+                CBL_ERR_OK);
+        ERR_CHECK(eCode);
+    }
+
+    p_own = link_sink_set(p_batch_prev_sink);
+    eCode = link_flush();
+    link_sink_set(p_own);
+
+    return eCode;
+}
 /****END OF FILE****/
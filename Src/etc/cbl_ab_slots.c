@@ -0,0 +1,143 @@
+/** @file cbl_ab_slots.c
+ *
+ * @brief A/B application slots. New application is written to the slot which
+ *        doesn't run and update only switches the active slot in boot record
+ */
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_fast_boot.h"
+#include <string.h>
+
+#if 1 == USE_AB_SLOTS
+static uint32_t ab_slot_start (uint8_t slot);
+#endif /* USE_AB_SLOTS */
+
+/**
+ * @brief Returns start address of the active application
+ */
+uint32_t ab_act_start (void)
+{
+#if 1 == USE_AB_SLOTS
+    return ab_slot_start(boot_record_get()->act_slot);
+#else
+    return BOOT_ACT_APP_START;
+#endif /* USE_AB_SLOTS */
+}
+
+/**
+ * @brief Returns start address new application is written to
+ */
+uint32_t ab_new_start (void)
+{
+#if 1 == USE_AB_SLOTS
+    return ab_slot_start(AB_SLOT_B - boot_record_get()->act_slot);
+#else
+    return BOOT_NEW_APP_START;
+#endif /* USE_AB_SLOTS */
+}
+
+/**
+ * @brief Returns max length of new application
+ */
+uint32_t ab_new_max_len (void)
+{
+#if 1 == USE_AB_SLOTS
+    return AB_SLOT_MAX_LEN;
+#else
+    return BOOT_NEW_APP_MAX_LEN;
+#endif /* USE_AB_SLOTS */
+}
+
+#if 1 == USE_AB_SLOTS
+/**
+ * @brief Counts boots of application on trial. Confirmed application stays
+ *        active, one which didn't confirm in AB_MAX_TRIAL_BOOTS boots is
+ *        replaced by the one in the other slot. Called once on every reset
+ */
+void ab_boot_check (void)
+{
+    boot_record_t * p_boot_record = boot_record_get();
+
+    if (false == p_boot_record->is_trial)
+    {
+        return;
+    }
+
+    if (true == hal_app_confirm_get())
+    {
+        INFO("Application confirmed\r\n");
+        hal_app_confirm_clear();
+        p_boot_record->is_trial = false;
+    }
+    else if (p_boot_record->boot_attempts >= AB_MAX_TRIAL_BOOTS)
+    {
+        p_boot_record->is_trial = false;
+
+        if (0 == p_boot_record->prev_app.len)
+        {
+            WARNING("Application not confirmed, nothing to roll back to\r\n");
+        }
+        else
+        {
+            WARNING("Application not confirmed, rolling back\r\n");
+            p_boot_record->act_slot = AB_SLOT_B - p_boot_record->act_slot;
+            p_boot_record->act_app = p_boot_record->prev_app;
+            p_boot_record->act_app_crc = p_boot_record->prev_app_crc;
+            p_boot_record->fast_boot_cycles = 0;
+            p_boot_record->is_sig_ok = false;
+
+            /* Failed application is still there, but never started again */
+            p_boot_record->prev_app.len = 0;
+        }
+    }
+    else
+    {
+        p_boot_record->boot_attempts++;
+    }
+
+    boot_record_set(p_boot_record);
+}
+
+/**
+ * @brief Makes new application active by switching the slot. Active one is
+ *        kept to roll back to
+ */
+cbl_err_code_t ab_switch (void)
+{
+    boot_record_t * p_boot_record = boot_record_get();
+
+    if (0 == p_boot_record->new_app.len
+            || p_boot_record->new_app.len > AB_SLOT_MAX_LEN)
+    {
+        return CBL_ERR_NEW_APP_LEN;
+    }
+
+    p_boot_record->prev_app = p_boot_record->act_app;
+    p_boot_record->prev_app_crc = p_boot_record->act_app_crc;
+
+    p_boot_record->act_slot = AB_SLOT_B - p_boot_record->act_slot;
+    p_boot_record->act_app = p_boot_record->new_app;
+    p_boot_record->new_app.len = 0;
+    p_boot_record->is_new_app_ready = false;
+    p_boot_record->is_trial = true;
+    p_boot_record->boot_attempts = 0;
+
+    /* Record is in RAM until set, digest reads the new active slot */
+    p_boot_record->act_app_crc = fast_boot_digest(
+            ab_slot_start(p_boot_record->act_slot), p_boot_record->act_app.len);
+    p_boot_record->fast_boot_cycles = 0;
+    /* Signature is verified again when it starts */
+    p_boot_record->is_sig_ok = false;
+
+    return boot_record_set(p_boot_record);
+}
+
+/**
+ * @brief Returns start address of the slot
+ */
+static uint32_t ab_slot_start (uint8_t slot)
+{
+    return AB_SLOT_B == slot ? BOOT_NEW_APP_START : BOOT_ACT_APP_START;
+}
+#endif /* USE_AB_SLOTS */
+
+/*** end of file ***/
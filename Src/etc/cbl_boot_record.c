@@ -4,59 +4,173 @@
  *        and of a new one, if it is available
  *
  * @note This file is part of custom bootloader, but is also included in the
- *       user application
+ *       user application. It needs only the HAL layer,
+ *       hal_write_program_bytes and hal_flash_erase_sector
  */
 #include "etc/cbl_boot_record.h"
-#include "commands/cbl_cmds_memory.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define GOOD_KEY 0x12345678
+#define SLOT_ERASED 0xFFFFFFFFUL /*!< Sequence number of an unused slot */
+#define SLOT_NONE UINT32_MAX /*!< No slot found */
+#define SLOT_UNKNOWN (UINT32_MAX - 1u) /*!< Log wasn't scanned yet */
+
+typedef struct
+{
+    uint32_t seq; /*!< Sequence number, higher is newer */
+    uint32_t crc; /*!< CRC32 of the record */
+    boot_record_t record;
+} boot_record_slot_t;
+
+/* Slot has to fit in its place in the sector */
+typedef char boot_record_slot_sz_check[
+        (sizeof(boot_record_slot_t) <= BOOT_RECORD_SLOT_SZ) ? 1 : -1];
+
+/* Application reads the same layout, new fields take bytes of reserved */
+typedef char boot_record_sz_check[
+        (sizeof(boot_record_t) == BOOT_RECORD_REC_SZ) ? 1 : -1];
 
-static volatile boot_record_t boot_record __attribute__((section(".appbr")));
 static boot_record_t boot_record_editable;
+/** Newest valid slot and first erased slot, found once and kept up to date
+ * by boot_record_set */
+static uint32_t act_slot = SLOT_UNKNOWN;
+static uint32_t next_slot = SLOT_UNKNOWN;
 
 static void boot_record_init (boot_record_t * p_boot_record);
+static const volatile boot_record_slot_t * boot_record_slot (uint32_t slot);
+static uint32_t boot_record_find (uint32_t * p_next);
+static uint32_t boot_record_crc (const uint8_t * buf, uint32_t len);
 /**
- * @brief Gets a editable copy of boot record
+ * @brief Gets a editable copy of boot record. Doesn't write, a record which
+ *        isn't in the log yet is written by the next boot_record_set
  *
- * @return Pointer to editable boot record if it has been initialized, else NULL
+ * @return Pointer to editable boot record
  */
 boot_record_t * boot_record_get (void)
 {
-    if (boot_record.key == GOOD_KEY)
+    /* Record written before the log was introduced is at sector start */
+    const volatile boot_record_t * p_legacy =
+            (const volatile boot_record_t *)BOOT_RECORD_START;
+
+    if (SLOT_UNKNOWN == act_slot)
+    {
+        act_slot = boot_record_find( &next_slot);
+    }
+
+    if (act_slot != SLOT_NONE)
+    {
+        memcpy( &boot_record_editable,
+                (void *) &boot_record_slot(act_slot)->record,
+                sizeof(boot_record_editable));
+    }
+    else if (p_legacy->key == GOOD_KEY)
     {
-        memcpy( &boot_record_editable, (void *) &boot_record,
-                sizeof(boot_record));
+        memcpy( &boot_record_editable, (void *)p_legacy,
+                sizeof(boot_record_editable));
     }
     else
     {
         boot_record_init( &boot_record_editable);
-        boot_record_set( &boot_record_editable);
     }
 
     return &boot_record_editable;
 }
 
 /**
- * @brief Sets the boot record value
+ * @brief Sets the boot record value. Appends it to the log, sector is erased
+ *        only if there is no free slot
  *
  * @param new_bl_record Value to be written
  */
 cbl_err_code_t boot_record_set (boot_record_t * p_new_boot_record)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t len = (uint32_t)sizeof(boot_record_t);
-    uint8_t *p_new_byte = (uint8_t *)p_new_boot_record;
+    boot_record_slot_t new_slot;
+    uint32_t next;
+    uint32_t addr;
 
-    p_new_boot_record->key = 0x12345678;
+    p_new_boot_record->key = GOOD_KEY;
+
+    if (SLOT_UNKNOWN == act_slot)
+    {
+        act_slot = boot_record_find( &next_slot);
+    }
+    next = next_slot;
+
+    new_slot.seq =
+            act_slot != SLOT_NONE ? boot_record_slot(act_slot)->seq + 1 : 0;
+    memcpy( &new_slot.record, p_new_boot_record, sizeof(new_slot.record));
+    new_slot.crc = boot_record_crc((uint8_t *) &new_slot.record,
+            sizeof(new_slot.record));
+
+    /* Scanned again after a failure, the sector may be written partly */
+    act_slot = SLOT_UNKNOWN;
+
+    if (next == SLOT_NONE || new_slot.seq == SLOT_ERASED)
+    {
+        /* Log is full, start it again */
+        eCode = hal_flash_erase_sector(BOOT_RECORD_SECTOR,
+                BOOT_RECORD_MAX_SECTORS);
+        ERR_CHECK(eCode);
+
+        next = 0;
+        new_slot.seq = 0;
+    }
 
-    eCode = hal_flash_erase_sector(BOOT_RECORD_SECTOR, BOOT_RECORD_MAX_SECTORS);
+    addr = BOOT_RECORD_START + next * BOOT_RECORD_SLOT_SZ;
+    eCode = hal_write_program_bytes(addr, (uint8_t *) &new_slot,
+            sizeof(new_slot));
     ERR_CHECK(eCode);
 
-    eCode = hal_write_program_bytes(BOOT_RECORD_START, p_new_byte, len);
+#if 1 == USE_WRITE_VERIFY
+    if (memcmp((const void *)addr, &new_slot, sizeof(new_slot)) != 0)
+    {
+        return CBL_ERR_VERIFY;
+    }
+#endif /* USE_WRITE_VERIFY */
+
+    act_slot = next;
+    next_slot = next + 1 < BOOT_RECORD_N_SLOTS ? next + 1 : SLOT_NONE;
+
+    return eCode;
+}
+
+/**
+ * @brief Gets application type parameter TXT_PAR_APP_TYPE, it is enumerated
+ *        only on the first call
+ *
+ * @param ph_prsr[in]     Parser containing parameters
+ * @param p_app_type[out] Application type, unchanged if parameter is not
+ *                        given
+ *
+ * @return CBL_ERR_NEED_PARAM if parameter is not given
+ */
+cbl_err_code_t parser_get_app_type (parser_t * ph_prsr,
+        app_type_t * p_app_type)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    parser_arg_t * p_arg = parser_get_arg(ph_prsr, TXT_PAR_APP_TYPE,
+            strlen(TXT_PAR_APP_TYPE));
+
+    if (NULL == p_arg)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    if (CONV_APP_TYPE != p_arg->conv)
+    {
+        app_type_t app_type;
+
+        eCode = enum_app_type(p_arg->val, p_arg->valLen, &app_type);
+        ERR_CHECK(eCode);
+        p_arg->num = app_type;
+        p_arg->conv = CONV_APP_TYPE;
+    }
+
+    *p_app_type = (app_type_t)p_arg->num;
     return eCode;
 }
 
@@ -91,6 +205,11 @@ cbl_err_code_t enum_app_type (char *char_app_type, uint32_t len,
     {
         *p_app_type = TYPE_SREC;
     }
+    else if (strlen(TXT_PAR_APP_TYPE_BIN_LZ4) == len
+            && strncmp(char_app_type, TXT_PAR_APP_TYPE_BIN_LZ4, len) == 0)
+    {
+        *p_app_type = TYPE_BIN_LZ4;
+    }
     else
     {
         *p_app_type = TYPE_UNDEF;
@@ -106,6 +225,8 @@ cbl_err_code_t enum_app_type (char *char_app_type, uint32_t len,
  */
 static void boot_record_init (boot_record_t * p_boot_record)
 {
+    memset(p_boot_record, 0, sizeof( *p_boot_record));
+
     p_boot_record->act_app.app_type = TYPE_UNDEF;
     p_boot_record->act_app.cksum_used = CKSUM_UNDEF;
     p_boot_record->act_app.len = 0;
@@ -118,4 +239,79 @@ static void boot_record_init (boot_record_t * p_boot_record)
     p_boot_record->is_new_app_ready = false;
 }
 
+/**
+ * @brief Gets slot of the log in flash
+ */
+static const volatile boot_record_slot_t * boot_record_slot (uint32_t slot)
+{
+    return (const volatile boot_record_slot_t *)(BOOT_RECORD_START
+            + slot * BOOT_RECORD_SLOT_SZ);
+}
+
+/**
+ * @brief Finds the newest valid slot. Slots are used in order, so the log
+ *        ends at the first erased slot. Slots with wrong CRC (interrupted
+ *        writes) are skipped
+ *
+ * @param p_next[out] First erased slot, SLOT_NONE if log is full
+ *
+ * @return Index of the newest valid slot, SLOT_NONE if there is none
+ */
+static uint32_t boot_record_find (uint32_t * p_next)
+{
+    uint32_t newest = SLOT_NONE;
+
+    *p_next = SLOT_NONE;
+
+    for (uint32_t iii = 0; iii < BOOT_RECORD_N_SLOTS; iii++)
+    {
+        const volatile boot_record_slot_t * p_slot = boot_record_slot(iii);
+
+        if (p_slot->seq == SLOT_ERASED)
+        {
+            *p_next = iii;
+            break;
+        }
+
+        if (p_slot->record.key == GOOD_KEY
+                && p_slot->crc
+                        == boot_record_crc((const uint8_t *) &p_slot->record,
+                                sizeof(p_slot->record))
+                && (newest == SLOT_NONE
+                        || p_slot->seq > boot_record_slot(newest)->seq))
+        {
+            newest = iii;
+        }
+    }
+
+    return newest;
+}
+
+/**
+ * @brief Software CRC32 (Ethernet, reflected) of the record. Hardware CRC is
+ *        not used, it may hold a transfer checksum in progress and user
+ *        application may not have it initialized
+ */
+static uint32_t boot_record_crc (const uint8_t * buf, uint32_t len)
+{
+    /* Half byte table of reflected polynomial 0xEDB88320 */
+    static const uint32_t crc_lut[16] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190,
+        0x6B6B51F4, 0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344,
+        0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278,
+        0xBDBDF21C
+    };
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        crc ^= buf[iii];
+        crc = (crc >> 4) ^ crc_lut[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_lut[crc & 0x0F];
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
 /*** end of file ***/
@@ -3,6 +3,7 @@
  * @brief All checksum implementations available
  */
 #include "etc/cbl_checksum.h"
+#include "etc/cbl_perf.h"
 #include <crc.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -15,29 +16,47 @@ static cbl_err_code_t calculate_crc32 (uint8_t * data, uint32_t len,
 #endif
 static uint32_t lit_to_big_endian (uint32_t number);
 static uint32_t reflect_ui32 (uint32_t number);
+static void crc32_feed_words (const uint8_t * buf, uint32_t n_words);
 
-static const uint8_t reflect_byte_table[] = { 0x00, 0x80, 0x40, 0xC0, 0x20,
-        0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0, 0x08,
-        0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38,
-        0xB8, 0x78, 0xF8, 0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14,
-        0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4, 0x0C, 0x8C, 0x4C, 0xCC, 0x2C,
-        0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC, 0x02,
-        0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32,
-        0xB2, 0x72, 0xF2, 0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A,
-        0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA, 0x06, 0x86, 0x46, 0xC6, 0x26,
-        0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6, 0x0E,
-        0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E,
-        0xBE, 0x7E, 0xFE, 0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11,
-        0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1, 0x09, 0x89, 0x49, 0xC9, 0x29,
-        0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9, 0x05,
-        0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35,
-        0xB5, 0x75, 0xF5, 0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D,
-        0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD, 0x03, 0x83, 0x43, 0xC3, 0x23,
-        0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3, 0x0B,
-        0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B,
-        0xBB, 0x7B, 0xFB, 0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17,
-        0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7, 0x0F, 0x8F, 0x4F, 0xCF, 0x2F,
-        0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF };
+#define CRC32_POLY_REFLECTED 0xEDB88320UL /*!< 0x4C11DB7 reflected */
+
+/* Bytes after the last whole word, hardware takes only words */
+static uint32_t crc_tail;
+static uint32_t crc_tail_len;
+
+/**
+ * @brief Gets checksum parameter TXT_PAR_CKSUM, it is enumerated only on the
+ *        first call
+ *
+ * @param ph_prsr[in]  Parser containing parameters
+ * @param p_cksum[out] Checksum, unchanged if parameter is not given
+ *
+ * @return CBL_ERR_NEED_PARAM if parameter is not given
+ */
+cbl_err_code_t parser_get_cksum (parser_t * ph_prsr, cksum_t * p_cksum)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    parser_arg_t * p_arg = parser_get_arg(ph_prsr, TXT_PAR_CKSUM,
+            strlen(TXT_PAR_CKSUM));
+
+    if (NULL == p_arg)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    if (CONV_CKSUM != p_arg->conv)
+    {
+        cksum_t cksum;
+
+        eCode = enum_checksum(p_arg->val, p_arg->valLen, &cksum);
+        ERR_CHECK(eCode);
+        p_arg->num = cksum;
+        p_arg->conv = CONV_CKSUM;
+    }
+
+    *p_cksum = (cksum_t)p_arg->num;
+    return eCode;
+}
 
 /**
  * @brief Checks checksum parameter value to check if it is supported
@@ -87,7 +106,7 @@ cbl_err_code_t enum_checksum (char * checksum, uint32_t len, cksum_t * p_cksum)
  * @param ph_sha256[in] Pointer to the handle of sha256 checksum, if not using
  *        sha256 send NULL for this parameter
  */
-void init_checksum (cksum_t cksum, SHA256_CTX * ph_sha256)
+void init_checksum (cksum_t cksum, sha256_ctx_t * ph_sha256)
 {
     switch (cksum)
     {
@@ -95,6 +114,8 @@ void init_checksum (cksum_t cksum, SHA256_CTX * ph_sha256)
         {
             /* Reset CRC value (0xFFFFFFFF) */
             __HAL_CRC_DR_RESET( &hcrc);
+            crc_tail = 0;
+            crc_tail_len = 0;
         }
         break;
 
@@ -102,7 +123,7 @@ void init_checksum (cksum_t cksum, SHA256_CTX * ph_sha256)
         {
             if (ph_sha256 != NULL)
             {
-                sha256_init(ph_sha256);
+                sha256_start(ph_sha256);
             }
         }
         break;
@@ -126,7 +147,7 @@ void init_checksum (cksum_t cksum, SHA256_CTX * ph_sha256)
  *        sha256 send NULL for this parameter
  */
 cbl_err_code_t accumulate_checksum (uint8_t * buf, uint32_t len, cksum_t cksum,
-        SHA256_CTX * ph_sha256)
+        sha256_ctx_t * ph_sha256)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
 
@@ -176,35 +197,118 @@ cbl_err_code_t accumulate_checksum (uint8_t * buf, uint32_t len, cksum_t cksum,
  *                                     RefOut: true
  *
  * @note Assumes memory is in little endian!
- * @note Input data length must be divisible by 4! So no leading zeroes are
- *       added.
+ * @note Any length is accepted. Bytes which don't make a whole word are kept
+ *       and joined with the next call, if the stream ends with them they are
+ *       added in software by crc32_get
  *
- * @param buf[in]       Bytes to accumulate
+ * @param buf[in]       Bytes to accumulate, can be a flash region
  * @param len[in]       Length of 'buf'
  */
 cbl_err_code_t accumulate_crc32 (uint8_t * buf, uint32_t len)
 {
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t ui32_data;
+    PERF_START(PERF_CKSUM);
 
-    /* For crc32 data must be divisible by 4 */
-    if ((len % 4) != 0)
+    /* Complete the word started by the previous call */
+    while (crc_tail_len > 0 && crc_tail_len < 4 && len > 0)
     {
-        return CBL_ERR_CKSUM_WRONG;
+        crc_tail |= (uint32_t) *buf << (8 * crc_tail_len);
+        crc_tail_len++;
+        buf++;
+        len--;
+    }
+    if (4 == crc_tail_len)
+    {
+        hcrc.Instance->DR = reflect_ui32(crc_tail);
+        crc_tail = 0;
+        crc_tail_len = 0;
     }
 
-    for (uint32_t iii = 0; iii < len; iii = iii + 4)
+    crc32_feed_words(buf, len / 4);
+    buf += len & ~3u;
+    len &= 3u;
+
+    while (len > 0)
     {
-        ui32_data = *(uint32_t *) &buf[iii];
+        crc_tail |= (uint32_t) *buf << (8 * crc_tail_len);
+        crc_tail_len++;
+        buf++;
+        len--;
+    }
 
-        /* Make big endian and reflect bytes */
-        ui32_data = reflect_ui32(ui32_data);
+    PERF_STOP(PERF_CKSUM);
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Calculates CRC32 of a memory region, e.g. an image in flash,
+ *        without copying it
+ *
+ * @param p_start[in] Start of the region
+ * @param len[in]     Length of the region
+ *
+ * @return CRC32, same as init_checksum, accumulate_crc32 and crc32_get
+ */
+uint32_t crc32_calc (const uint8_t * p_start, uint32_t len)
+{
+    init_checksum(CKSUM_CRC32, NULL);
+    accumulate_crc32((uint8_t *)p_start, len);
+
+    return crc32_get();
+}
 
-        HAL_CRC_Accumulate( &hcrc, &ui32_data, 1);
+#if 1 == USE_CRC_DMA
+/**
+ * @brief Starts DMA which feeds words as they are in memory to the CRC unit,
+ *        CPU is free until crc32_native_wait
+ *
+ * @note  STM32F4 CRC unit can't reflect input, so words are not reflected and
+ *        result is not CRC32 of crc32_calc. Use only for digests which are
+ *        both made and checked by the bootloader
+ * @note  Words shall stay unchanged until crc32_native_wait returns
+ *
+ * @param p_words[in] Word aligned start of the region
+ * @param n_words[in] Number of words
+ */
+cbl_err_code_t crc32_native_start (const uint32_t * p_words, uint32_t n_words)
+{
+    uint32_t n_dma;
+
+    init_checksum(CKSUM_CRC32, NULL);
+
+    /* DMA counter is 16 bits wide, longer regions are sent in pieces */
+    while (n_words > 0)
+    {
+        n_dma = ui32_min(n_words, CRC_DMA_MAX_WORDS);
+
+        while (false == hal_crc_dma_is_done())
+        {
+        }
+        if (hal_crc_dma_start(p_words, n_dma) != CBL_ERR_OK)
+        {
+            return CBL_ERR_CRC_DMA;
+        }
+
+        p_words += n_dma;
+        n_words -= n_dma;
     }
 
-    return eCode;
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Waits for DMA started by crc32_native_start
+ *
+ * @return Value of the CRC unit, without reflection and XOROut
+ */
+uint32_t crc32_native_wait (void)
+{
+    while (false == hal_crc_dma_is_done())
+    {
+    }
+
+    return hcrc.Instance->DR;
 }
+#endif /* USE_CRC_DMA */
 
 /**
  * @brief Accumulates bytes from 'buf' for sha256, accumulated states are stored
@@ -215,9 +319,11 @@ cbl_err_code_t accumulate_crc32 (uint8_t * buf, uint32_t len)
  * @param ph_sha256[in] Pointer of a handle of sha256 states
  */
 cbl_err_code_t accumulate_sha256 (uint8_t * buf, uint32_t len,
-        SHA256_CTX * ph_sha256)
+        sha256_ctx_t * ph_sha256)
 {
-    sha256_update(ph_sha256, buf, len);
+    PERF_START(PERF_CKSUM);
+    sha256_add(ph_sha256, buf, len);
+    PERF_STOP(PERF_CKSUM);
 
     return CBL_ERR_OK;
 }
@@ -231,7 +337,7 @@ cbl_err_code_t accumulate_sha256 (uint8_t * buf, uint32_t len,
  * @param ph_sha256[in]    Pointer of a handle of sha256 states
  */
 cbl_err_code_t verify_checksum (uint8_t * p_recv_cksum, uint32_t cksum_len,
-        cksum_t cksum, SHA256_CTX * ph_sha256)
+        cksum_t cksum, sha256_ctx_t * ph_sha256)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
 
@@ -275,7 +381,7 @@ cbl_err_code_t verify_checksum (uint8_t * p_recv_cksum, uint32_t cksum_len,
 cbl_err_code_t verify_crc32 (uint8_t * p_recv_cksum, uint32_t cksum_len)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t calculated_crc32 = hcrc.Instance->DR;
+    uint32_t calculated_crc32 = crc32_get();
     uint32_t expected_crc;
 
     if (cksum_len != 4)
@@ -288,12 +394,6 @@ cbl_err_code_t verify_crc32 (uint8_t * p_recv_cksum, uint32_t cksum_len)
     /* Bring in line with physical layer */
     expected_crc = lit_to_big_endian(expected_crc);
 
-    /* Reflect calculated CRC*/
-    calculated_crc32 = reflect_ui32(calculated_crc32);
-
-    /* XOROut */
-    calculated_crc32 = calculated_crc32 ^ 0xFFFFFFFF;
-
     if (calculated_crc32 != expected_crc)
     {
         eCode = CBL_ERR_CKSUM_WRONG;
@@ -302,6 +402,38 @@ cbl_err_code_t verify_crc32 (uint8_t * p_recv_cksum, uint32_t cksum_len)
     return eCode;
 }
 
+/**
+ * @brief Returns CRC32 of the bytes accumulated since init_checksum
+ *
+ * @note  Doesn't change the state, can be called more than once
+ *
+ * @return Reflected CRC32 with XOROut applied
+ */
+uint32_t crc32_get (void)
+{
+    uint32_t calculated_crc32 = hcrc.Instance->DR;
+
+    /* Reflect calculated CRC*/
+    calculated_crc32 = reflect_ui32(calculated_crc32);
+
+    /* Bytes after the last word, bitwise in reflected form */
+    for (uint32_t iii = 0; iii < crc_tail_len; iii++)
+    {
+        calculated_crc32 ^= (crc_tail >> (8 * iii)) & 0xFFu;
+
+        for (uint32_t bit = 0; bit < 8; bit++)
+        {
+            calculated_crc32 = (calculated_crc32 >> 1)
+                    ^ (CRC32_POLY_REFLECTED & (0 - (calculated_crc32 & 1u)));
+        }
+    }
+
+    /* XOROut */
+    calculated_crc32 = calculated_crc32 ^ 0xFFFFFFFF;
+
+    return calculated_crc32;
+}
+
 /**
  * @brief Verifies if received and calculated sha256 are the same
  *
@@ -310,17 +442,17 @@ cbl_err_code_t verify_crc32 (uint8_t * p_recv_cksum, uint32_t cksum_len)
  * @param ph_sha256    Handle of sha256 states
  */
 cbl_err_code_t verify_sha256 (uint8_t * p_recv_cksum, uint32_t cksum_len,
-        SHA256_CTX * ph_sha256)
+        sha256_ctx_t * ph_sha256)
 {
-    BYTE p_calculated_sha[SHA256_BLOCK_SIZE] = { 0 };
-    sha256_final(ph_sha256, p_calculated_sha);
+    uint8_t p_calculated_sha[SHA256_DIGEST_SZ] = { 0 };
+    sha256_finish(ph_sha256, p_calculated_sha);
 
-    if (SHA256_BLOCK_SIZE != cksum_len)
+    if (SHA256_DIGEST_SZ != cksum_len)
     {
         return CBL_ERR_CKSUM_WRONG;
     }
 
-    if (memcmp(p_recv_cksum, p_calculated_sha, SHA256_BLOCK_SIZE) != 0)
+    if (memcmp(p_recv_cksum, p_calculated_sha, SHA256_DIGEST_SZ) != 0)
     {
         return CBL_ERR_CKSUM_WRONG;
     }
@@ -361,6 +493,53 @@ uint32_t checksum_get_length(cksum_t cksum)
 
 }
 
+/**
+ * @brief Returns the checksum accumulated since init_checksum, in the byte
+ *        order host sends it. Length is checksum_get_length
+ *
+ * @param cksum[in]     Checksum type, CKSUM_CRC32 or CKSUM_SHA256
+ * @param ph_sha256[in] Handle of sha256 states, used only with sha256
+ * @param p_digest[out] Checksum, CRC32 is MSB first
+ */
+cbl_err_code_t checksum_get (cksum_t cksum, sha256_ctx_t * ph_sha256,
+        uint8_t * p_digest)
+{
+    uint32_t crc32;
+
+    switch (cksum)
+    {
+        case CKSUM_CRC32:
+        {
+            crc32 = crc32_get();
+            p_digest[0] = (uint8_t)(crc32 >> 24);
+            p_digest[1] = (uint8_t)(crc32 >> 16);
+            p_digest[2] = (uint8_t)(crc32 >> 8);
+            p_digest[3] = (uint8_t)crc32;
+        }
+        break;
+
+        case CKSUM_SHA256:
+        {
+            if (ph_sha256 == NULL)
+            {
+                return CBL_ERR_NULL_PAR;
+            }
+            sha256_finish(ph_sha256, p_digest);
+        }
+        break;
+
+        case CKSUM_NO:
+        case CKSUM_UNDEF:
+        default:
+        {
+            return CBL_ERR_UNSUP_CKSUM;
+        }
+        break;
+    }
+
+    return CBL_ERR_OK;
+}
+
 #if 0
 /**
  * @brief Returns if selected checksum is correct
@@ -458,27 +637,27 @@ cbl_err_code_t verify_crc_old (uint8_t * write_buf, uint32_t len)
  */
 cbl_err_code_t verify_sha256_old (uint8_t * buf, uint32_t len)
 {
-    BYTE *expected_sha = NULL;
-    BYTE calc_sha[SHA256_BLOCK_SIZE] =
+    uint8_t *expected_sha = NULL;
+    uint8_t calc_sha[SHA256_DIGEST_SZ] =
     {   0};
-    SHA256_CTX h_ctx;
+    sha256_ctx_t h_ctx;
 
-    if (len <= SHA256_BLOCK_SIZE)
+    if (len <= SHA256_DIGEST_SZ)
     {
         return CBL_ERR_CKSUM_WRONG;
     }
 
     /* SHA256 is on the end */
-    expected_sha = &buf[len - SHA256_BLOCK_SIZE];
+    expected_sha = &buf[len - SHA256_DIGEST_SZ];
 
     /* Don't look at checksum blocks */
-    len -= SHA256_BLOCK_SIZE;
+    len -= SHA256_DIGEST_SZ;
 
-    sha256_init( &h_ctx);
-    sha256_update( &h_ctx, buf, len);
-    sha256_final( &h_ctx, calc_sha);
+    sha256_start( &h_ctx);
+    sha256_add( &h_ctx, buf, len);
+    sha256_finish( &h_ctx, calc_sha);
 
-    if (memcmp(expected_sha, calc_sha, SHA256_BLOCK_SIZE) != 0)
+    if (memcmp(expected_sha, calc_sha, SHA256_DIGEST_SZ) != 0)
     {
         return CBL_ERR_CKSUM_WRONG;
     }
@@ -540,9 +719,42 @@ static uint32_t lit_to_big_endian (uint32_t number)
  */
 static uint32_t reflect_ui32 (uint32_t number)
 {
-    return (reflect_byte_table[number & 0xff] << 24)
-            | (reflect_byte_table[(number >> 8) & 0xff] << 16)
-            | (reflect_byte_table[(number >> 16) & 0xff] << 8)
-            | (reflect_byte_table[(number >> 24) & 0xff]);
+    /* Single RBIT instruction on Cortex-M4 */
+    return __RBIT(number);
+}
+
+/**
+ * @brief Writes reflected words straight to the CRC data register, HAL
+ *        function call per word is avoided
+ *
+ * @param buf[in]     Bytes to accumulate, don't have to be word aligned
+ * @param n_words[in] Number of words in 'buf'
+ */
+static void crc32_feed_words (const uint8_t * buf, uint32_t n_words)
+{
+    volatile uint32_t * p_dr = &hcrc.Instance->DR;
+    uint32_t word[4];
+
+    /* Unrolled so loop overhead is small next to the 4 cycles the CRC unit
+     * takes for a word. Words are copied out, buf may be unaligned and a
+     * cast would let the compiler merge the loads into LDM, which faults.
+     * With memcpy it uses only LDR, which may be unaligned */
+    while (n_words >= 4)
+    {
+        memcpy(word, buf, sizeof(word));
+        *p_dr = reflect_ui32(word[0]);
+        *p_dr = reflect_ui32(word[1]);
+        *p_dr = reflect_ui32(word[2]);
+        *p_dr = reflect_ui32(word[3]);
+        buf += sizeof(word);
+        n_words -= 4;
+    }
+    while (n_words > 0)
+    {
+        memcpy(word, buf, sizeof(word[0]));
+        *p_dr = reflect_ui32(word[0]);
+        buf += sizeof(word[0]);
+        n_words--;
+    }
 }
 /*** end of file ***/
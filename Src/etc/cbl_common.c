@@ -15,14 +15,32 @@ volatile uint32_t gRxCmdCntr;
 /** Used to signal an exit request to shell system */
 bool gIsExitReq = false;
 
+#define HEX_LUT_VALID 0x10 /*!< Set in hex_lut for every hex digit */
+
+/** Value of a hex digit with HEX_LUT_VALID set, 0 for other characters */
+static const uint8_t hex_lut[256] =
+{
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E,
+    ['F'] = 0x1F,
+    ['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E,
+    ['f'] = 0x1F
+};
+
+static void parser_add_arg (parser_t * phPrsr, char * pName, char * pVal,
+        char * pEnd);
+
 // \f - new page
 /**
- * @brief           Parses a command into parser_t. Command's form is as
- *                  follows: somecmd pname1=pval1 pname2=pval2
+ * @brief           Parses a command into parser_t in a single pass. Command's
+ *                  form is as follows: somecmd pname1=pval1 pname2=pval2
  *
  * @note            This function is destructive to input cmd, as it replaces
  *                  all ' ' and '=' with NULL terminator and transform every
  *                  character to lower case
+ * @note            Word without '=' ends the arguments, it stays in cmd after
+ *                  the NULL terminator of the command name
  *
  * @param cmd[in]   NULL terminated string containing command without CR LF,
  *                  parser changes it
@@ -34,53 +52,104 @@ bool gIsExitReq = false;
 cbl_err_code_t parser_run (char * cmd, size_t len, parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    char *pSpa = NULL;
-    char *pEqu = NULL;
-    char *pLastChar = &cmd[len];
-    uint8_t iii;
-
-    /* Convert the string to lower case */
-    strlwr(cmd);
+    char *pName = NULL;
+    char *pVal = NULL;
+    bool isArgsDone = false;
 
-    /* Find the first ' ' */
-    pSpa = memchr(cmd, ' ', len);
+    memset(phPrsr->idx, PARSER_IDX_EMPTY, sizeof(phPrsr->idx));
+    phPrsr->numOfArgs = 0u;
 
-    for (iii = 0u; iii < MAX_ARGS && pSpa != NULL; iii++)
+    for (size_t iii = 0u; iii < len; iii++)
     {
-        /* Command name/value name ends with ' ', replace with '\0' */
-        *pSpa = '\0';
-
-        /* Find an end of the param name */
-        pEqu = memchr(pSpa, '=', pLastChar - pSpa);
+        /* Convert the string to lower case */
+        cmd[iii] = tolower((uint8_t)cmd[iii]);
 
-        if (NULL == pEqu)
+        if (true == isArgsDone)
         {
-            /* Exit from the loop as there is no value for the argument */
-            break;
+            continue;
         }
 
-        /* Argument starts after ' ' */
-        phPrsr->args[iii][ARG_NAME] = (pSpa + 1);
-        /* Arguments end with '=', replace with '\0' */
-        *pEqu = '\0';
+        if (' ' == cmd[iii])
+        {
+            if (NULL != pVal)
+            {
+                parser_add_arg(phPrsr, pName, pVal, &cmd[iii]);
+            }
+            else if (NULL != pName)
+            {
+                /* Word without value */
+                isArgsDone = true;
+                continue;
+            }
 
-        /* Parameter value starts after '=' */
-        phPrsr->args[iii][ARG_VAL] = (pEqu + 1);
+            if (MAX_ARGS == phPrsr->numOfArgs)
+            {
+                isArgsDone = true;
+                continue;
+            }
+
+            /* Command name/value name ends with ' ', replace with '\0' */
+            cmd[iii] = '\0';
+            pName = &cmd[iii + 1];
+            pVal = NULL;
+        }
+        else if ('=' == cmd[iii] && NULL != pName && NULL == pVal)
+        {
+            /* Arguments end with '=', replace with '\0' */
+            cmd[iii] = '\0';
+            pVal = &cmd[iii + 1];
+        }
+    }
 
-        /* Find the next space */
-        pSpa = memchr(pEqu, ' ', pLastChar - pEqu);
+    if (false == isArgsDone && NULL != pVal)
+    {
+        parser_add_arg(phPrsr, pName, pVal, &cmd[len]);
     }
 
     phPrsr->cmd = cmd;
     phPrsr->len = len;
-    phPrsr->numOfArgs = iii;
 
     return eCode;
 }
 
+/**
+ * @brief           Adds an argument found by parser_run and indexes it by
+ *                  hash of its name
+ *
+ * @param pName[in] Start of the name, it ends 1 before pVal
+ *
+ * @param pVal[in]  Start of the value
+ *
+ * @param pEnd[in]  End of the value, replaced with '\0'
+ */
+static void parser_add_arg (parser_t * phPrsr, char * pName, char * pVal,
+        char * pEnd)
+{
+    parser_arg_t * pArg = &phPrsr->args[phPrsr->numOfArgs];
+    uint32_t slot;
+
+    *pEnd = '\0';
+
+    pArg->name = pName;
+    pArg->nameLen = (uint16_t)(pVal - 1 - pName);
+    pArg->val = pVal;
+    pArg->valLen = (uint16_t)(pEnd - pVal);
+    pArg->conv = CONV_NONE;
+
+    /* Collisions take the next free slot */
+    slot = str_hash(pArg->name, pArg->nameLen) & (PARSER_IDX_SZ - 1u);
+    while (PARSER_IDX_EMPTY != phPrsr->idx[slot])
+    {
+        slot = (slot + 1u) & (PARSER_IDX_SZ - 1u);
+    }
+    phPrsr->idx[slot] = phPrsr->numOfArgs;
+
+    phPrsr->numOfArgs++;
+}
+
 // \f - new page
 /**
- * @brief           Gets value from a parameter
+ * @brief           Gets an argument through the hash index
  *
  * @param p         parser
  *
@@ -88,33 +157,141 @@ cbl_err_code_t parser_run (char * cmd, size_t len, parser_t * phPrsr)
  *
  * @param lenName   Name length
  *
- * @return  Pointer to the value, when no parameter it returns NULL
+ * @return  Pointer to the argument, when no parameter it returns NULL
  */
-char *parser_get_val (parser_t * phPrsr, char * name, size_t lenName)
+parser_arg_t *parser_get_arg (parser_t * phPrsr, const char * name,
+        size_t lenName)
 {
-    size_t lenArgName;
+    uint32_t slot;
 
     if (phPrsr == NULL || name == NULL || lenName == 0)
         return NULL;
 
-    /* Walk through all the parameters */
-    for (uint32_t iii = 0u; iii < phPrsr->numOfArgs; iii++)
+    slot = str_hash(name, lenName) & (PARSER_IDX_SZ - 1u);
+
+    /* Empty slot ends the run of colliding names */
+    while (PARSER_IDX_EMPTY != phPrsr->idx[slot])
     {
-        /* Get the length of ith parameter */
-        lenArgName = strlen(phPrsr->args[iii][ARG_NAME]);
+        parser_arg_t * pArg = &phPrsr->args[phPrsr->idx[slot]];
 
-        /* Check if ith parameter is the requested one */
-        if (lenArgName == lenName
-                && strncmp(phPrsr->args[iii][ARG_NAME], name, lenArgName) == 0)
+        if (pArg->nameLen == lenName && memcmp(pArg->name, name, lenName) == 0)
         {
-            return phPrsr->args[iii][ARG_VAL];
+            return pArg;
         }
+        slot = (slot + 1u) & (PARSER_IDX_SZ - 1u);
     }
 
     /* No parameter with name 'name' found */
     return NULL;
 }
 
+/**
+ * @brief           Gets value from a parameter
+ *
+ * @param p         parser
+ *
+ * @param name      Name of a parameter
+ *
+ * @param lenName   Name length
+ *
+ * @return  Pointer to the value, when no parameter it returns NULL
+ */
+char *parser_get_val (parser_t * phPrsr, char * name, size_t lenName)
+{
+    parser_arg_t * pArg = parser_get_arg(phPrsr, name, lenName);
+
+    return NULL == pArg ? NULL : pArg->val;
+}
+
+/**
+ * @brief           Gets a number parameter, it is converted only on the first
+ *                  call
+ *
+ * @param name[in]  Name of a parameter
+ *
+ * @param base[in]  10 or 16, hex may start with 0x
+ *
+ * @param p_num[out] Number, unchanged if parameter is not given
+ *
+ * @return  CBL_ERR_NEED_PARAM if parameter is not given
+ */
+cbl_err_code_t parser_get_u32 (parser_t * phPrsr, const char * name,
+        uint8_t base, uint32_t * p_num)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    parser_conv_t conv = 16u == base ? CONV_HEX : CONV_DEC;
+    parser_arg_t * pArg = parser_get_arg(phPrsr, name, strlen(name));
+
+    if (NULL == pArg)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    if (conv != pArg->conv)
+    {
+        eCode = str2ui32(pArg->val, pArg->valLen, &pArg->num, base);
+        ERR_CHECK(eCode);
+        pArg->conv = conv;
+    }
+
+    *p_num = pArg->num;
+    return eCode;
+}
+
+/**
+ * @brief           Gets a boolean parameter, TXT_PAR_TRUE or TXT_PAR_FALSE
+ *
+ * @param name[in]  Name of a parameter
+ *
+ * @param p_bool[out] Boolean, unchanged if parameter is not given
+ *
+ * @return  CBL_ERR_NEED_PARAM if parameter is not given
+ */
+cbl_err_code_t parser_get_bool (parser_t * phPrsr, const char * name,
+        bool * p_bool)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    parser_arg_t * pArg = parser_get_arg(phPrsr, name, strlen(name));
+
+    if (NULL == pArg)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    if (CONV_BOOL != pArg->conv)
+    {
+        bool isTrue;
+
+        eCode = enum_bool(pArg->val, pArg->valLen, &isTrue);
+        ERR_CHECK(eCode);
+        pArg->num = isTrue;
+        pArg->conv = CONV_BOOL;
+    }
+
+    *p_bool = 0u != pArg->num;
+    return eCode;
+}
+
+/**
+ * @brief           FNV-1a hash, used for hash indexes of names
+ *
+ * @param buf[in]   Bytes to hash
+ *
+ * @param len[in]   Length of buf
+ */
+uint32_t str_hash (const char * buf, size_t len)
+{
+    uint32_t hash = STR_HASH_FNV_BASIS;
+
+    for (size_t iii = 0u; iii < len; iii++)
+    {
+        hash ^= (uint8_t)buf[iii];
+        hash *= STR_HASH_FNV_PRIME;
+    }
+
+    return hash;
+}
+
 // \f - new page
 
 /**
@@ -254,43 +431,13 @@ uint32_t ui32_min (uint32_t num1, uint32_t num2)
 cbl_err_code_t two_hex_chars2ui8 (uint8_t high_half, uint8_t low_half,
         uint8_t * p_result)
 {
-    cbl_err_code_t eCode = CBL_ERR_OK;
-
-    *p_result = 0x00;
+    uint32_t sum = 0;
+    uint8_t pair[2];
 
-    high_half = toupper(high_half);
-    low_half = toupper(low_half);
+    pair[0] = high_half;
+    pair[1] = low_half;
 
-    if (high_half >= '0' && high_half <= '9')
-    {
-        *p_result = (high_half - '0');
-    }
-    else if (high_half >= 'A' && high_half <= 'F')
-    {
-        *p_result = (high_half - 'A') + 0x0A;
-    }
-    else
-    {
-        return CBL_ERR_INV_HEX;
-    }
-
-    /* Move value to high-order half byte */
-    *p_result = ( *p_result & 0x0F) << 4;
-
-    if (low_half >= '0' && low_half <= '9')
-    {
-        *p_result |= (low_half - '0') & 0x0f;
-    }
-    else if (low_half >= 'A' && low_half <= 'F')
-    {
-        *p_result |= ((low_half - 'A') + 0x0A) & 0x0F;
-    }
-    else
-    {
-        return CBL_ERR_INV_HEX;
-    }
-
-    return eCode;
+    return hex_decode(pair, 1, p_result, &sum);
 }
 
 /**
@@ -306,23 +453,18 @@ cbl_err_code_t four_hex_chars2ui16 (uint8_t * array, uint32_t len,
         uint16_t * p_result)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t sum = 0;
+    uint8_t bytes[2];
 
     if (len != 4)
     {
         return CBL_ERR_INV_HEX;
     }
 
-    *p_result = 0;
-
-    for (int iii = 0; iii < len; iii += 2)
-    {
-        uint8_t one_byte;
-
-        eCode = two_hex_chars2ui8(array[iii], array[iii + 1], &one_byte);
-        ERR_CHECK(eCode);
+    eCode = hex_decode(array, sizeof(bytes), bytes, &sum);
+    ERR_CHECK(eCode);
 
-        *p_result |= one_byte << (8 - (iii * 4));
-    }
+    *p_result = (uint16_t)((bytes[0] << 8) | bytes[1]);
 
     return eCode;
 }
@@ -340,25 +482,89 @@ cbl_err_code_t eight_hex_chars2ui32 (uint8_t * array, uint32_t len,
         uint32_t * p_result)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t sum = 0;
+    uint8_t bytes[4];
 
     if (len != 8)
     {
         return CBL_ERR_INV_HEX;
     }
 
-    *p_result = 0;
+    eCode = hex_decode(array, sizeof(bytes), bytes, &sum);
+    ERR_CHECK(eCode);
 
-    for (int iii = 0; iii < len; iii += 2)
+    *p_result = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16)
+            | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+
+    return eCode;
+}
+
+/**
+ * @brief Converts pairs of hex characters to bytes and adds the bytes to
+ *        a sum, for record checksums. Characters are checked and converted
+ *        with one table look up, validity is checked once for all pairs
+ *
+ * @param p_hex[in]     Hex characters, upper or lower case
+ * @param n_bytes[in]   Number of bytes to convert, p_hex holds twice as many
+ *                      characters
+ * @param p_out[out]    Converted bytes
+ * @param p_sum[in,out] Sum the converted bytes are added to
+ *
+ * @return CBL_ERR_INV_HEX if any character is not a hex digit
+ */
+cbl_err_code_t hex_decode (const uint8_t * p_hex, uint32_t n_bytes,
+        uint8_t * p_out, uint32_t * p_sum)
+{
+    uint32_t valid = HEX_LUT_VALID;
+    uint32_t sum = *p_sum;
+
+    for (uint32_t iii = 0; iii < n_bytes; iii++)
     {
-        uint8_t one_byte;
+        uint8_t high_half = hex_lut[p_hex[2 * iii]];
+        uint8_t low_half = hex_lut[p_hex[2 * iii + 1]];
 
-        eCode = two_hex_chars2ui8(array[iii], array[iii + 1], &one_byte);
-        ERR_CHECK(eCode);
+        valid &= high_half & low_half;
 
-        *p_result |= one_byte << (24 - (iii * 4));
+        /* Valid flag of high half is shifted out */
+        p_out[iii] = (uint8_t)((high_half << 4) | (low_half & 0x0F));
+        sum += p_out[iii];
     }
 
-    return eCode;
+    if (0 == valid)
+    {
+        return CBL_ERR_INV_HEX;
+    }
+
+    *p_sum = sum;
+
+    return CBL_ERR_OK;
 }
-/*** end of file ***/
 
+/**
+ * @brief Converts text of a boolean parameter to boolean
+ *
+ * @param char_bool[in] Text of parameter value
+ * @param len[in]       Length of char_bool
+ * @param p_bool[out]   Pointer to boolean
+ */
+cbl_err_code_t enum_bool (char * char_bool, uint32_t len, bool * p_bool)
+{
+    if (strlen(TXT_PAR_TRUE) == len
+            && strncmp(char_bool, TXT_PAR_TRUE, len) == 0)
+    {
+        ( *p_bool) = true;
+    }
+    else if (strlen(TXT_PAR_FALSE) == len
+            && strncmp(char_bool, TXT_PAR_FALSE, len) == 0)
+    {
+        ( *p_bool) = false;
+    }
+    else
+    {
+        return CBL_ERR_PAR_BOOL;
+    }
+
+    return CBL_ERR_OK;
+}
+
+/*** end of file ***/
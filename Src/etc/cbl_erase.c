@@ -0,0 +1,276 @@
+/** @file cbl_erase.c
+ *
+ * @brief Lazy erase of the area an application is written to. Sectors are
+ *        erased just before the first write reaches them. Blank sectors are
+ *        always skipped. Programming, read back with USE_WRITE_VERIFY
+ */
+#include "etc/cbl_erase.h"
+#include "etc/cbl_boot_record.h"
+#include "etc/cbl_perf.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t act_sect_sz[BOOT_ACT_APP_MAX_SECTORS] =
+BOOT_ACT_APP_SECTOR_SIZES;
+static const uint32_t new_sect_sz[BOOT_NEW_APP_MAX_SECTORS] =
+BOOT_NEW_APP_SECTOR_SIZES;
+static const uint32_t flash_sect_sz[ERASE_N_SECTORS] = ERASE_SECTOR_SIZES;
+
+static cbl_err_code_t erase_if_used (uint32_t sect, uint32_t address,
+        uint32_t sect_sz, uint32_t * p_n_erased);
+
+/**
+ * @brief Prepares erasing of the area, nothing is erased yet
+ *
+ * @param ph_erase[out] Handle of the erase
+ * @param area_start    BOOT_ACT_APP_START or BOOT_NEW_APP_START
+ */
+cbl_err_code_t erase_init (h_erase_t * ph_erase, uint32_t area_start)
+{
+    if (BOOT_ACT_APP_START == area_start)
+    {
+        ph_erase->p_sect_sz = act_sect_sz;
+        ph_erase->first_sect = BOOT_ACT_APP_START_SECTOR;
+        ph_erase->n_sect = BOOT_ACT_APP_MAX_SECTORS;
+    }
+    else if (BOOT_NEW_APP_START == area_start)
+    {
+        ph_erase->p_sect_sz = new_sect_sz;
+        ph_erase->first_sect = BOOT_NEW_APP_START_SECTOR;
+        ph_erase->n_sect = BOOT_NEW_APP_MAX_SECTORS;
+    }
+    else
+    {
+        return CBL_ERR_INV_PARAM;
+    }
+
+    ph_erase->area_start = area_start;
+    ph_erase->n_done = 0;
+    ph_erase->done_end = area_start;
+    ph_erase->n_erased = 0;
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Makes sure the bytes can be written. Every sector from the start of
+ *        the area to the last byte is erased, unless it was done already or
+ *        is blank. Sectors before the bytes are included so gaps left by hex
+ *        and srec stay erased
+ *
+ * @param ph_erase Handle of the erase
+ * @param address  Address of the first byte to write
+ * @param len      Number of bytes to write
+ */
+cbl_err_code_t erase_prepare (h_erase_t * ph_erase, uint32_t address,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t sect_sz;
+
+    if (0 == len)
+    {
+        return eCode;
+    }
+
+    /* Bytes outside the area are refused by the write itself */
+    while (address + len > ph_erase->done_end
+            && ph_erase->n_done < ph_erase->n_sect)
+    {
+        sect_sz = ph_erase->p_sect_sz[ph_erase->n_done];
+
+        eCode = erase_if_used(ph_erase->first_sect + ph_erase->n_done,
+                ph_erase->done_end, sect_sz, &ph_erase->n_erased);
+        ERR_CHECK(eCode);
+
+        ph_erase->n_done++;
+        ph_erase->done_end += sect_sz;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Marks sectors before the address as done, they are kept as they are.
+ *        Used when transfer continues in the middle of the area
+ *
+ * @param ph_erase Handle of the erase
+ * @param address  Start of a sector, sectors from it on are erased on use
+ */
+void erase_skip (h_erase_t * ph_erase, uint32_t address)
+{
+    while (ph_erase->n_done < ph_erase->n_sect
+            && ph_erase->done_end + ph_erase->p_sect_sz[ph_erase->n_done]
+                    <= address)
+    {
+        ph_erase->done_end += ph_erase->p_sect_sz[ph_erase->n_done];
+        ph_erase->n_done++;
+    }
+}
+
+/**
+ * @brief Gets start of the sector of the area the address is in
+ *
+ * @param ph_erase Handle of the erase
+ * @param address  Address in the area
+ *
+ * @return Start of the sector, end of the area if address is after it
+ */
+uint32_t erase_sect_floor (const h_erase_t * ph_erase, uint32_t address)
+{
+    uint32_t sect_start = ph_erase->area_start;
+
+    for (uint32_t iii = 0; iii < ph_erase->n_sect; iii++)
+    {
+        if (address < sect_start + ph_erase->p_sect_sz[iii])
+        {
+            break;
+        }
+        sect_start += ph_erase->p_sect_sz[iii];
+    }
+
+    return sect_start;
+}
+
+/**
+ * @brief Erases sectors by number, blank ones are skipped
+ *
+ * @param first_sect      First sector to erase
+ * @param count           Number of sectors to erase
+ * @param p_n_erased[out] Number of sectors which had to be erased, rest were
+ *                        blank
+ */
+cbl_err_code_t erase_sectors (uint32_t first_sect, uint32_t count,
+        uint32_t * p_n_erased)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t address = ERASE_FLASH_START;
+
+    *p_n_erased = 0;
+
+    if (first_sect >= ERASE_N_SECTORS)
+    {
+        return CBL_ERR_INV_SECT;
+    }
+
+    if (0 == count || count > ERASE_N_SECTORS - first_sect)
+    {
+        return CBL_ERR_INV_SECT_COUNT;
+    }
+
+    for (uint32_t iii = 0; iii < first_sect; iii++)
+    {
+        address += flash_sect_sz[iii];
+    }
+
+    for (uint32_t iii = first_sect; iii < first_sect + count; iii++)
+    {
+        eCode = erase_if_used(iii, address, flash_sect_sz[iii], p_n_erased);
+        ERR_CHECK(eCode);
+
+        address += flash_sect_sz[iii];
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Checks if flash is erased, stops at the first programmed word.
+ *        Four words are read at once, which compiles to LDM, and are checked
+ *        together
+ *
+ * @param address Address of the first byte, word aligned
+ * @param len     Number of bytes, multiple of 4
+ *
+ * @return True if every byte is 0xFF
+ */
+bool flash_is_blank (uint32_t address, uint32_t len)
+{
+    const uint32_t *p_word = (const uint32_t *)address;
+    uint32_t n_words = len / 4u;
+    uint32_t iii = 0;
+
+    for (; iii + 4u <= n_words; iii += 4u)
+    {
+        if (UINT32_MAX != (p_word[iii] & p_word[iii + 1u] & p_word[iii + 2u]
+                & p_word[iii + 3u]))
+        {
+            return false;
+        }
+    }
+
+    for (; iii < n_words; iii++)
+    {
+        if (UINT32_MAX != p_word[iii])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Programs bytes to flash. With USE_WRITE_VERIFY set to 1 in
+ *        cbl_config.h written bytes are read back and compared with p_data
+ *        right away, so checksum accumulated over p_data also holds for the
+ *        flash
+ *
+ * @param address Address of the first byte
+ * @param p_data  Bytes to program
+ * @param len     Number of bytes
+ *
+ * @return CBL_ERR_VERIFY if flash doesn't hold p_data after programming
+ */
+cbl_err_code_t flash_program (uint32_t address, const uint8_t * p_data,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = hal_write_program_bytes(address, (uint8_t *)p_data, len);
+    ERR_CHECK(eCode);
+
+#if 1 == USE_WRITE_VERIFY
+    if (memcmp((const void *)address, p_data, len) != 0)
+    {
+        WARNING("Flash at 0x%08lx doesn't match written bytes\r\n", address);
+        return CBL_ERR_VERIFY;
+    }
+#endif /* USE_WRITE_VERIFY */
+
+    return eCode;
+}
+
+/**
+ * @brief Erases the sector unless it is blank
+ *
+ * @param sect               Sector number
+ * @param address            Address of the sector
+ * @param sect_sz            Size of the sector
+ * @param p_n_erased[in,out] Counter of erased sectors, incremented on erase
+ */
+static cbl_err_code_t erase_if_used (uint32_t sect, uint32_t address,
+        uint32_t sect_sz, uint32_t * p_n_erased)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (true == flash_is_blank(address, sect_sz))
+    {
+        return eCode;
+    }
+
+    PERF_START(PERF_ERASE);
+    hal_led_on(LED_MEMORY);
+    eCode = hal_flash_erase_sector(sect, 1);
+    hal_led_off(LED_MEMORY);
+    PERF_STOP(PERF_ERASE);
+    ERR_CHECK(eCode);
+
+    ( *p_n_erased)++;
+
+    return eCode;
+}
+
+/*** end of file ***/
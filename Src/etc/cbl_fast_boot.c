@@ -0,0 +1,112 @@
+/** @file cbl_fast_boot.c
+ *
+ * @brief Fast boot jumps to the active application without the shell, when
+ *        boot record enables it, no update is pending and the application
+ *        passes the check of its length, vector table and CRC32
+ */
+#include "etc/cbl_fast_boot.h"
+#include "etc/cbl_boot_record.h"
+#include "etc/cbl_checksum.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_perf.h"
+
+/**
+ * @brief Checks if boot record requests fast boot and no update is pending
+ */
+bool fast_boot_is_on (void)
+{
+    boot_record_t * p_boot_record = boot_record_get();
+
+    return true == p_boot_record->is_fast_boot
+            && false == p_boot_record->is_new_app_ready;
+}
+
+/**
+ * @brief Checks the active application before jumping to it without shell
+ *
+ * @return CBL_ERR_OK if application can be started
+ */
+cbl_err_code_t fast_boot_verify (void)
+{
+    uint32_t start = ab_act_start();
+    boot_record_t * p_boot_record = boot_record_get();
+    uint32_t len = p_boot_record->act_app.len;
+    uint32_t msp = *(volatile uint32_t *)start;
+    uint32_t reset_handler = *(volatile uint32_t *)(start + 4u);
+
+    if (0 == len || len > BOOT_ACT_APP_MAX_LEN)
+    {
+        return CBL_ERR_APP_LEN_UNKNOWN;
+    }
+
+    /* Initial stack pointer is the end of stack, word aligned, in RAM */
+    if ((msp % 4) != 0
+            || ((msp <= FAST_BOOT_SRAM_START || msp > FAST_BOOT_SRAM_END)
+                    && (msp <= FAST_BOOT_CCM_START || msp > FAST_BOOT_CCM_END)))
+    {
+        return CBL_ERR_FAST_BOOT;
+    }
+
+    /* Reset handler is thumb code inside of the application */
+    if ((reset_handler & 1u) == 0 || (reset_handler & ~1u) < start
+            || (reset_handler & ~1u) >= start + len)
+    {
+        return CBL_ERR_FAST_BOOT;
+    }
+
+    if (fast_boot_digest(start, len) != p_boot_record->act_app_crc)
+    {
+        return CBL_ERR_CKSUM_WRONG;
+    }
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Stores cycles since reset in the boot record, called right before
+ *        fast boot jumps. Only the first fast boot of an application is
+ *        measured, so later ones don't write the flash
+ */
+void fast_boot_cycles_store (void)
+{
+    boot_record_t * p_boot_record = boot_record_get();
+    uint32_t cycles = perf_cycles();
+
+    if (0 != p_boot_record->fast_boot_cycles)
+    {
+        return;
+    }
+
+    /* 0 means not measured */
+    p_boot_record->fast_boot_cycles = (0 != cycles) ? cycles : 1u;
+    boot_record_set(p_boot_record);
+}
+
+/**
+ * @brief Calculates CRC32 of an application, length is rounded up to whole
+ *        words, bytes after the application are erased
+ *
+ * @note  With USE_CRC_DMA the digest is native CRC of the CRC unit, it
+ *        differs from the one without DMA. After changing USE_CRC_DMA fast
+ *        boot has to be enabled again
+ *
+ * @param start Start of application
+ * @param len   Length of application
+ */
+uint32_t fast_boot_digest (uint32_t start, uint32_t len)
+{
+#if 1 == USE_CRC_DMA
+    if (crc32_native_start((const uint32_t *)start,
+            (len + 3u) / 4u) != CBL_ERR_OK)
+    {
+        /* Never matches a stored digest, shell is started */
+        return 0;
+    }
+
+    return crc32_native_wait();
+#else
+    return crc32_calc((const uint8_t *)start, (len + 3u) & ~3u);
+#endif /* USE_CRC_DMA */
+}
+
+/*** end of file ***/
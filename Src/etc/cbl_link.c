@@ -0,0 +1,281 @@
+/** @file cbl_link.c
+ *
+ * @brief Link to the host. UART is used unless host enumerated the USB CDC
+ *        device when the shell starts
+ */
+#include "etc/cbl_link.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if 1 == USE_TX_QUEUE
+#define TX_QUEUE_MASK (LINK_TX_QUEUE_SZ - 1u)
+#endif /* USE_TX_QUEUE */
+
+static cbl_err_code_t link_uart_send (const char * buf, size_t len);
+#if 1 == USE_TX_QUEUE
+static cbl_err_code_t link_uart_send_start (const char * buf, size_t len);
+static uint32_t tx_queue_count (void);
+#endif /* USE_TX_QUEUE */
+#if 1 != USE_RX_RING
+static cbl_err_code_t link_uart_recv_start (uint8_t * buf, uint32_t len);
+static bool link_uart_recv_is_done (void);
+#endif /* USE_RX_RING */
+
+static const link_t link_uart =
+{
+    .name = "UART",
+    .send = link_uart_send,
+#if 1 == USE_RX_RING
+    .recv_start = NULL,
+    .recv_is_done = NULL,
+    .recv_circ_start = hal_recv_from_host_circ_start,
+    .recv_circ_pos = hal_recv_from_host_circ_pos,
+#else
+    .recv_start = link_uart_recv_start,
+    .recv_is_done = link_uart_recv_is_done,
+    .recv_circ_start = NULL,
+    .recv_circ_pos = NULL,
+#endif /* USE_RX_RING */
+    .recv_stop = hal_recv_from_host_stop,
+    .baud_set = hal_uart_baud_set,
+#if 1 == USE_TX_QUEUE
+    .send_start = link_uart_send_start,
+    .send_is_done = hal_send_to_host_is_done,
+#else
+    .send_start = NULL,
+    .send_is_done = NULL,
+#endif /* USE_TX_QUEUE */
+};
+
+#if 1 == USE_LINK_USB
+static const link_t link_usb =
+{
+    .name = "USB",
+    .send = hal_usb_send,
+    .recv_start = NULL,
+    .recv_is_done = NULL,
+    .recv_circ_start = hal_usb_recv_circ_start,
+    .recv_circ_pos = hal_usb_recv_circ_pos,
+    .recv_stop = hal_usb_recv_stop,
+    .baud_set = NULL, /* Line coding of CDC doesn't change the speed */
+    .send_start = NULL, /* CDC packets are sent by USB itself */
+    .send_is_done = NULL,
+};
+#endif /* USE_LINK_USB */
+
+/** Link the shell runs on */
+static const link_t * p_link = &link_uart;
+/** Takes what is sent instead of the link, NULL if none */
+static const link_sink_t * p_sink = NULL;
+
+#if 1 == USE_TX_QUEUE
+/** Bytes waiting to be sent, TX DMA reads them from tx_tail */
+static uint8_t tx_queue[LINK_TX_QUEUE_SZ] __attribute__((aligned(4)));
+static uint32_t tx_head = 0; /*!< Index queued bytes are copied to next */
+static uint32_t tx_tail = 0; /*!< Index of the first byte not yet sent */
+static uint32_t tx_dma_len = 0; /*!< Bytes from tx_tail TX DMA is sending */
+#endif /* USE_TX_QUEUE */
+
+/**
+ * @brief Chooses the link, called before anything is sent to the host
+ */
+void link_init (void)
+{
+    link_flush();
+    p_link = &link_uart;
+
+#if 1 == USE_LINK_USB
+    if (true == hal_usb_is_configured())
+    {
+        p_link = &link_usb;
+    }
+#endif /* USE_LINK_USB */
+}
+
+/**
+ * @brief Returns the link the shell runs on
+ */
+const link_t * link_get (void)
+{
+    return p_link;
+}
+
+/**
+ * @brief Sets the sink, NULL sends to the link again
+ *
+ * @param p_new_sink[in] Sink or NULL
+ *
+ * @return Previous sink, to be set back
+ */
+const link_sink_t * link_sink_set (const link_sink_t * p_new_sink)
+{
+    const link_sink_t * p_prev = p_sink;
+
+    p_sink = p_new_sink;
+
+    return p_prev;
+}
+
+/**
+ * @brief Sends bytes to the host. With TX queue short sends are copied to the
+ *        queue and sent by DMA, else blocks until buf can be reused. With a
+ *        sink bytes go to the sink
+ */
+cbl_err_code_t link_send (const char * buf, size_t len)
+{
+#if 1 == USE_TX_QUEUE
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t first_len;
+
+    if (NULL != p_sink)
+    {
+        return p_sink->send(buf, len);
+    }
+
+    if (NULL == p_link->send_start || len > LINK_TX_QUEUE_SZ / 2u)
+    {
+        /* Long ones, e.g. memory read, are sent from where they are, after
+         * what is queued before them */
+        eCode = link_flush();
+        ERR_CHECK(eCode);
+
+        return p_link->send(buf, len);
+    }
+
+    /* One byte stays free, equal indexes mean an empty queue */
+    while (LINK_TX_QUEUE_SZ - 1u - tx_queue_count() < len)
+    {
+        eCode = link_tx_poll();
+        ERR_CHECK(eCode);
+    }
+
+    first_len = ui32_min(len, LINK_TX_QUEUE_SZ - tx_head);
+    memcpy( &tx_queue[tx_head], buf, first_len);
+    memcpy(tx_queue, buf + first_len, len - first_len);
+    tx_head = (tx_head + len) & TX_QUEUE_MASK;
+
+    return link_tx_poll();
+#else
+    if (NULL != p_sink)
+    {
+        return p_sink->send(buf, len);
+    }
+
+    return p_link->send(buf, len);
+#endif /* USE_TX_QUEUE */
+}
+
+/**
+ * @brief Blocks until every queued byte is sent. Without TX queue sends
+ *        always block, nothing to wait for. Sink is flushed first
+ */
+cbl_err_code_t link_flush (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (NULL != p_sink)
+    {
+        eCode = p_sink->flush();
+        ERR_CHECK(eCode);
+    }
+
+#if 1 == USE_TX_QUEUE
+    while (tx_queue_count() != 0)
+    {
+        eCode = link_tx_poll();
+        ERR_CHECK(eCode);
+    }
+#endif /* USE_TX_QUEUE */
+
+    return eCode;
+}
+
+/**
+ * @brief Moves TX queue on. When DMA finished starts it on the next queued
+ *        bytes, up to the end of the queue. Called from loops which wait
+ */
+cbl_err_code_t link_tx_poll (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+#if 1 == USE_TX_QUEUE
+    if (0 != tx_dma_len)
+    {
+        if (false == p_link->send_is_done())
+        {
+            return eCode;
+        }
+
+        tx_tail = (tx_tail + tx_dma_len) & TX_QUEUE_MASK;
+        tx_dma_len = 0;
+    }
+
+    if (tx_head != tx_tail)
+    {
+        tx_dma_len = (tx_head > tx_tail) ? tx_head - tx_tail :
+                LINK_TX_QUEUE_SZ - tx_tail;
+
+        eCode = p_link->send_start((const char *) &tx_queue[tx_tail],
+                tx_dma_len);
+        if (CBL_ERR_OK != eCode)
+        {
+            /* Queued bytes are lost, link is broken anyway */
+            tx_tail = tx_head;
+            tx_dma_len = 0;
+        }
+    }
+#endif /* USE_TX_QUEUE */
+
+    return eCode;
+}
+
+/**
+ * @brief Sends over UART
+ */
+static cbl_err_code_t link_uart_send (const char * buf, size_t len)
+{
+    return hal_send_to_host((char *)buf, len);
+}
+
+#if 1 == USE_TX_QUEUE
+/**
+ * @brief Starts TX DMA over UART
+ */
+static cbl_err_code_t link_uart_send_start (const char * buf, size_t len)
+{
+    return hal_send_to_host_start((char *)buf, len);
+}
+
+/**
+ * @brief Bytes in TX queue, also the ones DMA is sending
+ */
+static uint32_t tx_queue_count (void)
+{
+    return (tx_head - tx_tail) & TX_QUEUE_MASK;
+}
+#endif /* USE_TX_QUEUE */
+
+#if 1 != USE_RX_RING
+/**
+ * @brief Starts DMA receive of one request, UART callback counts it done
+ */
+static cbl_err_code_t link_uart_recv_start (uint8_t * buf, uint32_t len)
+{
+    /* Reset UART byte counter */
+    gRxCmdCntr = 0;
+
+    return hal_recv_from_host_start(buf, len);
+}
+
+/**
+ * @brief True when UART received the whole request
+ */
+static bool link_uart_recv_is_done (void)
+{
+    return gRxCmdCntr != 0;
+}
+#endif /* USE_RX_RING */
+
+/*** end of file ***/
@@ -0,0 +1,472 @@
+/** @file cbl_lz4.c
+ *
+ * @brief Streaming decompression of LZ4 frames straight to flash. Output is
+ *        written in order, so matches are copied from the flash already
+ *        written and only a small write buffer is kept in RAM
+ */
+#include "etc/cbl_lz4.h"
+#include "etc/cbl_perf.h"
+#include <string.h>
+
+#define LZ4_FLG_VERSION 0x40u /*!< Version bits shall be 01 */
+#define LZ4_FLG_BLOCK_CKSUM 0x10u
+#define LZ4_FLG_CONTENT_SIZE 0x08u
+#define LZ4_FLG_CONTENT_CKSUM 0x04u
+#define LZ4_FLG_DICT_ID 0x01u
+#define LZ4_BLOCK_RAW 0x80000000UL /*!< Block is stored uncompressed */
+#define LZ4_BLOCK_MAX (4UL * 1024 * 1024) /*!< Largest block of the format */
+#define LZ4_MIN_MATCH 4u
+#define LZ4_LEN_MORE 15u /*!< Length in token continues in next bytes */
+
+typedef enum
+{
+    LZ4_ST_MAGIC = 0,
+    LZ4_ST_FLG,
+    LZ4_ST_BD,
+    LZ4_ST_SKIP,
+    LZ4_ST_BLOCK_SIZE,
+    LZ4_ST_RAW,
+    LZ4_ST_TOKEN,
+    LZ4_ST_LIT_LEN,
+    LZ4_ST_LIT,
+    LZ4_ST_OFFSET,
+    LZ4_ST_MATCH_LEN,
+    LZ4_ST_DONE
+} lz4_state_t;
+
+static cbl_err_code_t lz4_copy (h_lz4_t * ph_lz4, const uint8_t * buf,
+        uint32_t len);
+static cbl_err_code_t lz4_match (h_lz4_t * ph_lz4, uint32_t offset);
+static cbl_err_code_t lz4_flush (h_lz4_t * ph_lz4);
+static cbl_err_code_t lz4_block_byte (h_lz4_t * ph_lz4);
+static void lz4_block_end (h_lz4_t * ph_lz4);
+static void lz4_literals_end (h_lz4_t * ph_lz4);
+static void lz4_skip (h_lz4_t * ph_lz4, uint32_t n_bytes, uint32_t next);
+
+/**
+ * @brief Prepares the decompressor for a new frame
+ *
+ * @param ph_lz4[out]   Handle of the decompressor
+ * @param out_start[in] Address of output, word aligned
+ * @param out_max[in]   Maximum length of output
+ * @param write[in]     Function receiving output
+ */
+cbl_err_code_t lz4_init (h_lz4_t * ph_lz4, uint32_t out_start,
+        uint32_t out_max, lz4_write_t write)
+{
+    if (NULL == ph_lz4 || NULL == write)
+    {
+        return CBL_ERR_NULL_PAR;
+    }
+
+    memset(ph_lz4, 0, sizeof( *ph_lz4));
+    ph_lz4->write = write;
+    ph_lz4->out_start = out_start;
+    ph_lz4->out_max = out_max;
+    ph_lz4->state = LZ4_ST_MAGIC;
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Decompresses next piece of the frame, pieces can be split anywhere.
+ *        Bytes after the end of the frame are ignored
+ *
+ * @param ph_lz4[in] Handle of the decompressor
+ * @param buf[in]    Piece of the frame
+ * @param len[in]    Length of buf
+ */
+cbl_err_code_t lz4_feed (h_lz4_t * ph_lz4, const uint8_t * buf, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t n_bytes;
+
+    while (len > 0 && LZ4_ST_DONE != ph_lz4->state)
+    {
+        switch (ph_lz4->state)
+        {
+            case LZ4_ST_RAW:
+            case LZ4_ST_LIT:
+            {
+                /* Bulk of the data, copied without looking at every byte */
+                n_bytes = ui32_min(len, ph_lz4->block_left);
+                if (LZ4_ST_LIT == ph_lz4->state)
+                {
+                    n_bytes = ui32_min(n_bytes, ph_lz4->lit_len);
+                    ph_lz4->lit_len -= n_bytes;
+                }
+                eCode = lz4_copy(ph_lz4, buf, n_bytes);
+                ERR_CHECK(eCode);
+                ph_lz4->block_left -= n_bytes;
+                buf += n_bytes;
+                len -= n_bytes;
+
+                if (LZ4_ST_RAW == ph_lz4->state)
+                {
+                    if (0 == ph_lz4->block_left)
+                    {
+                        lz4_block_end(ph_lz4);
+                    }
+                }
+                else if (0 == ph_lz4->lit_len)
+                {
+                    lz4_literals_end(ph_lz4);
+                }
+                else if (0 == ph_lz4->block_left)
+                {
+                    /* Block ended in the middle of literals */
+                    return CBL_ERR_INV_LZ4;
+                }
+            }
+            break;
+
+            case LZ4_ST_SKIP:
+            {
+                n_bytes = ui32_min(len, ph_lz4->skip);
+                ph_lz4->skip -= n_bytes;
+                buf += n_bytes;
+                len -= n_bytes;
+
+                if (0 == ph_lz4->skip)
+                {
+                    ph_lz4->state = ph_lz4->next_state;
+                }
+            }
+            break;
+
+            case LZ4_ST_MAGIC:
+            case LZ4_ST_BLOCK_SIZE:
+            case LZ4_ST_OFFSET:
+            {
+                /* Little endian fields, 4 or 2 bytes */
+                ph_lz4->field |= (uint32_t) *buf << (8 * ph_lz4->field_len);
+                ph_lz4->field_len++;
+                buf++;
+                len--;
+
+                if (LZ4_ST_OFFSET == ph_lz4->state)
+                {
+                    eCode = lz4_block_byte(ph_lz4);
+                    ERR_CHECK(eCode);
+
+                    if (2 == ph_lz4->field_len)
+                    {
+                        ph_lz4->field_len = 0;
+                        if (LZ4_LEN_MORE == ph_lz4->match_len)
+                        {
+                            ph_lz4->state = LZ4_ST_MATCH_LEN;
+                        }
+                        else
+                        {
+                            eCode = lz4_match(ph_lz4, ph_lz4->field);
+                            ERR_CHECK(eCode);
+                        }
+                    }
+                }
+                else if (4 == ph_lz4->field_len)
+                {
+                    uint32_t field = ph_lz4->field;
+
+                    ph_lz4->field = 0;
+                    ph_lz4->field_len = 0;
+
+                    if (LZ4_ST_MAGIC == ph_lz4->state)
+                    {
+                        if (LZ4_MAGIC != field)
+                        {
+                            return CBL_ERR_INV_LZ4;
+                        }
+                        ph_lz4->state = LZ4_ST_FLG;
+                    }
+                    else if (0 == field)
+                    {
+                        /* End mark, content checksum may follow */
+                        lz4_skip(ph_lz4,
+                                (ph_lz4->flg & LZ4_FLG_CONTENT_CKSUM) ? 4 : 0,
+                                LZ4_ST_DONE);
+                    }
+                    else
+                    {
+                        ph_lz4->block_left = field & ~LZ4_BLOCK_RAW;
+                        if (ph_lz4->block_left > LZ4_BLOCK_MAX)
+                        {
+                            return CBL_ERR_INV_LZ4;
+                        }
+                        ph_lz4->state = (field & LZ4_BLOCK_RAW) ?
+                                LZ4_ST_RAW : LZ4_ST_TOKEN;
+                    }
+                }
+            }
+            break;
+
+            case LZ4_ST_FLG:
+            {
+                ph_lz4->flg = *buf;
+                buf++;
+                len--;
+
+                if ((ph_lz4->flg & 0xC0u) != LZ4_FLG_VERSION)
+                {
+                    return CBL_ERR_INV_LZ4;
+                }
+                ph_lz4->state = LZ4_ST_BD;
+            }
+            break;
+
+            case LZ4_ST_BD:
+            {
+                buf++;
+                len--;
+
+                /* Content size, dictionary ID and header checksum */
+                lz4_skip(ph_lz4,
+                        ((ph_lz4->flg & LZ4_FLG_CONTENT_SIZE) ? 8 : 0)
+                                + ((ph_lz4->flg & LZ4_FLG_DICT_ID) ? 4 : 0)
+                                + 1, LZ4_ST_BLOCK_SIZE);
+            }
+            break;
+
+            case LZ4_ST_TOKEN:
+            {
+                eCode = lz4_block_byte(ph_lz4);
+                ERR_CHECK(eCode);
+
+                ph_lz4->lit_len = *buf >> 4;
+                ph_lz4->match_len = *buf & 0x0Fu;
+                buf++;
+                len--;
+
+                if (LZ4_LEN_MORE == ph_lz4->lit_len)
+                {
+                    ph_lz4->state = LZ4_ST_LIT_LEN;
+                }
+                else if (0 == ph_lz4->lit_len)
+                {
+                    lz4_literals_end(ph_lz4);
+                }
+                else
+                {
+                    ph_lz4->state = LZ4_ST_LIT;
+                }
+            }
+            break;
+
+            case LZ4_ST_LIT_LEN:
+            case LZ4_ST_MATCH_LEN:
+            {
+                uint8_t more = *buf;
+
+                eCode = lz4_block_byte(ph_lz4);
+                ERR_CHECK(eCode);
+                buf++;
+                len--;
+
+                if (LZ4_ST_LIT_LEN == ph_lz4->state)
+                {
+                    ph_lz4->lit_len += more;
+                    if (more != 255)
+                    {
+                        ph_lz4->state = LZ4_ST_LIT;
+                    }
+                }
+                else
+                {
+                    ph_lz4->match_len += more;
+                    if (more != 255)
+                    {
+                        eCode = lz4_match(ph_lz4, ph_lz4->field);
+                        ERR_CHECK(eCode);
+                    }
+                }
+            }
+            break;
+
+            default:
+            {
+                return CBL_ERR_STATE;
+            }
+            break;
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Checks that the frame ended and writes the rest of output
+ *
+ * @param ph_lz4[in] Handle of the decompressor, out_len is length of output
+ */
+cbl_err_code_t lz4_finish (h_lz4_t * ph_lz4)
+{
+    if (LZ4_ST_DONE != ph_lz4->state)
+    {
+        return CBL_ERR_INV_LZ4;
+    }
+
+    return lz4_flush(ph_lz4);
+}
+
+/**
+ * @brief Appends bytes to output
+ */
+static cbl_err_code_t lz4_copy (h_lz4_t * ph_lz4, const uint8_t * buf,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t n_bytes;
+
+    if (len > ph_lz4->out_max - ph_lz4->out_len)
+    {
+        return CBL_ERR_NEW_APP_LEN;
+    }
+
+    while (len > 0)
+    {
+        n_bytes = ui32_min(len, LZ4_WBUF_SZ - ph_lz4->wbuf_len);
+        memcpy( &ph_lz4->wbuf[ph_lz4->wbuf_len], buf, n_bytes);
+        ph_lz4->wbuf_len += n_bytes;
+        ph_lz4->out_len += n_bytes;
+        buf += n_bytes;
+        len -= n_bytes;
+
+        if (LZ4_WBUF_SZ == ph_lz4->wbuf_len)
+        {
+            eCode = lz4_flush(ph_lz4);
+            ERR_CHECK(eCode);
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Copies match of match_len from 'offset' bytes back. Bytes already
+ *        written are read from flash, the rest from wbuf. Match may overlap
+ *        itself, so it is copied byte by byte
+ */
+static cbl_err_code_t lz4_match (h_lz4_t * ph_lz4, uint32_t offset)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t len = ph_lz4->match_len + LZ4_MIN_MATCH;
+    uint32_t src = ph_lz4->out_len - offset;
+    uint32_t wbuf_base;
+    uint8_t byte;
+
+    ph_lz4->field = 0;
+
+    if (0 == offset || offset > ph_lz4->out_len)
+    {
+        return CBL_ERR_INV_LZ4;
+    }
+    if (len > ph_lz4->out_max - ph_lz4->out_len)
+    {
+        return CBL_ERR_NEW_APP_LEN;
+    }
+
+    while (len > 0)
+    {
+        wbuf_base = ph_lz4->out_len - ph_lz4->wbuf_len;
+        if (src >= wbuf_base)
+        {
+            byte = ph_lz4->wbuf[src - wbuf_base];
+        }
+        else
+        {
+            byte = *(const volatile uint8_t *)(ph_lz4->out_start + src);
+        }
+
+        ph_lz4->wbuf[ph_lz4->wbuf_len] = byte;
+        ph_lz4->wbuf_len++;
+        ph_lz4->out_len++;
+        src++;
+        len--;
+
+        if (LZ4_WBUF_SZ == ph_lz4->wbuf_len)
+        {
+            eCode = lz4_flush(ph_lz4);
+            ERR_CHECK(eCode);
+        }
+    }
+
+    ph_lz4->state = LZ4_ST_TOKEN;
+    if (0 == ph_lz4->block_left)
+    {
+        lz4_block_end(ph_lz4);
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Writes output collected in wbuf
+ */
+static cbl_err_code_t lz4_flush (h_lz4_t * ph_lz4)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (ph_lz4->wbuf_len != 0)
+    {
+        PERF_START(PERF_WRITE);
+        eCode = ph_lz4->write(
+                ph_lz4->out_start + ph_lz4->out_len - ph_lz4->wbuf_len,
+                ph_lz4->wbuf, ph_lz4->wbuf_len);
+        PERF_STOP(PERF_WRITE);
+        ph_lz4->wbuf_len = 0;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Counts a byte of compressed block which is not a literal
+ */
+static cbl_err_code_t lz4_block_byte (h_lz4_t * ph_lz4)
+{
+    if (0 == ph_lz4->block_left)
+    {
+        return CBL_ERR_INV_LZ4;
+    }
+    ph_lz4->block_left--;
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Continues after a block, its checksum is skipped
+ */
+static void lz4_block_end (h_lz4_t * ph_lz4)
+{
+    lz4_skip(ph_lz4, (ph_lz4->flg & LZ4_FLG_BLOCK_CKSUM) ? 4 : 0,
+            LZ4_ST_BLOCK_SIZE);
+}
+
+/**
+ * @brief Continues after literals of a sequence, last sequence of a block has
+ *        no match
+ */
+static void lz4_literals_end (h_lz4_t * ph_lz4)
+{
+    if (0 == ph_lz4->block_left)
+    {
+        lz4_block_end(ph_lz4);
+    }
+    else
+    {
+        ph_lz4->field = 0;
+        ph_lz4->field_len = 0;
+        ph_lz4->state = LZ4_ST_OFFSET;
+    }
+}
+
+/**
+ * @brief Skips bytes of the frame, then continues with 'next' state
+ */
+static void lz4_skip (h_lz4_t * ph_lz4, uint32_t n_bytes, uint32_t next)
+{
+    ph_lz4->skip = n_bytes;
+    ph_lz4->next_state = next;
+    ph_lz4->state = (0 == n_bytes) ? next : LZ4_ST_SKIP;
+}
+
+/*** end of file ***/
@@ -0,0 +1,111 @@
+/** @file cbl_mem.c
+ *
+ * @brief Static memory arena for the big buffers of the commands, used as a
+ *        stack. Also measures peak use of the processor stack
+ */
+#include "etc/cbl_mem.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Symbols of the linker script, only their addresses are used */
+extern uint32_t _estack;
+extern uint32_t _Min_Stack_Size;
+
+static uint8_t arena[MEM_ARENA_SZ] __attribute__((aligned(MEM_ALIGN)));
+static uint32_t arena_used = 0;
+static uint32_t arena_peak = 0;
+
+/**
+ * @brief Takes bytes from the arena. They are given back with mem_release
+ *        of a mark taken before, at the latest when the command ends
+ *
+ * @param size Number of bytes
+ *
+ * @return Pointer aligned to MEM_ALIGN, NULL if arena is full
+ */
+void * mem_alloc (uint32_t size)
+{
+    uint32_t aligned = (size + MEM_ALIGN - 1u) & ~(MEM_ALIGN - 1u);
+    void * p_mem;
+
+    if (aligned < size || aligned > MEM_ARENA_SZ - arena_used)
+    {
+        WARNING("Arena full, %lu bytes requested\r\n", size);
+        return NULL;
+    }
+
+    p_mem = &arena[arena_used];
+    arena_used += aligned;
+
+    if (arena_used > arena_peak)
+    {
+        arena_peak = arena_used;
+    }
+
+    return p_mem;
+}
+
+/**
+ * @brief Returns mark of the arena, everything taken after it is given back
+ *        with mem_release
+ */
+uint32_t mem_mark (void)
+{
+    return arena_used;
+}
+
+/**
+ * @brief Gives back everything taken from the arena after the mark
+ */
+void mem_release (uint32_t mark)
+{
+    if (mark < arena_used)
+    {
+        arena_used = mark;
+    }
+}
+
+/**
+ * @brief Fills unused part of the stack with MEM_STACK_PAINT, called once at
+ *        start, when the stack is nearly empty
+ */
+void mem_stack_paint (void)
+{
+    volatile uint32_t here = 0;
+    uint32_t *p_bottom = (uint32_t *)((uint32_t) &_estack
+            - (uint32_t) &_Min_Stack_Size);
+    /* Leave the frame of this function alone */
+    uint32_t *p_top = (uint32_t *)(((uint32_t) &here - 64u) & ~3u);
+
+    for (uint32_t *p_word = p_bottom; p_word < p_top; p_word++)
+    {
+        *p_word = MEM_STACK_PAINT;
+    }
+}
+
+/**
+ * @brief Gets use of the arena and of the stack. Stack peak is found as the
+ *        lowest word which isn't MEM_STACK_PAINT anymore, if stack used more
+ *        than _Min_Stack_Size its size is returned
+ *
+ * @param p_stats[out] Statistics
+ */
+void mem_stats_get (mem_stats_t * p_stats)
+{
+    const uint32_t *p_bottom = (const uint32_t *)((uint32_t) &_estack
+            - (uint32_t) &_Min_Stack_Size);
+    const uint32_t *p_word = p_bottom;
+
+    while (p_word < &_estack && MEM_STACK_PAINT == *p_word)
+    {
+        p_word++;
+    }
+
+    p_stats->arena_sz = MEM_ARENA_SZ;
+    p_stats->arena_used = arena_used;
+    p_stats->arena_peak = arena_peak;
+    p_stats->stack_sz = (uint32_t) &_Min_Stack_Size;
+    p_stats->stack_peak = (uint32_t) &_estack - (uint32_t)p_word;
+}
+
+/*** end of file ***/
@@ -0,0 +1,124 @@
+/** @file cbl_perf.c
+ *
+ * @brief Cycle counter probes around the hot paths of an update. With
+ *        USE_PERF set to 1 in cbl_config.h every probe adds count, total, min
+ *        and max of the cycles it took to a static table, which is shown with
+ *        the perf command. Without it probes compile to nothing
+ */
+#include "etc/cbl_perf.h"
+
+/* Cortex-M4 debug registers, used directly so no CMSIS is needed */
+#define DEMCR (*(volatile uint32_t *)0xE000EDFCUL)
+#define DEMCR_TRCENA (1UL << 24)
+#define DWT_CTRL (*(volatile uint32_t *)0xE0001000UL)
+#define DWT_CTRL_CYCCNTENA (1UL << 0)
+#define DWT_CYCCNT (*(volatile uint32_t *)0xE0001004UL)
+
+#if 1 == USE_PERF
+static perf_stat_t perf_table[PERF_N_PROBES];
+
+/* Same order as perf_probe_t */
+static const char * const perf_names[PERF_N_PROBES] =
+{
+    "rx-wait",
+    "erase",
+    "write",
+    "cksum",
+    "records",
+    "lz4"
+};
+#endif /* USE_PERF */
+
+/**
+ * @brief Starts the cycle counter from 0. Also clears the table
+ */
+void perf_timer_start (void)
+{
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+#if 1 == USE_PERF
+    perf_reset();
+#endif /* USE_PERF */
+}
+
+/**
+ * @brief Gets cycles since perf_timer_start, wraps around in about 25 s
+ */
+uint32_t perf_cycles (void)
+{
+    return DWT_CYCCNT;
+}
+
+#if 1 == USE_PERF
+/**
+ * @brief Adds one hit of a probe to the table
+ *
+ * @param probe[in]  Probe which was hit
+ * @param cycles[in] Cycles the hit took
+ */
+void perf_add (perf_probe_t probe, uint32_t cycles)
+{
+    perf_stat_t * p_stat;
+
+    if (probe >= PERF_N_PROBES)
+    {
+        return;
+    }
+
+    p_stat = &perf_table[probe];
+    p_stat->count++;
+    p_stat->total += cycles;
+    if (cycles < p_stat->min)
+    {
+        p_stat->min = cycles;
+    }
+    if (cycles > p_stat->max)
+    {
+        p_stat->max = cycles;
+    }
+}
+
+/**
+ * @brief Clears all probes
+ */
+void perf_reset (void)
+{
+    for (uint32_t iii = 0; iii < PERF_N_PROBES; iii++)
+    {
+        perf_table[iii].count = 0;
+        perf_table[iii].total = 0;
+        perf_table[iii].min = UINT32_MAX;
+        perf_table[iii].max = 0;
+    }
+}
+
+/**
+ * @brief Gets statistics of a probe, NULL for invalid probe
+ */
+const perf_stat_t * perf_get (perf_probe_t probe)
+{
+    if (probe >= PERF_N_PROBES)
+    {
+        return NULL;
+    }
+
+    return &perf_table[probe];
+}
+
+/**
+ * @brief Gets name of a probe shown by the perf command
+ */
+const char * perf_name (perf_probe_t probe)
+{
+    if (probe >= PERF_N_PROBES)
+    {
+        return "";
+    }
+
+    return perf_names[probe];
+}
+#endif /* USE_PERF */
+
+/*** end of file ***/
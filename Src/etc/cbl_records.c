@@ -0,0 +1,600 @@
+/** @file cbl_records.c
+ *
+ * @brief Decoding of Intel hex and Motorola S-record files. Text is fed in
+ *        pieces of any length, records split between pieces are put together
+ *        before they are decoded
+ */
+#include "etc/cbl_records.h"
+#include "etc/cbl_perf.h"
+#include <string.h>
+
+#define IHEX_START ':'
+#define IHEX_HDR_LEN 3 /*!< ':' and byte count */
+#define SREC_START 'S'
+#define SREC_HDR_LEN 4 /*!< 'S', function type and byte count */
+
+static cbl_err_code_t records_get_len (h_records_t * ph_rec);
+static cbl_err_code_t records_handle (h_records_t * ph_rec);
+static cbl_err_code_t records_write (h_records_t * ph_rec, uint32_t address,
+        uint8_t * p_data, uint32_t len);
+static cbl_err_code_t records_flush (h_records_t * ph_rec);
+static bool records_is_in_area (const h_records_t * ph_rec, uint32_t address,
+        uint32_t len);
+static cbl_err_code_t hex_handle_fcn (h_records_t * ph_rec,
+        uint8_t * p_fcn_start, uint32_t len);
+static cbl_err_code_t hex_handle_fcn_00 (h_records_t * ph_rec,
+        uint16_t fcn_address, uint8_t * p_data, uint8_t byte_count);
+static cbl_err_code_t hex_handle_fcn_01 (h_records_t * ph_rec,
+        uint8_t byte_count);
+static cbl_err_code_t hex_handle_fcn_04 (h_records_t * ph_rec,
+        uint8_t * p_data, uint8_t byte_count);
+static cbl_err_code_t hex_handle_fcn_05 (h_records_t * ph_rec,
+        uint8_t * p_data, uint8_t byte_count);
+static cbl_err_code_t srec_handle_fcn (h_records_t * ph_rec,
+        uint8_t * p_fcn_start, uint32_t len);
+static cbl_err_code_t srec_handle_fcn_3 (h_records_t * ph_rec,
+        uint8_t * p_rec, uint8_t byte_count);
+
+/**
+ * @brief Prepares the decoder for a new file
+ *
+ * @param ph_rec[out]  Handle of the decoder
+ * @param app_type[in] TYPE_HEX or TYPE_SREC
+ * @param write[in]    Function receiving decoded data
+ */
+cbl_err_code_t records_init (h_records_t * ph_rec, app_type_t app_type,
+        record_write_t write)
+{
+    if (NULL == ph_rec || NULL == write)
+    {
+        return CBL_ERR_NULL_PAR;
+    }
+
+    if (TYPE_HEX != app_type && TYPE_SREC != app_type)
+    {
+        return CBL_ERR_APP_TYPE;
+    }
+
+    ph_rec->app_type = app_type;
+    ph_rec->write = write;
+    ph_rec->is_EOF = false;
+    ph_rec->upper_address = 0;
+    ph_rec->p_main = 0; /* Unused! */
+    ph_rec->area_start = BOOT_ACT_APP_START;
+    ph_rec->area_len = BOOT_ACT_APP_MAX_LEN;
+    ph_rec->addr_end = 0;
+    ph_rec->line_len = 0;
+    ph_rec->rec_len = 0;
+    ph_rec->wbuf_addr = 0;
+    ph_rec->wbuf_len = 0;
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Sets the area data records have to be in, used when file is linked
+ *        somewhere else than active application
+ *
+ * @param ph_rec[in] Handle of the decoder, after records_init
+ * @param start[in]  Start address of the area
+ * @param len[in]    Length of the area
+ */
+void records_set_area (h_records_t * ph_rec, uint32_t start, uint32_t len)
+{
+    ph_rec->area_start = start;
+    ph_rec->area_len = len;
+}
+
+/**
+ * @brief Decodes next piece of the file. Characters between records (line
+ *        endings) are skipped, incomplete record at the end of the piece is
+ *        kept for the next call
+ *
+ * @param ph_rec[in] Handle of the decoder
+ * @param buf[in]    Piece of the file
+ * @param len[in]    Length of buf
+ */
+cbl_err_code_t records_feed (h_records_t * ph_rec, const uint8_t * buf,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint8_t start_char = TYPE_HEX == ph_rec->app_type ? IHEX_START : SREC_START;
+    uint32_t hdr_len = TYPE_HEX == ph_rec->app_type ? IHEX_HDR_LEN : SREC_HDR_LEN;
+    uint32_t iii = 0;
+
+    while (iii < len && false == ph_rec->is_EOF)
+    {
+        uint32_t need;
+
+        if (0 == ph_rec->line_len)
+        {
+            /* Look for the start of the next record */
+            const uint8_t *p_start = memchr( &buf[iii], start_char, len - iii);
+
+            if (NULL == p_start)
+            {
+                break;
+            }
+            iii = p_start - buf;
+        }
+
+        /* Take header first, once byte count is known take the whole rest */
+        need = (0 == ph_rec->rec_len ? hdr_len : ph_rec->rec_len)
+                - ph_rec->line_len;
+        need = ui32_min(need, len - iii);
+
+        memcpy( &ph_rec->line[ph_rec->line_len], &buf[iii], need);
+        ph_rec->line_len += need;
+        iii += need;
+
+        if (0 == ph_rec->rec_len && hdr_len == ph_rec->line_len)
+        {
+            eCode = records_get_len(ph_rec);
+            ERR_CHECK(eCode);
+        }
+
+        if (0 != ph_rec->rec_len && ph_rec->rec_len == ph_rec->line_len)
+        {
+            eCode = records_handle(ph_rec);
+            ERR_CHECK(eCode);
+
+            ph_rec->line_len = 0;
+            ph_rec->rec_len = 0;
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Writes data still collected and checks that the file ended properly
+ */
+cbl_err_code_t records_finish (h_records_t * ph_rec)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = records_flush(ph_rec);
+    ERR_CHECK(eCode);
+
+    if (TYPE_HEX == ph_rec->app_type)
+    {
+        /* Intel hex has to end with EOF record */
+        return true == ph_rec->is_EOF ? CBL_ERR_OK : CBL_ERR_INV_IHEX;
+    }
+
+    return 0 == ph_rec->line_len ? CBL_ERR_OK : CBL_ERR_INV_SREC;
+}
+
+/**
+ * @brief Fills length of the current record from its header
+ */
+static cbl_err_code_t records_get_len (h_records_t * ph_rec)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint8_t byte_count;
+
+    if (TYPE_HEX == ph_rec->app_type)
+    {
+        eCode = two_hex_chars2ui8(ph_rec->line[1], ph_rec->line[2],
+                &byte_count);
+        ERR_CHECK(eCode);
+
+        /* 1 - ':', 2 - byte count, 4 - address, 2 - fcn code, 2*n -  data,
+         * 2 - checksum */
+        ph_rec->rec_len = 1 + 2 + 4 + 2 + byte_count * 2 + 2;
+
+        /* Record is copied into line, it has to fit */
+        if (ph_rec->rec_len > IHEX_MAX_LEN
+                || ph_rec->rec_len > sizeof(ph_rec->line))
+        {
+            return CBL_ERR_INV_IHEX;
+        }
+    }
+    else
+    {
+        eCode = two_hex_chars2ui8(ph_rec->line[2], ph_rec->line[3],
+                &byte_count);
+        ERR_CHECK(eCode);
+
+        if (byte_count < 3)
+        {
+            return CBL_ERR_INV_SREC;
+        }
+
+        /* 4 = 'S', function type and byte count */
+        ph_rec->rec_len = byte_count * 2 + 4;
+
+        if (ph_rec->rec_len > SREC_MAX_LEN
+                || ph_rec->rec_len > sizeof(ph_rec->line))
+        {
+            return CBL_ERR_INV_SREC;
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Decodes the collected record
+ */
+static cbl_err_code_t records_handle (h_records_t * ph_rec)
+{
+    if (TYPE_HEX == ph_rec->app_type)
+    {
+        return hex_handle_fcn(ph_rec, ph_rec->line, ph_rec->line_len);
+    }
+
+    return srec_handle_fcn(ph_rec, ph_rec->line, ph_rec->line_len);
+}
+
+/**
+ * @brief Collects decoded data, sink gets it in blocks ending on
+ *        RECORDS_WBUF_SZ boundary. Only the first and the last block of a run
+ *        of consecutive records can be shorter, so the sink can program whole
+ *        words instead of single bytes
+ */
+static cbl_err_code_t records_write (h_records_t * ph_rec, uint32_t address,
+        uint8_t * p_data, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (address + len > ph_rec->addr_end)
+    {
+        ph_rec->addr_end = address + len;
+    }
+
+    /* Data not following the collected one starts a new run */
+    if (ph_rec->wbuf_len != 0
+            && address != ph_rec->wbuf_addr + ph_rec->wbuf_len)
+    {
+        eCode = records_flush(ph_rec);
+        ERR_CHECK(eCode);
+    }
+
+    while (len > 0)
+    {
+        uint32_t part;
+
+        if (0 == ph_rec->wbuf_len)
+        {
+            ph_rec->wbuf_addr = address;
+        }
+
+        /* Fill up to the next boundary */
+        part = RECORDS_WBUF_SZ - (address & (RECORDS_WBUF_SZ - 1));
+        part = ui32_min(part, len);
+
+        memcpy( &ph_rec->wbuf[ph_rec->wbuf_len], p_data, part);
+        ph_rec->wbuf_len += part;
+        address += part;
+        p_data += part;
+        len -= part;
+
+        if ((address & (RECORDS_WBUF_SZ - 1)) == 0)
+        {
+            eCode = records_flush(ph_rec);
+            ERR_CHECK(eCode);
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Passes collected data to the sink
+ */
+static cbl_err_code_t records_flush (h_records_t * ph_rec)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (ph_rec->wbuf_len != 0)
+    {
+        PERF_START(PERF_WRITE);
+        eCode = ph_rec->write(ph_rec->wbuf_addr, ph_rec->wbuf,
+                ph_rec->wbuf_len);
+        PERF_STOP(PERF_WRITE);
+        ph_rec->wbuf_len = 0;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Checks if data of a record is inside of the area
+ */
+static bool records_is_in_area (const h_records_t * ph_rec, uint32_t address,
+        uint32_t len)
+{
+    return address >= ph_rec->area_start
+            && address - ph_rec->area_start <= ph_rec->area_len
+            && len <= ph_rec->area_len - (address - ph_rec->area_start);
+}
+
+/**
+ * @brief Decodes Intel hex record and calls handler of its function
+ *
+ * @param ph_rec[in]      Handle of the decoder
+ * @param p_fcn_start[in] Pointer to record, starting with ':'
+ * @param len[in]         Length of the record
+ */
+static cbl_err_code_t hex_handle_fcn (h_records_t * ph_rec,
+        uint8_t * p_fcn_start, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    /* 1 - byte count, 2 - address, 1 - fcn code, n - data, 1 - checksum */
+    uint8_t p_rec[1 + 2 + 1 + 255 + 1];
+    uint32_t n_bytes = (len - 1) / 2;
+    uint32_t sum = 0;
+    uint8_t byte_count; /* Number of byte PAIRS, not number of characters! */
+    uint16_t fcn_address;
+    uint8_t fcn_code;
+    uint8_t * p_data = &p_rec[4];
+
+    /* 11 is the minimal theoretical function length */
+    if (len < 11 || (len - 1) % 2 != 0 || n_bytes > sizeof(p_rec))
+    {
+        return CBL_ERR_INV_IHEX;
+    }
+
+    /* Whole record after ':' in one pass, checksum included */
+    eCode = hex_decode( &p_fcn_start[1], n_bytes, p_rec, &sum);
+    ERR_CHECK(eCode);
+
+    byte_count = p_rec[0];
+    if (n_bytes != 1 + 2 + 1 + byte_count + 1u)
+    {
+        return CBL_ERR_INV_IHEX;
+    }
+
+    /* Checksum is 2's complement of the other bytes, all add up to 0 */
+    if ((sum & 0xFF) != 0)
+    {
+        /* Not CBL_ERR_CKSUM_WRONG, that one makes framed chunk repeat */
+        return CBL_ERR_REC_CKSUM;
+    }
+
+    /* BIG ENDIAN */
+    fcn_address = (uint16_t)((p_rec[1] << 8) | p_rec[2]);
+    fcn_code = p_rec[3];
+
+    switch (fcn_code)
+    {
+        case 00:
+        {
+            /* Data function handler */
+            eCode = hex_handle_fcn_00(ph_rec, fcn_address, p_data, byte_count);
+        }
+        break;
+
+        case 01:
+        {
+            /* EOF function handler */
+            eCode = hex_handle_fcn_01(ph_rec, byte_count);
+        }
+        break;
+
+        case 04:
+        {
+            /* Extended linear address handler */
+            eCode = hex_handle_fcn_04(ph_rec, p_data, byte_count);
+        }
+        break;
+
+        case 05:
+        {
+            /* Start linear address handler */
+            eCode = hex_handle_fcn_05(ph_rec, p_data, byte_count);
+        }
+        break;
+
+        default:
+        {
+            return CBL_ERR_IHEX_FCN;
+        }
+        break;
+
+    }
+
+    return eCode;
+}
+
+static cbl_err_code_t hex_handle_fcn_00 (h_records_t * ph_rec,
+        uint16_t fcn_address, uint8_t * p_data, uint8_t byte_count)
+{
+    /* Data function handler */
+    uint32_t address;
+
+    address = (ph_rec->upper_address << 16) | fcn_address;
+
+    if (false == records_is_in_area(ph_rec, address, byte_count))
+    {
+        return CBL_ERR_SEGMEN;
+    }
+
+    return records_write(ph_rec, address, p_data, byte_count);
+}
+
+static cbl_err_code_t hex_handle_fcn_01 (h_records_t * ph_rec,
+        uint8_t byte_count)
+{
+    /* EOF function handler */
+    if (byte_count != 0)
+    {
+        return CBL_ERR_INV_IHEX;
+    }
+
+    ph_rec->is_EOF = true;
+
+    /* Nothing follows, write what is collected */
+    return records_flush(ph_rec);
+}
+
+static cbl_err_code_t hex_handle_fcn_04 (h_records_t * ph_rec,
+        uint8_t * p_data, uint8_t byte_count)
+{
+    /* Extended linear address handler */
+    if (byte_count != 2)
+    {
+        return CBL_ERR_INV_IHEX;
+    }
+
+    /* BIG ENDIAN */
+    ph_rec->upper_address = (uint16_t)((p_data[0] << 8) | p_data[1]);
+
+    return CBL_ERR_OK;
+}
+
+static cbl_err_code_t hex_handle_fcn_05 (h_records_t * ph_rec,
+        uint8_t * p_data, uint8_t byte_count)
+{
+    /* Start linear address handler */
+    if (byte_count != 4)
+    {
+        return CBL_ERR_INV_IHEX;
+    }
+
+    /* BIG ENDIAN */
+    ph_rec->p_main = (uint32_t *)(((uint32_t)p_data[0] << 24)
+            | ((uint32_t)p_data[1] << 16) | ((uint32_t)p_data[2] << 8)
+            | (uint32_t)p_data[3]);
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Handles given S-record function and write to active application flash
+ *        if needed
+ *
+ * @note Flash sectors containing active application shall be erased before
+ *
+ * @param ph_rec[in]      Handle of the decoder
+ * @param p_fcn_start[in] Pointer to function
+ * @param len[in]         Length of the function
+ *
+ * @return Error status
+ */
+static cbl_err_code_t srec_handle_fcn (h_records_t * ph_rec,
+        uint8_t * p_fcn_start, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    /* 1 - byte count, n - address, data and checksum */
+    uint8_t p_rec[1 + 255];
+    uint32_t n_bytes = (len - 2) / 2;
+    uint32_t sum = 0;
+    uint8_t fcn_num;
+    uint8_t byte_count; /* Number of byte PAIRS, not number of characters! */
+
+    /* 8 is the minimal theoretical function length */
+    if (len < 8 || (len - 2) % 2 != 0 || n_bytes > sizeof(p_rec))
+    {
+        return CBL_ERR_INV_SREC;
+    }
+
+    /* Whole record after 'S' and function type in one pass */
+    eCode = hex_decode( &p_fcn_start[2], n_bytes, p_rec, &sum);
+    ERR_CHECK(eCode);
+
+    byte_count = p_rec[0];
+    if (n_bytes != byte_count + 1u || byte_count < 3)
+    {
+        return CBL_ERR_INV_SREC;
+    }
+
+    /* Checksum is 1's complement of the other bytes, all add up to 0xFF */
+    if ((sum & 0xFF) != 0xFF)
+    {
+        return CBL_ERR_REC_CKSUM;
+    }
+
+    fcn_num = p_fcn_start[1];
+
+    switch (fcn_num)
+    {
+        case '0':
+        {
+            /* Header: contains description of following bytes
+             * SW4STM32 usually writes file name */
+            /* Handle not needed */
+        }
+        break;
+
+        case '3':
+        {
+            eCode = srec_handle_fcn_3(ph_rec, p_rec, byte_count);
+            ERR_CHECK(eCode);
+        }
+        break;
+
+        case '5':
+        {
+            /* Optional */
+            /* Contains number of 'S3' functions in a file */
+            /* Handle not needed */
+        }
+        break;
+
+        case '6':
+        {
+            /* Optional */
+            /* Contains number of 'S3' functions in a file */
+            /* Handle not needed */
+        }
+        break;
+
+        case '7':
+        {
+            /* File terminator */
+            /* Contains starting execution location */
+            /* Handle not needed for memory devices */
+        }
+        break;
+
+        default:
+        {
+            return CBL_ERR_SREC_FCN;
+        }
+        break;
+
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Handler for S-record function '3'
+ *
+ * @param ph_rec[in]     Handle of the decoder
+ * @param p_rec[in]      Decoded record, starting with byte count
+ * @param byte_count[in] Number contained in byte_count field
+ */
+static cbl_err_code_t srec_handle_fcn_3 (h_records_t * ph_rec,
+        uint8_t * p_rec, uint8_t byte_count)
+{
+    uint32_t address;
+    uint32_t data_len;
+
+    /* 4 for address, 1 for checksum */
+    if (byte_count < 4 + 1)
+    {
+        return CBL_ERR_INV_SREC;
+    }
+    data_len = byte_count - 4 - 1;
+
+    if (0 == data_len)
+    {
+        return CBL_ERR_OK;
+    }
+
+    /* BIG ENDIAN */
+    address = ((uint32_t)p_rec[1] << 24) | ((uint32_t)p_rec[2] << 16)
+            | ((uint32_t)p_rec[3] << 8) | (uint32_t)p_rec[4];
+
+    if (false == records_is_in_area(ph_rec, address, data_len))
+    {
+        return CBL_ERR_SEGMEN;
+    }
+
+    return records_write(ph_rec, address, &p_rec[5], data_len);
+}
+
+/*** end of file ***/
@@ -0,0 +1,218 @@
+/** @file cbl_rx.c
+ *
+ * @brief Receiving bytes from the host. Bytes are either received by arming
+ *        DMA for every request, or are taken from a circular DMA ring that
+ *        runs for the whole shell session (USE_RX_RING set to 1 in
+ *        cbl_config.h). Bytes come from the link chosen with link_init
+ */
+#include "etc/cbl_rx.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_perf.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Fills requests instead of the link, NULL if none */
+static rx_src_t rx_src = NULL;
+
+#if 1 == USE_RX_RING
+#define RX_RING_MASK (RX_RING_SZ - 1u)
+
+/** DMA writes received bytes here, in circles */
+static volatile uint8_t rx_ring[RX_RING_SZ] __attribute__((aligned(4)));
+/** Index of the next byte to be read from the ring */
+static uint32_t rx_tail = 0;
+/** Buffer and length of the current request */
+static uint8_t * p_rx_buf = NULL;
+static uint32_t rx_len = 0;
+
+static uint32_t rx_ring_count (void);
+#endif /* 1 == USE_RX_RING */
+
+/**
+ * @brief Prepares receiving from the host. With ring starts the circular DMA,
+ *        bytes received from now on are kept until read
+ */
+cbl_err_code_t rx_init (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+#if 1 == USE_RX_RING
+    rx_tail = 0;
+    rx_len = 0;
+
+    eCode = link_get()->recv_circ_start((uint8_t *)rx_ring, RX_RING_SZ);
+#endif /* 1 == USE_RX_RING */
+
+    return eCode;
+}
+
+/**
+ * @brief Stops receiving from the host, shall be called before giving control
+ *        to other application
+ */
+void rx_deinit (void)
+{
+    link_get()->recv_stop();
+}
+
+/**
+ * @brief Starts receiving 'len' bytes from the host into 'buf'. Does not
+ *        block, use rx_wait for the bytes
+ *
+ * @note  Only one request can be active at a time. With a source the bytes
+ *        are in buf when it returns
+ *
+ * @param buf[out] Buffer for received bytes
+ * @param len[in]  Number of bytes to receive
+ */
+cbl_err_code_t rx_start (uint8_t * buf, uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (NULL != rx_src)
+    {
+        return rx_src(buf, len);
+    }
+
+#if 1 == USE_RX_RING
+    /* Ring is always receiving, only remember where to put the bytes */
+    p_rx_buf = buf;
+    rx_len = len;
+#else
+    eCode = link_get()->recv_start(buf, len);
+#endif /* 1 == USE_RX_RING */
+
+    return eCode;
+}
+
+/**
+ * @brief Blocks until bytes requested with rx_start are in the buffer
+ */
+void rx_wait (void)
+{
+#if 1 == USE_RX_RING
+    uint32_t first_len;
+#endif /* 1 == USE_RX_RING */
+
+    if (NULL != rx_src)
+    {
+        /* Source filled the request already */
+        return;
+    }
+
+#if 1 == USE_RX_RING
+    while (rx_ring_count() < rx_len)
+    {
+        /* Wait for 'rx_len' bytes, responses are sent meanwhile */
+        link_tx_poll();
+    }
+
+    /* Copy out, request can wrap around the end of the ring */
+    first_len = ui32_min(rx_len, RX_RING_SZ - rx_tail);
+    memcpy(p_rx_buf, (uint8_t *) &rx_ring[rx_tail], first_len);
+    memcpy(p_rx_buf + first_len, (uint8_t *)rx_ring, rx_len - first_len);
+
+    rx_tail = (rx_tail + rx_len) & RX_RING_MASK;
+    rx_len = 0;
+#else
+    while (false == link_get()->recv_is_done())
+    {
+        /* Wait for the bytes, responses are sent meanwhile */
+        link_tx_poll();
+    }
+#endif /* 1 == USE_RX_RING */
+}
+
+/**
+ * @brief Waits for bytes of the request like rx_wait, but gives up after the
+ *        timeout. Request is dropped then, bytes already received of it are
+ *        lost
+ *
+ * @param timeout_ms[in] Time to wait in milliseconds, at most 25000 so the
+ *                       cycle counter doesn't wrap
+ *
+ * @return CBL_ERR_RX_TIMEOUT if bytes didn't come in time
+ */
+cbl_err_code_t rx_wait_timeout (uint32_t timeout_ms)
+{
+    uint32_t start = perf_cycles();
+    uint32_t timeout = timeout_ms * (PERF_CLK_HZ / 1000u);
+
+    if (NULL != rx_src)
+    {
+        return CBL_ERR_OK;
+    }
+
+#if 1 == USE_RX_RING
+    while (rx_ring_count() < rx_len)
+#else
+    while (false == link_get()->recv_is_done())
+#endif /* 1 == USE_RX_RING */
+    {
+        link_tx_poll();
+
+        if (perf_cycles() - start > timeout)
+        {
+#if 1 == USE_RX_RING
+            rx_tail = (rx_tail + rx_ring_count()) & RX_RING_MASK;
+            rx_len = 0;
+#else
+            link_get()->recv_stop();
+#endif /* 1 == USE_RX_RING */
+            return CBL_ERR_RX_TIMEOUT;
+        }
+    }
+
+    rx_wait();
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Drops the active request, e.g. when a command fails while a chunk
+ *        is in flight. Host was already told to send, so its bytes are
+ *        taken and thrown away, they would otherwise be received into a
+ *        buffer given back meanwhile or be read as the next command
+ *
+ * @note  Shall be called before the buffer of the request is freed. Does
+ *        nothing if no request is active
+ */
+void rx_abort (void)
+{
+    (void)rx_wait_timeout(RX_ABORT_TIMEOUT_MS);
+}
+
+/**
+ * @brief Sets the source of requests, NULL receives from the link again
+ *
+ * @param new_src[in] Source or NULL
+ *
+ * @return Previous source, to be set back
+ */
+rx_src_t rx_src_set (rx_src_t new_src)
+{
+    rx_src_t prev = rx_src;
+
+    rx_src = new_src;
+
+    return prev;
+}
+
+#if 1 == USE_RX_RING
+/**
+ * @brief Number of received bytes not yet read from the ring
+ *
+ * @note  Ring never fills completely as host only sends when bootloader
+ *        requests, so equal indexes mean an empty ring
+ */
+static uint32_t rx_ring_count (void)
+{
+    uint32_t head = link_get()->recv_circ_pos();
+
+    return (head - rx_tail) & RX_RING_MASK;
+}
+#endif /* 1 == USE_RX_RING */
+
+/*** end of file ***/
@@ -0,0 +1,77 @@
+/** @file cbl_secure_boot.c
+ *
+ * @brief Secure boot checks signature of the active application, result is
+ *        cached in the boot record
+ */
+#include "etc/cbl_secure_boot.h"
+#include "etc/cbl_boot_record.h"
+#include "etc/cbl_checksum.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_perf.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Checks the active application may be started. SHA-256 of the image
+ *        is always calculated. If signature of the same digest was verified
+ *        before, check is done. Else signature is verified and the digest is
+ *        cached in the boot record
+ *
+ * @note  Cache saves only the signature verification. CRC32 of the image is
+ *        not used, image with the same CRC32 is easy to make
+ *
+ * @return CBL_ERR_SIG if signature is invalid, application shall not start
+ */
+cbl_err_code_t secure_boot_check (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    boot_record_t * p_boot_record = boot_record_get();
+    uint32_t start = ab_act_start();
+    uint32_t len = p_boot_record->act_app.len;
+    sha256_ctx_t h_sha256;
+    uint8_t digest[SHA256_DIGEST_SZ];
+
+    if (len <= SECURE_BOOT_SIG_SZ || len > BOOT_ACT_APP_MAX_LEN)
+    {
+        return CBL_ERR_APP_LEN_UNKNOWN;
+    }
+
+    PERF_START(PERF_CKSUM);
+    sha256_start( &h_sha256);
+    sha256_add( &h_sha256, (const uint8_t *)start, len - SECURE_BOOT_SIG_SZ);
+    sha256_finish( &h_sha256, digest);
+    PERF_STOP(PERF_CKSUM);
+
+    if (true == p_boot_record->is_sig_ok
+            && memcmp(digest, p_boot_record->sig_digest, sizeof(digest)) == 0)
+    {
+        return eCode;
+    }
+
+    INFO("Verifying signature of active application\r\n");
+
+    eCode = hal_sig_verify(digest,
+            (const uint8_t *)(start + len - SECURE_BOOT_SIG_SZ));
+    if (CBL_ERR_OK != eCode)
+    {
+        WARNING("Signature of active application is invalid\r\n");
+
+        if (true == p_boot_record->is_sig_ok)
+        {
+            /* Image changed after it was verified */
+            p_boot_record->is_sig_ok = false;
+            boot_record_set(p_boot_record);
+        }
+
+        return CBL_ERR_SIG;
+    }
+
+    memcpy(p_boot_record->sig_digest, digest, sizeof(digest));
+    p_boot_record->is_sig_ok = true;
+
+    return boot_record_set(p_boot_record);
+}
+
+/*** end of file ***/
@@ -0,0 +1,238 @@
+/** @file cbl_sha256.c
+ *
+ * @brief SHA-256 tuned for Cortex-M4. Rounds are unrolled so the working
+ *        variables stay in registers, rotations are folded into EOR by the
+ *        barrel shifter
+ */
+#include "etc/cbl_sha256.h"
+#include <string.h>
+
+#if 1 == USE_SHA256_CCM
+#define SHA256_W_SECTION __attribute__((section(".ccmram")))
+#else
+#define SHA256_W_SECTION
+#endif
+
+/* FIPS 180-4 functions, ROR compiles to a single instruction */
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define BSIG0(x) (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define BSIG1(x) (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define SSIG0(x) (ROR(x, 7) ^ ROR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x) (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* Only 16 words of schedule are kept, word i replaces word i - 16 */
+#define W(i) sha256_w[(i) & 15]
+#define EXPAND(i) (W(i) += SSIG1(W((i) - 2)) + W((i) - 7) + SSIG0(W((i) - 15)))
+
+/* Instead of moving the variables, their roles rotate between rounds */
+#define ROUND(a, b, c, d, e, f, g, h, i, w)                                 \
+    do                                                                      \
+    {                                                                       \
+        uint32_t t1 = (h) + BSIG1(e) + CH(e, f, g) + sha256_k[i] + (w);     \
+        (d) += t1;                                                          \
+        (h) = t1 + BSIG0(a) + MAJ(a, b, c);                                 \
+    }                                                                       \
+    while (0)
+
+#define ROUNDS8(i, w)                                                       \
+    do                                                                      \
+    {                                                                       \
+        ROUND(a, b, c, d, e, f, g, h, (i) + 0, w((i) + 0));                 \
+        ROUND(h, a, b, c, d, e, f, g, (i) + 1, w((i) + 1));                 \
+        ROUND(g, h, a, b, c, d, e, f, (i) + 2, w((i) + 2));                 \
+        ROUND(f, g, h, a, b, c, d, e, (i) + 3, w((i) + 3));                 \
+        ROUND(e, f, g, h, a, b, c, d, (i) + 4, w((i) + 4));                 \
+        ROUND(d, e, f, g, h, a, b, c, (i) + 5, w((i) + 5));                 \
+        ROUND(c, d, e, f, g, h, a, b, (i) + 6, w((i) + 6));                 \
+        ROUND(b, c, d, e, f, g, h, a, (i) + 7, w((i) + 7));                 \
+    }                                                                       \
+    while (0)
+
+static const uint32_t sha256_k[64] = { 0x428a2f98, 0x71374491, 0xb5c0fbcf,
+        0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98,
+        0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+        0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+        0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8,
+        0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+        0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e,
+        0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+        0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c,
+        0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee,
+        0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+        0xc67178f2 };
+
+static uint32_t sha256_w[16] SHA256_W_SECTION;
+
+static void sha256_blocks (uint32_t * state, const uint8_t * buf,
+        uint32_t n_blocks);
+static uint32_t load_be32 (const uint8_t * p);
+static void store_be32 (uint8_t * p, uint32_t val);
+
+/**
+ * @brief Starts a new hash
+ *
+ * @param p_ctx[out] Handle of the hash
+ */
+void sha256_start (sha256_ctx_t * p_ctx)
+{
+    p_ctx->state[0] = 0x6a09e667;
+    p_ctx->state[1] = 0xbb67ae85;
+    p_ctx->state[2] = 0x3c6ef372;
+    p_ctx->state[3] = 0xa54ff53a;
+    p_ctx->state[4] = 0x510e527f;
+    p_ctx->state[5] = 0x9b05688c;
+    p_ctx->state[6] = 0x1f83d9ab;
+    p_ctx->state[7] = 0x5be0cd19;
+    p_ctx->len = 0;
+    p_ctx->block_len = 0;
+}
+
+/**
+ * @brief Adds bytes to the hash. Whole blocks are compressed straight from
+ *        'buf', only the rest is copied
+ *
+ * @param p_ctx[in] Handle of the hash
+ * @param buf[in]   Bytes to add, can be a flash region
+ * @param len[in]   Length of 'buf'
+ */
+void sha256_add (sha256_ctx_t * p_ctx, const uint8_t * buf, uint32_t len)
+{
+    uint32_t n_copy;
+
+    p_ctx->len += len;
+
+    if (p_ctx->block_len > 0)
+    {
+        n_copy = ui32_min(len, SHA256_BLOCK_SZ - p_ctx->block_len);
+        memcpy( &p_ctx->block[p_ctx->block_len], buf, n_copy);
+        p_ctx->block_len += n_copy;
+        buf += n_copy;
+        len -= n_copy;
+
+        if (SHA256_BLOCK_SZ == p_ctx->block_len)
+        {
+            sha256_blocks(p_ctx->state, p_ctx->block, 1);
+            p_ctx->block_len = 0;
+        }
+    }
+
+    if (len >= SHA256_BLOCK_SZ)
+    {
+        sha256_blocks(p_ctx->state, buf, len / SHA256_BLOCK_SZ);
+        buf += len & ~(SHA256_BLOCK_SZ - 1);
+        len &= SHA256_BLOCK_SZ - 1;
+    }
+
+    if (len > 0)
+    {
+        memcpy(p_ctx->block, buf, len);
+        p_ctx->block_len = len;
+    }
+}
+
+/**
+ * @brief Pads the message and returns the digest
+ *
+ * @param p_ctx[in]     Handle of the hash, has to be started again after
+ * @param p_digest[out] SHA256_DIGEST_SZ bytes of digest
+ */
+void sha256_finish (sha256_ctx_t * p_ctx, uint8_t * p_digest)
+{
+    uint64_t n_bits = p_ctx->len * 8u;
+
+    p_ctx->block[p_ctx->block_len] = 0x80;
+    p_ctx->block_len++;
+
+    /* Length doesn't fit, it goes to an extra block */
+    if (p_ctx->block_len > SHA256_BLOCK_SZ - 8u)
+    {
+        memset( &p_ctx->block[p_ctx->block_len], 0,
+                SHA256_BLOCK_SZ - p_ctx->block_len);
+        sha256_blocks(p_ctx->state, p_ctx->block, 1);
+        p_ctx->block_len = 0;
+    }
+
+    memset( &p_ctx->block[p_ctx->block_len], 0,
+            SHA256_BLOCK_SZ - 8u - p_ctx->block_len);
+    store_be32( &p_ctx->block[SHA256_BLOCK_SZ - 8u], (uint32_t)(n_bits >> 32));
+    store_be32( &p_ctx->block[SHA256_BLOCK_SZ - 4u], (uint32_t)n_bits);
+    sha256_blocks(p_ctx->state, p_ctx->block, 1);
+
+    for (uint32_t iii = 0; iii < 8; iii++)
+    {
+        store_be32( &p_digest[iii * 4u], p_ctx->state[iii]);
+    }
+}
+
+/**
+ * @brief Compresses whole blocks
+ *
+ * @param state[in]    Hash state, updated
+ * @param buf[in]      Blocks, don't have to be word aligned
+ * @param n_blocks[in] Number of blocks in 'buf'
+ */
+static void sha256_blocks (uint32_t * state, const uint8_t * buf,
+        uint32_t n_blocks)
+{
+    uint32_t a, b, c, d, e, f, g, h;
+
+    while (n_blocks > 0)
+    {
+        for (uint32_t iii = 0; iii < 16; iii++)
+        {
+            sha256_w[iii] = load_be32( &buf[iii * 4u]);
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        ROUNDS8(0, W);
+        ROUNDS8(8, W);
+        for (uint32_t iii = 16; iii < 64; iii += 8)
+        {
+            ROUNDS8(iii, EXPAND);
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        buf += SHA256_BLOCK_SZ;
+        n_blocks--;
+    }
+}
+
+/**
+ * @brief Loads a big endian word, compiles to LDR and REV
+ */
+static uint32_t load_be32 (const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+            | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * @brief Stores a word as big endian
+ */
+static void store_be32 (uint8_t * p, uint32_t val)
+{
+    p[0] = (uint8_t)(val >> 24);
+    p[1] = (uint8_t)(val >> 16);
+    p[2] = (uint8_t)(val >> 8);
+    p[3] = (uint8_t)val;
+}
+
+/*** end of file ***/
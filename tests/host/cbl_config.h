@@ -0,0 +1,29 @@
+/** @file cbl_config.h
+ *
+ * @brief Options of the host build, HAL layer is the simulation in sim_hal.c
+ */
+#ifndef CBL_CONFIG_H
+#define CBL_CONFIG_H
+
+#define USE_CMDS_MEMORY 1
+#define USE_CMDS_OPT_BYTES 0
+#define USE_CMDS_ETC 1
+#define USE_CMDS_UPDATE_NEW 1
+#define USE_CMDS_UPDATE_ACT 1
+#define USE_CMDS_TEMPLATE 0
+#define USE_CMDS_BINARY 1
+
+#define USE_PERF 1
+#define USE_AB_SLOTS 0
+#define USE_CRC_DMA 0
+#define USE_RX_RING 0
+#define USE_SHA256_CCM 0
+#define USE_LINK_USB 0
+#define USE_TX_QUEUE 0
+#define USE_WRITE_VERIFY 1
+#define USE_SECURE_BOOT 0
+
+#include "sim_hal.h"
+
+#endif /* CBL_CONFIG_H */
+/*** end of file ***/
@@ -0,0 +1,45 @@
+/** @file crc.h
+ *
+ * @brief CRC unit of STM32 HAL for the host. Writes to DR are emulated by
+ *        sim_hal.c, reset goes through it as DR page is write protected
+ */
+#ifndef SIM_CRC_H
+#define SIM_CRC_H
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint32_t DR; /*!< Data register */
+    volatile uint32_t IDR; /*!< Independent data register */
+    volatile uint32_t CR; /*!< Control register */
+} CRC_TypeDef;
+
+typedef struct
+{
+    CRC_TypeDef * Instance;
+} CRC_HandleTypeDef;
+
+extern CRC_HandleTypeDef hcrc;
+
+void sim_crc_reset (CRC_HandleTypeDef * ph_crc);
+
+#define __HAL_CRC_DR_RESET(HANDLE) sim_crc_reset(HANDLE)
+
+/**
+ * @brief Reverses bits of the word, RBIT instruction of Cortex-M4
+ */
+static inline uint32_t __RBIT (uint32_t value)
+{
+    uint32_t result = 0;
+
+    for (uint32_t iii = 0; iii < 32u; iii++)
+    {
+        result = (result << 1) | (value & 1u);
+        value >>= 1;
+    }
+
+    return result;
+}
+
+#endif /* SIM_CRC_H */
+/*** end of file ***/
@@ -0,0 +1,818 @@
+/** @file sim_hal.c
+ *
+ * @brief HAL layer for the host, see sim_hal.h
+ */
+#define _GNU_SOURCE
+#include "etc/cbl_common.h"
+#include "etc/cbl_sha256.h"
+#include <crc.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define SIM_PAGE_SZ 4096u
+#define SIM_CRC_POLY 0x04C11DB7UL
+#define SIM_TRAP_FLAG 0x100u /*!< TF of EFLAGS, single-steps */
+#define SIM_DWT_CYCCNT (*(volatile uint32_t *)(SIM_DWT_START + 4u))
+#define SIM_US_TO_CYCLES(US) ((uint64_t)(US) * (SIM_CLK_HZ / 1000000UL))
+#define SIM_IDLE_TICK_US 10000u /*!< Idle time of a tick of the timer */
+#define SIM_IDLE_POLL_US 10u /*!< Idle time of a poll of empty ring */
+
+typedef struct
+{
+    uint8_t * p_buf;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t pos; /*!< Next byte to be taken, only for received bytes */
+} sim_queue_t;
+
+static cbl_err_code_t sim_flash_check (uint32_t addr, uint32_t len);
+static void sim_map (uint32_t addr, uint32_t len, uint8_t fill);
+static void sim_queue_put (sim_queue_t * p_queue, const void * buf,
+        uint32_t len);
+static void sim_time_add (uint64_t cycles, uint64_t * p_phase);
+static void sim_host_take (uint8_t * buf, uint32_t len);
+static void sim_host_gone (void);
+static void sim_idle (uint64_t delta);
+static void sim_starve (bool is_on);
+static void sim_on_tick (int sig);
+static uint32_t sim_sector_start (uint32_t sector);
+static void sim_crc_on_fault (int sig, siginfo_t * p_info, void * p_ctx);
+static void sim_crc_on_step (int sig, siginfo_t * p_info, void * p_ctx);
+
+CRC_HandleTypeDef hcrc;
+jmp_buf sim_restart_jmp;
+
+/* Typical values of the STM32F407 datasheet, 2.7 V to 3.6 V */
+static sim_model_t model =
+{
+    .erase_16k_us = 250000u,
+    .erase_64k_us = 550000u,
+    .erase_128k_us = 1000000u,
+    .erase_mass_us = 8000000u,
+    .program_word_us = 16u,
+    .baud = SIM_BAUD_DEFAULT,
+};
+static sim_stats_t stats;
+static uint64_t cycles;
+static const uint32_t sect_sz[SIM_FLASH_N_SECTORS] = SIM_FLASH_SECTOR_SIZES;
+
+/** Bytes host sent, bootloader takes them in order */
+static sim_queue_t to_cbl;
+/** Bytes bootloader sent */
+static sim_queue_t to_host;
+
+/** Ring of USE_RX_RING, NULL while receive is stopped */
+static uint8_t * p_ring;
+static uint32_t ring_sz;
+/** Index in the ring written next */
+static uint32_t ring_head;
+/** Request waits for bytes the host didn't queue, timer adds idle time */
+static volatile bool is_starved;
+/** Idle time since the host sent the last byte */
+static volatile uint64_t gone_cycles;
+/** Processor is reset when the host is gone, once */
+static bool is_gone_reset;
+/** TX DMA was started and wasn't polled yet */
+static bool is_tx_busy;
+/** Application confirmed it started, A/B slots */
+static bool is_app_confirmed;
+
+/** Page of the CRC unit, read only except for the write being stepped */
+static CRC_TypeDef * p_crc_regs;
+/** CRC of the words written so far, DR reads it */
+static uint32_t crc_val;
+
+/**
+ * @brief Maps flash, RAM and debug registers, installs the CRC unit and
+ *        resets the statistics. Flash is erased
+ */
+void sim_init (void)
+{
+    struct sigaction sa = { 0 };
+
+    sim_map(SIM_FLASH_START, SIM_FLASH_SZ, 0xFF);
+    sim_map(SIM_SRAM_START, SIM_SRAM_SZ, 0x00);
+    sim_map(SIM_CCM_START, SIM_CCM_SZ, 0x00);
+    sim_map(SIM_DWT_START, SIM_PAGE_SZ, 0x00);
+    sim_map(SIM_SCS_START, SIM_PAGE_SZ, 0x00);
+
+    p_crc_regs = mmap(NULL, SIM_PAGE_SZ, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == p_crc_regs)
+    {
+        perror("sim: CRC unit");
+        exit(EXIT_FAILURE);
+    }
+    hcrc.Instance = p_crc_regs;
+    sim_crc_reset( &hcrc);
+
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset( &sa.sa_mask);
+    sa.sa_sigaction = sim_crc_on_fault;
+    sigaction(SIGSEGV, &sa, NULL);
+    sa.sa_sigaction = sim_crc_on_step;
+    sigaction(SIGTRAP, &sa, NULL);
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = sim_on_tick;
+    sigaction(SIGALRM, &sa, NULL);
+
+    sim_stats_reset();
+    to_cbl.len = 0;
+    to_cbl.pos = 0;
+    to_host.len = 0;
+    p_ring = NULL;
+    sim_starve(false);
+    gone_cycles = 0;
+    is_gone_reset = false;
+    is_tx_busy = false;
+    is_app_confirmed = false;
+}
+
+/**
+ * @brief Sets the timing model, baud rate of it is the rate of UART
+ */
+void sim_model_set (const sim_model_t * p_model)
+{
+    model = *p_model;
+}
+
+const sim_stats_t * sim_stats_get (void)
+{
+    return &stats;
+}
+
+void sim_stats_reset (void)
+{
+    memset( &stats, 0, sizeof(stats));
+}
+
+/**
+ * @brief Modeled cycles since sim_init, CPU time isn't counted
+ */
+uint64_t sim_cycles (void)
+{
+    return cycles;
+}
+
+/**
+ * @brief Writes flash directly, e.g. to put back an old application
+ */
+void sim_flash_fill (uint32_t addr, uint8_t val, uint32_t len)
+{
+    memset((void *)(uintptr_t)addr, val, len);
+}
+
+/**
+ * @brief Queues bytes host sends, bootloader receives them in order
+ */
+void sim_host_send (const void * buf, uint32_t len)
+{
+    /* Bytes already taken are dropped, so the queue doesn't grow */
+    if (to_cbl.pos == to_cbl.len)
+    {
+        to_cbl.pos = 0;
+        to_cbl.len = 0;
+    }
+
+    sim_queue_put( &to_cbl, buf, len);
+}
+
+void sim_host_send_str (const char * str)
+{
+    sim_host_send(str, strlen(str));
+}
+
+/**
+ * @brief Bytes queued by the host which bootloader didn't take yet
+ */
+uint32_t sim_host_pending (void)
+{
+    return to_cbl.len - to_cbl.pos;
+}
+
+/**
+ * @brief Everything bootloader sent since the last clear, zero terminated
+ */
+const char * sim_host_output (uint32_t * p_len)
+{
+    sim_queue_put( &to_host, "", 1);
+    to_host.len--;
+
+    if (NULL != p_len)
+    {
+        *p_len = to_host.len;
+    }
+
+    return (const char *)to_host.p_buf;
+}
+
+void sim_host_output_clear (void)
+{
+    to_host.len = 0;
+}
+
+/**
+ * @brief True if bootloader sent the text since the last clear
+ */
+bool sim_host_output_has (const char * str)
+{
+    uint32_t len;
+    const char * p_out = sim_host_output( &len);
+
+    return NULL != memmem(p_out, len, str, strlen(str));
+}
+
+/**
+ * @brief Next time bootloader waits for bytes the host didn't queue, the
+ *        processor is reset, as by a watchdog or power cycle. Else the
+ *        bootloader waits until its timeout or the test fails
+ */
+void sim_host_gone_reset (bool is_reset)
+{
+    is_gone_reset = is_reset;
+}
+
+/**
+ * @brief Rate UART runs at
+ */
+uint32_t sim_baud_get (void)
+{
+    return model.baud;
+}
+
+/**
+ * @brief Sets what hal_app_confirm_get returns, application would set it
+ */
+void sim_app_confirm_set (bool is_confirmed)
+{
+    is_app_confirmed = is_confirmed;
+}
+
+/**
+ * @brief Sets DR to the initial value, replaces __HAL_CRC_DR_RESET
+ */
+void sim_crc_reset (CRC_HandleTypeDef * ph_crc)
+{
+    crc_val = 0xFFFFFFFFUL;
+
+    mprotect(p_crc_regs, SIM_PAGE_SZ, PROT_READ | PROT_WRITE);
+    ph_crc->Instance->DR = crc_val;
+    mprotect(p_crc_regs, SIM_PAGE_SZ, PROT_READ);
+}
+
+size_t strlcat (char * dst, const char * src, size_t size)
+{
+    size_t dst_len = strnlen(dst, size);
+    size_t src_len = strlen(src);
+
+    if (dst_len < size)
+    {
+        size_t n = src_len < size - dst_len - 1u ? src_len :
+                size - dst_len - 1u;
+
+        memcpy( &dst[dst_len], src, n);
+        dst[dst_len + n] = '\0';
+    }
+
+    return dst_len + src_len;
+}
+
+char * utoa (unsigned value, char * str, int base)
+{
+    const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char tmp[33];
+    uint32_t len = 0;
+
+    do
+    {
+        tmp[len++] = digits[value % (unsigned)base];
+        value /= (unsigned)base;
+    }
+    while (0 != value);
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        str[iii] = tmp[len - 1u - iii];
+    }
+    str[len] = '\0';
+
+    return str;
+}
+
+void hal_init (void)
+{
+}
+
+void hal_periph_init (void)
+{
+}
+
+void hal_deinit (void)
+{
+}
+
+cbl_err_code_t hal_send_to_host (const char * buf, size_t len)
+{
+    sim_queue_put( &to_host, buf, len);
+    stats.n_tx += len;
+    sim_time_add(SIM_US_TO_CYCLES(len * 10ULL * 1000000ULL / model.baud),
+            &stats.uart_cycles);
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Sends at once too, DMA is reported done at the second poll so the
+ *        queue of the link fills and drains
+ */
+cbl_err_code_t hal_send_to_host_start (const char * buf, size_t len)
+{
+    is_tx_busy = true;
+
+    return hal_send_to_host(buf, len);
+}
+
+bool hal_send_to_host_is_done (void)
+{
+    bool is_done = !is_tx_busy;
+
+    is_tx_busy = false;
+
+    return is_done;
+}
+
+/**
+ * @brief Takes the bytes from what host queued, DMA is done at once
+ *
+ * @note  If host didn't queue all of them, the ones it did are taken and the
+ *        request is never done. Idle time passes until it is stopped
+ */
+cbl_err_code_t hal_recv_from_host_start (uint8_t * buf, uint32_t len)
+{
+    uint32_t n_bytes = ui32_min(sim_host_pending(), len);
+
+    sim_host_take(buf, n_bytes);
+    if (n_bytes < len)
+    {
+        sim_host_gone();
+        sim_starve(true);
+
+        return CBL_ERR_OK;
+    }
+
+    /* UART callback counts received requests */
+    gRxCmdCntr++;
+
+    return CBL_ERR_OK;
+}
+
+cbl_err_code_t hal_recv_from_host_circ_start (uint8_t * buf, uint32_t len)
+{
+    p_ring = buf;
+    ring_sz = len;
+    ring_head = 0;
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Host sends a burst of what it queued at every poll, so the ring
+ *        holds at most a burst more than the request waited for. Idle time
+ *        passes if it has nothing
+ */
+uint32_t hal_recv_from_host_circ_pos (void)
+{
+    uint32_t n_bytes = ui32_min(sim_host_pending(), SIM_RING_BURST);
+    uint32_t first_len;
+
+    if (NULL == p_ring || 0 == n_bytes)
+    {
+        sim_host_gone();
+        sim_idle(SIM_US_TO_CYCLES(SIM_IDLE_POLL_US));
+
+        return ring_head;
+    }
+
+    first_len = ui32_min(n_bytes, ring_sz - ring_head);
+    sim_host_take( &p_ring[ring_head], first_len);
+    sim_host_take(p_ring, n_bytes - first_len);
+    ring_head = (ring_head + n_bytes) % ring_sz;
+
+    return ring_head;
+}
+
+void hal_recv_from_host_stop (void)
+{
+    p_ring = NULL;
+    sim_starve(false);
+}
+
+cbl_err_code_t hal_uart_baud_set (uint32_t baud)
+{
+    model.baud = baud;
+
+    return CBL_ERR_OK;
+}
+
+cbl_err_code_t hal_flash_erase_sector (uint32_t sector, uint32_t count)
+{
+    if (sector >= SIM_FLASH_N_SECTORS || count > SIM_FLASH_N_SECTORS - sector)
+    {
+        return CBL_ERR_HAL_ERASE;
+    }
+
+    for (uint32_t iii = sector; iii < sector + count; iii++)
+    {
+        uint32_t erase_us = model.erase_128k_us;
+
+        if (16u * 1024u == sect_sz[iii])
+        {
+            erase_us = model.erase_16k_us;
+        }
+        else if (64u * 1024u == sect_sz[iii])
+        {
+            erase_us = model.erase_64k_us;
+        }
+
+        sim_flash_fill(sim_sector_start(iii), 0xFF, sect_sz[iii]);
+        stats.n_erased++;
+        sim_time_add(SIM_US_TO_CYCLES(erase_us), &stats.erase_cycles);
+    }
+
+    return CBL_ERR_OK;
+}
+
+cbl_err_code_t hal_flash_erase_mass (void)
+{
+    sim_flash_fill(SIM_FLASH_START, 0xFF, SIM_FLASH_SZ);
+    stats.n_erased += SIM_FLASH_N_SECTORS;
+    stats.n_mass_erased++;
+    sim_time_add(SIM_US_TO_CYCLES(model.erase_mass_us), &stats.erase_cycles);
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Programs like flash does, bits only go from 1 to 0
+ */
+cbl_err_code_t hal_write_program_bytes (uint32_t addr, uint8_t * buf,
+        uint32_t len)
+{
+    uint8_t * p_flash = (uint8_t *)(uintptr_t)addr;
+    cbl_err_code_t eCode = sim_flash_check(addr, len);
+
+    ERR_CHECK(eCode);
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        p_flash[iii] &= buf[iii];
+    }
+
+    stats.n_programmed += len;
+    sim_time_add(SIM_US_TO_CYCLES((len + 3u) / 4u * model.program_word_us),
+            &stats.program_cycles);
+
+    return CBL_ERR_OK;
+}
+
+cbl_err_code_t hal_verify_flash_address (uint32_t addr)
+{
+    return sim_flash_check(addr, 1);
+}
+
+cbl_err_code_t hal_verify_jump_address (uint32_t addr)
+{
+    if (CBL_ERR_OK == sim_flash_check(addr, 1)
+            || (addr >= SIM_SRAM_START && addr < SIM_SRAM_START + SIM_SRAM_SZ))
+    {
+        return CBL_ERR_OK;
+    }
+
+    return CBL_ERR_JUMP_INV_ADDR;
+}
+
+uint32_t hal_id_code_get (void)
+{
+    /* DBGMCU_IDCODE of STM32F407, revision 2 */
+    return 0x10076413UL;
+}
+
+bool hal_blue_btn_state_get (void)
+{
+    return false;
+}
+
+void hal_led_on (led_t led)
+{
+    UNUSED(led);
+}
+
+void hal_led_off (led_t led)
+{
+    UNUSED(led);
+}
+
+void hal_vtor_set (uint32_t addr)
+{
+    UNUSED(addr);
+}
+
+void hal_msp_set (uint32_t msp)
+{
+    UNUSED(msp);
+}
+
+void hal_disable_interrupts (void)
+{
+}
+
+void hal_stop_systick (void)
+{
+}
+
+/**
+ * @brief Goes back to the test, which checks the state a reset would find
+ */
+void hal_system_restart (void)
+{
+    stats.n_restarts++;
+
+    /* Peripherals are reset too */
+    p_ring = NULL;
+    sim_starve(false);
+    is_tx_busy = false;
+
+    longjmp(sim_restart_jmp, 1);
+}
+
+bool hal_app_confirm_get (void)
+{
+    return is_app_confirmed;
+}
+
+void hal_app_confirm_clear (void)
+{
+    is_app_confirmed = false;
+}
+
+/**
+ * @brief Valid signature is the digest followed by zeros, there is no key.
+ *        Calls are counted, so the test sees the cache of secure boot
+ */
+cbl_err_code_t hal_sig_verify (const uint8_t * p_digest,
+        const uint8_t * p_sig)
+{
+    stats.n_sig_verify++;
+
+    if (0 != memcmp(p_sig, p_digest, SHA256_DIGEST_SZ))
+    {
+        return CBL_ERR_SIG;
+    }
+
+    for (uint32_t iii = SHA256_DIGEST_SZ; iii < SIM_SIG_SZ; iii++)
+    {
+        if (0 != p_sig[iii])
+        {
+            return CBL_ERR_SIG;
+        }
+    }
+
+    return CBL_ERR_OK;
+}
+
+void hal_rdp_lvl_get (char * buf, size_t len)
+{
+    snprintf(buf, len, "level 0");
+}
+
+cbl_err_code_t hal_write_prot_get (char * buf, size_t len)
+{
+    snprintf(buf, len, "0x000");
+
+    return CBL_ERR_OK;
+}
+
+cbl_err_code_t hal_change_write_prot (uint32_t mask, bool is_enable)
+{
+    UNUSED(mask);
+    UNUSED(is_enable);
+
+    return CBL_ERR_NOT_IMPL;
+}
+
+cbl_err_code_t hal_opt_bytes_get (void * p_opt)
+{
+    UNUSED(p_opt);
+
+    return CBL_ERR_NOT_IMPL;
+}
+
+cbl_err_code_t hal_opt_bytes_program (const void * p_opt)
+{
+    UNUSED(p_opt);
+
+    return CBL_ERR_NOT_IMPL;
+}
+
+static cbl_err_code_t sim_flash_check (uint32_t addr, uint32_t len)
+{
+    if (addr < SIM_FLASH_START || len > SIM_FLASH_SZ
+            || addr - SIM_FLASH_START > SIM_FLASH_SZ - len)
+    {
+        return CBL_ERR_WRITE_INV_ADDR;
+    }
+
+    return CBL_ERR_OK;
+}
+
+static void sim_map (uint32_t addr, uint32_t len, uint8_t fill)
+{
+    void * p_mem = mmap((void *)(uintptr_t)addr, len, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (MAP_FAILED == p_mem && EEXIST != errno)
+    {
+        fprintf(stderr, "sim: can't map 0x%08x\n", addr);
+        exit(EXIT_FAILURE);
+    }
+
+    memset((void *)(uintptr_t)addr, fill, len);
+}
+
+static void sim_queue_put (sim_queue_t * p_queue, const void * buf,
+        uint32_t len)
+{
+    if (p_queue->len + len > p_queue->cap)
+    {
+        p_queue->cap = (p_queue->len + len) * 2u;
+        p_queue->p_buf = realloc(p_queue->p_buf, p_queue->cap);
+        if (NULL == p_queue->p_buf)
+        {
+            fprintf(stderr, "sim: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy( &p_queue->p_buf[p_queue->len], buf, len);
+    p_queue->len += len;
+}
+
+/**
+ * @brief Advances the cycle counter, perf probes around the HAL call see the
+ *        modeled time
+ */
+static void sim_time_add (uint64_t delta, uint64_t * p_phase)
+{
+    cycles += delta;
+    *p_phase += delta;
+    SIM_DWT_CYCCNT += (uint32_t)delta;
+}
+
+/**
+ * @brief Takes bytes the host queued, they take the time of UART
+ */
+static void sim_host_take (uint8_t * buf, uint32_t len)
+{
+    memcpy(buf, &to_cbl.p_buf[to_cbl.pos], len);
+    to_cbl.pos += len;
+    stats.n_rx += len;
+    sim_time_add(SIM_US_TO_CYCLES(len * 10ULL * 1000000ULL / model.baud),
+            &stats.uart_cycles);
+
+    if (0 != len)
+    {
+        gone_cycles = 0;
+    }
+}
+
+/**
+ * @brief Bootloader waits for bytes the host doesn't have, resets if the
+ *        test asked so
+ */
+static void sim_host_gone (void)
+{
+    if (true == is_gone_reset)
+    {
+        is_gone_reset = false;
+        hal_system_restart();
+    }
+}
+
+/**
+ * @brief Bootloader waits for the host. Test fails if it waits longer than
+ *        the host would, also called from the timer
+ */
+static void sim_idle (uint64_t delta)
+{
+    const char msg[] = "sim: bootloader waits for bytes host didn't queue\n";
+
+    sim_time_add(delta, &stats.idle_cycles);
+    gone_cycles += delta;
+
+    if (gone_cycles > SIM_US_TO_CYCLES(SIM_HOST_GONE_MS * 1000ULL))
+    {
+        /* Only async signal safe calls, timer may call it */
+        write(STDERR_FILENO, msg, sizeof(msg) - 1u);
+        _exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Runs the timer while a request waits, nothing of the core is
+ *        called then
+ */
+static void sim_starve (bool is_on)
+{
+    struct itimerval timer = { 0 };
+
+    if (true == is_on)
+    {
+        timer.it_interval.tv_usec = 1000;
+        timer.it_value.tv_usec = 1000;
+    }
+
+    is_starved = is_on;
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+static void sim_on_tick (int sig)
+{
+    UNUSED(sig);
+
+    if (true == is_starved)
+    {
+        sim_idle(SIM_US_TO_CYCLES(SIM_IDLE_TICK_US));
+    }
+}
+
+static uint32_t sim_sector_start (uint32_t sector)
+{
+    uint32_t addr = SIM_FLASH_START;
+
+    for (uint32_t iii = 0; iii < sector; iii++)
+    {
+        addr += sect_sz[iii];
+    }
+
+    return addr;
+}
+
+/**
+ * @brief Write to the read only CRC page. Page is opened and the write is
+ *        single-stepped, sim_crc_on_step takes the word
+ */
+static void sim_crc_on_fault (int sig, siginfo_t * p_info, void * p_ctx)
+{
+    ucontext_t * p_uc = p_ctx;
+    uint8_t * p_addr = p_info->si_addr;
+
+    if (p_addr < (uint8_t *)p_crc_regs
+            || p_addr >= (uint8_t *)p_crc_regs + SIM_PAGE_SZ)
+    {
+        /* Real fault, let it crash */
+        signal(sig, SIG_DFL);
+        return;
+    }
+
+    mprotect(p_crc_regs, SIM_PAGE_SZ, PROT_READ | PROT_WRITE);
+    p_uc->uc_mcontext.gregs[REG_EFL] |= SIM_TRAP_FLAG;
+}
+
+/**
+ * @brief Write to DR is done, word is added to the CRC, which is what DR
+ *        reads from now on
+ */
+static void sim_crc_on_step (int sig, siginfo_t * p_info, void * p_ctx)
+{
+    ucontext_t * p_uc = p_ctx;
+    uint32_t data = p_crc_regs->DR;
+
+    UNUSED(sig);
+    UNUSED(p_info);
+
+    /* Same as the CRC unit, MSB first, no reflection */
+    for (uint32_t iii = 0; iii < 32u; iii++)
+    {
+        bool is_xor = ((crc_val ^ data) & 0x80000000UL) != 0;
+
+        crc_val <<= 1;
+        data <<= 1;
+        if (true == is_xor)
+        {
+            crc_val ^= SIM_CRC_POLY;
+        }
+    }
+
+    p_crc_regs->DR = crc_val;
+    mprotect(p_crc_regs, SIM_PAGE_SZ, PROT_READ);
+    p_uc->uc_mcontext.gregs[REG_EFL] &= ~(greg_t)SIM_TRAP_FLAG;
+}
+
+/*** end of file ***/
@@ -0,0 +1,146 @@
+/** @file sim_hal.h
+ *
+ * @brief HAL layer for the host. Flash, SRAM and debug registers are
+ *        mapped at the addresses of STM32F407, UART is a pair of byte queues
+ *        the test fills and reads. Erase, program and UART take the time of
+ *        the timing model, it is added to the cycle counter so the perf
+ *        probes measure them
+ *
+ * @note  Core reads flash and debug registers through their addresses and casts them to
+ *        uint32_t, so memory is mapped below 4 GB with mmap and the target
+ *        is linked without PIE
+ * @note  CRC data register is emulated by write protecting its page, every
+ *        write to it faults and is single-stepped, see sim_hal.c
+ * @note  Only modeled time advances the cycle counter, CPU time of the core
+ *        isn't counted. Receive is done when it is started, so overlap of
+ *        receive with programming isn't modeled. With USE_RX_RING bytes go to
+ *        the ring a burst at every poll of its position
+ * @note  Host sends only what the test queued. While bootloader waits for
+ *        more, idle time passes, so timeouts expire. If the host is gone for
+ *        SIM_HOST_GONE_MS the test fails, or the processor is reset if the
+ *        test asked so with sim_host_gone_reset
+ */
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include "custom_bootloader.h"
+
+#define SIM_FLASH_START 0x08000000UL
+#define SIM_FLASH_SZ (1024u * 1024u)
+#define SIM_FLASH_N_SECTORS 12u
+#define SIM_FLASH_SECTOR_SIZES { 16 * 1024, 16 * 1024, 16 * 1024, 16 * 1024, \
+                                 64 * 1024, 128 * 1024, 128 * 1024,           \
+                                 128 * 1024, 128 * 1024, 128 * 1024,          \
+                                 128 * 1024, 128 * 1024 }
+#define SIM_SRAM_START 0x20000000UL
+#define SIM_SRAM_SZ (128u * 1024u)
+#define SIM_CCM_START 0x10000000UL
+#define SIM_CCM_SZ (64u * 1024u)
+#define SIM_DWT_START 0xE0001000UL /*!< DWT_CTRL, DWT_CYCCNT follows it */
+#define SIM_SCS_START 0xE000E000UL /*!< System control space, DEMCR */
+
+#define SIM_CLK_HZ 168000000UL /*!< Same as PERF_CLK_HZ */
+#define SIM_BAUD_DEFAULT 115200u
+#define SIM_HOST_GONE_MS 30000u /*!< Longer than any timeout of the core */
+#define SIM_RING_BURST 64u /*!< Bytes put to the ring at a poll */
+#define SIM_SIG_SZ 64u /*!< Valid signature is the digest, then zeros */
+
+typedef enum
+{
+    LED_POWER_ON = 0,
+    LED_READY,
+    LED_BUSY,
+    LED_MEMORY
+} led_t;
+
+typedef struct
+{
+    uint32_t erase_16k_us; /*!< Erase of a 16 KB sector */
+    uint32_t erase_64k_us; /*!< Erase of a 64 KB sector */
+    uint32_t erase_128k_us; /*!< Erase of a 128 KB sector */
+    uint32_t erase_mass_us; /*!< Erase of the whole flash */
+    uint32_t program_word_us; /*!< Programming of a word, x32 parallelism */
+    uint32_t baud; /*!< Rate of UART, 10 bits per byte */
+} sim_model_t;
+
+typedef struct
+{
+    uint32_t n_erased; /*!< Sectors erased, mass erase counts all */
+    uint32_t n_mass_erased; /*!< Mass erases */
+    uint32_t n_programmed; /*!< Bytes programmed */
+    uint32_t n_rx; /*!< Bytes received by the bootloader */
+    uint32_t n_tx; /*!< Bytes sent by the bootloader */
+    uint32_t n_restarts; /*!< Calls of hal_system_restart */
+    uint32_t n_sig_verify; /*!< Calls of hal_sig_verify */
+    uint64_t erase_cycles; /*!< Modeled time of erases */
+    uint64_t program_cycles; /*!< Modeled time of programming */
+    uint64_t uart_cycles; /*!< Modeled time of UART transfers */
+    uint64_t idle_cycles; /*!< Time bootloader waited for the host */
+} sim_stats_t;
+
+/** hal_system_restart jumps here with 1, set with setjmp by the test */
+extern jmp_buf sim_restart_jmp;
+
+void sim_init (void);
+void sim_model_set (const sim_model_t * p_model);
+const sim_stats_t * sim_stats_get (void);
+void sim_stats_reset (void);
+uint64_t sim_cycles (void);
+void sim_flash_fill (uint32_t addr, uint8_t val, uint32_t len);
+void sim_host_send (const void * buf, uint32_t len);
+void sim_host_send_str (const char * str);
+uint32_t sim_host_pending (void);
+const char * sim_host_output (uint32_t * p_len);
+void sim_host_output_clear (void);
+bool sim_host_output_has (const char * str);
+void sim_host_gone_reset (bool is_reset);
+uint32_t sim_baud_get (void);
+void sim_app_confirm_set (bool is_confirmed);
+
+/* Functions of newlib the core uses, glibc doesn't have them */
+size_t strlcat (char * dst, const char * src, size_t size);
+char * utoa (unsigned value, char * str, int base);
+
+/* HAL layer interface, see Appendix B of README.md */
+void hal_init (void);
+void hal_periph_init (void);
+void hal_deinit (void);
+cbl_err_code_t hal_send_to_host (const char * buf, size_t len);
+cbl_err_code_t hal_send_to_host_start (const char * buf, size_t len);
+bool hal_send_to_host_is_done (void);
+cbl_err_code_t hal_recv_from_host_start (uint8_t * buf, uint32_t len);
+cbl_err_code_t hal_recv_from_host_circ_start (uint8_t * buf, uint32_t len);
+uint32_t hal_recv_from_host_circ_pos (void);
+void hal_recv_from_host_stop (void);
+cbl_err_code_t hal_uart_baud_set (uint32_t baud);
+cbl_err_code_t hal_flash_erase_sector (uint32_t sector, uint32_t count);
+cbl_err_code_t hal_flash_erase_mass (void);
+cbl_err_code_t hal_write_program_bytes (uint32_t addr, uint8_t * buf,
+        uint32_t len);
+cbl_err_code_t hal_verify_flash_address (uint32_t addr);
+cbl_err_code_t hal_verify_jump_address (uint32_t addr);
+uint32_t hal_id_code_get (void);
+bool hal_blue_btn_state_get (void);
+void hal_led_on (led_t led);
+void hal_led_off (led_t led);
+void hal_vtor_set (uint32_t addr);
+void hal_msp_set (uint32_t msp);
+void hal_disable_interrupts (void);
+void hal_stop_systick (void);
+void hal_system_restart (void);
+bool hal_app_confirm_get (void);
+void hal_app_confirm_clear (void);
+cbl_err_code_t hal_sig_verify (const uint8_t * p_digest,
+        const uint8_t * p_sig);
+/* Options which are off in the host build, they refuse */
+void hal_rdp_lvl_get (char * buf, size_t len);
+cbl_err_code_t hal_write_prot_get (char * buf, size_t len);
+cbl_err_code_t hal_change_write_prot (uint32_t mask, bool is_enable);
+cbl_err_code_t hal_opt_bytes_get (void * p_opt);
+cbl_err_code_t hal_opt_bytes_program (const void * p_opt);
+
+#endif /* SIM_HAL_H */
+/*** end of file ***/
@@ -0,0 +1,1660 @@
+/** @file test_host.c
+ *
+ * @brief Runs the core on the simulated HAL. Every test gets the name of a
+ *        ctest target and starts with erased flash. "bench" replays an image
+ *        through update-new and update-act and reports the modeled time of
+ *        erase, program and UART, together with the perf table
+ *
+ *        Usage: cbl_host_test <test>
+ *               cbl_host_test bench [file [bin|hex|srec [baud]]]
+ *
+ * @note  Same tests run with both configurations of the host build, checks
+ *        depending on an option are under the option
+ */
+#define _GNU_SOURCE
+#include "etc/cbl_common.h"
+#include "etc/cbl_ab_slots.h"
+#include "etc/cbl_boot_record.h"
+#include "etc/cbl_fast_boot.h"
+#include "etc/cbl_link.h"
+#include "etc/cbl_lz4.h"
+#include "etc/cbl_mem.h"
+#include "etc/cbl_perf.h"
+#include "etc/cbl_rx.h"
+#include "etc/cbl_secure_boot.h"
+#include "etc/cbl_sha256.h"
+#include "commands/cbl_cmds_binary.h"
+#include "commands/cbl_cmds_etc.h"
+#include "commands/cbl_cmds_memory.h"
+#include "sim_hal.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TEST_CMD_SZ 128u
+#define TEST_IMG_SEED 0x1234567u
+#define TEST_HEX_LINE 16u /*!< Data bytes in a hex or srec record */
+#define TEST_BENCH_LEN (256u * 1024u) /*!< Image replayed if no file given */
+#define TEST_SECT_8_SZ (128u * 1024u) /*!< First sector of new application */
+#define TEST_LZ4_HASH_SZ 4096u /*!< Entries of match finder of lz4_make */
+#if 1 == USE_SECURE_BOOT
+#define TEST_REFUSED_ADDR BOOT_RECORD_START /*!< Host can't write it */
+#else
+#define TEST_REFUSED_ADDR 0x40000000UL /*!< Not in the flash */
+#endif /* USE_SECURE_BOOT */
+
+#define CHECK(EXPR) do                                                     \
+                    {                                                      \
+                        if (!(EXPR))                                       \
+                        {                                                  \
+                            fprintf(stderr, "%s:%d: check failed: %s\n",   \
+                                    __FILE__, __LINE__, #EXPR);            \
+                            return false;                                  \
+                        }                                                  \
+                    }                                                      \
+                    while (0)
+
+typedef struct
+{
+    const char * name;
+    bool (*run) (void);
+} test_t;
+
+typedef struct
+{
+    uint8_t * p_buf;
+    uint32_t len;
+} test_buf_t;
+
+static bool test_checksums (void);
+static bool test_flash_write (void);
+static bool test_flash_write_bad_cksum (void);
+static bool test_flash_write_window (void);
+static bool test_flash_write_framed (void);
+static bool test_update_bin (void);
+static bool test_update_hex (void);
+static bool test_update_srec (void);
+static bool test_update_lz4 (void);
+static bool test_update_resume (void);
+static bool test_boot_records (void);
+static bool test_binary (void);
+static bool test_batch (void);
+static bool test_fast_boot (void);
+static bool test_set_baud (void);
+#if 1 == USE_AB_SLOTS
+static bool test_ab_rollback (void);
+#endif /* USE_AB_SLOTS */
+#if 1 == USE_SECURE_BOOT
+static bool test_secure_boot (void);
+#endif /* USE_SECURE_BOOT */
+static int bench (int argc, char ** argv);
+
+static cbl_err_code_t run_cmd (const char * cmd);
+static bool run_update_new (const char * cmd);
+#if 1 == USE_AB_SLOTS
+static bool run_update (const uint8_t * p_img, uint32_t len);
+#endif /* USE_AB_SLOTS */
+static cbl_err_code_t run_batch (const char * script);
+static void restart_done (uint32_t mark);
+static uint32_t link_start (void);
+static uint32_t output_count (const char * str);
+static void image_make (uint8_t * p_img, uint32_t len);
+static void image_make_packable (uint8_t * p_img, uint32_t len);
+static void hex_make (test_buf_t * p_out, const uint8_t * p_img,
+        uint32_t len, uint32_t addr);
+static void srec_make (test_buf_t * p_out, const uint8_t * p_img,
+        uint32_t len, uint32_t addr);
+static void lz4_make (test_buf_t * p_out, const uint8_t * p_img,
+        uint32_t len);
+static uint32_t lz4_block_make (uint8_t * p_out, const uint8_t * p_img,
+        uint32_t len);
+static void chunk_frame_send (uint32_t seq, uint32_t chunk,
+        const uint8_t * p_data, uint32_t len, bool is_bad);
+static void buf_printf (test_buf_t * p_out, const char * fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+static uint32_t crc32_ref (const uint8_t * buf, uint32_t len);
+static void put_u32_be (uint8_t * p, uint32_t val);
+static void put_u32_le (uint8_t * p, uint32_t val);
+static uint32_t get_u32_le (const uint8_t * p);
+static uint32_t bin_frame_make (uint8_t * p_frame, uint8_t code,
+        const uint8_t * p_payload, uint32_t len);
+static void bin_frame_send (uint8_t code, const uint8_t * p_payload,
+        uint32_t len);
+static const uint8_t * bin_frame_next (const uint8_t * p_out,
+        const uint8_t * p_end, uint8_t * p_code, uint32_t * p_status,
+        const uint8_t ** pp_data, uint32_t * p_len);
+
+static const test_t tests[] =
+{
+    { "checksums", test_checksums },
+    { "flash_write", test_flash_write },
+    { "flash_write_bad_cksum", test_flash_write_bad_cksum },
+    { "flash_write_window", test_flash_write_window },
+    { "flash_write_framed", test_flash_write_framed },
+    { "update_bin", test_update_bin },
+    { "update_hex", test_update_hex },
+    { "update_srec", test_update_srec },
+    { "update_lz4", test_update_lz4 },
+    { "update_resume", test_update_resume },
+    { "boot_records", test_boot_records },
+    { "binary", test_binary },
+    { "batch", test_batch },
+    { "fast_boot", test_fast_boot },
+    { "set_baud", test_set_baud },
+#if 1 == USE_AB_SLOTS
+    { "ab_rollback", test_ab_rollback },
+#endif /* USE_AB_SLOTS */
+#if 1 == USE_SECURE_BOOT
+    { "secure_boot", test_secure_boot },
+#endif /* USE_SECURE_BOOT */
+};
+#define TESTS_LEN (sizeof(tests) / sizeof(tests[0]))
+
+int main (int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <test>|bench [file [type [baud]]]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* Same start as the shell, without the welcome message */
+    sim_init();
+    perf_timer_start();
+    link_init();
+    rx_init();
+
+    if (0 == strcmp(argv[1], "bench"))
+    {
+        return bench(argc, argv);
+    }
+
+    for (uint32_t iii = 0; iii < TESTS_LEN; iii++)
+    {
+        if (0 == strcmp(argv[1], tests[iii].name))
+        {
+            return true == tests[iii].run() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    fprintf(stderr, "unknown test %s\n", argv[1]);
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief CRC32 of the emulated CRC unit and sha256 against known answers,
+ *        through mem-hash
+ */
+static bool test_checksums (void)
+{
+    const char check[] = "123456789";
+    const char abc[] = "abc";
+
+    CHECK(CBL_ERR_OK == hal_write_program_bytes(BOOT_NEW_APP_START,
+                    (uint8_t *)check, strlen(check)));
+    CHECK(CBL_ERR_OK == run_cmd("mem-hash start=0x08080000 count=9 "
+                    "cksum=crc32"));
+    CHECK(sim_host_output_has("crc32:cbf43926"));
+
+    /* Unaligned start and length, tail is added in software */
+    CHECK(CBL_ERR_OK == run_cmd("mem-hash start=0x08080001 count=7 "
+                    "cksum=crc32"));
+    {
+        char expected[32];
+
+        snprintf(expected, sizeof(expected), "crc32:%08x",
+                crc32_ref((const uint8_t *)check + 1, 7));
+        CHECK(sim_host_output_has(expected));
+    }
+
+    CHECK(CBL_ERR_OK == hal_write_program_bytes(BOOT_NEW_APP_START + 16u,
+                    (uint8_t *)abc, strlen(abc)));
+    CHECK(CBL_ERR_OK == run_cmd("mem-hash start=0x08080010 count=3 "
+                    "cksum=sha256"));
+    CHECK(sim_host_output_has("sha256:ba7816bf8f01cfea414140de5dae2223b00361a3"
+                    "96177a9cb410ff61f20015ad"));
+
+    return true;
+}
+
+/**
+ * @brief Erases new application area and writes two and a half chunks to it
+ *        with CRC32 of the transfer
+ */
+static bool test_flash_write (void)
+{
+    const uint32_t len = 2u * FLASH_WRITE_SZ + 1000u;
+    uint8_t * p_img = malloc(len);
+    uint8_t crc[4];
+    char cmd[TEST_CMD_SZ];
+
+    image_make(p_img, len);
+    put_u32_be(crc, crc32_ref(p_img, len));
+
+    /* Blank sector is skipped, written one is erased */
+    CHECK(CBL_ERR_OK == run_cmd("flash-erase type=sector sector=8 count=1"));
+    CHECK(0 == sim_stats_get()->n_erased);
+    sim_flash_fill(BOOT_NEW_APP_START + 100u, 0x00u, 4u);
+    CHECK(CBL_ERR_OK == run_cmd("flash-erase type=sector sector=8 count=1"));
+    CHECK(1 == sim_stats_get()->n_erased);
+
+    sim_host_send(p_img, len);
+    sim_host_send(crc, sizeof(crc));
+    snprintf(cmd, sizeof(cmd), "flash-write start=0x%08lx count=%u "
+            "cksum=crc32", BOOT_NEW_APP_START, len);
+    CHECK(CBL_ERR_OK == run_cmd(cmd));
+
+    CHECK(sim_host_output_has("chunks:3"));
+    CHECK(sim_host_output_has(TXT_SUCCESS));
+    CHECK(0 == sim_host_pending());
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, p_img, len));
+    CHECK(len == sim_stats_get()->n_programmed);
+
+    CHECK(CBL_ERR_INV_SECT_COUNT == run_cmd("flash-erase type=sector "
+                    "sector=11 count=2"));
+    CHECK(CBL_ERR_INV_SECT == run_cmd("flash-erase type=sector sector=12 "
+                    "count=1"));
+
+#if 1 == USE_SECURE_BOOT
+    /* Bootloader and boot record are refused, mass erase keeps them */
+    CHECK(CBL_ERR_WRITE_INV_ADDR == run_cmd("flash-write start=0x0800C000 "
+                    "count=4"));
+    CHECK(CBL_ERR_INV_SECT == run_cmd("flash-erase type=sector sector=3 "
+                    "count=1"));
+    CHECK(CBL_ERR_OK == boot_record_set(boot_record_get()));
+    sim_stats_reset();
+    CHECK(CBL_ERR_OK == run_cmd("flash-erase type=mass"));
+    CHECK(0 == sim_stats_get()->n_mass_erased);
+    CHECK(sim_host_output_has("erased:1|skipped:7"));
+    CHECK(0xFFu != *(const uint8_t *)BOOT_RECORD_START);
+    CHECK(0xFFu == *(const uint8_t *)BOOT_NEW_APP_START);
+#else
+    CHECK(CBL_ERR_OK == run_cmd("flash-erase type=mass"));
+    CHECK(1 == sim_stats_get()->n_mass_erased);
+#endif /* USE_SECURE_BOOT */
+
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief Wrong checksum of the transfer fails flash-write
+ */
+static bool test_flash_write_bad_cksum (void)
+{
+    const uint32_t len = 3000u;
+    uint8_t * p_img = malloc(len);
+    uint8_t crc[4];
+    char cmd[TEST_CMD_SZ];
+
+    image_make(p_img, len);
+    put_u32_be(crc, crc32_ref(p_img, len) ^ 1u);
+
+    sim_host_send(p_img, len);
+    sim_host_send(crc, sizeof(crc));
+    snprintf(cmd, sizeof(cmd), "flash-write start=0x%08lx count=%u "
+            "cksum=crc32", BOOT_NEW_APP_START, len);
+    CHECK(CBL_ERR_CKSUM_WRONG == run_cmd(cmd));
+    CHECK(0 == sim_host_pending());
+
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief Pipelined flash-write, next chunk is requested before the current
+ *        one is programmed. Window larger than the buffers is refused
+ */
+static bool test_flash_write_window (void)
+{
+    const uint32_t len = 2u * FLASH_WRITE_SZ + 1000u;
+    uint8_t * p_img = malloc(len);
+    uint8_t crc[4];
+    char cmd[TEST_CMD_SZ];
+
+    image_make(p_img, len);
+    put_u32_be(crc, crc32_ref(p_img, len));
+
+    sim_host_send(p_img, len);
+    sim_host_send(crc, sizeof(crc));
+    snprintf(cmd, sizeof(cmd), "flash-write start=0x%08lx count=%u "
+            "cksum=crc32 window=2", BOOT_NEW_APP_START, len);
+    CHECK(CBL_ERR_OK == run_cmd(cmd));
+
+    CHECK(sim_host_output_has("chunks:3|window:2"));
+    CHECK(3 == output_count("chunk OK"));
+    CHECK(sim_host_output_has(TXT_SUCCESS));
+    CHECK(0 == sim_host_pending());
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, p_img, len));
+    CHECK(len == sim_stats_get()->n_programmed);
+
+    snprintf(cmd, sizeof(cmd), "flash-write start=0x%08lx count=%u "
+            "window=%u", BOOT_NEW_APP_START + TEST_SECT_8_SZ / 2u, len,
+            FLASH_WRITE_N_BUFS + 1u);
+    CHECK(CBL_ERR_INV_WINDOW == run_cmd(cmd));
+
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief Framed flash-write. Corrupted chunk and chunk with a wrong sequence
+ *        number are rejected and requested again after the other ones,
+ *        nothing of them is programmed
+ */
+static bool test_flash_write_framed (void)
+{
+    const uint32_t len = 2u * FLASH_WRITE_SZ + 1000u;
+    const uint32_t start = BOOT_NEW_APP_START + TEST_SECT_8_SZ / 2u;
+    uint8_t * p_img = malloc(len);
+    uint8_t crc[4];
+    char cmd[TEST_CMD_SZ];
+
+    image_make(p_img, len);
+    put_u32_be(crc, crc32_ref(p_img, len));
+
+    /* Chunk 1 is corrupted, chunk 2 is in flight meanwhile */
+    chunk_frame_send(0, 0, p_img, len, false);
+    chunk_frame_send(1, 1, p_img, len, true);
+    chunk_frame_send(2, 2, p_img, len, false);
+    chunk_frame_send(1, 1, p_img, len, false);
+    sim_host_send(crc, sizeof(crc));
+    snprintf(cmd, sizeof(cmd), "flash-write start=0x%08lx count=%u "
+            "cksum=crc32 window=2 frame=true", BOOT_NEW_APP_START, len);
+    CHECK(CBL_ERR_OK == run_cmd(cmd));
+
+    CHECK(1 == output_count(TXT_RESP_FLASH_WRITE_CHUNK_NOK));
+    CHECK(3 == output_count("chunk OK"));
+    CHECK(sim_host_output_has(TXT_SUCCESS));
+    CHECK(0 == sim_host_pending());
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, p_img, len));
+    CHECK(len == sim_stats_get()->n_programmed);
+
+    /* Lock-step, host sends chunk 1 when chunk 0 is requested */
+    sim_host_output_clear();
+    sim_stats_reset();
+    chunk_frame_send(1, 1, p_img, len, false);
+    chunk_frame_send(1, 1, p_img, len, false);
+    chunk_frame_send(2, 2, p_img, len, false);
+    chunk_frame_send(0, 0, p_img, len, false);
+    sim_host_send(crc, sizeof(crc));
+    snprintf(cmd, sizeof(cmd), "flash-write start=0x%08lx count=%u "
+            "cksum=crc32 frame=true", start, len);
+    CHECK(CBL_ERR_OK == run_cmd(cmd));
+
+    CHECK(1 == output_count(TXT_RESP_FLASH_WRITE_CHUNK_NOK));
+    CHECK(0 == sim_host_pending());
+    CHECK(0 == memcmp((void *)start, p_img, len));
+    CHECK(len == sim_stats_get()->n_programmed);
+
+    /* Frame CRC32 is over whole words */
+    snprintf(cmd, sizeof(cmd), "flash-write start=0x%08lx count=%u "
+            "frame=true", start + len, 10u);
+    CHECK(CBL_ERR_CRC_LEN == run_cmd(cmd));
+
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief Binary image through update-new, restart and update-act. With A/B
+ *        slots update-act switches to the slot the image was written to
+ */
+static bool test_update_bin (void)
+{
+    const uint32_t len = 150u * 1024u + 123u;
+    uint8_t * p_img = malloc(len);
+    uint8_t digest[SHA256_DIGEST_SZ];
+    sha256_ctx_t h_sha256;
+    boot_record_t * p_rec;
+    char cmd[TEST_CMD_SZ];
+
+    image_make(p_img, len);
+    sha256_start( &h_sha256);
+    sha256_add( &h_sha256, p_img, len);
+    sha256_finish( &h_sha256, digest);
+
+    sim_host_send(p_img, len);
+    sim_host_send(digest, sizeof(digest));
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=bin cksum=sha256",
+            len);
+    CHECK(run_update_new(cmd));
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, p_img, len));
+
+    p_rec = boot_record_get();
+    CHECK(true == p_rec->is_new_app_ready);
+    CHECK(TYPE_BIN == p_rec->new_app.app_type);
+    CHECK(len == p_rec->new_app.len);
+
+    CHECK(CBL_ERR_OK == run_cmd("update-act"));
+    CHECK(0 == memcmp((void *)ab_act_start(), p_img, len));
+
+    p_rec = boot_record_get();
+    CHECK(false == p_rec->is_new_app_ready);
+    CHECK(TYPE_BIN == p_rec->act_app.app_type);
+    CHECK(len == p_rec->act_app.len);
+
+#if 1 == USE_AB_SLOTS
+    /* Nothing is copied, new application area is the active slot now */
+    CHECK(BOOT_NEW_APP_START == ab_act_start());
+    CHECK(true == p_rec->is_trial);
+    CHECK(0xFFu == *(const uint8_t *)BOOT_ACT_APP_START);
+#else
+    /* Same image again, no sector of the active application changes */
+    p_rec->is_new_app_ready = true;
+    CHECK(CBL_ERR_OK == boot_record_set(p_rec));
+    sim_stats_reset();
+    CHECK(CBL_ERR_OK == run_cmd("update-act"));
+    CHECK(sim_host_output_has("Sectors written: 0"));
+    CHECK(0 == sim_stats_get()->n_erased);
+    /* Only the boot record is programmed */
+    CHECK(sim_stats_get()->n_programmed <= BOOT_RECORD_SLOT_SZ);
+    CHECK(0 == memcmp((void *)BOOT_ACT_APP_START, p_img, len));
+#endif /* USE_AB_SLOTS */
+
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief Intel hex is stored as text by update-new and decoded by
+ *        update-act, boot record holds the length of the decoded image. With
+ *        A/B slots update-new decodes it, slot can't hold text
+ */
+static bool test_update_hex (void)
+{
+    const uint32_t len = 20000u;
+    uint8_t * p_img = malloc(len);
+    test_buf_t hex = { 0 };
+    uint8_t crc[4];
+    char cmd[TEST_CMD_SZ];
+
+    image_make(p_img, len);
+    hex_make( &hex, p_img, len, link_start());
+    put_u32_be(crc, crc32_ref(hex.p_buf, hex.len));
+
+    sim_host_send(hex.p_buf, hex.len);
+    sim_host_send(crc, sizeof(crc));
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=hex cksum=crc32",
+            hex.len);
+    CHECK(run_update_new(cmd));
+#if 1 == USE_AB_SLOTS
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, p_img, len));
+    CHECK(TYPE_BIN == boot_record_get()->new_app.app_type);
+    CHECK(len == boot_record_get()->new_app.len);
+#else
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, hex.p_buf, hex.len));
+    CHECK(TYPE_HEX == boot_record_get()->new_app.app_type);
+    CHECK(hex.len == boot_record_get()->new_app.len);
+#endif /* USE_AB_SLOTS */
+
+    CHECK(CBL_ERR_OK == run_cmd("update-act"));
+    CHECK(0 == memcmp((void *)ab_act_start(), p_img, len));
+
+    /* Active application is the decoded image, not the text */
+    CHECK(TYPE_BIN == boot_record_get()->act_app.app_type);
+    CHECK(len == boot_record_get()->act_app.len);
+
+    free(hex.p_buf);
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief S-record is decoded while received, update-act copies the binary.
+ *        Record with a wrong checksum fails the transfer
+ */
+static bool test_update_srec (void)
+{
+    const uint32_t len = 30000u;
+    uint8_t * p_img = malloc(len);
+    test_buf_t srec = { 0 };
+    char cmd[TEST_CMD_SZ];
+    char * p_rec;
+    boot_record_t * p_boot_rec;
+
+    image_make(p_img, len);
+    srec_make( &srec, p_img, len, link_start());
+
+    sim_host_send(srec.p_buf, srec.len);
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=srec cksum=no "
+            "decode=true", srec.len);
+    CHECK(run_update_new(cmd));
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, p_img, len));
+
+    p_boot_rec = boot_record_get();
+    CHECK(TYPE_BIN == p_boot_rec->new_app.app_type);
+    CHECK(len == p_boot_rec->new_app.len);
+
+    CHECK(CBL_ERR_OK == run_cmd("update-act"));
+    CHECK(0 == memcmp((void *)ab_act_start(), p_img, len));
+
+    /* Slot written next may be the other one */
+    free(srec.p_buf);
+    srec.p_buf = NULL;
+    srec.len = 0;
+    srec_make( &srec, p_img, len, link_start());
+
+    /* Last digit of the checksum of the first data record */
+    p_rec = strstr((char *)srec.p_buf, "\r\nS3");
+    p_rec = strstr(p_rec + 2, "\r\n");
+    p_rec[-1] = ('0' == p_rec[-1]) ? '1' : '0';
+
+    sim_host_send(srec.p_buf, srec.len);
+    if (0 == setjmp(sim_restart_jmp))
+    {
+        CHECK(CBL_ERR_REC_CKSUM == run_cmd(cmd));
+    }
+    CHECK(1 == sim_stats_get()->n_restarts);
+
+    free(srec.p_buf);
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief LZ4 frame is decompressed while received, checksum is over the
+ *        output. Framed and pipelined, first chunk is corrupted, chunk in
+ *        flight is rejected too and the stream continues from the first
+ */
+static bool test_update_lz4 (void)
+{
+    const uint32_t len = 60000u;
+    uint8_t * p_img = malloc(len);
+    test_buf_t lz4 = { 0 };
+    uint8_t digest[SHA256_DIGEST_SZ];
+    sha256_ctx_t h_sha256;
+    uint32_t n_chunks;
+    char cmd[TEST_CMD_SZ];
+
+    image_make_packable(p_img, len);
+    lz4_make( &lz4, p_img, len);
+    CHECK(lz4.len < len * 3u / 4u);
+    sha256_start( &h_sha256);
+    sha256_add( &h_sha256, p_img, len);
+    sha256_finish( &h_sha256, digest);
+
+    sim_host_send(lz4.p_buf, lz4.len);
+    sim_host_send(digest, sizeof(digest));
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=bin-lz4 "
+            "cksum=sha256", lz4.len);
+    CHECK(run_update_new(cmd));
+    CHECK(0 == memcmp((void *)ab_new_start(), p_img, len));
+    CHECK(TYPE_BIN == boot_record_get()->new_app.app_type);
+    CHECK(len == boot_record_get()->new_app.len);
+
+    CHECK(CBL_ERR_OK == run_cmd("update-act"));
+    CHECK(0 == memcmp((void *)ab_act_start(), p_img, len));
+
+    sim_host_output_clear();
+    n_chunks = (lz4.len + FLASH_WRITE_SZ - 1u) / FLASH_WRITE_SZ;
+    chunk_frame_send(0, 0, lz4.p_buf, lz4.len, true);
+    chunk_frame_send(1, 1, lz4.p_buf, lz4.len, false);
+    for (uint32_t iii = 0; iii < n_chunks; iii++)
+    {
+        chunk_frame_send(iii, iii, lz4.p_buf, lz4.len, false);
+    }
+    sim_host_send(digest, sizeof(digest));
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=bin-lz4 "
+            "cksum=sha256 window=2 frame=true", lz4.len);
+    CHECK(run_update_new(cmd));
+    CHECK(2 == output_count(TXT_RESP_FLASH_WRITE_CHUNK_NOK));
+    CHECK(0 == memcmp((void *)ab_new_start(), p_img, len));
+    CHECK(len == boot_record_get()->new_app.len);
+
+    free(lz4.p_buf);
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief Transfer interrupted by a reset continues from its checkpoint, only
+ *        bytes after it are sent again. Other image can't continue it
+ */
+static bool test_update_resume (void)
+{
+    const uint32_t len = 150u * 1024u + 123u;
+    const uint32_t sent = 140u * 1024u;
+    uint8_t * p_img = malloc(len);
+    uint8_t digest[SHA256_DIGEST_SZ];
+    sha256_ctx_t h_sha256;
+    boot_record_t * p_rec;
+    char cmd[TEST_CMD_SZ];
+    uint32_t mark;
+
+    image_make(p_img, len);
+    sha256_start( &h_sha256);
+    sha256_add( &h_sha256, p_img, len);
+    sha256_finish( &h_sha256, digest);
+
+    /* Host is gone after 'sent' bytes, watchdog resets */
+    sim_host_send(p_img, sent);
+    sim_host_gone_reset(true);
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=bin cksum=sha256 "
+            "id=5a", len);
+    mark = mem_mark();
+    if (0 == setjmp(sim_restart_jmp))
+    {
+        run_cmd(cmd);
+        fprintf(stderr, "update-new returned\n");
+        return false;
+    }
+    restart_done(mark);
+
+    /* Sector 8 was written full, the one after it may still change */
+    p_rec = boot_record_get();
+    CHECK(false == p_rec->is_new_app_ready);
+    CHECK(TEST_SECT_8_SZ == p_rec->xfer.done);
+    CHECK(0 == memcmp((void *)ab_new_start(), p_img, TEST_SECT_8_SZ));
+
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=bin cksum=sha256 "
+            "id=5b resume=true", len);
+    CHECK(CBL_ERR_NO_RESUME == run_cmd(cmd));
+
+    sim_stats_reset();
+    sim_host_output_clear();
+    sim_host_send(p_img + TEST_SECT_8_SZ, len - TEST_SECT_8_SZ);
+    sim_host_send(digest, sizeof(digest));
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=bin cksum=sha256 "
+            "id=5a resume=true", len);
+    CHECK(run_update_new(cmd));
+
+    CHECK(sim_host_output_has("resume|offset:131072"));
+    CHECK(len - TEST_SECT_8_SZ + sizeof(digest) == sim_stats_get()->n_rx);
+    CHECK(0 == memcmp((void *)ab_new_start(), p_img, len));
+    p_rec = boot_record_get();
+    CHECK(true == p_rec->is_new_app_ready);
+    CHECK(len == p_rec->new_app.len);
+    CHECK(0 == p_rec->xfer.done);
+
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief Boot record is appended to the log, sector is erased only after
+ *        all slots are used
+ */
+static bool test_boot_records (void)
+{
+    const uint32_t n_sets = BOOT_RECORD_N_SLOTS + 8u;
+    boot_record_t * p_rec = boot_record_get();
+
+    CHECK(false == p_rec->is_new_app_ready);
+    CHECK(0 == p_rec->act_app.len);
+
+    for (uint32_t iii = 1; iii <= n_sets; iii++)
+    {
+        p_rec = boot_record_get();
+        p_rec->act_app.len = iii;
+        p_rec->act_app.app_type = TYPE_BIN;
+        CHECK(CBL_ERR_OK == boot_record_set(p_rec));
+
+        /* Editable copy is read again from flash */
+        memset(p_rec, 0, sizeof(*p_rec));
+        p_rec = boot_record_get();
+        CHECK(iii == p_rec->act_app.len);
+        CHECK(TYPE_BIN == p_rec->act_app.app_type);
+
+        CHECK((iii <= BOOT_RECORD_N_SLOTS ? 0u : 1u)
+                == sim_stats_get()->n_erased);
+    }
+
+    /* Slots above the newest one are still erased */
+    for (uint32_t iii = n_sets - BOOT_RECORD_N_SLOTS;
+            iii < BOOT_RECORD_N_SLOTS; iii++)
+    {
+        const uint8_t * p_slot = (const uint8_t *)(BOOT_RECORD_START
+                + iii * BOOT_RECORD_SLOT_SZ);
+
+        for (uint32_t jjj = 0; jjj < BOOT_RECORD_SLOT_SZ; jjj++)
+        {
+            CHECK(0xFF == p_slot[jjj]);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Binary frames run flash-erase, flash-write and mem-read through
+ *        the command table, bad frame is answered without running it
+ */
+static bool test_binary (void)
+{
+    const uint32_t len = 301u;
+    uint8_t payload[BIN_MAX_PAYLOAD];
+    uint8_t img[301];
+    const uint8_t * p_out;
+    const uint8_t * p_end;
+    const uint8_t * p_data;
+    uint32_t out_len;
+    uint32_t status;
+    uint32_t data_len;
+    uint8_t code;
+    uint8_t frame[BIN_HDR_SZ + BIN_MAX_PAYLOAD + 3u + BIN_CRC_SZ];
+    uint32_t frame_len;
+
+    image_make(img, len);
+
+    /* Erase sector 8 */
+    put_u32_le( &payload[0], 0);
+    put_u32_le( &payload[4], 8);
+    put_u32_le( &payload[8], 1);
+    bin_frame_send(CMD_FLASH_ERASE, payload, 12);
+
+    /* Corrupted frame is answered without running it, host repeats it */
+    put_u32_le( &payload[0], BOOT_NEW_APP_START);
+    memcpy( &payload[4], img, len);
+    frame_len = bin_frame_make(frame, CMD_FLASH_WRITE, payload, 4 + len);
+    frame[BIN_HDR_SZ + 10u] ^= 0x01u;
+    sim_host_send(frame, frame_len);
+    bin_frame_send(CMD_FLASH_WRITE, payload, 4 + len);
+
+    put_u32_le( &payload[4], len);
+    bin_frame_send(CMD_MEM_READ, payload, 8);
+
+    /* Boot record with secure boot, else an address outside of flash */
+    put_u32_le( &payload[0], TEST_REFUSED_ADDR);
+    bin_frame_send(CMD_FLASH_WRITE, payload, 4 + 4);
+
+    bin_frame_send(BIN_CODE_LEAVE, NULL, 0);
+
+    CHECK(CBL_ERR_OK == run_cmd(TXT_CMD_BINARY));
+    CHECK(0 == sim_host_pending());
+    CHECK(0 == memcmp((void *)BOOT_NEW_APP_START, img, len));
+
+    p_out = (const uint8_t *)sim_host_output( &out_len);
+    p_end = p_out + out_len;
+    p_out = (const uint8_t *)strstr((const char *)p_out, TXT_RESP_BINARY);
+    CHECK(NULL != p_out);
+    p_out += strlen(TXT_RESP_BINARY);
+
+    p_out = bin_frame_next(p_out, p_end, &code, &status, &p_data, &data_len);
+    CHECK(NULL != p_out && CMD_FLASH_ERASE == code && CBL_ERR_OK == status);
+
+    p_out = bin_frame_next(p_out, p_end, &code, &status, &p_data, &data_len);
+    CHECK(NULL != p_out && CMD_FLASH_WRITE == code);
+    CHECK(CBL_ERR_CKSUM_WRONG == status);
+
+    /* Text flash-write sends is the data of the response */
+    p_out = bin_frame_next(p_out, p_end, &code, &status, &p_data, &data_len);
+    CHECK(NULL != p_out && CMD_FLASH_WRITE == code && CBL_ERR_OK == status);
+    CHECK(NULL != memmem(p_data, data_len, "chunks:1", 8));
+
+    p_out = bin_frame_next(p_out, p_end, &code, &status, &p_data, &data_len);
+    CHECK(NULL != p_out && CMD_MEM_READ == code && CBL_ERR_OK == status);
+    CHECK(len == data_len && 0 == memcmp(p_data, img, len));
+
+    p_out = bin_frame_next(p_out, p_end, &code, &status, &p_data, &data_len);
+    CHECK(NULL != p_out && CMD_FLASH_WRITE == code);
+    CHECK(CBL_ERR_WRITE_INV_ADDR == status);
+
+    p_out = bin_frame_next(p_out, p_end, &code, &status, &p_data, &data_len);
+    CHECK(NULL != p_out && BIN_CODE_LEAVE == code && CBL_ERR_OK == status);
+
+    return true;
+}
+
+/**
+ * @brief Batch stops after exit wherever it is, reset and a failed jump-to
+ *        are reported in one summary
+ */
+static bool test_batch (void)
+{
+    const char hash[] = "mem-hash start=0x08080000 count=4 cksum=crc32";
+    char script[TEST_CMD_SZ];
+    uint32_t mark;
+
+    /* Exit as the last step leaves after the summary */
+    snprintf(script, sizeof(script), "%s;exit", hash);
+    CHECK(CBL_ERR_OK == run_batch(script));
+    CHECK(true == gIsExitReq);
+    CHECK(1 == output_count("batch|"));
+    CHECK(sim_host_output_has("batch|steps:2|done:2|"));
+    CHECK(sim_host_output_has("crc32:"));
+    CHECK(sim_host_output_has("step:1|exit|OK|"));
+    gIsExitReq = false;
+
+    /* Steps after exit don't run */
+    sim_host_output_clear();
+    snprintf(script, sizeof(script), "exit;%s", hash);
+    CHECK(CBL_ERR_OK == run_batch(script));
+    CHECK(true == gIsExitReq);
+    CHECK(1 == output_count("batch|"));
+    CHECK(sim_host_output_has("batch|steps:2|done:1|"));
+    CHECK(false == sim_host_output_has("crc32:"));
+    gIsExitReq = false;
+
+    /* Refused jump is reported once, as failed */
+    sim_host_output_clear();
+    snprintf(script, sizeof(script), "%s;jump-to addr=0x40000000;%s", hash,
+            hash);
+    CHECK(CBL_ERR_JUMP_INV_ADDR == run_batch(script));
+    CHECK(1 == output_count("batch|"));
+    CHECK(sim_host_output_has("batch|steps:3|done:2|"));
+    CHECK(sim_host_output_has("step:1|jump-to|ERROR|"));
+    CHECK(1 == output_count("crc32:"));
+
+    /* Summary goes out before the reset, after its "OK" */
+    sim_host_output_clear();
+    snprintf(script, sizeof(script), "%s;reset", hash);
+    mark = mem_mark();
+    if (0 == setjmp(sim_restart_jmp))
+    {
+        run_batch(script);
+        fprintf(stderr, "reset returned\n");
+        return false;
+    }
+    restart_done(mark);
+    CHECK(1 == sim_stats_get()->n_restarts);
+    CHECK(1 == output_count("batch|"));
+    CHECK(sim_host_output_has("batch|steps:2|done:2|"));
+    CHECK(sim_host_output_has("step:1|reset|OK|"));
+
+    return true;
+}
+
+/**
+ * @brief Fast boot checks the active application, first fast boot stores
+ *        its reset to jump time once, perf shows it
+ */
+static bool test_fast_boot (void)
+{
+    const uint32_t len = 10000u;
+    uint8_t * p_img = malloc(len);
+    boot_record_t * p_rec;
+    uint32_t n_programmed;
+
+    /* Stack at the end of SRAM, reset handler inside, thumb */
+    image_make(p_img, len);
+    put_u32_le( &p_img[0], 0x20020000UL);
+    put_u32_le( &p_img[4], BOOT_ACT_APP_START + 0x201u);
+    CHECK(CBL_ERR_OK == hal_write_program_bytes(BOOT_ACT_APP_START, p_img,
+                    len));
+    p_rec = boot_record_get();
+    p_rec->act_app.app_type = TYPE_BIN;
+    p_rec->act_app.len = len;
+    CHECK(CBL_ERR_OK == boot_record_set(p_rec));
+
+    CHECK(CBL_ERR_OK == run_cmd("fast-boot enable=true"));
+    CHECK(true == fast_boot_is_on());
+    CHECK(CBL_ERR_OK == fast_boot_verify());
+    CHECK(CBL_ERR_OK == run_cmd("perf"));
+    CHECK(sim_host_output_has("fast-boot|cycles:0|"));
+
+    fast_boot_cycles_store();
+    CHECK(0 != boot_record_get()->fast_boot_cycles);
+    n_programmed = sim_stats_get()->n_programmed;
+    fast_boot_cycles_store();
+    CHECK(n_programmed == sim_stats_get()->n_programmed);
+
+    sim_host_output_clear();
+    CHECK(CBL_ERR_OK == run_cmd("perf"));
+    CHECK(false == sim_host_output_has("fast-boot|cycles:0|"));
+
+    /* Enabling again measures again */
+    CHECK(CBL_ERR_OK == run_cmd("fast-boot enable=true"));
+    CHECK(0 == boot_record_get()->fast_boot_cycles);
+
+    /* Changed application fails the check */
+    sim_flash_fill(BOOT_ACT_APP_START + 100u, 0x00u, 1u);
+    CHECK(CBL_ERR_CKSUM_WRONG == fast_boot_verify());
+
+    free(p_img);
+    return true;
+}
+
+/**
+ * @brief set-baud switches after the probe. Without it old rate is used
+ *        again after the timeout, also with a wrong one
+ */
+static bool test_set_baud (void)
+{
+    uint64_t start = sim_cycles();
+
+    CHECK(CBL_ERR_BAUD == run_cmd("set-baud rate=921600"));
+    CHECK(sim_host_output_has("baud:921600"));
+    CHECK(SIM_BAUD_DEFAULT == sim_baud_get());
+    CHECK(sim_cycles() - start
+            >= SET_BAUD_TIMEOUT_MS * (uint64_t)(SIM_CLK_HZ / 1000u));
+
+    sim_host_send_str("baud!\r\n");
+    CHECK(CBL_ERR_BAUD == run_cmd("set-baud rate=921600"));
+    CHECK(SIM_BAUD_DEFAULT == sim_baud_get());
+    CHECK(false == sim_host_output_has(TXT_SET_BAUD_CONFIRM));
+
+    sim_host_send_str(TXT_SET_BAUD_PROBE);
+    CHECK(CBL_ERR_OK == run_cmd("set-baud rate=921600"));
+    CHECK(921600u == sim_baud_get());
+    CHECK(sim_host_output_has(TXT_SET_BAUD_CONFIRM));
+    CHECK(0 == sim_host_pending());
+
+    CHECK(CBL_ERR_BAUD_RANGE == run_cmd("set-baud rate=1200"));
+    CHECK(921600u == sim_baud_get());
+
+    return true;
+}
+
+#if 1 == USE_AB_SLOTS
+/**
+ * @brief Switched slot which confirms itself stays active, one which
+ *        doesn't in AB_MAX_TRIAL_BOOTS boots is rolled back
+ */
+static bool test_ab_rollback (void)
+{
+    const uint32_t len = 20000u;
+    uint8_t * p_first = malloc(len);
+    uint8_t * p_second = malloc(len);
+    boot_record_t * p_rec;
+
+    image_make(p_first, len);
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        p_second[iii] = p_first[iii] ^ 0x5Au;
+    }
+
+    CHECK(run_update(p_first, len));
+    p_rec = boot_record_get();
+    CHECK(AB_SLOT_B == p_rec->act_slot);
+    CHECK(true == p_rec->is_trial);
+
+    sim_app_confirm_set(true);
+    ab_boot_check();
+    CHECK(false == boot_record_get()->is_trial);
+    CHECK(false == hal_app_confirm_get());
+
+    /* Confirmed application is kept to roll back to */
+    CHECK(run_update(p_second, len));
+    CHECK(BOOT_ACT_APP_START == ab_act_start());
+    CHECK(0 == memcmp((void *)ab_act_start(), p_second, len));
+    CHECK(len == boot_record_get()->prev_app.len);
+
+    for (uint32_t iii = 0; iii < AB_MAX_TRIAL_BOOTS; iii++)
+    {
+        ab_boot_check();
+        CHECK(AB_SLOT_A == boot_record_get()->act_slot);
+        CHECK(true == boot_record_get()->is_trial);
+    }
+
+    ab_boot_check();
+    p_rec = boot_record_get();
+    CHECK(AB_SLOT_B == p_rec->act_slot);
+    CHECK(false == p_rec->is_trial);
+    CHECK(len == p_rec->act_app.len);
+    CHECK(0 == p_rec->prev_app.len);
+    CHECK(0 == memcmp((void *)ab_act_start(), p_first, len));
+
+    free(p_second);
+    free(p_first);
+    return true;
+}
+#endif /* USE_AB_SLOTS */
+
+#if 1 == USE_SECURE_BOOT
+/**
+ * @brief Signature of the active application is verified once, its digest
+ *        is cached. Changed image is refused, jump-to only goes into the
+ *        verified image
+ */
+static bool test_secure_boot (void)
+{
+    const uint32_t len = 10000u;
+    uint8_t * p_img = malloc(len);
+    uint8_t * p_sig = &p_img[len - SECURE_BOOT_SIG_SZ];
+    sha256_ctx_t h_sha256;
+    boot_record_t * p_rec;
+
+    /* Signature of sim_hal.c is the digest followed by zeros */
+    image_make(p_img, len);
+    memset(p_sig, 0, SECURE_BOOT_SIG_SZ);
+    sha256_start( &h_sha256);
+    sha256_add( &h_sha256, p_img, len - SECURE_BOOT_SIG_SZ);
+    sha256_finish( &h_sha256, p_sig);
+
+    CHECK(CBL_ERR_OK == hal_write_program_bytes(ab_act_start(), p_img, len));
+    p_rec = boot_record_get();
+    p_rec->act_app.app_type = TYPE_BIN;
+    p_rec->act_app.len = len;
+    CHECK(CBL_ERR_OK == boot_record_set(p_rec));
+
+    CHECK(CBL_ERR_OK == secure_boot_check());
+    CHECK(1 == sim_stats_get()->n_sig_verify);
+    CHECK(true == boot_record_get()->is_sig_ok);
+    CHECK(CBL_ERR_OK == secure_boot_check());
+    CHECK(1 == sim_stats_get()->n_sig_verify);
+
+    CHECK(CBL_ERR_OK == jump_verify_address(ab_act_start() + 4u));
+    CHECK(CBL_ERR_JUMP_INV_ADDR == jump_verify_address(ab_act_start() + len
+                    - SECURE_BOOT_SIG_SZ));
+    CHECK(CBL_ERR_JUMP_INV_ADDR == run_cmd("jump-to addr=0x08000000"));
+
+    /* Changed image is verified again */
+    sim_flash_fill(ab_act_start() + 100u, 0x00u, 1u);
+    CHECK(CBL_ERR_SIG == secure_boot_check());
+    CHECK(2 == sim_stats_get()->n_sig_verify);
+    CHECK(false == boot_record_get()->is_sig_ok);
+    CHECK(CBL_ERR_SIG == jump_verify_address(ab_act_start() + 4u));
+
+    free(p_img);
+    return true;
+}
+#endif /* USE_SECURE_BOOT */
+
+/**
+ * @brief Replays an image through update-new and update-act, prints modeled
+ *        time of every phase and the perf table
+ */
+static int bench (int argc, char ** argv)
+{
+    test_buf_t img = { 0 };
+    const char * type = argc > 3 ? argv[3] : TXT_PAR_APP_TYPE_BIN;
+    uint8_t digest[SHA256_DIGEST_SZ];
+    sha256_ctx_t h_sha256;
+    sim_model_t model =
+    {
+        .erase_16k_us = 250000u,
+        .erase_64k_us = 550000u,
+        .erase_128k_us = 1000000u,
+        .erase_mass_us = 8000000u,
+        .program_word_us = 16u,
+        .baud = argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 10) :
+        SIM_BAUD_DEFAULT,
+    };
+    const sim_stats_t * p_stats = sim_stats_get();
+    char cmd[TEST_CMD_SZ];
+    clock_t cpu_start;
+    double total_s;
+    FILE * p_file;
+
+    if (argc > 2)
+    {
+        p_file = fopen(argv[2], "rb");
+        if (NULL == p_file)
+        {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+        fseek(p_file, 0, SEEK_END);
+        img.len = (uint32_t)ftell(p_file);
+        rewind(p_file);
+        img.p_buf = malloc(img.len);
+        if (fread(img.p_buf, 1, img.len, p_file) != img.len)
+        {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+        fclose(p_file);
+    }
+    else
+    {
+        img.len = TEST_BENCH_LEN;
+        img.p_buf = malloc(img.len);
+        image_make(img.p_buf, img.len);
+    }
+
+    sim_model_set( &model);
+    sim_stats_reset();
+    cpu_start = clock();
+
+    sha256_start( &h_sha256);
+    sha256_add( &h_sha256, img.p_buf, img.len);
+    sha256_finish( &h_sha256, digest);
+
+    sim_host_send(img.p_buf, img.len);
+    sim_host_send(digest, sizeof(digest));
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=%s cksum=sha256",
+            img.len, type);
+    if (false == run_update_new(cmd) || CBL_ERR_OK != run_cmd("update-act"))
+    {
+        fprintf(stderr, "bench: update failed\n%s\n", sim_host_output(NULL));
+        return EXIT_FAILURE;
+    }
+
+    total_s = (double)sim_cycles() / SIM_CLK_HZ;
+    printf("image      %u bytes, %s, %u baud\n", img.len, type, model.baud);
+    printf("received   %u bytes, sent %u bytes\n", p_stats->n_rx,
+            p_stats->n_tx);
+    printf("programmed %u bytes, erased %u sectors\n", p_stats->n_programmed,
+            p_stats->n_erased);
+    printf("uart       %.3f s\n", (double)p_stats->uart_cycles / SIM_CLK_HZ);
+    printf("erase      %.3f s\n", (double)p_stats->erase_cycles / SIM_CLK_HZ);
+    printf("program    %.3f s\n",
+            (double)p_stats->program_cycles / SIM_CLK_HZ);
+    printf("total      %.3f s, %.1f KB/s\n", total_s,
+            img.len / 1024.0 / total_s);
+    printf("host cpu   %.3f s\n",
+            (double)(clock() - cpu_start) / CLOCKS_PER_SEC);
+
+    sim_host_output_clear();
+    run_cmd("perf");
+    printf("%s", sim_host_output(NULL));
+
+    free(img.p_buf);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Runs one command like the shell does, arena is given back after it.
+ *        Queued responses are sent, shell does it while it waits for the
+ *        next command
+ */
+static cbl_err_code_t run_cmd (const char * cmd)
+{
+    char buf[TEST_CMD_SZ] = { 0 };
+    uint32_t mark = mem_mark();
+    cbl_err_code_t eCode;
+
+    strncpy(buf, cmd, sizeof(buf) - 1u);
+    eCode = CBL_process_cmd(buf, strlen(buf));
+    mem_release(mark);
+    link_flush();
+
+    return eCode;
+}
+
+/**
+ * @brief Runs update-new, which restarts the processor on success
+ *
+ * @return True if it restarted and all queued bytes were taken
+ */
+static bool run_update_new (const char * cmd)
+{
+    uint32_t mark = mem_mark();
+    uint32_t n_restarts = sim_stats_get()->n_restarts;
+
+    if (0 == setjmp(sim_restart_jmp))
+    {
+        cbl_err_code_t eCode = run_cmd(cmd);
+
+        fprintf(stderr, "update-new returned %d\n", eCode);
+        return false;
+    }
+
+    restart_done(mark);
+
+    CHECK(n_restarts + 1u == sim_stats_get()->n_restarts);
+    CHECK(0 == sim_host_pending());
+    CHECK(sim_host_output_has(TXT_SUCCESS));
+
+    return true;
+}
+
+#if 1 == USE_AB_SLOTS
+/**
+ * @brief Binary image through update-new and update-act, checksum is CRC32
+ */
+static bool run_update (const uint8_t * p_img, uint32_t len)
+{
+    uint8_t crc[4];
+    char cmd[TEST_CMD_SZ];
+
+    put_u32_be(crc, crc32_ref(p_img, len));
+    sim_host_send(p_img, len);
+    sim_host_send(crc, sizeof(crc));
+    snprintf(cmd, sizeof(cmd), "update-new count=%u type=bin cksum=crc32",
+            len);
+    CHECK(run_update_new(cmd));
+    CHECK(CBL_ERR_OK == run_cmd("update-act"));
+
+    return true;
+}
+#endif /* USE_AB_SLOTS */
+
+/**
+ * @brief Sends the script after "ready" of batch and runs it
+ */
+static cbl_err_code_t run_batch (const char * script)
+{
+    char cmd[TEST_CMD_SZ];
+
+    sim_host_send_str(script);
+    snprintf(cmd, sizeof(cmd), "batch count=%zu", strlen(script));
+
+    return run_cmd(cmd);
+}
+
+/**
+ * @brief Processor was reset, RAM of the simulation isn't. Gives back the
+ *        arena of the command and starts the link like the bootloader does
+ */
+static void restart_done (uint32_t mark)
+{
+    mem_release(mark);
+    link_sink_set(NULL);
+    rx_init();
+}
+
+/**
+ * @brief Address images are linked for, decoded records have to be there.
+ *        With A/B slots it is the slot update-new writes
+ */
+static uint32_t link_start (void)
+{
+#if 1 == USE_AB_SLOTS
+    return ab_new_start();
+#else
+    return BOOT_ACT_APP_START;
+#endif /* USE_AB_SLOTS */
+}
+
+/**
+ * @brief Number of times str is in what bootloader sent
+ */
+static uint32_t output_count (const char * str)
+{
+    uint32_t len;
+    const char * p_out = sim_host_output( &len);
+    const char * p_end = p_out + len;
+    uint32_t count = 0;
+
+    while (NULL != (p_out = memmem(p_out, p_end - p_out, str, strlen(str))))
+    {
+        count++;
+        p_out += strlen(str);
+    }
+
+    return count;
+}
+
+/**
+ * @brief Fills the image with pseudo random bytes, same for every run
+ */
+static void image_make (uint8_t * p_img, uint32_t len)
+{
+    uint32_t state = TEST_IMG_SEED;
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        state = state * 1103515245u + 12345u;
+        p_img[iii] = (uint8_t)(state >> 16);
+    }
+}
+/**
+ * @brief Image with repeated runs, so LZ4 finds matches. Every other 256
+ *        bytes repeat the bytes 1000 before them
+ */
+static void image_make_packable (uint8_t * p_img, uint32_t len)
+{
+    image_make(p_img, len);
+
+    for (uint32_t iii = 1000u; iii < len; iii++)
+    {
+        if (0 != (iii / 256u) % 2u)
+        {
+            p_img[iii] = p_img[iii - 1000u];
+        }
+    }
+}
+
+
+/**
+ * @brief Intel hex of the image, extended linear address records at every
+ *        64 KB
+ */
+static void hex_make (test_buf_t * p_out, const uint8_t * p_img,
+        uint32_t len, uint32_t addr)
+{
+    for (uint32_t offset = 0; offset < len; offset += TEST_HEX_LINE)
+    {
+        uint32_t cur = addr + offset;
+        uint32_t n = ui32_min(TEST_HEX_LINE, len - offset);
+        uint8_t sum;
+
+        if (0 == offset || 0 == (cur & 0xFFFFu))
+        {
+            sum = (uint8_t)(2u + 4u + (cur >> 24) + (cur >> 16));
+            buf_printf(p_out, ":02000004%04X%02X\r\n", cur >> 16,
+                    (uint8_t)(0x100u - sum));
+        }
+
+        sum = (uint8_t)(n + (cur >> 8) + cur);
+        buf_printf(p_out, ":%02X%04X00", n, cur & 0xFFFFu);
+        for (uint32_t iii = 0; iii < n; iii++)
+        {
+            sum += p_img[offset + iii];
+            buf_printf(p_out, "%02X", p_img[offset + iii]);
+        }
+        buf_printf(p_out, "%02X\r\n", (uint8_t)(0x100u - sum));
+    }
+
+    buf_printf(p_out, ":00000001FF\r\n");
+}
+
+/**
+ * @brief S-record of the image, S3 data records and S7 termination
+ */
+static void srec_make (test_buf_t * p_out, const uint8_t * p_img,
+        uint32_t len, uint32_t addr)
+{
+    uint8_t sum;
+
+    buf_printf(p_out, "S00600004844521B\r\n");
+
+    for (uint32_t offset = 0; offset < len; offset += TEST_HEX_LINE)
+    {
+        uint32_t cur = addr + offset;
+        uint32_t n = ui32_min(TEST_HEX_LINE, len - offset);
+
+        sum = (uint8_t)((n + 5u) + (cur >> 24) + (cur >> 16) + (cur >> 8)
+                + cur);
+        buf_printf(p_out, "S3%02X%08X", n + 5u, cur);
+        for (uint32_t iii = 0; iii < n; iii++)
+        {
+            sum += p_img[offset + iii];
+            buf_printf(p_out, "%02X", p_img[offset + iii]);
+        }
+        buf_printf(p_out, "%02X\r\n", (uint8_t)~sum);
+    }
+
+    sum = (uint8_t)(5u + (addr >> 24) + (addr >> 16) + (addr >> 8) + addr);
+    buf_printf(p_out, "S705%08X%02X\r\n", addr, (uint8_t)~sum);
+}
+/**
+ * @brief LZ4 frame of the image. Image without its tail is one compressed
+ *        block, tail is a raw block. Tail is as long as needed for the frame
+ *        to be a multiple of 4 bytes, framed transfers need it
+ *
+ * @note  Header checksum is left 0, cbl_lz4.c skips it
+ */
+static void lz4_make (test_buf_t * p_out, const uint8_t * p_img,
+        uint32_t len)
+{
+    const uint8_t header[] = { 0x04, 0x22, 0x4D, 0x18, 0x60, 0x70, 0x00 };
+    uint8_t * p_block = malloc(len + len / 255u + 16u);
+    uint32_t block_len;
+    uint32_t tail = 4u;
+
+    /* Header, two block sizes and end mark are 19 bytes */
+    for (;; tail++)
+    {
+        block_len = lz4_block_make(p_block, p_img, len - tail);
+        if (0 == (sizeof(header) + 12u + block_len + tail) % 4u)
+        {
+            break;
+        }
+    }
+
+    p_out->len = sizeof(header) + 12u + block_len + tail;
+    p_out->p_buf = malloc(p_out->len);
+    memcpy(p_out->p_buf, header, sizeof(header));
+    put_u32_le( &p_out->p_buf[7], block_len);
+    memcpy( &p_out->p_buf[11], p_block, block_len);
+    put_u32_le( &p_out->p_buf[11u + block_len], tail | 0x80000000UL);
+    memcpy( &p_out->p_buf[15u + block_len], &p_img[len - tail], tail);
+    put_u32_le( &p_out->p_buf[15u + block_len + tail], 0);
+
+    free(p_block);
+}
+
+/**
+ * @brief Compresses to an LZ4 block greedily, matches are found with a hash
+ *        of 4 bytes. Last match ends 5 bytes before the end and starts at
+ *        least 12 before it, as the format requires
+ *
+ * @return Length of the block
+ */
+static uint32_t lz4_block_make (uint8_t * p_out, const uint8_t * p_img,
+        uint32_t len)
+{
+    static uint32_t table[TEST_LZ4_HASH_SZ];
+    uint32_t out_len = 0;
+    uint32_t anchor = 0;
+    uint32_t pos = 0;
+
+    memset(table, 0, sizeof(table));
+
+    while (len >= 13u && pos <= len - 13u)
+    {
+        uint32_t word;
+        uint32_t hash;
+        uint32_t ref;
+        uint32_t match_len = 4u;
+        uint32_t lit_len = pos - anchor;
+        uint8_t * p_token;
+
+        memcpy( &word, &p_img[pos], sizeof(word));
+        hash = (word * 2654435761u) >> 20;
+        ref = table[hash];
+        table[hash] = pos + 1u;
+
+        /* Table holds position + 1, 0 is empty */
+        if (0 == ref || pos - (ref - 1u) > 0xFFFFu
+                || 0 != memcmp( &p_img[ref - 1u], &p_img[pos], 4u))
+        {
+            pos++;
+            continue;
+        }
+        ref--;
+
+        while (pos + match_len < len - 5u
+                && p_img[ref + match_len] == p_img[pos + match_len])
+        {
+            match_len++;
+        }
+
+        p_token = &p_out[out_len++];
+        *p_token = (uint8_t)(ui32_min(lit_len, 15u) << 4);
+        if (lit_len >= 15u)
+        {
+            uint32_t more = lit_len - 15u;
+
+            for (; more >= 255u; more -= 255u)
+            {
+                p_out[out_len++] = 255u;
+            }
+            p_out[out_len++] = (uint8_t)more;
+        }
+        memcpy( &p_out[out_len], &p_img[anchor], lit_len);
+        out_len += lit_len;
+
+        put_u32_le( &p_out[out_len], pos - ref);
+        out_len += 2u;
+
+        *p_token |= (uint8_t)ui32_min(match_len - 4u, 15u);
+        if (match_len - 4u >= 15u)
+        {
+            uint32_t more = match_len - 4u - 15u;
+
+            for (; more >= 255u; more -= 255u)
+            {
+                p_out[out_len++] = 255u;
+            }
+            p_out[out_len++] = (uint8_t)more;
+        }
+
+        pos += match_len;
+        anchor = pos;
+    }
+
+    /* Last literals, sequence without match */
+    {
+        uint32_t lit_len = len - anchor;
+
+        p_out[out_len++] = (uint8_t)(ui32_min(lit_len, 15u) << 4);
+        if (lit_len >= 15u)
+        {
+            uint32_t more = lit_len - 15u;
+
+            for (; more >= 255u; more -= 255u)
+            {
+                p_out[out_len++] = 255u;
+            }
+            p_out[out_len++] = (uint8_t)more;
+        }
+        memcpy( &p_out[out_len], &p_img[anchor], lit_len);
+        out_len += lit_len;
+    }
+
+    return out_len;
+}
+
+
+static void buf_printf (test_buf_t * p_out, const char * fmt, ...)
+{
+    char line[128];
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    p_out->p_buf = realloc(p_out->p_buf, p_out->len + n + 1u);
+    memcpy( &p_out->p_buf[p_out->len], line, n + 1u);
+    p_out->len += n;
+}
+
+/**
+ * @brief CRC32 of Apendix A, bitwise, independent of the CRC unit
+ */
+static uint32_t crc32_ref (const uint8_t * buf, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        crc ^= buf[iii];
+        for (uint32_t bit = 0; bit < 8u; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+
+    return ~crc;
+}
+
+static void put_u32_be (uint8_t * p, uint32_t val)
+{
+    p[0] = (uint8_t)(val >> 24);
+    p[1] = (uint8_t)(val >> 16);
+    p[2] = (uint8_t)(val >> 8);
+    p[3] = (uint8_t)val;
+}
+
+static void put_u32_le (uint8_t * p, uint32_t val)
+{
+    p[0] = (uint8_t)val;
+    p[1] = (uint8_t)(val >> 8);
+    p[2] = (uint8_t)(val >> 16);
+    p[3] = (uint8_t)(val >> 24);
+}
+
+static uint32_t get_u32_le (const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+            | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Builds a request frame of cbl_cmds_binary.h
+ *
+ * @return Length of the frame
+ */
+static uint32_t bin_frame_make (uint8_t * p_frame, uint8_t code,
+        const uint8_t * p_payload, uint32_t len)
+{
+    uint32_t padded = (len + 3u) & ~3u;
+
+    memset(p_frame, 0, BIN_HDR_SZ + padded);
+    p_frame[0] = BIN_SOF_REQ;
+    p_frame[1] = code;
+    p_frame[2] = (uint8_t)len;
+    p_frame[3] = (uint8_t)(len >> 8);
+    if (0 != len)
+    {
+        memcpy( &p_frame[BIN_HDR_SZ], p_payload, len);
+    }
+    put_u32_be( &p_frame[BIN_HDR_SZ + padded],
+            crc32_ref(p_frame, BIN_HDR_SZ + padded));
+
+    return BIN_HDR_SZ + padded + BIN_CRC_SZ;
+}
+
+/**
+ * @brief Queues a request frame
+ */
+static void bin_frame_send (uint8_t code, const uint8_t * p_payload,
+        uint32_t len)
+{
+    uint8_t frame[BIN_HDR_SZ + BIN_MAX_PAYLOAD + 3u + BIN_CRC_SZ];
+
+    sim_host_send(frame, bin_frame_make(frame, code, p_payload, len));
+}
+
+/**
+ * @brief Parses the next response frame and checks its CRC32
+ *
+ * @return Start of the frame after it, NULL if frame is broken
+ */
+static const uint8_t * bin_frame_next (const uint8_t * p_out,
+        const uint8_t * p_end, uint8_t * p_code, uint32_t * p_status,
+        const uint8_t ** pp_data, uint32_t * p_len)
+{
+    uint32_t len;
+    uint32_t padded;
+    uint32_t crc;
+
+    if (NULL == p_out || p_end - p_out < (long)(BIN_HDR_SZ + 4u)
+            || BIN_SOF_RESP != p_out[0])
+    {
+        return NULL;
+    }
+
+    len = (uint32_t)p_out[2] | ((uint32_t)p_out[3] << 8);
+    padded = (len + 3u) & ~3u;
+    if (p_end - p_out < (long)(BIN_HDR_SZ + padded + BIN_CRC_SZ))
+    {
+        return NULL;
+    }
+
+    crc = ((uint32_t)p_out[BIN_HDR_SZ + padded] << 24)
+            | ((uint32_t)p_out[BIN_HDR_SZ + padded + 1u] << 16)
+            | ((uint32_t)p_out[BIN_HDR_SZ + padded + 2u] << 8)
+            | (uint32_t)p_out[BIN_HDR_SZ + padded + 3u];
+    if (crc != crc32_ref(p_out, BIN_HDR_SZ + padded))
+    {
+        return NULL;
+    }
+
+    *p_code = p_out[1];
+    *p_status = get_u32_le( &p_out[BIN_HDR_SZ]);
+    *pp_data = &p_out[BIN_HDR_SZ + 4u];
+    *p_len = len - 4u;
+
+    return p_out + BIN_HDR_SZ + padded + BIN_CRC_SZ;
+}
+/**
+ * @brief Queues a chunk of framed flash-write: sequence number, data of
+ *        'chunk', CRC32 of both. Corrupted one has a bit of data flipped
+ *        after its CRC32 was calculated
+ *
+ * @param seq[in]    Sequence number in the frame
+ * @param chunk[in]  Index of the chunk of the data sent in the frame
+ * @param p_data[in] Data of the whole transfer
+ * @param len[in]    Length of the whole transfer
+ * @param is_bad[in] Corrupts the frame
+ */
+static void chunk_frame_send (uint32_t seq, uint32_t chunk,
+        const uint8_t * p_data, uint32_t len, bool is_bad)
+{
+    uint8_t frame[FLASH_WRITE_BUF_SZ];
+    uint32_t chunk_len = ui32_min(len - chunk * FLASH_WRITE_SZ,
+            (uint32_t)FLASH_WRITE_SZ);
+
+    put_u32_le(frame, seq);
+    memcpy( &frame[4], &p_data[chunk * FLASH_WRITE_SZ], chunk_len);
+    put_u32_be( &frame[4u + chunk_len], crc32_ref(frame, 4u + chunk_len));
+    if (true == is_bad)
+    {
+        frame[4u + chunk_len / 2u] ^= 0x10u;
+    }
+
+    sim_host_send(frame, 8u + chunk_len);
+}
+
+
+/*** end of file ***/